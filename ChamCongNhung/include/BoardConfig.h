@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Cách nối cảm biến vân tay:
+//   0 (mặc định): SoftwareSerial trên D5/D6 ở 57600 baud, log debug trên Serial (USB).
+//   1: UART0 phần cứng sau Serial.swap() (RX = D7/GPIO13, TX = D8/GPIO15), baud cao hơn
+//      được thương lượng lúc khởi động. Log debug chuyển sang Serial1 (chỉ có TX, D4/GPIO2),
+//      còi và chân TOUCH dời sang D5/D6. Bật bằng build flag -DSENSOR_ON_HW_UART=1.
+#ifndef SENSOR_ON_HW_UART
+#define SENSOR_ON_HW_UART 0
+#endif
+
+// --- Hardware Pins ---
+#define SCREEN_WIDTH 128
+#define SCREEN_HEIGHT 32
+
+#if SENSOR_ON_HW_UART
+#define BUZZER_PIN D5
+// GPIO12 không có trở kéo: không nối chân TOUCH thì nối D6 xuống GND (hoặc tắt useTouchPin)
+#define FINGER_TOUCH_PIN D6
+#define DebugSerial Serial1
+#else
+#define BUZZER_PIN D7
+#define FINGERPRINT_RX D5
+#define FINGERPRINT_TX D6
+// Chân báo chạm của cảm biến (TOUCH/WAKEUP trên R503, R307 bản cảm ứng: HIGH khi có ngón tay).
+// D8 (GPIO15) có trở kéo xuống trên NodeMCU: không nối dây thì luôn đọc LOW.
+#define FINGER_TOUCH_PIN D8
+#define DebugSerial Serial
+#endif
+
+#define OLED_ADDRESS 0x3C
+#define OLED_I2C_CLOCK 400000UL // I2C fast mode, giữ nguyên cả ngoài lúc display()
+
+// --- Chấm công ---
+// Cùng một người quét lại trong khoảng này (tính từ lượt chấm gần nhất đã vào journal hoặc đã
+// gửi đi) thì không gửi nữa, chỉ báo trên màn hình. 0 = tắt.
+#ifndef SCAN_SUPPRESS_WINDOW_MS
+#define SCAN_SUPPRESS_WINDOW_MS 30000UL
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// Đồng hồ cục bộ của thiết bị: giờ = mốc lấy từ NTP + millis() trôi qua từ mốc đó,
+// có bù sai số tần số thạch anh (drift) ước lượng qua các lần đồng bộ.
+//
+// Đồng bộ SNTP chạy nền và không chặn: loop() gửi một gói 48 byte, các lần loop()
+// sau mới đọc phản hồi (hoặc bỏ sau 1 s). Đọc giờ lúc quét vân tay chỉ là vài phép
+// tính trên millis(), không chạm mạng.
+//
+// Giờ trả về cộng thêm timeOffset (GMT+7) như NTPClient trước đây, nên server vẫn
+// nhận timestamp theo đúng quy ước cũ.
+struct ClockStats {
+    uint32_t syncs;        // Phản hồi NTP hợp lệ
+    uint32_t failures;     // Hết thời gian chờ / phản hồi sai
+    uint32_t lastRttMs;
+    int32_t lastStepMs;    // Chênh lệch giữa giờ đang chạy và giờ NTP ở lần đồng bộ gần nhất
+    uint32_t rejected;     // Phản hồi có RTT lớn bất thường (đọc trễ), bỏ và hỏi lại
+    uint32_t lookups;      // Lần phân giải tên máy chủ (hostByName() chặn loop())
+};
+
+class ClockService {
+public:
+    ClockService(WiFiUDP &udp, const char *server, int32_t timeOffset);
+
+    void begin();
+    // Gọi mỗi loop(): gửi yêu cầu khi tới hạn, đọc phản hồi nếu đã có. canBlock = false khi
+    // đang có người quét: không phân giải DNS lúc đó, dùng IP đã có hoặc chờ lúc rảnh
+    void loop(bool networkUp, bool canBlock = true);
+    // Đang chờ phản hồi: gọi pollReply() thường xuyên (mỗi ms lúc rảnh) để thời điểm
+    // nhận sát thời điểm gói tới, RTT đo được mới đúng
+    bool isAwaitingReply() const { return isWaiting; }
+    void pollReply() {
+        if (isWaiting) readReply();
+    }
+
+    bool isSynced() const { return syncedAt != 0; }
+    // Giờ hiện tại (epoch giây + phần nghìn giây), false nếu chưa đồng bộ lần nào
+    bool now(uint32_t &epoch, uint16_t &ms) const { return epochAt(millis(), epoch, ms); }
+    // Giờ tại một thời điểm millis() trong lần khởi động này
+    bool epochAt(uint32_t atMillis, uint32_t &epoch, uint16_t &ms) const;
+
+    uint32_t syncAgeS() const { return isSynced() ? (millis() - syncedAt) / 1000 : 0; }
+    int32_t driftPpm() const { return driftPpb / 1000; } // Đã bù; âm = thạch anh chạy nhanh
+    uint32_t errorMs() const;                             // Ước lượng sai số hiện tại
+    const ClockStats &stats() const { return clockStats; }
+
+private:
+    int64_t utcMsAt(uint32_t atMillis) const;
+    void sendRequest(bool canBlock);
+    void readReply();
+    void applySample(uint64_t serverMs, uint32_t atMillis, uint32_t rttMs);
+    void scheduleRetry();
+
+    WiFiUDP &udp;
+    const char *server;
+    IPAddress serverIp;
+    bool isServerResolved = false;
+    int32_t timeOffset;
+
+    // Mốc: tại millis() = anchorMillis, giờ UTC là anchorEpochMs
+    uint64_t anchorEpochMs = 0;
+    uint32_t anchorMillis = 0;
+    uint32_t syncedAt = 0;        // millis() lần đồng bộ gần nhất, 0 = chưa
+    // Mẫu gốc để đo drift: giữ nguyên qua các lần đồng bộ cho tới khi đồng hồ nhảy
+    uint64_t baseEpochMs = 0;
+    uint32_t baseMillis = 0;
+    int32_t driftPpb = 0;         // Hiệu chỉnh tần số, phần tỉ
+    bool isDriftKnown = false;
+
+    bool isWaiting = false;
+    uint32_t requestMillis = 0;
+    uint32_t requestCookie = 0;   // Ghi vào transmit timestamp, server trả lại ở originate
+    uint32_t nextRequestAt = 0;
+    uint32_t pollMs;
+    uint32_t retryMs;
+    uint32_t bestRttMs = 0;       // RTT nhỏ nhất đã thấy, 0 = chưa có
+    uint8_t rejectedInRow = 0;
+    uint8_t failuresInRow = 0;    // Lỗi liên tiếp với IP đang dùng
+
+    ClockStats clockStats = {};
+};
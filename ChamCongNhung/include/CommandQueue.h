@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+enum DeviceCommandType : uint8_t {
+    COMMAND_ENROLL,
+    COMMAND_DELETE,     // templateId..templateId + count - 1 (delete_range)
+    COMMAND_INVENTORY,  // Đọc bảng chiếm chỗ của thư viện mẫu
+    COMMAND_UPLOAD_TEMPLATE, // Gửi đặc trưng của slot templateId lên server
+    COMMAND_LOAD_TEMPLATE,   // Nạp đặc trưng trong TemplateBuffers[count] vào slot templateId
+};
+
+// Lệnh server gửi xuống, chờ chạy. rid là id yêu cầu phía server (0 = server cũ không
+// gửi rid), được trả lại nguyên vẹn trong enroll_status/delete_status.
+struct DeviceCommand {
+    uint32_t rid;
+    uint16_t templateId;
+    uint16_t count;
+    DeviceCommandType type;
+};
+
+// Hàng đợi vòng cố định cho lệnh enroll/delete: callback WebSocket chỉ xếp lệnh vào đây,
+// loop() chạy lần lượt từng lệnh khi không có đăng ký nào đang chạy. Đầy thì server
+// nhận lỗi ngay thay vì lệnh bị mất.
+class CommandQueue {
+public:
+    static const uint8_t CAPACITY = 8;
+
+    bool push(const DeviceCommand &command);
+    bool pop(DeviceCommand &command);
+    // Bỏ lệnh đang chờ: theo rid nếu rid != 0, không thì theo loại + template id
+    bool remove(DeviceCommandType type, uint32_t rid, uint16_t templateId);
+    void clear() { count = 0; }
+
+    uint8_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+private:
+    DeviceCommand items[CAPACITY] = {};
+    uint8_t head = 0;
+    uint8_t count = 0;
+};
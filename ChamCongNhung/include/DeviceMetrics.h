@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+// Histogram độ trễ theo các mốc cố định (ms) và bộ đếm sự kiện. Thiết bị gửi định kỳ trong
+// message "metrics": histogram chỉ gồm khoảng từ lần gửi thành công trước (xoá sau mỗi lần
+// gửi, nên số đếm nhỏ và message ngắn), bộ đếm tích luỹ từ lúc khởi động (server lấy hiệu
+// hai lần gửi, không mất gì khi một lần gửi thất bại). Mốc phải khớp METRIC_BUCKET_BOUNDS_MS phía server
+// (controllers/deviceMetricsController.js): bucket i đếm giá trị < mốc i, bucket cuối là phần còn lại.
+static const uint8_t METRIC_BUCKETS = 15;
+extern const uint16_t metricBucketBoundsMs[METRIC_BUCKETS - 1];
+
+enum MetricStage : uint8_t {
+    METRIC_GET_IMAGE,  // getImage() chụp được ảnh
+    METRIC_IMAGE2TZ,
+    METRIC_SEARCH,     // fingerFastSearch()
+    METRIC_WS_SEND,    // sendTXT/sendBIN của một frame
+    METRIC_WS_ENCODE,  // measure + serialize một frame (JSON hoặc MessagePack, theo định dạng đang dùng)
+    METRIC_WS_DECODE,  // deserializeJson/deserializeMsgPack một frame nhận được
+    METRIC_LOOP,       // Phần việc của một vòng loop() (không tính thời gian chờ vòng sau)
+    METRIC_RECONNECT,  // Mất WebSocket -> kết nối lại
+    METRIC_WIFI_CONNECT, // Khởi động / mất WiFi -> có IP (WifiManager)
+    METRIC_STAGE_COUNT
+};
+
+enum MetricCounter : uint8_t {
+    METRIC_SCANS,         // Lượt quét nhận diện được, đã ghi journal/gửi
+    METRIC_SUPPRESSED,    // Lượt quét lặp lại bị chặn (RecentMatches)
+    METRIC_UNKNOWN,       // Ngón tay không có trong thư viện
+    METRIC_SENSOR_ERRORS, // getImage/image2Tz lỗi
+    METRIC_WS_DROPPED,    // Message không gửi được (mất kết nối, quá lớn, gửi lỗi)
+    METRIC_RECONNECTS,
+    METRIC_WIFI_DROPS,    // Mất WiFi khi đang kết nối
+    METRIC_COUNTER_COUNT
+};
+
+struct LatencyHistogram {
+    uint32_t counts[METRIC_BUCKETS];
+    uint32_t maxUs;
+
+    void record(uint32_t us);
+    uint32_t total() const;
+};
+
+class DeviceMetrics {
+public:
+    void record(MetricStage stage, uint32_t us) { histograms[stage].record(us); }
+    void count(MetricCounter counter) { counters[counter]++; }
+    void clearHistograms();
+
+    const LatencyHistogram &histogram(MetricStage stage) const { return histograms[stage]; }
+    uint32_t counter(MetricCounter counter) const { return counters[counter]; }
+
+    static const char *const stageNames[METRIC_STAGE_COUNT];
+    static const char *const counterNames[METRIC_COUNTER_COUNT];
+
+private:
+    LatencyHistogram histograms[METRIC_STAGE_COUNT] = {};
+    uint32_t counters[METRIC_COUNTER_COUNT] = {};
+};
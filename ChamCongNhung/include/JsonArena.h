@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+// Allocator cho ArduinoJson cấp phát từ một vùng nhớ tĩnh.
+// Từ ArduinoJson 7, StaticJsonDocument<N> chỉ còn là tên khác của JsonDocument
+// và luôn cấp phát trên heap; các document trên đường quét/gửi tin dùng
+// `JsonDocument doc(&jsonArena);` để không đụng tới heap.
+//
+// Cấp phát kiểu bump: khối cuối cùng có thể giãn/thu tại chỗ, các khối khác
+// chỉ được thu hồi khi mọi khối đã được giải phóng (tất cả document đã huỷ),
+// khi đó arena tự quay về rỗng. Hết chỗ thì rơi về malloc() và đếm lại.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    static const size_t CAPACITY = 4096;
+
+    void *allocate(size_t size) override;
+    void deallocate(void *ptr) override;
+    void *reallocate(void *ptr, size_t newSize) override;
+
+    size_t used() const { return top; }
+    size_t highWater() const { return peak; }
+    uint32_t heapFallbacks() const { return fallbacks; }
+
+private:
+    struct Header {
+        uint32_t size;
+        uint32_t prev; // offset của khối trước (để thu hồi khối cuối)
+    };
+
+    bool owns(const void *ptr) const;
+    Header *headerOf(void *ptr);
+
+    alignas(8) uint8_t buffer[CAPACITY];
+    size_t top = 0;
+    uint32_t last = UINT32_MAX; // offset header của khối cấp phát gần nhất
+    uint16_t live = 0;
+    size_t peak = 0;
+    uint32_t fallbacks = 0;
+};
+
+extern JsonArena jsonArena;
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Các lượt chấm đã được nhận gần đây, để cùng một người không bị chấm lại trong cửa sổ chống
+// trùng: giữ tay lâu mà cảm biến lúc thấy lúc không (NOFINGER thoáng qua làm mất điều kiện
+// nhấc tay), hoặc đặt lại tay ngay sau khi nghe còi. Chỉ lượt đã vào journal hoặc đã gửi đi
+// mới được record(): lượt gửi hỏng thì người đó quét lại được ngay. Bảng cố định CAPACITY
+// mục, đầy thì ghi đè mục cũ nhất; không cấp phát heap.
+class RecentMatches {
+public:
+    static const uint8_t CAPACITY = 8;
+
+    // true: templateId có lượt chấm được nhận trong windowMs trước now - bỏ lượt này.
+    // Chỉ đọc: lượt bị bỏ không kéo dài cửa sổ. windowMs = 0 tắt chống trùng.
+    bool suppress(uint16_t templateId, uint32_t now, uint32_t windowMs) const;
+    // Ghi nhận lượt chấm của templateId lúc now (đã vào journal / đã gửi)
+    void record(uint16_t templateId, uint32_t now);
+    void clear() { count = 0; }
+
+private:
+    struct Entry {
+        uint16_t templateId;
+        uint32_t at; // millis() lúc lượt chấm gần nhất được nhận
+    };
+    Entry items[CAPACITY] = {};
+    uint8_t count = 0;
+};
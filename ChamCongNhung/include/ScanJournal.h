@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Một lần quét vân tay lưu trên flash (16 byte, kích thước cố định)
+struct ScanRecord {
+    uint32_t seq;        // Số thứ tự tăng dần, không reset khi khởi động lại
+    uint32_t time;       // Epoch (giây) nếu có SCAN_FLAG_EPOCH, ngược lại millis() lúc quét
+    uint16_t templateId;
+    uint8_t flags;
+    uint8_t bootId;      // 8 bit thấp của số lần khởi động khi quét
+    // 16 bit thấp của CRC32 (12 byte phía trên, cộng ms nếu có SCAN_FLAG_MS)
+    uint16_t crc;
+    uint16_t ms;         // Phần nghìn giây của time, chỉ có nghĩa khi có SCAN_FLAG_MS
+};
+static_assert(sizeof(ScanRecord) == 16, "ScanRecord must stay 16 bytes");
+
+#define SCAN_FLAG_EPOCH 0x01
+#define SCAN_FLAG_MS 0x02
+
+struct ScanJournalStats {
+    uint32_t appended;
+    uint32_t retired;
+    uint32_t dropped;         // Bản ghi chưa gửi bị ghi đè khi journal đầy
+    uint32_t crcErrors;
+    // Lần flush xuống flash (bản ghi + meta). Mỗi lần LittleFS ghi ít nhất một trang cộng một
+    // commit vào block metadata, dù chỉ đổi 16 byte: đây mới là thước đo hao mòn, không phải số byte
+    uint32_t programs;
+    uint32_t metaWrites;      // ... trong đó ghi "/jnl.meta"
+    uint32_t segmentsCreated; // Mỗi segment ~ một block 4 KB bị xoá (chưa tính LittleFS dọn block metadata)
+    uint32_t lastWriteUs;
+    uint32_t maxWriteUs;
+    uint64_t totalWriteUs;
+};
+
+// Journal dạng ring buffer chỉ ghi nối (append-only) trên LittleFS.
+// Bản ghi được chia thành các segment file "/jnl/<seq đầu>" 256 bản ghi (4 KB),
+// tối đa MAX_SEGMENTS segment. Vị trí đã gửi xong (ackedSeq) lưu trong "/jnl.meta".
+// Segment chỉ bị xoá khi mọi bản ghi trong đó đã được retire, nên sau khi mất điện
+// journal khôi phục đúng thứ tự từ bản ghi chưa gửi đầu tiên.
+// ackedSeq được ghi xuống meta theo lô (commit()): mất điện trước đó thì vài bản ghi đã ack
+// được gửi lại, server bỏ qua nhờ seq.
+class ScanJournal {
+public:
+    static const uint16_t RECORDS_PER_SEGMENT = 256;
+    static const uint8_t MAX_SEGMENTS = 8;
+    static const uint16_t META_COMMIT_RECORDS = 32;
+
+    bool begin(fs::FS &fs);
+    bool append(uint16_t templateId, uint32_t time, uint8_t flags, uint16_t ms = 0);
+    bool read(uint32_t seq, ScanRecord &out);
+    void retire(uint32_t seq);
+    // Lưu ackedSeq khi đã dồn META_COMMIT_RECORDS bản ghi, khi xoá được segment, hoặc khi ack
+    // chưa lưu đầu tiên đã chờ maxDelayMs (0 = lưu ngay). Gọi thường xuyên, phần lớn là no-op.
+    bool commit(uint32_t maxDelayMs = 0);
+
+    uint32_t firstPending() const { return ackedSeq + 1; }
+    uint32_t nextSeq() const { return headSeq; }
+    uint32_t pendingCount() const { return headSeq - 1 - ackedSeq; }
+    uint8_t bootId() const { return (uint8_t)bootCount; }
+    // Ngẫu nhiên, đổi mỗi khi journal tạo lại từ đầu (mất meta, format flash): seq bắt đầu lại
+    // từ 1, server dựa vào đây để không coi seq mới là bản gửi lại của seq cũ
+    uint32_t journalId() const { return currentJournalId; }
+    const ScanJournalStats &stats() const { return journalStats; }
+
+    static uint32_t crc32(const uint8_t *data, size_t len);
+    static uint16_t recordCrc(const ScanRecord &rec);
+
+private:
+    struct Meta {
+        uint32_t magic;
+        uint32_t ackedSeq;
+        uint32_t bootCount;
+        uint32_t journalId;
+        uint32_t crc;
+    };
+
+    static uint32_t segmentStart(uint32_t seq);
+    static void segmentPath(uint32_t first, char *buf, size_t len);
+
+    uint32_t recoverSegment(uint32_t first);
+    bool openAppend(uint32_t first);
+    void dropOldestSegment();
+    void removeSegment(uint32_t first);
+    bool writeMeta();
+
+    fs::FS *fs = nullptr;
+    File appendFile;
+    uint32_t appendFirst = 0;
+    File readFile;
+    uint32_t readFirst = 0;
+    File metaFile;
+
+    uint32_t headSeq = 1;
+    uint32_t ackedSeq = 0;
+    uint32_t committedAck = 0;
+    uint32_t uncommittedSince = 0; // millis() của lần retire đầu tiên chưa lưu
+    uint32_t bootCount = 0;
+    uint32_t currentJournalId = 0;
+    ScanJournalStats journalStats = {};
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Thời gian mỗi lệnh tới cảm biến vân tay, đo bằng micros() quanh lời gọi thư viện
+// (gửi gói lệnh + cảm biến xử lý + nhận gói phản hồi).
+enum SensorCommand : uint8_t {
+    SENSOR_POLL,         // getImage() không có ngón tay
+    SENSOR_GET_IMAGE,    // getImage() chụp được ảnh
+    SENSOR_IMAGE2TZ,
+    SENSOR_SEARCH,
+    SENSOR_CREATE_MODEL,
+    SENSOR_STORE_MODEL,
+    SENSOR_DELETE_MODEL,
+    SENSOR_IDENTIFY,     // Cả getFingerprintID(): getImage + image2Tz + fingerFastSearch
+    SENSOR_READ_INDEX,   // ReadIndexTable, một trang 256 slot
+    SENSOR_UPLOAD_TEMPLATE,   // LoadChar + UpChar, 512 byte
+    SENSOR_DOWNLOAD_TEMPLATE, // DownChar 512 byte + storeModel
+    SENSOR_COMMAND_COUNT
+};
+
+struct SensorTiming {
+    uint32_t count;
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+
+    uint32_t avgUs() const { return count ? totalUs / count : 0; }
+};
+
+extern SensorTiming sensorTimings[SENSOR_COMMAND_COUNT];
+extern const char *const sensorCommandNames[SENSOR_COMMAND_COUNT];
+
+void recordSensorTiming(SensorCommand command, uint32_t startUs);
+void printSensorTimings(Print &out);
+
+// uint8_t p = timedSensorCall(SENSOR_IMAGE2TZ, [] { return finger.image2Tz(); });
+template <typename Call>
+uint8_t timedSensorCall(SensorCommand command, Call call) {
+    uint32_t start = micros();
+    uint8_t result = call();
+    recordSensorTiming(command, start);
+    return result;
+}
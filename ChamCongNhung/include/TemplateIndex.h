@@ -0,0 +1,16 @@
+#pragma once
+
+#include <Adafruit_Fingerprint.h>
+
+// Lệnh cảm biến AS608/R307 mà Adafruit_Fingerprint không bọc sẵn, gửi qua
+// writeStructuredPacket()/getStructuredPacket() của thư viện:
+//   ReadIndexTable (0x1F): bảng chiếm chỗ của thư viện mẫu, 32 byte cho mỗi trang 256 slot,
+//                          bit n (byte n/8, bit n%8) = slot n đã có mẫu
+//   DeleteChar (0x0C) với N > 1: xoá `count` slot liên tiếp trong một lệnh
+#define FINGERPRINT_READINDEXTABLE 0x1F
+
+static const uint16_t TEMPLATE_INDEX_PAGE_SLOTS = 256;
+static const uint8_t TEMPLATE_INDEX_PAGE_BYTES = TEMPLATE_INDEX_PAGE_SLOTS / 8;
+
+uint8_t readTemplateIndex(Adafruit_Fingerprint &finger, uint8_t page, uint8_t table[TEMPLATE_INDEX_PAGE_BYTES]);
+uint8_t deleteTemplateRange(Adafruit_Fingerprint &finger, uint16_t first, uint16_t count);
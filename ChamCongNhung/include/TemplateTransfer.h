@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Adafruit_Fingerprint.h>
+
+// Sao chép đặc trưng vân tay giữa cảm biến và server để đăng ký một lần, dùng ở mọi
+// thiết bị:
+//   upload  : LoadChar (slot -> CharBuffer1) + UpChar, đọc các gói dữ liệu của cảm biến
+//   download: DownChar vào CharBuffer1, ghi các gói dữ liệu, rồi storeModel(slot)
+// Đặc trưng AS608/R307 là 512 byte. Gói dữ liệu đặt 32 byte: getStructuredPacket() của
+// thư viện chép cả 2 byte checksum vào Adafruit_Fingerprint_Packet::data[64], nên gói 64
+// byte trở lên sẽ tràn mảng đó.
+//
+// Kích thước gói là tham số hệ thống của cảm biến (SetSysPara ghi vào flash của cảm biến,
+// còn sau khi mất điện): lần truyền đầu tiên đổi sang 32 byte, restorePacketSize() trả lại
+// giá trị cũ khi hết đợt truyền, để công cụ/firmware khác dùng cảm biến thấy cấu hình như cũ.
+// Một đợt nạp nhiều mẫu chỉ tốn hai lần ghi tham số.
+//
+// Trên WebSocket, đặc trưng đi thành các đoạn TEMPLATE_CHUNK_BYTES byte (base64):
+//   thiết bị -> server: template_chunk { id, rid, offset, total, data }
+//   server -> thiết bị: template_load  { id, rid, offset, total, data }
+// Đoạn server gửi xuống được gom vào một trong TEMPLATE_BUFFERS bộ đệm tĩnh; đủ 512 byte
+// thì lệnh nạp vào hàng đợi lệnh như enroll/delete.
+static const uint16_t TEMPLATE_BYTES = 512;
+static const uint8_t TEMPLATE_PACKET_BYTES = 32;
+static const uint8_t TEMPLATE_CHUNK_BYTES = 128;
+static const uint8_t TEMPLATE_BUFFERS = 2;
+
+#define FINGERPRINT_DOWNCHAR 0x09
+
+uint8_t uploadTemplate(Adafruit_Fingerprint &finger, uint16_t slot, uint8_t out[TEMPLATE_BYTES]);
+uint8_t downloadTemplate(Adafruit_Fingerprint &finger, const uint8_t data[TEMPLATE_BYTES], uint16_t slot);
+// Gọi lúc cảm biến rảnh: đã idleMs không truyền mẫu nào thì trả kích thước gói về như trước
+uint8_t restorePacketSize(Adafruit_Fingerprint &finger, uint32_t idleMs);
+
+// base64 không cấp phát heap; encode ghi cả NUL (out cần 4 * ceil(len / 3) + 1 byte)
+void encodeBase64(const uint8_t *data, size_t len, char *out);
+int decodeBase64(const char *text, uint8_t *out, size_t maxLen); // Số byte, -1 nếu sai định dạng
+
+struct TemplateBuffer {
+    uint32_t rid;
+    uint16_t templateId;
+    uint16_t received; // Byte đã nhận (đoạn phải tới theo thứ tự)
+    bool inUse;
+    uint8_t data[TEMPLATE_BYTES];
+};
+
+class TemplateBuffers {
+public:
+    // Thêm một đoạn template_load. Trả chỉ số bộ đệm khi đã đủ TEMPLATE_BYTES, -1 khi còn
+    // chờ đoạn sau, -2 khi lỗi (error trỏ tới lý do; bộ đệm của rid đó được giải phóng)
+    int8_t addChunk(uint32_t rid, uint16_t templateId, uint16_t offset, uint16_t total, const char *base64,
+                    const char *&error);
+    TemplateBuffer &at(uint8_t index) { return buffers[index]; }
+    void release(uint8_t index) { buffers[index].inUse = false; }
+    bool releaseRid(uint32_t rid, uint16_t templateId); // rid = 0: theo templateId
+    bool busy() const;
+    void clear();
+
+private:
+    TemplateBuffer buffers[TEMPLATE_BUFFERS] = {};
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Tên hiển thị của một mẫu vân tay (16 byte, kích thước cố định)
+struct DirectoryEntry {
+    char name[15];  // Tên rút gọn (ASCII, kết thúc bằng NUL), "" = chưa có
+    uint8_t flags;
+};
+static_assert(sizeof(DirectoryEntry) == 16, "DirectoryEntry must stay 16 bytes");
+
+#define DIRECTORY_FLAG_ACTIVE 0x01
+
+// Bảng template id -> tên rút gọn/trạng thái do server đẩy xuống, để màn hình hiện
+// tên người quét ngay mà không chờ server. Cả bảng nằm trong RAM (mảng tĩnh, đủ cho
+// toàn bộ dung lượng cảm biến) và được sao lưu nguyên khối vào "/users.dir" sau mỗi
+// lần đồng bộ xong, nên khởi động lại khi mất mạng vẫn có tên.
+//
+// version là phiên bản bảng phía server: thiết bị gửi lên khi kết nối, server trả
+// về delta (các mục đổi từ phiên bản đó) hoặc cả bảng nếu đã quá cũ.
+class UserDirectory {
+public:
+    static const uint16_t CAPACITY = 127; // MAX_FINGERPRINT_CAPACITY phía server
+    static const uint8_t NAME_LENGTH = sizeof(DirectoryEntry::name) - 1;
+
+    bool begin(fs::FS &fs);
+    const DirectoryEntry *find(uint16_t templateId) const; // nullptr nếu không có tên
+    bool set(uint16_t templateId, const char *name, uint8_t flags);
+    void remove(uint16_t templateId);
+    void clear(); // Xoá hết và về phiên bản 0 (chờ đồng bộ cả bảng)
+    bool save();
+
+    uint32_t version() const { return dirVersion; }
+    void setVersion(uint32_t version) { dirVersion = version; }
+    uint16_t count() const;
+    static size_t ramBytes() { return sizeof(UserDirectory); }
+    static size_t flashBytes() { return sizeof(Header) + sizeof(DirectoryEntry) * CAPACITY; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t crc; // CRC32 của toàn bộ entries
+        uint32_t reserved;
+    };
+
+    fs::FS *fs = nullptr;
+    uint32_t dirVersion = 0;
+    DirectoryEntry entries[CAPACITY] = {};
+};
+
+static_assert(sizeof(DirectoryEntry) * UserDirectory::CAPACITY + 16 <= 2048,
+              "User directory must fit a 2 KB flash file");
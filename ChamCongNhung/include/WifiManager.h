@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <FS.h>
+
+// Kết nối WiFi chạy nền, không chặn loop(): quét vân tay vẫn chạy (ghi journal) trong lúc
+// chưa có mạng, không còn chờ 30 s rồi ESP.restart() như trước.
+//
+// Kết nối nhanh: kênh + BSSID của AP lần trước lưu trong "/wifi.bin" (LittleFS, còn sau khi
+// mất điện), begin() kèm kênh/BSSID thì SDK bỏ qua bước quét mọi kênh (~2 s). Cache sai (AP
+// đổi kênh, thay AP) thì lần thử thất bại nhanh và quay về quét đầy đủ, thành công thì ghi
+// lại cache. IP tĩnh (setStaticIp) bỏ qua cả DHCP.
+//
+// Mất mạng (hoặc chưa có lúc khởi động) thì thử liên tục trong 30 s đầu như SDK vẫn làm (AP
+// khởi động lại, chập chờn), sau đó chờ lùi dần giữa các lần thử (1 s, 2 s, 4 s... tối đa 15 s).
+// Tự kết nối lại của SDK bị tắt để không tranh nhau.
+struct WifiStats {
+    uint32_t connects;
+    uint32_t fastConnects;  // ... trong đó kết nối thẳng bằng kênh/BSSID đã lưu
+    uint32_t fallbacks;     // Kết nối thẳng thất bại (cache cũ hoặc AP tắt), phải quét lại
+    uint32_t failures;      // Lần thử hết hạn / AP không thấy
+    uint32_t drops;         // Đang kết nối thì mất
+    uint32_t lastConnectMs; // Bắt đầu thử (khởi động / mất mạng) -> có IP, lần gần nhất
+};
+
+enum WifiEvent : uint8_t {
+    WIFI_EVENT_NONE,
+    WIFI_EVENT_CONNECTED, // Vừa có IP (lần đầu hoặc kết nối lại)
+    WIFI_EVENT_LOST
+};
+
+class WifiManager {
+public:
+    static const uint8_t BSSID_LENGTH = 6;
+
+    WifiManager(const char *ssid, const char *password);
+
+    // IP tĩnh; IPAddress() (0.0.0.0) = DHCP. Gọi trước begin().
+    void setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+    // Đọc cache (fs = nullptr: không có flash) và bắt đầu lần thử đầu tiên, trả về ngay
+    void begin(fs::FS *fs);
+    // Gọi mỗi loop(): theo dõi lần thử đang chạy, thử lại khi tới hạn
+    WifiEvent loop();
+
+    bool isConnected() const { return state == STATE_CONNECTED; }
+    const WifiStats &stats() const { return wifiStats; }
+
+    // Ghi cache kênh/BSSID cho ssid (dùng khi kết nối xong; bench dùng để giả lập lần khởi động trước)
+    static bool writeCache(fs::FS &fs, const char *ssid, const uint8_t *bssid, uint8_t channel);
+
+private:
+    enum State : uint8_t { STATE_IDLE, STATE_CONNECTING, STATE_CONNECTED, STATE_BACKOFF };
+
+    struct Cache {
+        uint32_t magic;
+        uint32_t ssidCrc;
+        uint8_t bssid[BSSID_LENGTH];
+        uint8_t channel;
+        uint8_t reserved;
+        uint32_t crc;
+    };
+
+    void loadCache();
+    void saveCache();
+    void startAttempt(bool fast);
+    void attemptFailed();
+
+    const char *ssid;
+    const char *password;
+    fs::FS *fs = nullptr;
+    IPAddress staticIp;
+    IPAddress gateway;
+    IPAddress subnet;
+    IPAddress dns;
+
+    bool hasCache = false;
+    uint8_t cachedBssid[BSSID_LENGTH] = {};
+    uint8_t cachedChannel = 0;
+
+    State state = STATE_IDLE;
+    bool isFastAttempt = false;
+    uint32_t attemptStartedAt = 0;
+    uint32_t connectingSince = 0; // Khởi động / mất mạng, để đo lastConnectMs
+    uint32_t backoffMs = 0;
+    uint32_t retryAt = 0;
+
+    WifiStats wifiStats = {};
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Arduino.h"
+#include "SoftwareSerial.h"
+
+#define FINGERPRINT_OK 0x00
+#define FINGERPRINT_PACKETRECIEVEERR 0x01
+#define FINGERPRINT_NOFINGER 0x02
+#define FINGERPRINT_IMAGEFAIL 0x03
+#define FINGERPRINT_IMAGEMESS 0x06
+#define FINGERPRINT_FEATUREFAIL 0x07
+#define FINGERPRINT_NOMATCH 0x08
+#define FINGERPRINT_NOTFOUND 0x09
+#define FINGERPRINT_ENROLLMISMATCH 0x0A
+#define FINGERPRINT_BADLOCATION 0x0B
+#define FINGERPRINT_DBREADFAIL 0x0C
+#define FINGERPRINT_UPLOADFEATUREFAIL 0x0D
+#define FINGERPRINT_PACKETRESPONSEFAIL 0x0E
+#define FINGERPRINT_UPLOADFAIL 0x0F
+#define FINGERPRINT_DELETEFAIL 0x10
+#define FINGERPRINT_DBCLEARFAIL 0x11
+#define FINGERPRINT_PASSFAIL 0x13
+#define FINGERPRINT_INVALIDIMAGE 0x15
+#define FINGERPRINT_FLASHERR 0x18
+#define FINGERPRINT_TIMEOUT 0xFF
+
+#define FINGERPRINT_STARTCODE 0xEF01
+#define FINGERPRINT_COMMANDPACKET 0x1
+#define FINGERPRINT_ACKPACKET 0x7
+#define FINGERPRINT_DATAPACKET 0x2
+#define FINGERPRINT_ENDDATAPACKET 0x8
+#define FINGERPRINT_LOAD 0x07
+#define FINGERPRINT_UPLOAD 0x08
+#define FINGERPRINT_DELETE 0x0C
+#define DEFAULTTIMEOUT 1000
+
+enum fingerprint_packet_size {
+    FINGERPRINT_PACKET_SIZE_32,
+    FINGERPRINT_PACKET_SIZE_64,
+    FINGERPRINT_PACKET_SIZE_128,
+    FINGERPRINT_PACKET_SIZE_256,
+};
+
+#define FINGERPRINT_BAUDRATE_9600 0x1
+#define FINGERPRINT_BAUDRATE_19200 0x2
+#define FINGERPRINT_BAUDRATE_28800 0x3
+#define FINGERPRINT_BAUDRATE_38400 0x4
+#define FINGERPRINT_BAUDRATE_48000 0x5
+#define FINGERPRINT_BAUDRATE_57600 0x6
+#define FINGERPRINT_BAUDRATE_67200 0x7
+#define FINGERPRINT_BAUDRATE_76800 0x8
+#define FINGERPRINT_BAUDRATE_86400 0x9
+#define FINGERPRINT_BAUDRATE_96000 0xA
+#define FINGERPRINT_BAUDRATE_105600 0xB
+#define FINGERPRINT_BAUDRATE_115200 0xC
+
+// Gói tin thô như thư viện thật (writeStructuredPacket/getStructuredPacket)
+struct Adafruit_Fingerprint_Packet {
+    Adafruit_Fingerprint_Packet(uint8_t type, uint16_t length, uint8_t *data) : type(type), length(length) {
+        memcpy(this->data, data, length < 64 ? length : 64);
+    }
+    uint16_t start_code = FINGERPRINT_STARTCODE;
+    uint8_t address[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t type;
+    uint16_t length;
+    uint8_t data[64];
+};
+
+// Cảm biến AS608/R307 giả lập. Mỗi lệnh tính thời gian truyền UART theo baud
+// (gói lệnh + gói phản hồi, 10 bit/byte) cộng thời gian xử lý trong CostModel.
+// Thư viện thật chờ phản hồi bằng delay(1) nên thời gian xử lý là CPU rảnh; byte
+// qua SoftwareSerial thì CPU bận (bit-bang, tắt ngắt), qua UART phần cứng thì không.
+// Baud khác baud cảm biến đang lưu thì verifyPassword() hết thời gian chờ (1 s).
+// Ngón tay đặt lên cảm biến là một "person"; thư viện mẫu là slot -> person.
+class Adafruit_Fingerprint {
+public:
+    static const uint16_t CAPACITY = 127;
+
+    Adafruit_Fingerprint(SoftwareSerial *ss, uint32_t password = 0x0) : swSerial(ss) {}
+    Adafruit_Fingerprint(HardwareSerial *hs, uint32_t password = 0x0) : hwSerial(hs) {}
+
+    void begin(uint32_t baud);
+    bool verifyPassword();
+    uint8_t setBaudRate(uint8_t baudrate);
+    uint8_t setPacketSize(uint8_t size);
+    uint8_t getParameters();
+    uint8_t getImage();
+    uint8_t image2Tz(uint8_t slot = 1);
+    uint8_t createModel();
+    uint8_t storeModel(uint16_t id);
+    uint8_t deleteModel(uint16_t id);
+    uint8_t loadModel(uint16_t id); // LoadChar: slot -> CharBuffer1
+    uint8_t getModel();             // UpChar CharBuffer1: sau đó đọc gói dữ liệu bằng getStructuredPacket()
+    uint8_t emptyDatabase();
+    uint8_t fingerFastSearch();
+    uint8_t getTemplateCount();
+    // Lệnh thô: DeleteChar (xoá N slot), ReadIndexTable, DownChar + gói dữ liệu
+    void writeStructuredPacket(const Adafruit_Fingerprint_Packet &packet);
+    uint8_t getStructuredPacket(Adafruit_Fingerprint_Packet *packet, uint16_t timeout = DEFAULTTIMEOUT);
+
+    uint16_t fingerID = 0;
+    uint16_t confidence = 0;
+    uint16_t templateCount = 0;
+    uint16_t capacity = CAPACITY;
+    uint16_t packet_len = 128; // Sau getParameters()
+
+private:
+    void transact(uint8_t commandBytes, uint8_t replyBytes, uint32_t processUs);
+
+    SoftwareSerial *swSerial = nullptr;
+    HardwareSerial *hwSerial = nullptr;
+    uint32_t baud = 57600;
+    int charBuffer[2] = {0, 0}; // person trong CharBuffer1/2 (0 = chưa có)
+    int imageOf = 0;            // person trong ImageBuffer
+    int model = 0;
+    void stream(uint32_t bytes); // Gói dữ liệu (không có phản hồi)
+
+    uint8_t rawCommand[8] = {}; // Gói lệnh thô đang chờ getStructuredPacket()
+    uint8_t rawLength = 0;
+    uint8_t transfer[512] = {}; // Đặc trưng đang upload/download
+    int16_t uploadOffset = -1;  // >= 0: đang upload, getStructuredPacket() trả gói dữ liệu
+    int16_t downloadOffset = -1; // >= 0: sau DownChar, writeStructuredPacket() nhận gói dữ liệu
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Chỉ phần vẽ chữ (font mặc định 6x8) mà firmware dùng
+class Adafruit_GFX : public Print {
+public:
+    Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h) {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+
+    void setCursor(int16_t x, int16_t y) {
+        cursorX = x;
+        cursorY = y;
+    }
+    int16_t getCursorX() const { return cursorX; }
+    int16_t getCursorY() const { return cursorY; }
+    void setTextColor(uint16_t c) { textColor = c; }
+    void setTextColor(uint16_t c, uint16_t bg) { textColor = c; }
+    void setTextSize(uint8_t s) { textSize = s ? s : 1; }
+    void setTextWrap(bool w) { wrap = w; }
+    int16_t width() const { return WIDTH; }
+    int16_t height() const { return HEIGHT; }
+
+    using Print::write;
+    size_t write(uint8_t c) override;
+
+protected:
+    virtual void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint8_t size);
+
+    const int16_t WIDTH, HEIGHT;
+    int16_t cursorX = 0;
+    int16_t cursorY = 0;
+    uint16_t textColor = 1;
+    uint8_t textSize = 1;
+    bool wrap = true;
+};
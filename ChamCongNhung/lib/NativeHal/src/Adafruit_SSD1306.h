@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define BLACK 0
+#define WHITE 1
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_MEMORYMODE 0x20
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+
+#define WIRE_MAX min(256, BUFFER_LENGTH)
+
+// SSD1306 giả lập: display() gửi cả framebuffer qua Wire giống hệt thư viện thật
+// (đặt địa chỉ trang/cột rồi các gói 0x40 + dữ liệu, tối đa WIRE_MAX byte mỗi gói).
+// Ngoài framebuffer còn giữ lại text đã in theo từng dòng để harness kiểm tra.
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+    Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi = &Wire, int8_t rst_pin = -1,
+                     uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL);
+    ~Adafruit_SSD1306();
+
+    bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0, bool reset = true,
+               bool periphBegin = true);
+    void display();
+    void clearDisplay();
+    void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+    void ssd1306_command(uint8_t c);
+    uint8_t *getBuffer() { return buffer; }
+
+    const char *textLine(uint8_t row) const;
+
+protected:
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint8_t size) override;
+
+private:
+    void commandList(const uint8_t *c, uint8_t n);
+
+    TwoWire *wire;
+    uint8_t *buffer = nullptr;
+    uint8_t i2caddr = 0x3C;
+    uint32_t wireClk;
+    uint32_t restoreClk;
+    char lines[4][22] = {}; // 21 ký tự mỗi dòng ở cỡ chữ 1
+};
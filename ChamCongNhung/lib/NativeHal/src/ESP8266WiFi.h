@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+// WiFi giả lập: một AP (BSSID cố định, kênh đổi được qua hal::setWifiChannel()).
+// begin() không kèm kênh/BSSID phải quét mọi kênh (CostModel::wifiScanMs) rồi mới
+// associate + DHCP; kèm kênh/BSSID đúng thì bỏ qua bước quét, sai thì thất bại
+// (WL_NO_SSID_AVAIL) sau wifiAssociateMs. IP tĩnh (config()) bỏ qua DHCP.
+// Như SDK: mất AP thì tự kết nối lại (quét lại từ đầu) trừ khi setAutoReconnect(false).
+class ESP8266WiFiClass {
+public:
+    bool mode(WiFiMode_t m) { return true; }
+    void persistent(bool persistent) {}
+    bool setAutoReconnect(bool autoReconnect);
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress());
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t *bssid = nullptr, bool connect = true);
+    bool disconnect(bool wifioff = false);
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+    IPAddress localIP();
+    uint8_t *BSSID();
+    int32_t channel();
+    int hostByName(const char *host, IPAddress &result, uint32_t timeoutMs = 10000);
+    int32_t RSSI() { return -58; }
+};
+
+extern ESP8266WiFiClass WiFi;
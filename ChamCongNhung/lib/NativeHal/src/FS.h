@@ -0,0 +1,75 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+// Hệ thống file trong RAM thay cho LittleFS. Ghi xuống "flash" khi flush()/close()
+// tốn CostModel::flashWriteUs, tạo file mới tốn flashEraseUs (xoá block).
+namespace fs {
+
+struct FileNode {
+    std::vector<uint8_t> data;
+};
+
+class File {
+public:
+    File() {}
+    File(std::shared_ptr<FileNode> node, bool append) : node(node), append(append) {
+        if (append) pos = node->data.size();
+    }
+
+    explicit operator bool() const { return (bool)node; }
+    size_t read(uint8_t *buf, size_t size);
+    size_t write(const uint8_t *buf, size_t size);
+    bool seek(uint32_t pos);
+    size_t position() const { return pos; }
+    size_t size() const { return node ? node->data.size() : 0; }
+    bool truncate(uint32_t size);
+    void flush();
+    void close();
+
+private:
+    std::shared_ptr<FileNode> node;
+    bool append = false;
+    size_t pos = 0;
+    size_t dirty = 0;
+};
+
+class Dir {
+public:
+    Dir() {}
+    Dir(std::vector<std::string> names) : names(names) {}
+    bool next() { return ++index < (int)names.size(); }
+    String fileName() const { return String(names[index]); }
+
+private:
+    std::vector<std::string> names;
+    int index = -1;
+};
+
+class FS {
+public:
+    bool begin() { return true; }
+    bool format();
+    bool exists(const char *path);
+    bool mkdir(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *from, const char *to);
+    File open(const char *path, const char *mode);
+    Dir openDir(const char *path);
+
+private:
+    std::map<std::string, std::shared_ptr<FileNode>> files;
+    std::set<std::string> dirs;
+};
+
+} // namespace fs
+
+using fs::Dir;
+using fs::File;
+using fs::FS;
@@ -0,0 +1,168 @@
+#include "Adafruit_SSD1306.h"
+
+TwoWire Wire;
+
+namespace hal {
+
+static Adafruit_SSD1306 *activeDisplay = nullptr;
+
+const char *displayLine(uint8_t row) {
+    return activeDisplay ? activeDisplay->textLine(row) : "";
+}
+
+} // namespace hal
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    uint32_t bits = (1 + pending) * 9 + 2;
+    uint64_t us = (uint64_t)bits * 1000000 / clockHz;
+    hal::busyFor(us);
+    hal::counters().i2cBytes += 1 + pending;
+    hal::counters().i2cUs += us;
+    pending = 0;
+    return 0;
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+    if (c == '\n') {
+        cursorX = 0;
+        cursorY += textSize * 8;
+    } else if (c != '\r') {
+        if (wrap && cursorX + textSize * 6 > WIDTH) {
+            cursorX = 0;
+            cursorY += textSize * 8;
+        }
+        drawChar(cursorX, cursorY, c, textColor, textSize);
+        cursorX += textSize * 6;
+    }
+    return 1;
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t i = x; i < x + w; i++) {
+        for (int16_t j = y; j < y + h; j++) drawPixel(i, j, color);
+    }
+}
+
+// Không có bảng font thật: mỗi ký tự vẽ 5 cột điểm ảnh suy ra từ mã ký tự,
+// đủ để framebuffer thay đổi đúng vùng khi nội dung thay đổi
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint8_t size) {
+    if (c == ' ') return;
+    for (int8_t col = 0; col < 5; col++) {
+        uint8_t bits = (uint8_t)(c * 31 + col * 17) | 0x01;
+        for (int8_t row = 0; row < 8; row++) {
+            if (bits & (1 << row)) {
+                for (uint8_t sx = 0; sx < size; sx++) {
+                    for (uint8_t sy = 0; sy < size; sy++) {
+                        drawPixel(x + col * size + sx, y + row * size + sy, color);
+                    }
+                }
+            }
+        }
+    }
+}
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin,
+                                   uint32_t clkDuring, uint32_t clkAfter)
+    : Adafruit_GFX(w, h), wire(twi), wireClk(clkDuring), restoreClk(clkAfter) {}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() { free(buffer); }
+
+bool Adafruit_SSD1306::begin(uint8_t switchvcc, uint8_t addr, bool reset, bool periphBegin) {
+    buffer = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8));
+    if (!buffer) return false;
+    if (addr) i2caddr = addr;
+    hal::activeDisplay = this;
+    clearDisplay();
+    if (periphBegin) wire->begin();
+
+    // Chuỗi lệnh khởi tạo của thư viện thật (~25 byte lệnh)
+    static const uint8_t init[] = {SSD1306_DISPLAYOFF, 0xD5, 0x80, 0xA8, 0x1F, 0xD3, 0x00, 0x40,
+                                   0x8D, 0x14, SSD1306_MEMORYMODE, 0x00, 0xA1, 0xC8, 0xDA, 0x02,
+                                   0x81, 0x8F, 0xD9, 0xF1, 0xDB, 0x40, 0xA4, 0xA6, 0x2E,
+                                   SSD1306_DISPLAYON};
+    wire->setClock(wireClk);
+    commandList(init, sizeof(init));
+    wire->setClock(restoreClk);
+    return true;
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+    memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+    memset(lines, 0, sizeof(lines));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) return;
+    uint8_t &b = buffer[x + (y / 8) * WIDTH];
+    if (color == WHITE) b |= 1 << (y & 7);
+    else b &= ~(1 << (y & 7));
+}
+
+void Adafruit_SSD1306::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    Adafruit_GFX::fillRect(x, y, w, h, color);
+    // Text nằm trong vùng bị tô cũng mất (theo dòng text 8 px)
+    for (int16_t row = max<int16_t>(0, y / 8); row <= (y + h - 1) / 8 && row < 4; row++) {
+        for (int16_t col = max<int16_t>(0, x / 6); col < 21 && col * 6 < x + w; col++) lines[row][col] = 0;
+    }
+}
+
+void Adafruit_SSD1306::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint8_t size) {
+    Adafruit_GFX::drawChar(x, y, c, color, size);
+    int row = y / 8;
+    int col = x / 6;
+    if (row >= 0 && row < 4 && col >= 0 && col < 21) lines[row][col] = c;
+}
+
+const char *Adafruit_SSD1306::textLine(uint8_t row) const {
+    return row < 4 ? lines[row] : "";
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    wire->write(c);
+    wire->endTransmission();
+}
+
+void Adafruit_SSD1306::commandList(const uint8_t *c, uint8_t n) {
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    uint16_t bytesOut = 1;
+    while (n--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x00);
+            bytesOut = 1;
+        }
+        wire->write(*c++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+}
+
+void Adafruit_SSD1306::display() {
+    wire->setClock(wireClk);
+    static const uint8_t dlist1[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0};
+    commandList(dlist1, sizeof(dlist1));
+    ssd1306_command(WIDTH - 1);
+
+    uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+    uint8_t *ptr = buffer;
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x40);
+    uint16_t bytesOut = 1;
+    while (count--) {
+        if (bytesOut >= WIRE_MAX) {
+            wire->endTransmission();
+            wire->beginTransmission(i2caddr);
+            wire->write((uint8_t)0x40);
+            bytesOut = 1;
+        }
+        wire->write(*ptr++);
+        bytesOut++;
+    }
+    wire->endTransmission();
+    wire->setClock(restoreClk);
+    hal::counters().displayFrames++;
+}
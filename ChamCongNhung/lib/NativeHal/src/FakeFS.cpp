@@ -0,0 +1,120 @@
+#include "FS.h"
+
+fs::FS LittleFS;
+
+namespace fs {
+
+size_t File::read(uint8_t *buf, size_t size) {
+    if (!node || pos >= node->data.size()) return 0;
+    size_t n = min(size, node->data.size() - pos);
+    memcpy(buf, node->data.data() + pos, n);
+    pos += n;
+    return n;
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+    if (!node) return 0;
+    hal::AllocPause pause;
+    if (append) pos = node->data.size();
+    if (node->data.size() < pos + size) node->data.resize(pos + size);
+    memcpy(node->data.data() + pos, buf, size);
+    pos += size;
+    dirty += size;
+    return size;
+}
+
+bool File::seek(uint32_t newPos) {
+    if (!node || newPos > node->data.size()) return false;
+    pos = newPos;
+    return true;
+}
+
+bool File::truncate(uint32_t size) {
+    if (!node) return false;
+    hal::AllocPause pause;
+    node->data.resize(size);
+    if (pos > size) pos = size;
+    dirty++;
+    return true;
+}
+
+void File::flush() {
+    if (!node || dirty == 0) return;
+    hal::busyFor(hal::cost().flashWriteUs);
+    hal::counters().flashWrites++;
+    hal::counters().flashBytes += dirty;
+    dirty = 0;
+}
+
+void File::close() {
+    flush();
+    hal::AllocPause pause;
+    node.reset();
+}
+
+bool FS::format() {
+    hal::AllocPause pause;
+    files.clear();
+    return true;
+}
+
+bool FS::exists(const char *path) {
+    hal::AllocPause pause;
+    std::string p(path);
+    if (files.count(p)) return true;
+    std::string prefix = p + "/";
+    for (auto &entry : files) {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0) return true;
+    }
+    return dirs.count(p) > 0;
+}
+
+bool FS::mkdir(const char *path) {
+    hal::AllocPause pause;
+    dirs.insert(path);
+    return true;
+}
+
+bool FS::remove(const char *path) {
+    hal::AllocPause pause;
+    return files.erase(path) > 0;
+}
+
+// Như LittleFS: đổi tên đè lên file đích (nếu có) một cách nguyên tử
+bool FS::rename(const char *from, const char *to) {
+    hal::AllocPause pause;
+    auto it = files.find(from);
+    if (it == files.end()) return false;
+    std::shared_ptr<FileNode> node = it->second;
+    files.erase(it);
+    files[to] = node;
+    return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+    hal::AllocPause pause;
+    auto it = files.find(path);
+    if (mode[0] == 'r' && it == files.end()) return File();
+
+    if (it == files.end()) {
+        hal::busyFor(hal::cost().flashEraseUs);
+        it = files.emplace(path, std::make_shared<FileNode>()).first;
+    } else if (mode[0] == 'w') {
+        it->second->data.clear();
+    }
+    return File(it->second, mode[0] == 'a');
+}
+
+Dir FS::openDir(const char *path) {
+    hal::AllocPause pause;
+    std::vector<std::string> names;
+    std::string prefix = std::string(path) + "/";
+    for (auto &entry : files) {
+        if (entry.first.compare(0, prefix.size(), prefix) == 0) {
+            names.push_back(entry.first.substr(prefix.size()));
+        }
+    }
+    return Dir(names);
+}
+
+} // namespace fs
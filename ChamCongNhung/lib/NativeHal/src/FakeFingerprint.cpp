@@ -0,0 +1,274 @@
+#include "Adafruit_Fingerprint.h"
+
+namespace hal {
+
+static int currentFinger = 0;
+static int library[Adafruit_Fingerprint::CAPACITY + 1] = {};
+static uint8_t touchPin = 0xFF;
+static uint64_t captureUs = 0;
+static uint32_t storedBaud = 57600;
+static uint16_t storedPacketLen = 128; // Mặc định xuất xưởng AS608
+static uint32_t packetSizeWrites = 0;
+
+void wireFingerTouch(uint8_t pin) { touchPin = pin; }
+uint64_t lastCaptureUs() { return captureUs; }
+void setSensorBaud(uint32_t baud) { storedBaud = baud; }
+uint32_t sensorBaud() { return storedBaud; }
+uint16_t sensorPacketLen() { return storedPacketLen; }
+uint32_t sensorPacketSizeWrites() { return packetSizeWrites; }
+
+void placeFinger(int person) {
+    currentFinger = person;
+    captureUs = 0;
+    if (touchPin != 0xFF) setInputLevel(touchPin, HIGH);
+}
+
+void liftFinger() {
+    currentFinger = 0;
+    if (touchPin != 0xFF) setInputLevel(touchPin, LOW);
+}
+
+int fingerOn() { return currentFinger; }
+
+void enrollPerson(uint16_t slot, int person) {
+    if (slot >= 1 && slot <= Adafruit_Fingerprint::CAPACITY) library[slot] = person;
+}
+
+int personAt(uint16_t slot) {
+    return slot >= 1 && slot <= Adafruit_Fingerprint::CAPACITY ? library[slot] : 0;
+}
+
+void templateBytes(int person, uint8_t out[512]) {
+    memcpy(out, &person, 4);
+    for (int i = 4; i < 512; i++) out[i] = (uint8_t)(person * 31 + i * 7);
+}
+
+int templatePerson(const uint8_t data[512]) {
+    int person;
+    memcpy(&person, data, 4);
+    uint8_t expected[512];
+    templateBytes(person, expected);
+    return person > 0 && memcmp(data, expected, 512) == 0 ? person : 0;
+}
+
+} // namespace hal
+
+// Gói tin: header 2 + địa chỉ 4 + PID 1 + độ dài 2 + nội dung + checksum 2
+// Chờ như getStructuredPacket(): delay(1) cho tới khi có byte
+static void waitForReply(uint64_t us) {
+    delay(us / 1000);
+    hal::idleFor(us % 1000);
+}
+
+void Adafruit_Fingerprint::transact(uint8_t commandBytes, uint8_t replyBytes, uint32_t processUs) {
+    uint32_t bytes = 11 + commandBytes + 11 + replyBytes;
+    uint64_t uartUs = (uint64_t)bytes * 10 * 1000000 / baud;
+    if (swSerial) {
+        hal::busyFor(uartUs);
+        waitForReply(processUs);
+    } else {
+        waitForReply(uartUs + processUs);
+    }
+    hal::Counters &c = hal::counters();
+    c.sensorCommands++;
+    c.sensorUs += uartUs + processUs;
+    c.uartBytes += bytes;
+}
+
+void Adafruit_Fingerprint::begin(uint32_t baud) {
+    delay(1000); // Như thư viện thật: chờ cảm biến khởi động
+    this->baud = baud;
+    if (swSerial) swSerial->begin(baud);
+    if (hwSerial) hwSerial->begin(baud);
+}
+
+bool Adafruit_Fingerprint::verifyPassword() {
+    if (baud != hal::storedBaud) {
+        hal::busyFor((uint64_t)(11 + 5) * 10 * 1000000 / baud);
+        waitForReply(1000000); // Không hiểu gói lệnh: hết DEFAULTTIMEOUT
+        return false;
+    }
+    transact(5, 1, hal::cost().sensorCmdUs);
+    return true;
+}
+
+// Ghi baud mới vào cảm biến; phản hồi vẫn ở baud cũ, lệnh sau phải begin() lại
+uint8_t Adafruit_Fingerprint::setBaudRate(uint8_t baudrate) {
+    transact(3, 1, hal::cost().sensorCmdUs);
+    if (baudrate < FINGERPRINT_BAUDRATE_9600 || baudrate > FINGERPRINT_BAUDRATE_115200) return FINGERPRINT_PACKETRESPONSEFAIL;
+    hal::storedBaud = 9600UL * baudrate;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::getParameters() {
+    transact(1, 17, hal::cost().sensorCmdUs);
+    packet_len = hal::storedPacketLen;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::setPacketSize(uint8_t size) {
+    transact(3, 1, hal::cost().sensorCmdUs);
+    if (size > FINGERPRINT_PACKET_SIZE_256) return FINGERPRINT_PACKETRESPONSEFAIL;
+    hal::storedPacketLen = packet_len = 32 << size;
+    hal::packetSizeWrites++;
+    return FINGERPRINT_OK;
+}
+
+void Adafruit_Fingerprint::stream(uint32_t bytes) {
+    uint64_t uartUs = (uint64_t)bytes * 10 * 1000000 / baud;
+    if (swSerial) hal::busyFor(uartUs);
+    else waitForReply(uartUs);
+    hal::Counters &c = hal::counters();
+    c.sensorUs += uartUs;
+    c.uartBytes += bytes;
+}
+
+uint8_t Adafruit_Fingerprint::getImage() {
+    if (hal::currentFinger == 0) {
+        transact(1, 1, hal::cost().getImageNoFingerUs);
+        return FINGERPRINT_NOFINGER;
+    }
+    transact(1, 1, hal::cost().getImageUs);
+    imageOf = hal::currentFinger;
+    if (hal::captureUs == 0) hal::captureUs = hal::nowUs();
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::image2Tz(uint8_t slot) {
+    transact(2, 1, hal::cost().image2TzUs);
+    if (imageOf == 0) return FINGERPRINT_INVALIDIMAGE;
+    charBuffer[slot == 2 ? 1 : 0] = imageOf;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::createModel() {
+    transact(1, 1, hal::cost().createModelUs);
+    if (charBuffer[0] == 0 || charBuffer[0] != charBuffer[1]) return FINGERPRINT_ENROLLMISMATCH;
+    model = charBuffer[0];
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::storeModel(uint16_t id) {
+    transact(4, 1, hal::cost().storeModelUs);
+    if (id < 1 || id > CAPACITY) return FINGERPRINT_BADLOCATION;
+    hal::library[id] = model;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::deleteModel(uint16_t id) {
+    transact(5, 1, hal::cost().deleteModelUs);
+    if (id < 1 || id > CAPACITY) return FINGERPRINT_BADLOCATION;
+    hal::library[id] = 0;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::loadModel(uint16_t id) {
+    transact(4, 1, hal::cost().sensorCmdUs);
+    if (id < 1 || id > CAPACITY) return FINGERPRINT_BADLOCATION;
+    if (hal::library[id] == 0) return FINGERPRINT_DBREADFAIL;
+    charBuffer[0] = model = hal::library[id];
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::getModel() {
+    transact(2, 1, hal::cost().sensorCmdUs);
+    hal::templateBytes(charBuffer[0], transfer);
+    uploadOffset = 0;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::emptyDatabase() {
+    transact(1, 1, hal::cost().deleteModelUs);
+    for (int &slot : hal::library) slot = 0;
+    return FINGERPRINT_OK;
+}
+
+uint8_t Adafruit_Fingerprint::fingerFastSearch() {
+    transact(6, 5, hal::cost().searchUs);
+    for (uint16_t id = 1; id <= CAPACITY; id++) {
+        if (hal::library[id] != 0 && hal::library[id] == charBuffer[0]) {
+            fingerID = id;
+            confidence = 120;
+            return FINGERPRINT_OK;
+        }
+    }
+    fingerID = 0;
+    confidence = 0;
+    return FINGERPRINT_NOTFOUND;
+}
+
+uint8_t Adafruit_Fingerprint::getTemplateCount() {
+    transact(1, 3, hal::cost().sensorCmdUs);
+    templateCount = 0;
+    for (uint16_t id = 1; id <= CAPACITY; id++) {
+        if (hal::library[id] != 0) templateCount++;
+    }
+    return FINGERPRINT_OK;
+}
+
+void Adafruit_Fingerprint::writeStructuredPacket(const Adafruit_Fingerprint_Packet &packet) {
+    if (packet.type == FINGERPRINT_DATAPACKET || packet.type == FINGERPRINT_ENDDATAPACKET) {
+        stream(11 + packet.length);
+        if (downloadOffset < 0) return; // Cảm biến không chờ dữ liệu: bỏ qua
+        uint16_t n = std::min<uint16_t>(packet.length, sizeof(transfer) - downloadOffset);
+        memcpy(transfer + downloadOffset, packet.data, n);
+        downloadOffset += n;
+        if (packet.type == FINGERPRINT_ENDDATAPACKET) {
+            charBuffer[0] = model = downloadOffset == sizeof(transfer) ? hal::templatePerson(transfer) : 0;
+            downloadOffset = -1;
+        }
+        return;
+    }
+    rawLength = std::min<uint16_t>(packet.length, sizeof(rawCommand));
+    memcpy(rawCommand, packet.data, rawLength);
+}
+
+// Phản hồi gói lệnh thô vừa ghi: DeleteChar N (tính giá như một deleteModel) và
+// ReadIndexTable 0x1F (trang 256 slot, bit n = slot n có mẫu)
+uint8_t Adafruit_Fingerprint::getStructuredPacket(Adafruit_Fingerprint_Packet *packet, uint16_t timeout) {
+    if (uploadOffset >= 0) {
+        // Gói dữ liệu packet_len byte (+2 checksum trong data như thư viện thật; gói lớn hơn
+        // 62 byte làm tràn Adafruit_Fingerprint_Packet::data ở thư viện thật, ở đây bị cắt)
+        uint16_t n = std::min<uint16_t>(std::min<uint16_t>(hal::storedPacketLen, sizeof(packet->data) - 2),
+                                        sizeof(transfer) - uploadOffset);
+        stream(11 + n);
+        memcpy(packet->data, transfer + uploadOffset, n);
+        packet->length = n + 2;
+        uploadOffset += n;
+        packet->type = uploadOffset == (int16_t)sizeof(transfer) ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET;
+        if (packet->type == FINGERPRINT_ENDDATAPACKET) uploadOffset = -1;
+        return FINGERPRINT_OK;
+    }
+    uint8_t command = rawLength ? rawCommand[0] : 0;
+    packet->type = FINGERPRINT_ACKPACKET;
+    memset(packet->data, 0, sizeof(packet->data));
+    if (command == FINGERPRINT_DELETE && rawLength == 5) {
+        transact(5, 1, hal::cost().deleteModelUs);
+        uint16_t first = rawCommand[1] << 8 | rawCommand[2];
+        uint16_t count = rawCommand[3] << 8 | rawCommand[4];
+        if (first + count - 1 > CAPACITY || count == 0) {
+            packet->data[0] = FINGERPRINT_BADLOCATION;
+        } else {
+            for (uint16_t id = first; id < first + count; id++) hal::library[id] = 0;
+        }
+        packet->length = 3;
+    } else if (command == 0x09 && rawLength == 2) { // DownChar
+        transact(2, 1, hal::cost().sensorCmdUs);
+        downloadOffset = 0;
+        packet->length = 3;
+    } else if (command == 0x1F && rawLength == 2) {
+        transact(2, 33, hal::cost().sensorCmdUs);
+        uint16_t base = rawCommand[1] * 256;
+        for (uint16_t bit = 0; bit < 256; bit++) {
+            uint16_t slot = base + bit;
+            if (slot <= CAPACITY && hal::library[slot] != 0) packet->data[1 + bit / 8] |= 1 << (bit % 8);
+        }
+        packet->length = 35;
+    } else {
+        transact(rawLength, 1, hal::cost().sensorCmdUs);
+        packet->data[0] = FINGERPRINT_PACKETRESPONSEFAIL;
+        packet->length = 3;
+    }
+    rawLength = 0;
+    return FINGERPRINT_OK;
+}
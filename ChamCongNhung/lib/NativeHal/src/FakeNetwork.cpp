@@ -0,0 +1,161 @@
+#include "ESP8266WiFi.h"
+#include "WiFiUdp.h"
+
+ESP8266WiFiClass WiFi;
+
+namespace hal {
+
+static bool wifiUp = true;
+static bool wifiBegun = false;
+static bool wifiAttemptOk = false;
+static uint64_t wifiResolveAt = 0; // Lần thử kết nối đang chạy có kết quả lúc này
+static bool wifiAutoReconnect = true;
+static bool wifiStaticIp = false;
+static uint8_t apChannel = 6;
+static uint8_t apBssid[6] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc};
+static uint32_t scanCount = 0;
+static uint32_t beginCount = 0;
+static bool ntpReachable = true;
+static uint32_t wallClockAtBoot = 1718000000; // 2024-06-10
+static int32_t clockDriftPpm = 0;
+
+static uint64_t wifiAttemptUs(bool scan) {
+    return ((scan ? cost().wifiScanMs : 0) + cost().wifiAssociateMs + (wifiStaticIp ? 0 : cost().wifiDhcpMs)) * 1000ULL;
+}
+
+void setWifiUp(bool up) {
+    if (up == wifiUp) return;
+    wifiUp = up;
+    if (!up) {
+        // Mất kết nối, hoặc lần thử đang chạy thất bại
+        wifiAttemptOk = false;
+        wifiResolveAt = nowUs();
+    } else if (wifiBegun && wifiAutoReconnect) {
+        // SDK tự quét lại và kết nối khi AP xuất hiện
+        wifiAttemptOk = true;
+        wifiResolveAt = nowUs() + wifiAttemptUs(true);
+    }
+}
+
+void setWifiChannel(uint8_t channel) { apChannel = channel; }
+uint8_t wifiChannel() { return apChannel; }
+const uint8_t *wifiBssid() { return apBssid; }
+uint32_t wifiScans() { return scanCount; }
+uint32_t wifiBegins() { return beginCount; }
+void setNtpReachable(bool reachable) { ntpReachable = reachable; }
+void setWallClock(uint32_t epochUtc) { wallClockAtBoot = epochUtc; }
+void setClockDrift(int32_t ppm) { clockDriftPpm = ppm; }
+
+uint64_t wallClockMsAt(uint64_t deviceUs) {
+    int64_t trueUs = (int64_t)deviceUs - (int64_t)deviceUs * clockDriftPpm / 1000000;
+    return (uint64_t)wallClockAtBoot * 1000 + trueUs / 1000;
+}
+
+uint64_t wallClockMs() { return wallClockMsAt(nowUs()); }
+
+} // namespace hal
+
+bool ESP8266WiFiClass::setAutoReconnect(bool autoReconnect) {
+    hal::wifiAutoReconnect = autoReconnect;
+    return true;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+    hal::wifiStaticIp = local[0] != 0;
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid,
+                                    bool connect) {
+    hal::wifiBegun = true;
+    hal::beginCount++;
+    bool direct = channel > 0 && bssid;
+    if (!direct) hal::scanCount++;
+    bool found = !direct || (channel == hal::apChannel && memcmp(bssid, hal::apBssid, 6) == 0);
+    hal::wifiAttemptOk = hal::wifiUp && found;
+    uint64_t failUs = (direct ? hal::cost().wifiAssociateMs : hal::cost().wifiScanMs) * 1000ULL;
+    hal::wifiResolveAt = hal::nowUs() + (hal::wifiAttemptOk ? hal::wifiAttemptUs(!direct) : failUs);
+    return WL_DISCONNECTED;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff) {
+    hal::wifiBegun = false;
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+    if (!hal::wifiBegun) return WL_IDLE_STATUS;
+    if (hal::nowUs() < hal::wifiResolveAt) return WL_DISCONNECTED;
+    return hal::wifiAttemptOk ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+    return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress();
+}
+
+uint8_t *ESP8266WiFiClass::BSSID() { return hal::apBssid; }
+
+int32_t ESP8266WiFiClass::channel() { return hal::apChannel; }
+
+int ESP8266WiFiClass::hostByName(const char *host, IPAddress &result, uint32_t timeoutMs) {
+    if (status() != WL_CONNECTED) return 0;
+    hal::busyFor(hal::cost().dnsUs);
+    result = IPAddress(162, 159, 200, 1);
+    return 1;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+    outLen = 0;
+    return WiFi.status() == WL_CONNECTED;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size) {
+    size = min(size, sizeof(out) - outLen);
+    memcpy(out + outLen, buffer, size);
+    outLen += size;
+    return size;
+}
+
+static void writeNtpTime(uint8_t *p, uint64_t unixMs) {
+    uint32_t seconds = (uint32_t)(unixMs / 1000 + 2208988800ULL);
+    uint32_t fraction = (uint32_t)(((unixMs % 1000) << 32) / 1000);
+    for (int i = 0; i < 4; i++) {
+        p[i] = seconds >> (24 - 8 * i);
+        p[4 + i] = fraction >> (24 - 8 * i);
+    }
+}
+
+// Máy chủ nhận gói ở giữa RTT, trả lời ngay (receive = transmit)
+int WiFiUDP::endPacket() {
+    hal::counters().ntpRequests++;
+    hal::busyFor(hal::cost().udpSendUs);
+    if (outLen < sizeof(out) || WiFi.status() != WL_CONNECTED || !hal::ntpReachable) return 1;
+    uint64_t serverUs = hal::nowUs() + hal::cost().ntpRttUs / 2;
+    memset(in, 0, sizeof(in));
+    in[0] = 0b00100100; // LI 0, version 4, mode 4 (server)
+    in[1] = 2;          // stratum
+    memcpy(in + 24, out + 40, 8); // originate = transmit của client
+    writeNtpTime(in + 32, hal::wallClockMsAt(serverUs));
+    writeNtpTime(in + 40, hal::wallClockMsAt(serverUs));
+    hasReply = true;
+    isReplyReadable = false;
+    replyAtUs = hal::nowUs() + hal::cost().ntpRttUs;
+    return 1;
+}
+
+int WiFiUDP::parsePacket() {
+    if (!hasReply || hal::nowUs() < replyAtUs) return 0;
+    hasReply = false;
+    isReplyReadable = true;
+    return sizeof(in);
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t len) {
+    if (!isReplyReadable) return 0;
+    len = min(len, sizeof(in));
+    memcpy(buffer, in, len);
+    isReplyReadable = false;
+    return len;
+}
+
+void WiFiUDP::flush() { isReplyReadable = false; }
@@ -0,0 +1,192 @@
+#include <deque>
+#include <string>
+
+#include "ESP8266WiFi.h"
+#include "WebSocketsClient.h"
+
+namespace hal {
+
+enum class FrameKind { Text, Binary, Ping, Pong };
+
+struct ServerFrame {
+    uint64_t deliverAt;
+    std::string text;
+    FrameKind kind;
+};
+
+static const uint32_t pongRttMs = 20; // Server trả pong cho ping của thiết bị
+
+static bool serverUp = true;
+static bool blackholed = false;
+static std::function<void(const uint8_t *, size_t, bool)> serverHandler;
+static std::function<void(const char *)> connectHandler;
+static std::deque<ServerFrame> toDevice;
+
+void setServerUp(bool up) { serverUp = up; }
+bool isServerUp() { return serverUp; }
+
+void onServerReceive(std::function<void(const uint8_t *data, size_t len, bool binary)> handler) {
+    serverHandler = handler;
+}
+
+void onServerConnect(std::function<void(const char *url)> handler) { connectHandler = handler; }
+
+void serverSend(const char *text, uint32_t delayMs) {
+    if (blackholed) return;
+    AllocPause pause;
+    toDevice.push_back({nowUs() + (uint64_t)delayMs * 1000, text, FrameKind::Text});
+}
+
+void serverSendBinary(const uint8_t *data, size_t len, uint32_t delayMs) {
+    if (blackholed) return;
+    AllocPause pause;
+    toDevice.push_back({nowUs() + (uint64_t)delayMs * 1000, std::string((const char *)data, len), FrameKind::Binary});
+}
+
+void serverPing(uint32_t delayMs) {
+    if (blackholed) return;
+    AllocPause pause;
+    toDevice.push_back({nowUs() + (uint64_t)delayMs * 1000, "", FrameKind::Ping});
+}
+
+void blackholeConnection() {
+    blackholed = true;
+    AllocPause pause;
+    toDevice.clear();
+}
+
+} // namespace hal
+
+void WebSocketsClient::begin(const char *host, uint16_t port, const char *url, const char *protocol) {
+    if (connected) disconnect();
+    snprintf(this->url, sizeof(this->url), "%s", url);
+    begun = true;
+    lastConnectionFail = 0;
+}
+
+void WebSocketsClient::disconnect() {
+    if (!connected) return;
+    connected = false;
+    {
+        hal::AllocPause pause;
+        hal::toDevice.clear();
+    }
+    if (event) event(WStype_DISCONNECTED, nullptr, 0);
+}
+
+void WebSocketsClient::loop() {
+    if (!begun) return;
+    hal::busyFor(hal::cost().wsLoopUs);
+
+    if (connected && (!hal::serverUp || WiFi.status() != WL_CONNECTED)) {
+        lastConnectionFail = millis();
+        disconnect();
+        return;
+    }
+
+    if (!connected) {
+        if (lastConnectionFail != 0 && millis() - lastConnectionFail < reconnectInterval) return;
+        if (WiFi.status() != WL_CONNECTED) return;
+        if (!hal::serverUp) {
+            hal::busyFor(hal::cost().wsConnectFailUs);
+            lastConnectionFail = millis();
+            return;
+        }
+        hal::busyFor(hal::cost().wsConnectUs);
+        hal::counters().wsConnects++;
+        connected = true;
+        hal::blackholed = false;
+        lastPing = millis();
+        pongReceived = true;
+        pongTimeoutCount = 0;
+        if (hal::connectHandler) {
+            hal::AllocPause pause;
+            hal::connectHandler(url);
+        }
+        if (event) event(WStype_CONNECTED, (uint8_t *)url, strlen(url));
+        return;
+    }
+
+    // Giao các frame server đã tới hạn (thư viện thật cũng NUL-terminate payload)
+    static uint8_t rxBuffer[1024];
+    while (connected && !hal::toDevice.empty() && hal::toDevice.front().deliverAt <= hal::nowUs()) {
+        size_t len;
+        hal::FrameKind kind;
+        {
+            hal::AllocPause pause;
+            const std::string &text = hal::toDevice.front().text;
+            kind = hal::toDevice.front().kind;
+            len = min(text.size(), sizeof(rxBuffer) - 1);
+            memcpy(rxBuffer, text.data(), len);
+            rxBuffer[len] = 0;
+            hal::toDevice.pop_front();
+        }
+        if (kind == hal::FrameKind::Ping) {
+            sendControl(); // Pong tự động
+            if (event) event(WStype_PING, rxBuffer, 0);
+        } else if (kind == hal::FrameKind::Pong) {
+            pongReceived = true;
+            if (event) event(WStype_PONG, rxBuffer, 0);
+        } else {
+            hal::counters().wsFramesIn++;
+            if (event) event(kind == hal::FrameKind::Binary ? WStype_BIN : WStype_TEXT, rxBuffer, len);
+        }
+    }
+    if (connected) handleHeartbeat();
+}
+
+// Như handleHBPing()/handleHBTimeout() của links2004/WebSockets
+void WebSocketsClient::handleHeartbeat() {
+    if (hbPingInterval == 0) return;
+    if (millis() - lastPing > hbPingInterval && sendPing()) {
+        lastPing = millis();
+        pongReceived = false;
+    }
+    if (pongReceived) {
+        pongTimeoutCount = 0;
+    } else if (millis() - lastPing > hbPongTimeout) {
+        pongTimeoutCount++;
+        lastPing = millis() - hbPingInterval - 500; // Ping lại ngay ở vòng sau
+        if (hbDisconnectCount && pongTimeoutCount >= hbDisconnectCount) {
+            lastConnectionFail = millis();
+            disconnect();
+        }
+    }
+}
+
+void WebSocketsClient::sendControl() {
+    hal::busyFor(hal::cost().wsSendUs);
+    hal::counters().wsControlFrames++;
+}
+
+bool WebSocketsClient::sendPing(uint8_t *payload, size_t length) {
+    if (!connected) return false;
+    sendControl();
+    if (!hal::blackholed) {
+        hal::AllocPause pause;
+        hal::toDevice.push_back({hal::nowUs() + hal::pongRttMs * 1000ULL, "", hal::FrameKind::Pong});
+    }
+    return true;
+}
+
+bool WebSocketsClient::send(uint8_t *payload, size_t length, bool headerToPayload, bool binary) {
+    if (!connected) return false;
+    uint8_t *data = headerToPayload ? payload + WEBSOCKETS_MAX_HEADER_SIZE : payload;
+    if (!binary && length == 0) length = strlen((const char *)data);
+    hal::busyFor(hal::cost().wsSendUs + (uint64_t)length * hal::cost().wsSendPerByteNs / 1000);
+    hal::counters().wsFramesOut++;
+    hal::counters().wsBytesOut += length;
+    if (hal::serverHandler && !hal::blackholed) {
+        hal::AllocPause pause;
+        hal::serverHandler(data, length, binary);
+    }
+    return true;
+}
+
+bool WebSocketsClient::sendTXT(uint8_t *payload, size_t length, bool headerToPayload) {
+    return send(payload, length, headerToPayload, false);
+}
+
+bool WebSocketsClient::sendBIN(uint8_t *payload, size_t length, bool headerToPayload) {
+    return send(payload, length, headerToPayload, true);
+}
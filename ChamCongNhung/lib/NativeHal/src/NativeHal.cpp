@@ -0,0 +1,194 @@
+#include "Arduino.h"
+
+#include <malloc.h>
+#include <new>
+
+namespace hal {
+
+static CostModel costModel;
+static Counters counterValues = {};
+static uint64_t clockUs = 0;
+static bool verbose = false;
+static bool countAllocs = false;
+static int levels[17] = {};
+static uint64_t rises[17] = {};
+static void (*isrs[17])() = {};
+static int isrModes[17] = {};
+static uint64_t liveHeapBytes = 0;
+static std::function<void()> idleHook;
+
+CostModel &cost() { return costModel; }
+Counters &counters() { return counterValues; }
+void resetCounters() { counterValues = {}; }
+
+uint64_t nowUs() { return clockUs; }
+
+void busyFor(uint64_t us) {
+    clockUs += us;
+    counterValues.busyUs += us;
+}
+
+void idleFor(uint64_t us) {
+    clockUs += us;
+    counterValues.idleUs += us;
+}
+
+void onIdle(std::function<void()> hook) { idleHook = hook; }
+
+void setAllocCounting(bool on) { countAllocs = on; }
+
+AllocPause::AllocPause() : previous(countAllocs) { countAllocs = false; }
+AllocPause::~AllocPause() { countAllocs = previous; }
+
+void setVerbose(bool on) { verbose = on; }
+
+int pinLevel(uint8_t pin) { return pin < 17 ? levels[pin] : LOW; }
+uint64_t lastRiseUs(uint8_t pin) { return pin < 17 ? rises[pin] : 0; }
+
+void setInputLevel(uint8_t pin, int level) {
+    if (pin >= 17 || levels[pin] == level) return;
+    levels[pin] = level;
+    if (level == HIGH) rises[pin] = clockUs;
+    int mode = isrModes[pin];
+    if (isrs[pin] && (mode == CHANGE || (mode == RISING) == (level == HIGH))) isrs[pin]();
+}
+
+static void noteMalloc(void *ptr) {
+    if (!ptr) return;
+    size_t size = malloc_usable_size(ptr);
+    liveHeapBytes += size;
+    if (countAllocs) {
+        counterValues.mallocs++;
+        counterValues.mallocBytes += size;
+    }
+}
+
+static void noteFree(void *ptr) {
+    if (!ptr) return;
+    liveHeapBytes -= malloc_usable_size(ptr);
+    if (countAllocs) counterValues.frees++;
+}
+
+} // namespace hal
+
+// --- Đếm cấp phát: build_flags của env:native có -Wl,--wrap=malloc,... ---
+extern "C" {
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    hal::noteMalloc(ptr);
+    return ptr;
+}
+
+void __wrap_free(void *ptr) {
+    hal::noteFree(ptr);
+    __real_free(ptr);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    void *ptr = __real_calloc(n, size);
+    hal::noteMalloc(ptr);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    hal::noteFree(ptr);
+    void *moved = __real_realloc(ptr, size);
+    hal::noteMalloc(moved);
+    return moved;
+}
+}
+
+void *operator new(size_t size) {
+    void *ptr = malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+// --- Arduino core ---
+HardwareSerial Serial;
+HardwareSerial Serial1;
+EspClass ESP;
+
+unsigned long millis() { return hal::nowUs() / 1000; }
+unsigned long micros() { return (uint32_t)hal::nowUs(); }
+void delay(unsigned long ms) {
+    while (ms--) {
+        hal::idleFor(1000);
+        if (hal::idleHook) {
+            hal::AllocPause pause;
+            hal::idleHook();
+        }
+    }
+}
+void delayMicroseconds(unsigned int us) { hal::busyFor(us); }
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= 17) return;
+    if (value == HIGH && hal::levels[pin] == LOW) hal::rises[pin] = hal::nowUs();
+    hal::levels[pin] = value;
+}
+
+int digitalRead(uint8_t pin) { return hal::pinLevel(pin); }
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+    if (pin >= 17) return;
+    hal::isrs[pin] = isr;
+    hal::isrModes[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (pin < 17) hal::isrs[pin] = nullptr;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    if (hal::verbose) fwrite(buffer, 1, size, stdout);
+
+    // FIFO 128 byte xả ở tốc độ baud; ghi khi FIFO đầy thì CPU chờ
+    const uint64_t byteNs = 10ULL * 1000000000ULL / baud;
+    uint64_t now = hal::nowUs();
+    if (fifoEmptyAt < now) fifoEmptyAt = now;
+    fifoEmptyAt += size * byteNs / 1000;
+    uint64_t fifoUs = 128 * byteNs / 1000;
+    if (fifoEmptyAt - now > fifoUs) {
+        uint64_t wait = fifoEmptyAt - now - fifoUs;
+        hal::busyFor(wait);
+        hal::counters().logUs += wait;
+    }
+    hal::counters().logBytes += size;
+    return size;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    // ESP8266 còn ~50 KB heap sau khi khởi động WiFi
+    const uint64_t heapSize = 50000;
+    return hal::liveHeapBytes < heapSize ? heapSize - hal::liveHeapBytes : 0;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() { return getFreeHeap(); }
+uint8_t EspClass::getHeapFragmentation() { return 0; }
+
+// Bộ sinh số ngẫu nhiên phần cứng: ở đây là LCG cố định để các lần chạy bench giống nhau
+uint32_t EspClass::random() {
+    static uint32_t state = 0x2545F491;
+    state = state * 1664525 + 1013904223;
+    return state;
+}
+
+void EspClass::restart() {
+    fflush(stdout);
+    fprintf(stderr, "[NativeHal] ESP.restart() at %lu ms\n", millis());
+    exit(3);
+}
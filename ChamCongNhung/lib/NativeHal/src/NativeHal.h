@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+// Lớp phần cứng giả lập cho env:native.
+// Các header Arduino.h, Adafruit_Fingerprint.h, Adafruit_SSD1306.h, WiFiUdp.h,
+// WebSocketsClient.h, ESP8266WiFi.h, LittleFS.h... trong thư viện này có cùng tên
+// và cùng phần API mà firmware dùng, nên main.cpp biên dịch nguyên vẹn trên Linux.
+//
+// Thời gian là đồng hồ ảo: millis()/micros() chỉ tăng khi firmware delay() (CPU rảnh)
+// hoặc khi thiết bị giả lập "tốn" thời gian (UART tới cảm biến, I2C tới màn hình,
+// ghi flash, kết nối mạng - CPU bận). Chi phí lấy từ CostModel bên dưới, là ước
+// lượng theo datasheet/đo đạc thô, dùng để so sánh trước/sau chứ không phải số tuyệt đối.
+namespace hal {
+
+struct CostModel {
+    // Cảm biến vân tay AS608/R307: thời gian xử lý bên trong cảm biến (chưa gồm UART)
+    uint32_t getImageNoFingerUs = 25000;
+    uint32_t getImageUs = 90000;
+    uint32_t image2TzUs = 130000;
+    uint32_t searchUs = 70000;
+    uint32_t createModelUs = 60000;
+    uint32_t storeModelUs = 120000;
+    uint32_t deleteModelUs = 80000;
+    uint32_t sensorCmdUs = 5000; // Lệnh ngắn: verifyPassword, getTemplateCount
+
+    // WebSocket/TCP
+    uint32_t wsConnectUs = 30000;
+    uint32_t wsConnectFailUs = 500000; // TCP connect tới server không trả lời
+    uint32_t wsSendUs = 300;
+    uint32_t wsSendPerByteNs = 1000;
+    uint32_t wsLoopUs = 40;
+
+    uint32_t ntpRttUs = 40000;
+    uint32_t udpSendUs = 200;
+    uint32_t dnsUs = 30000;
+
+    // LittleFS
+    uint32_t flashWriteUs = 1500; // Mỗi lần flush
+    uint32_t flashEraseUs = 40000; // Tạo file mới (xoá một block 4 KB)
+
+    // WiFi: quét tìm AP trên mọi kênh, xác thực + associate, xin IP qua DHCP
+    uint32_t wifiScanMs = 1800;
+    uint32_t wifiAssociateMs = 400;
+    uint32_t wifiDhcpMs = 300;
+
+    // Thời gian CPU của chính loop() (phần không phải I/O)
+    uint32_t loopOverheadUs = 150;
+};
+
+struct Counters {
+    uint64_t busyUs;     // CPU bận chờ I/O
+    uint64_t idleUs;     // Trong delay()
+    uint64_t mallocs;
+    uint64_t frees;
+    uint64_t mallocBytes;
+    uint32_t sensorCommands;
+    uint64_t sensorUs;
+    uint32_t uartBytes;  // Byte UART tới cảm biến (lệnh + phản hồi)
+    uint32_t logBytes;   // Byte Serial debug
+    uint64_t logUs;      // Thời gian chờ FIFO Serial debug
+    uint32_t displayFrames;
+    uint32_t i2cBytes;
+    uint64_t i2cUs;
+    uint32_t flashWrites;
+    uint32_t flashBytes;
+    uint32_t wsFramesOut;
+    uint32_t wsBytesOut;
+    uint32_t wsFramesIn;
+    uint32_t wsConnects;
+    uint32_t wsControlFrames; // Ping/pong thiết bị gửi
+    uint32_t ntpRequests;
+};
+
+CostModel &cost();
+Counters &counters();
+void resetCounters();
+
+// --- Đồng hồ ảo ---
+uint64_t nowUs();
+void busyFor(uint64_t us);
+void idleFor(uint64_t us);
+// Gọi mỗi ms ảo trong delay(): thế giới bên ngoài (người đặt tay, server...) vẫn
+// chạy trong lúc firmware ngủ, nên ngắt GPIO có thể đánh thức nó giữa chừng
+void onIdle(std::function<void()> hook);
+
+// --- Cấp phát heap (đếm qua -Wl,--wrap=malloc,... và operator new) ---
+void setAllocCounting(bool on);
+
+// Tạm dừng đếm trong phạm vi: dùng cho phần "mạng/flash" của thiết bị giả lập và
+// phía server giả lập, những thứ không chiếm heap của ESP8266 thật.
+struct AllocPause {
+    AllocPause();
+    ~AllocPause();
+    bool previous;
+};
+
+// --- Log Serial của firmware ---
+void setVerbose(bool on);
+
+// --- GPIO ---
+int pinLevel(uint8_t pin);
+uint64_t lastRiseUs(uint8_t pin); // 0 nếu chưa từng lên HIGH
+void setInputLevel(uint8_t pin, int level); // Mạch ngoài đổi mức chân (gọi ISR nếu có attachInterrupt)
+
+// --- Cảm biến vân tay ---
+void placeFinger(int person); // person > 0
+void liftFinger();
+int fingerOn();               // 0 nếu không có ngón tay
+void enrollPerson(uint16_t slot, int person);
+int personAt(uint16_t slot);  // 0 nếu slot trống
+// Đặc trưng 512 byte mà cảm biến giả upload/nhận cho một person (person nằm ở 4 byte đầu)
+void templateBytes(int person, uint8_t out[512]);
+int templatePerson(const uint8_t data[512]); // 0 nếu dữ liệu không phải đặc trưng hợp lệ
+// Nối chân TOUCH của cảm biến (HIGH khi có ngón tay) vào pin; mặc định không nối
+void wireFingerTouch(uint8_t pin);
+uint64_t lastCaptureUs();     // getImage() đầu tiên chụp được ảnh từ lần đặt tay gần nhất, 0 nếu chưa
+void setSensorBaud(uint32_t baud); // Baud cảm biến đang lưu (mặc định xuất xưởng 57600)
+uint32_t sensorBaud();
+uint16_t sensorPacketLen();        // Kích thước gói dữ liệu cảm biến đang lưu (xuất xưởng 128)
+uint32_t sensorPacketSizeWrites(); // Số lần ghi kích thước gói (SetSysPara) vào cảm biến
+
+// --- Màn hình ---
+const char *displayLine(uint8_t row); // row 0..3, nội dung text đang hiển thị
+
+// --- Mạng ---
+void setWifiUp(bool up);
+void setWifiChannel(uint8_t channel); // AP chuyển kênh: kênh/BSSID thiết bị đã lưu không còn đúng
+uint8_t wifiChannel();
+const uint8_t *wifiBssid();
+uint32_t wifiScans();                 // Số lần begin() phải quét mọi kênh
+uint32_t wifiBegins();
+void setServerUp(bool up);
+bool isServerUp();
+// Frame thiết bị gửi lên server
+void onServerReceive(std::function<void(const uint8_t *data, size_t len, bool binary)> handler);
+// Thiết bị vừa kết nối WebSocket (url gồm cả query, ví dụ "/?deviceId=...&dir=0")
+void onServerConnect(std::function<void(const char *url)> handler);
+// Server gửi xuống thiết bị sau delayMs (giao trong webSocket.loop())
+void serverSend(const char *text, uint32_t delayMs = 0);
+// ... frame binary (MessagePack), thiết bị nhận qua WStype_BIN
+void serverSendBinary(const uint8_t *data, size_t len, uint32_t delayMs = 0);
+// Server ping thiết bị sau delayMs (thiết bị tự trả pong)
+void serverPing(uint32_t delayMs = 0);
+// Kết nối hiện tại chết "im lặng" (NAT/AP làm rơi TCP): gửi vẫn thành công nhưng không
+// tới server, server không gửi xuống được, cho tới khi chính thiết bị ngắt kết nối
+void blackholeConnection();
+void setNtpReachable(bool reachable);
+void setWallClock(uint32_t epochUtc); // Giờ thực tại thời điểm khởi động
+// Thạch anh thiết bị chạy nhanh ppm phần triệu: millis() trôi nhanh hơn giờ thực
+void setClockDrift(int32_t ppm);
+uint64_t wallClockMs();               // Giờ thực UTC (ms) lúc này
+uint64_t wallClockMsAt(uint64_t deviceUs);
+
+} // namespace hal
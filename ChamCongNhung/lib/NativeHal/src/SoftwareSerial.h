@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Stream {
+public:
+    SoftwareSerial(int8_t rxPin, int8_t txPin) {}
+    void begin(unsigned long baud) { this->baud = baud; }
+    unsigned long baudRate() const { return baud; }
+    using Print::write;
+    size_t write(uint8_t c) override { return 1; }
+
+private:
+    unsigned long baud = 9600;
+};
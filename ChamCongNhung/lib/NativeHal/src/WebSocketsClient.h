@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+
+#include "Arduino.h"
+
+#define WEBSOCKETS_MAX_HEADER_SIZE (14)
+
+typedef enum {
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG,
+} WStype_t;
+
+// WebSocketsClient giả lập (links2004/WebSockets). Server ở phía harness:
+// frame thiết bị gửi đi tới hal::onServerReceive, frame server gửi xuống đi qua
+// hal::serverSend và được giao trong loop(). Kết nối (TCP + handshake) chặn CPU
+// trong CostModel::wsConnectUs, hoặc wsConnectFailUs nếu server không chạy.
+// Ping/pong như thư viện thật: tự trả pong cho ping của server (báo WStype_PING), và
+// enableHeartbeat() tự ping, ngắt kết nối khi liên tiếp disconnectTimeoutCount lần không có pong.
+class WebSocketsClient {
+public:
+    typedef std::function<void(WStype_t type, uint8_t *payload, size_t length)> WebSocketClientEvent;
+
+    void begin(const char *host, uint16_t port, const char *url = "/", const char *protocol = "arduino");
+    void onEvent(WebSocketClientEvent cbEvent) { event = cbEvent; }
+    void loop();
+    bool sendTXT(uint8_t *payload, size_t length = 0, bool headerToPayload = false);
+    bool sendTXT(const char *payload, size_t length = 0, bool headerToPayload = false) {
+        return sendTXT((uint8_t *)payload, length, headerToPayload);
+    }
+    bool sendBIN(uint8_t *payload, size_t length, bool headerToPayload = false);
+    bool sendPing(uint8_t *payload = nullptr, size_t length = 0);
+    void setReconnectInterval(unsigned long time) { reconnectInterval = time; }
+    void enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount) {
+        hbPingInterval = pingInterval;
+        hbPongTimeout = pongTimeout;
+        hbDisconnectCount = disconnectTimeoutCount;
+    }
+    void disconnect();
+    bool isConnected() const { return connected; }
+
+private:
+    bool send(uint8_t *payload, size_t length, bool headerToPayload, bool binary);
+    void sendControl();
+    void handleHeartbeat();
+
+    WebSocketClientEvent event;
+    char url[128] = "/";
+    bool begun = false;
+    bool connected = false;
+    unsigned long reconnectInterval = 500;
+    unsigned long lastConnectionFail = 0;
+
+    uint32_t hbPingInterval = 0; // 0 = không tự ping
+    uint32_t hbPongTimeout = 0;
+    uint8_t hbDisconnectCount = 0;
+    unsigned long lastPing = 0;
+    bool pongReceived = true;
+    uint8_t pongTimeoutCount = 0;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Arduino.h"
+
+// UDP giả lập, chỉ đủ cho SNTP: mọi gói gửi đi coi như tới máy chủ NTP (cổng 123).
+// Phản hồi tới sau CostModel::ntpRttUs, mang giờ thực (setWallClock/setClockDrift)
+// tại lúc máy chủ nhận; WiFi mất hoặc setNtpReachable(false) thì không có phản hồi.
+class WiFiUDP {
+public:
+    uint8_t begin(uint16_t port) { return 1; }
+    void stop() {}
+    int beginPacket(IPAddress ip, uint16_t port);
+    size_t write(const uint8_t *buffer, size_t size);
+    int endPacket();
+    int parsePacket();
+    int read(uint8_t *buffer, size_t len);
+    void flush();
+
+private:
+    uint8_t out[48] = {};
+    size_t outLen = 0;
+    uint8_t in[48] = {};
+    bool hasReply = false;
+    bool isReplyReadable = false;
+    uint64_t replyAtUs = 0;
+};
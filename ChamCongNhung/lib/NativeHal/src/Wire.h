@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 128
+
+// I2C giả lập: mỗi transaction tốn (1 byte địa chỉ + dữ liệu) * 9 bit + start/stop
+// ở tốc độ clock hiện tại; CPU chờ trong suốt thời gian truyền (như twi của ESP8266)
+class TwoWire {
+public:
+    void begin() {}
+    void begin(int sda, int scl) {}
+    void setClock(uint32_t frequency) { clockHz = frequency; }
+    uint32_t getClock() const { return clockHz; }
+    void beginTransmission(uint8_t address) { pending = 0; }
+    size_t write(uint8_t data) {
+        pending++;
+        return 1;
+    }
+    size_t write(const uint8_t *data, size_t quantity) {
+        pending += quantity;
+        return quantity;
+    }
+    uint8_t endTransmission(bool sendStop = true);
+
+private:
+    uint32_t clockHz = 100000;
+    uint32_t pending = 0;
+};
+
+extern TwoWire Wire;
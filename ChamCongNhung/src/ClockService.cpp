@@ -0,0 +1,198 @@
+#include "ClockService.h"
+#include "BoardConfig.h"
+#include <ESP8266WiFi.h>
+
+static const uint32_t NTP_UNIX_OFFSET = 2208988800UL; // 1900-01-01 -> 1970-01-01 (giây)
+static const uint16_t NTP_PORT = 123;
+static const uint16_t LOCAL_PORT = 2390;
+static const uint8_t PACKET_SIZE = 48;
+static const uint32_t REPLY_TIMEOUT_MS = 1000;
+static const uint32_t MAX_RTT_MS = 500;                // Phản hồi chậm hơn: sai số quá lớn
+static const uint32_t MIN_POLL_MS = 64000;             // Chu kỳ đồng bộ ban đầu
+static const uint32_t MAX_POLL_MS = 1024000;           // Khi đồng hồ đã ổn định
+static const uint32_t RETRY_MS = 5000;                 // Lỗi: thử lại sau 5 s, 10 s... tới MIN_POLL_MS
+static const uint32_t REJECT_RETRY_MS = 2000;
+static const uint32_t DNS_TIMEOUT_MS = 2000;           // hostByName() chặn tối đa chừng này
+static const uint8_t RESOLVE_AFTER_FAILURES = 3;       // IP cũ hỏng liền chừng này lần thì hỏi lại DNS
+static const uint8_t MAX_REJECTED_IN_ROW = 3;          // Sau đó chấp nhận: đường mạng đã chậm hơn thật
+static const int32_t STEP_RESET_MS = 500;              // Lệch hơn: coi như đồng hồ bị đặt lại
+static const uint32_t DRIFT_MIN_BASELINE_MS = 256000;  // Ước lượng drift trên khoảng đủ dài
+static const uint32_t DRIFT_MAX_BASELINE_MS = 0x7FFFFFFF;
+static const int64_t MAX_DRIFT_PPB = 500000;           // Thạch anh lệch quá 500 ppm là đo sai
+static const uint32_t UNKNOWN_DRIFT_PPM = 50;          // Sai số giả định khi chưa đo được drift
+static const uint32_t RESIDUAL_DRIFT_PPM = 5;
+
+static uint32_t readBigEndian32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// NTP timestamp (giây từ 1900 + phần lẻ 32 bit) -> ms UTC từ 1970
+static uint64_t ntpToUnixMs(const uint8_t *p) {
+    uint64_t seconds = readBigEndian32(p) - NTP_UNIX_OFFSET;
+    uint64_t fraction = readBigEndian32(p + 4);
+    return seconds * 1000 + ((fraction * 1000) >> 32);
+}
+
+ClockService::ClockService(WiFiUDP &udp, const char *server, int32_t timeOffset)
+    : udp(udp), server(server), timeOffset(timeOffset), pollMs(MIN_POLL_MS), retryMs(RETRY_MS) {}
+
+void ClockService::begin() {
+    udp.begin(LOCAL_PORT);
+}
+
+int64_t ClockService::utcMsAt(uint32_t atMillis) const {
+    // Có dấu: lượt quét trước lần đồng bộ đầu tiên nằm trước mốc
+    int32_t elapsed = (int32_t)(atMillis - anchorMillis);
+    return (int64_t)anchorEpochMs + elapsed + (int64_t)elapsed * driftPpb / 1000000000LL;
+}
+
+bool ClockService::epochAt(uint32_t atMillis, uint32_t &epoch, uint16_t &ms) const {
+    if (!isSynced()) return false;
+    int64_t localMs = utcMsAt(atMillis) + (int64_t)timeOffset * 1000;
+    epoch = (uint32_t)(localMs / 1000);
+    ms = (uint16_t)(localMs % 1000);
+    return true;
+}
+
+uint32_t ClockService::errorMs() const {
+    if (!isSynced()) return 0;
+    uint32_t ppm = isDriftKnown ? RESIDUAL_DRIFT_PPM : UNKNOWN_DRIFT_PPM;
+    return clockStats.lastRttMs / 2 + (uint32_t)((uint64_t)(millis() - syncedAt) * ppm / 1000000);
+}
+
+void ClockService::loop(bool networkUp, bool canBlock) {
+    if (isWaiting) {
+        readReply();
+        return;
+    }
+    if (networkUp && (int32_t)(millis() - nextRequestAt) >= 0) {
+        sendRequest(canBlock);
+    }
+}
+
+void ClockService::sendRequest(bool canBlock) {
+    // hostByName() chặn loop() (tới DNS_TIMEOUT_MS) nên giữ IP đã phân giải được qua các lần
+    // lỗi, chỉ hỏi lại khi IP đó hỏng nhiều lần liền (máy chủ trong pool có thể đã đổi), và
+    // chỉ lúc không có ai đang quét
+    if (!isServerResolved || failuresInRow >= RESOLVE_AFTER_FAILURES) {
+        if (!canBlock) {
+            if (!isServerResolved) return; // Chưa có IP nào: chờ lúc rảnh
+        } else {
+            clockStats.lookups++;
+            failuresInRow = 0;
+            IPAddress ip;
+            if (WiFi.hostByName(server, ip, DNS_TIMEOUT_MS)) {
+                serverIp = ip;
+                isServerResolved = true;
+            } else if (!isServerResolved) {
+                DebugSerial.printf("[Clock] Cannot resolve %s\n", server);
+                scheduleRetry();
+                return;
+            }
+        }
+    }
+
+    while (udp.parsePacket() > 0) udp.flush(); // Bỏ phản hồi trễ của yêu cầu trước
+
+    uint8_t packet[PACKET_SIZE] = {};
+    packet[0] = 0b11100011; // LI = 3 (chưa đồng bộ), version 4, mode 3 (client)
+    requestCookie = micros() ^ (clockStats.syncs << 16) ^ clockStats.failures;
+    packet[40] = requestCookie >> 24;
+    packet[41] = requestCookie >> 16;
+    packet[42] = requestCookie >> 8;
+    packet[43] = requestCookie;
+
+    if (!udp.beginPacket(serverIp, NTP_PORT) || udp.write(packet, PACKET_SIZE) != PACKET_SIZE ||
+        !udp.endPacket()) {
+        scheduleRetry();
+        return;
+    }
+    requestMillis = millis();
+    isWaiting = true;
+}
+
+void ClockService::readReply() {
+    uint32_t now = millis();
+    int size = udp.parsePacket();
+    if (size <= 0) {
+        if (now - requestMillis > REPLY_TIMEOUT_MS) {
+            isWaiting = false;
+            scheduleRetry();
+        }
+        return;
+    }
+
+    uint8_t packet[PACKET_SIZE];
+    bool valid = size >= PACKET_SIZE && udp.read(packet, PACKET_SIZE) == PACKET_SIZE;
+    udp.flush();
+    // Chỉ nhận phản hồi của server (mode 4, stratum > 0) cho đúng yêu cầu vừa gửi
+    valid = valid && (packet[0] & 0x07) == 4 && packet[1] != 0 && readBigEndian32(packet + 24) == requestCookie;
+    if (!valid) return; // Gói lạ: vẫn chờ phản hồi thật tới hết thời gian
+
+    isWaiting = false;
+    uint64_t receiveMs = ntpToUnixMs(packet + 32);
+    uint64_t transmitMs = ntpToUnixMs(packet + 40);
+    uint32_t serverHoldMs = transmitMs > receiveMs ? (uint32_t)(transmitMs - receiveMs) : 0;
+    uint32_t elapsed = now - requestMillis;
+    uint32_t rttMs = elapsed > serverHoldMs ? elapsed - serverHoldMs : 0;
+    if (rttMs > MAX_RTT_MS) {
+        scheduleRetry();
+        return;
+    }
+    // Gói tới lúc loop() đang bận (quét vân tay...) thì được đọc trễ: RTT phình ra và
+    // giờ suy ra lệch nửa phần trễ đó. Bỏ mẫu như vậy, hỏi lại sau ít giây.
+    if (bestRttMs && rttMs > bestRttMs * 2 + 10 && rejectedInRow < MAX_REJECTED_IN_ROW) {
+        rejectedInRow++;
+        clockStats.rejected++;
+        nextRequestAt = now + REJECT_RETRY_MS;
+        return;
+    }
+    bestRttMs = (bestRttMs && rejectedInRow < MAX_REJECTED_IN_ROW) ? min(bestRttMs, rttMs) : rttMs;
+    rejectedInRow = 0;
+    applySample(transmitMs + rttMs / 2, now, rttMs);
+}
+
+void ClockService::applySample(uint64_t serverMs, uint32_t atMillis, uint32_t rttMs) {
+    int32_t stepMs = 0;
+    if (isSynced()) stepMs = (int32_t)((int64_t)serverMs - utcMsAt(atMillis));
+
+    // Drift đo trên khoảng từ mốc gốc (baseline) tới giờ: khoảng càng dài, sai số do
+    // RTT bất đối xứng càng nhỏ. Đồng hồ nhảy (hoặc khoảng quá dài cho int32) thì đo lại.
+    uint32_t baseline = atMillis - baseMillis;
+    if (!isSynced() || abs(stepMs) > STEP_RESET_MS || baseline > DRIFT_MAX_BASELINE_MS) {
+        baseEpochMs = serverMs;
+        baseMillis = atMillis;
+        isDriftKnown = false;
+        driftPpb = 0;
+        pollMs = MIN_POLL_MS;
+    } else {
+        if (baseline >= DRIFT_MIN_BASELINE_MS) {
+            int64_t errorMs = (int64_t)(serverMs - baseEpochMs) - baseline;
+            int64_t ppb = errorMs * 1000000000LL / baseline;
+            driftPpb = (int32_t)max(-MAX_DRIFT_PPB, min(ppb, MAX_DRIFT_PPB));
+            isDriftKnown = true;
+        }
+        pollMs = min(pollMs * 2, MAX_POLL_MS);
+    }
+
+    anchorEpochMs = serverMs;
+    anchorMillis = atMillis;
+    syncedAt = atMillis ? atMillis : 1;
+    retryMs = RETRY_MS;
+    failuresInRow = 0;
+    nextRequestAt = atMillis + pollMs;
+    clockStats.syncs++;
+    clockStats.lastRttMs = rttMs;
+    clockStats.lastStepMs = stepMs;
+    DebugSerial.printf("[Clock] Synced: step %ld ms, rtt %lu ms, drift %ld ppm%s, next in %lu s\n",
+                       (long)stepMs, (unsigned long)rttMs, (long)driftPpm(), isDriftKnown ? "" : " (measuring)",
+                       (unsigned long)(pollMs / 1000));
+}
+
+// Lỗi liên tiếp: giãn dần thời gian thử lại, nhưng không thưa hơn chu kỳ đồng bộ thường
+void ClockService::scheduleRetry() {
+    clockStats.failures++;
+    if (failuresInRow < 255) failuresInRow++;
+    nextRequestAt = millis() + retryMs;
+    retryMs = min(retryMs * 2, MIN_POLL_MS);
+}
@@ -0,0 +1,31 @@
+#include "CommandQueue.h"
+
+bool CommandQueue::push(const DeviceCommand &command) {
+    if (count == CAPACITY) return false;
+    items[(head + count) % CAPACITY] = command;
+    count++;
+    return true;
+}
+
+bool CommandQueue::pop(DeviceCommand &command) {
+    if (count == 0) return false;
+    command = items[head];
+    head = (head + 1) % CAPACITY;
+    count--;
+    return true;
+}
+
+bool CommandQueue::remove(DeviceCommandType type, uint32_t rid, uint16_t templateId) {
+    for (uint8_t i = 0; i < count; i++) {
+        const DeviceCommand &item = items[(head + i) % CAPACITY];
+        bool match = rid ? item.rid == rid : item.type == type && item.templateId == templateId;
+        if (!match) continue;
+        // Dồn các lệnh phía sau lên một chỗ, giữ nguyên thứ tự
+        for (uint8_t j = i; j + 1 < count; j++) {
+            items[(head + j) % CAPACITY] = items[(head + j + 1) % CAPACITY];
+        }
+        count--;
+        return true;
+    }
+    return false;
+}
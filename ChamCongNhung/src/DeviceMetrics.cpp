@@ -0,0 +1,30 @@
+#include "DeviceMetrics.h"
+
+// 1-2-5 từ 1 ms tới 30 s: gửi frame ~1 ms, lệnh cảm biến 30-300 ms, kết nối lại vài giây
+const uint16_t metricBucketBoundsMs[METRIC_BUCKETS - 1] = {1, 2, 5, 10, 20, 50, 100, 200, 500,
+                                                           1000, 2000, 5000, 10000, 30000};
+
+const char *const DeviceMetrics::stageNames[METRIC_STAGE_COUNT] = {
+    "getImage", "image2Tz", "search", "wsSend", "wsEncode", "wsDecode", "loop", "reconnect", "wifi",
+};
+
+const char *const DeviceMetrics::counterNames[METRIC_COUNTER_COUNT] = {
+    "scans", "suppressed", "unknown", "sensorErrors", "wsDropped", "reconnects", "wifiDrops",
+};
+
+void LatencyHistogram::record(uint32_t us) {
+    uint8_t bucket = 0;
+    while (bucket < METRIC_BUCKETS - 1 && us >= metricBucketBoundsMs[bucket] * 1000UL) bucket++;
+    counts[bucket]++;
+    if (us > maxUs) maxUs = us;
+}
+
+void DeviceMetrics::clearHistograms() {
+    for (uint8_t i = 0; i < METRIC_STAGE_COUNT; i++) histograms[i] = {};
+}
+
+uint32_t LatencyHistogram::total() const {
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < METRIC_BUCKETS; i++) sum += counts[i];
+    return sum;
+}
@@ -0,0 +1,78 @@
+#include "JsonArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+JsonArena jsonArena;
+
+static size_t alignUp(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+bool JsonArena::owns(const void *ptr) const {
+    return ptr >= buffer && ptr < buffer + CAPACITY;
+}
+
+JsonArena::Header *JsonArena::headerOf(void *ptr) {
+    return (Header *)((uint8_t *)ptr - sizeof(Header));
+}
+
+void *JsonArena::allocate(size_t size) {
+    size_t need = sizeof(Header) + alignUp(size);
+    if (top + need > CAPACITY) {
+        fallbacks++;
+        return malloc(size);
+    }
+
+    Header *header = (Header *)(buffer + top);
+    header->size = size;
+    header->prev = last;
+    last = top;
+    top += need;
+    live++;
+    if (top > peak) peak = top;
+    return header + 1;
+}
+
+void JsonArena::deallocate(void *ptr) {
+    if (!ptr) return;
+    if (!owns(ptr)) {
+        free(ptr);
+        return;
+    }
+
+    size_t offset = (uint8_t *)headerOf(ptr) - buffer;
+    if (offset == last) {
+        top = offset;
+        last = headerOf(ptr)->prev;
+    }
+    if (--live == 0) {
+        top = 0;
+        last = UINT32_MAX;
+    }
+}
+
+void *JsonArena::reallocate(void *ptr, size_t newSize) {
+    if (!ptr) return allocate(newSize);
+    if (!owns(ptr)) return realloc(ptr, newSize);
+
+    Header *header = headerOf(ptr);
+    size_t offset = (uint8_t *)header - buffer;
+    if (offset == last && offset + sizeof(Header) + alignUp(newSize) <= CAPACITY) {
+        // Khối cuối: giãn/thu tại chỗ
+        header->size = newSize;
+        top = offset + sizeof(Header) + alignUp(newSize);
+        if (top > peak) peak = top;
+        return ptr;
+    }
+    if (newSize <= header->size) {
+        header->size = newSize;
+        return ptr;
+    }
+
+    void *moved = allocate(newSize);
+    if (!moved) return nullptr;
+    memcpy(moved, ptr, header->size);
+    deallocate(ptr);
+    return moved;
+}
@@ -0,0 +1,22 @@
+#include "RecentMatches.h"
+
+bool RecentMatches::suppress(uint16_t templateId, uint32_t now, uint32_t windowMs) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (items[i].templateId == templateId) return now - items[i].at < windowMs;
+    }
+    return false;
+}
+
+void RecentMatches::record(uint16_t templateId, uint32_t now) {
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        Entry &item = items[i];
+        if (item.templateId == templateId) {
+            item.at = now;
+            return;
+        }
+        if (now - item.at > now - items[oldest].at) oldest = i;
+    }
+    uint8_t slot = count < CAPACITY ? count++ : oldest;
+    items[slot] = {templateId, now};
+}
@@ -0,0 +1,286 @@
+#include "ScanJournal.h"
+#include "BoardConfig.h"
+
+static const char *JOURNAL_DIR = "/jnl";
+static const char *JOURNAL_META = "/jnl.meta";
+static const uint32_t JOURNAL_MAGIC = 0x4A4E4C32; // "JNL2"
+
+uint32_t ScanJournal::segmentStart(uint32_t seq) {
+    return ((seq - 1) / RECORDS_PER_SEGMENT) * RECORDS_PER_SEGMENT + 1;
+}
+
+void ScanJournal::segmentPath(uint32_t first, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%08lx", JOURNAL_DIR, (unsigned long)first);
+}
+
+uint32_t ScanJournal::crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+uint16_t ScanJournal::recordCrc(const ScanRecord &rec) {
+    uint8_t data[offsetof(ScanRecord, crc) + sizeof(rec.ms)];
+    size_t len = offsetof(ScanRecord, crc);
+    memcpy(data, &rec, len);
+    if (rec.flags & SCAN_FLAG_MS) {
+        memcpy(data + len, &rec.ms, sizeof(rec.ms));
+        len += sizeof(rec.ms);
+    }
+    return (uint16_t)crc32(data, len);
+}
+
+bool ScanJournal::begin(fs::FS &filesystem) {
+    fs = &filesystem;
+    if (!fs->exists(JOURNAL_DIR)) {
+        fs->mkdir(JOURNAL_DIR);
+    }
+
+    metaFile = fs->open(JOURNAL_META, "r+");
+    if (metaFile) {
+        Meta meta;
+        size_t size = metaFile.read((uint8_t *)&meta, sizeof(meta));
+        if (size == sizeof(meta) && meta.magic == JOURNAL_MAGIC &&
+            meta.crc == crc32((const uint8_t *)&meta, offsetof(Meta, crc))) {
+            ackedSeq = meta.ackedSeq;
+            bootCount = meta.bootCount;
+            currentJournalId = meta.journalId;
+        } else {
+            DebugSerial.println("[Journal] Meta file corrupted, starting from scratch");
+        }
+    }
+    // Không đọc được meta thì cấp journalId mới: server coi đây là journal khác nên seq (bắt đầu
+    // lại từ 1, hoặc tiếp từ segment còn lại) không bị lọc nhầm thành bản gửi lại
+    if (currentJournalId == 0) currentJournalId = ESP.random() | 1;
+    bootCount++;
+    headSeq = ackedSeq + 1;
+
+    // Tìm segment cũ nhất và mới nhất còn trên flash
+    uint32_t oldest = 0, newest = 0;
+    Dir dir = fs->openDir(JOURNAL_DIR);
+    while (dir.next()) {
+        uint32_t first = strtoul(dir.fileName().c_str(), nullptr, 16);
+        if (first == 0) continue;
+        if (oldest == 0 || first < oldest) oldest = first;
+        if (first > newest) newest = first;
+    }
+
+    if (newest != 0) {
+        uint32_t valid = recoverSegment(newest);
+        if (newest + valid > headSeq) headSeq = newest + valid;
+        if (oldest > ackedSeq + 1) {
+            DebugSerial.printf("[Journal] Records %lu..%lu missing, skipping\n",
+                               (unsigned long)(ackedSeq + 1), (unsigned long)(oldest - 1));
+            ackedSeq = oldest - 1;
+        }
+        // Segment đã gửi hết nhưng chưa kịp xoá trước khi mất điện
+        for (uint32_t first = oldest;
+             first + RECORDS_PER_SEGMENT - 1 <= ackedSeq && first != segmentStart(headSeq);
+             first += RECORDS_PER_SEGMENT) {
+            removeSegment(first);
+        }
+    }
+    committedAck = ackedSeq;
+
+    DebugSerial.printf("[Journal] Boot #%lu, pending %lu (seq %lu..%lu)\n",
+                       (unsigned long)bootCount, (unsigned long)pendingCount(),
+                       (unsigned long)firstPending(), (unsigned long)(headSeq - 1));
+    return writeMeta();
+}
+
+// Kiểm tra segment mới nhất, cắt bỏ bản ghi ghi dở (mất điện giữa chừng).
+// Trả về số bản ghi hợp lệ liên tiếp từ đầu segment.
+uint32_t ScanJournal::recoverSegment(uint32_t first) {
+    char path[24];
+    segmentPath(first, path, sizeof(path));
+    File f = fs->open(path, "r+");
+    if (!f) return 0;
+
+    uint32_t valid = 0;
+    ScanRecord rec;
+    while (f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec)) {
+        if (rec.crc != recordCrc(rec)) {
+            // Bản ghi đệm (seq = 0) do khôi phục trước đó thì vẫn giữ vị trí
+            if (rec.seq != 0) {
+                journalStats.crcErrors++;
+                break;
+            }
+        } else if (rec.seq != first + valid) {
+            break;
+        }
+        valid++;
+    }
+    if (f.size() != valid * sizeof(ScanRecord)) {
+        DebugSerial.printf("[Journal] Truncating torn tail of %s to %lu records\n", path, (unsigned long)valid);
+        f.truncate(valid * sizeof(ScanRecord));
+    }
+    f.close();
+    return valid;
+}
+
+bool ScanJournal::openAppend(uint32_t first) {
+    if (appendFile && appendFirst == first) return true;
+    if (appendFile) appendFile.close();
+
+    char path[24];
+    segmentPath(first, path, sizeof(path));
+    bool isNew = !fs->exists(path);
+    appendFile = fs->open(path, "a+"); // a+: đọc lại được bằng chính handle này
+    if (!appendFile) {
+        DebugSerial.printf("[Journal] Cannot open %s\n", path);
+        return false;
+    }
+    appendFirst = first;
+    if (isNew) journalStats.segmentsCreated++;
+    return true;
+}
+
+void ScanJournal::removeSegment(uint32_t first) {
+    if (appendFile && appendFirst == first) appendFile.close();
+    if (readFile && readFirst == first) readFile.close();
+    char path[24];
+    segmentPath(first, path, sizeof(path));
+    fs->remove(path);
+}
+
+// Journal đầy: bỏ segment cũ nhất để luôn ghi được lần quét mới
+void ScanJournal::dropOldestSegment() {
+    uint32_t first = segmentStart(ackedSeq + 1);
+    uint32_t last = first + RECORDS_PER_SEGMENT - 1;
+    journalStats.dropped += last - ackedSeq;
+    DebugSerial.printf("[Journal] Full, dropping unsent records %lu..%lu\n",
+                       (unsigned long)(ackedSeq + 1), (unsigned long)last);
+    removeSegment(first);
+    ackedSeq = last;
+    commit();
+}
+
+bool ScanJournal::append(uint16_t templateId, uint32_t time, uint8_t flags, uint16_t ms) {
+    if (!fs) return false;
+
+    uint32_t start = micros();
+    uint32_t seq = headSeq;
+    uint32_t first = segmentStart(seq);
+    if (first - segmentStart(ackedSeq + 1) >= (uint32_t)MAX_SEGMENTS * RECORDS_PER_SEGMENT) {
+        dropOldestSegment();
+    }
+    if (!openAppend(first)) return false;
+
+    // Nếu file segment bị thiếu bản ghi (mất file giữa chừng), đệm cho đúng vị trí
+    uint32_t expected = (seq - first) * sizeof(ScanRecord);
+    ScanRecord pad = {};
+    while (appendFile.size() < expected) {
+        appendFile.write((const uint8_t *)&pad, sizeof(pad));
+    }
+
+    ScanRecord rec;
+    rec.seq = seq;
+    rec.time = time;
+    rec.templateId = templateId;
+    rec.flags = flags;
+    rec.bootId = bootId();
+    rec.ms = (flags & SCAN_FLAG_MS) ? ms : 0;
+    rec.crc = recordCrc(rec);
+
+    if (appendFile.write((const uint8_t *)&rec, sizeof(rec)) != sizeof(rec)) {
+        DebugSerial.println("[Journal] Write failed");
+        appendFile.close();
+        return false;
+    }
+    appendFile.flush(); // Mỗi lượt quét phải nằm trên flash trước khi báo thành công
+    headSeq++;
+
+    uint32_t elapsed = micros() - start;
+    journalStats.appended++;
+    journalStats.programs++;
+    journalStats.lastWriteUs = elapsed;
+    journalStats.totalWriteUs += elapsed;
+    if (elapsed > journalStats.maxWriteUs) journalStats.maxWriteUs = elapsed;
+    return true;
+}
+
+bool ScanJournal::read(uint32_t seq, ScanRecord &out) {
+    if (!fs || seq <= ackedSeq || seq >= headSeq) return false;
+
+    uint32_t first = segmentStart(seq);
+    uint32_t offset = (seq - first) * sizeof(ScanRecord);
+    // Bản ghi trong segment đang ghi: đọc qua handle append (không mở file mới)
+    File *source = &readFile;
+    if (appendFile && appendFirst == first) {
+        source = &appendFile;
+    } else if (!readFile || readFirst != first) {
+        if (readFile) readFile.close();
+        char path[24];
+        segmentPath(first, path, sizeof(path));
+        readFile = fs->open(path, "r");
+        if (!readFile) return false;
+        readFirst = first;
+    }
+
+    if (!source->seek(offset) || source->read((uint8_t *)&out, sizeof(out)) != sizeof(out)) {
+        return false;
+    }
+    if (out.seq != seq || out.crc != recordCrc(out)) {
+        journalStats.crcErrors++;
+        return false;
+    }
+    return true;
+}
+
+void ScanJournal::retire(uint32_t seq) {
+    if (seq >= headSeq) seq = headSeq - 1;
+    if (seq <= ackedSeq) return;
+    if (ackedSeq == committedAck) uncommittedSince = millis();
+    journalStats.retired += seq - ackedSeq;
+    ackedSeq = seq;
+}
+
+// Lưu vị trí đã retire và xoá các segment đã gửi hết (trừ segment đang ghi)
+bool ScanJournal::commit(uint32_t maxDelayMs) {
+    if (!fs || ackedSeq == committedAck) return true;
+
+    uint32_t headFirst = segmentStart(headSeq);
+    uint32_t oldestFirst = segmentStart(committedAck + 1);
+    bool freesSegment = oldestFirst + RECORDS_PER_SEGMENT - 1 <= ackedSeq && oldestFirst != headFirst;
+    if (!freesSegment && ackedSeq - committedAck < META_COMMIT_RECORDS &&
+        millis() - uncommittedSince < maxDelayMs) {
+        return true;
+    }
+
+    for (uint32_t first = oldestFirst;
+         first + RECORDS_PER_SEGMENT - 1 <= ackedSeq && first != headFirst;
+         first += RECORDS_PER_SEGMENT) {
+        removeSegment(first);
+    }
+    committedAck = ackedSeq;
+    return writeMeta();
+}
+
+bool ScanJournal::writeMeta() {
+    Meta meta;
+    meta.magic = JOURNAL_MAGIC;
+    meta.ackedSeq = committedAck;
+    meta.bootCount = bootCount;
+    meta.journalId = currentJournalId;
+    meta.crc = crc32((const uint8_t *)&meta, offsetof(Meta, crc));
+
+    // Giữ file meta mở và ghi đè tại chỗ để commit không phải mở file (cấp phát heap)
+    if (!metaFile) {
+        metaFile = fs->open(JOURNAL_META, fs->exists(JOURNAL_META) ? "r+" : "w+");
+        if (!metaFile) {
+            DebugSerial.println("[Journal] Cannot write meta file");
+            return false;
+        }
+    }
+    metaFile.seek(0);
+    bool ok = metaFile.write((const uint8_t *)&meta, sizeof(meta)) == sizeof(meta);
+    metaFile.flush();
+    journalStats.programs++;
+    journalStats.metaWrites++;
+    return ok;
+}
@@ -0,0 +1,28 @@
+#include "SensorTiming.h"
+
+SensorTiming sensorTimings[SENSOR_COMMAND_COUNT] = {};
+
+const char *const sensorCommandNames[SENSOR_COMMAND_COUNT] = {
+    "poll", "getImage", "image2Tz", "search", "createModel", "storeModel", "deleteModel", "identify", "readIndex",
+    "uploadTemplate", "downloadTemplate",
+};
+
+void recordSensorTiming(SensorCommand command, uint32_t startUs) {
+    uint32_t us = micros() - startUs;
+    SensorTiming &timing = sensorTimings[command];
+    timing.count++;
+    timing.lastUs = us;
+    timing.totalUs += us;
+    if (us > timing.maxUs) timing.maxUs = us;
+}
+
+// Mỗi lệnh đã dùng: số lần, trung bình/lớn nhất (us)
+void printSensorTimings(Print &out) {
+    for (uint8_t i = 0; i < SENSOR_COMMAND_COUNT; i++) {
+        const SensorTiming &timing = sensorTimings[i];
+        if (timing.count == 0) continue;
+        out.printf(" %s n=%lu avg=%lu max=%lu", sensorCommandNames[i], (unsigned long)timing.count,
+                   (unsigned long)timing.avgUs(), (unsigned long)timing.maxUs);
+    }
+    out.println();
+}
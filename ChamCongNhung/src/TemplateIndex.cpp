@@ -0,0 +1,26 @@
+#include "TemplateIndex.h"
+
+// Gửi gói lệnh rồi nhận gói phản hồi vào chính packet (như thư viện làm với lệnh của nó);
+// trả mã xác nhận (byte đầu nội dung phản hồi)
+static uint8_t exchange(Adafruit_Fingerprint &finger, Adafruit_Fingerprint_Packet &packet) {
+    finger.writeStructuredPacket(packet);
+    if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK) return FINGERPRINT_PACKETRECIEVEERR;
+    if (packet.type != FINGERPRINT_ACKPACKET) return FINGERPRINT_PACKETRECIEVEERR;
+    return packet.data[0];
+}
+
+uint8_t readTemplateIndex(Adafruit_Fingerprint &finger, uint8_t page, uint8_t table[TEMPLATE_INDEX_PAGE_BYTES]) {
+    uint8_t command[] = {FINGERPRINT_READINDEXTABLE, page};
+    Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(command), command);
+    uint8_t p = exchange(finger, packet);
+    if (p != FINGERPRINT_OK) return p;
+    memcpy(table, packet.data + 1, TEMPLATE_INDEX_PAGE_BYTES);
+    return FINGERPRINT_OK;
+}
+
+uint8_t deleteTemplateRange(Adafruit_Fingerprint &finger, uint16_t first, uint16_t count) {
+    uint8_t command[] = {FINGERPRINT_DELETE, (uint8_t)(first >> 8), (uint8_t)(first & 0xFF),
+                         (uint8_t)(count >> 8), (uint8_t)(count & 0xFF)};
+    Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(command), command);
+    return exchange(finger, packet);
+}
@@ -0,0 +1,164 @@
+#include "TemplateTransfer.h"
+
+static bool isPacketSize32 = false;
+static uint8_t previousPacketSize = FINGERPRINT_PACKET_SIZE_32; // FINGERPRINT_PACKET_SIZE_* trước khi đổi
+static uint32_t lastTransferAt = 0;
+
+// Cảm biến cần gói dữ liệu 32 byte; đổi (ghi vào cảm biến) nếu đang khác
+static uint8_t usePacketSize32(Adafruit_Fingerprint &finger) {
+    lastTransferAt = millis();
+    if (isPacketSize32) return FINGERPRINT_OK;
+    uint8_t p = finger.getParameters();
+    if (p != FINGERPRINT_OK) return p;
+    previousPacketSize = FINGERPRINT_PACKET_SIZE_32;
+    while ((32u << previousPacketSize) < finger.packet_len && previousPacketSize < FINGERPRINT_PACKET_SIZE_256) {
+        previousPacketSize++;
+    }
+    if (previousPacketSize != FINGERPRINT_PACKET_SIZE_32) p = finger.setPacketSize(FINGERPRINT_PACKET_SIZE_32);
+    isPacketSize32 = p == FINGERPRINT_OK;
+    return p;
+}
+
+uint8_t restorePacketSize(Adafruit_Fingerprint &finger, uint32_t idleMs) {
+    if (!isPacketSize32 || millis() - lastTransferAt < idleMs) return FINGERPRINT_OK;
+    uint8_t p = FINGERPRINT_OK;
+    if (previousPacketSize != FINGERPRINT_PACKET_SIZE_32) p = finger.setPacketSize(previousPacketSize);
+    if (p == FINGERPRINT_OK) isPacketSize32 = false;
+    return p;
+}
+
+uint8_t uploadTemplate(Adafruit_Fingerprint &finger, uint16_t slot, uint8_t out[TEMPLATE_BYTES]) {
+    uint8_t p = usePacketSize32(finger);
+    if (p == FINGERPRINT_OK) p = finger.loadModel(slot);
+    if (p == FINGERPRINT_OK) p = finger.getModel();
+    if (p != FINGERPRINT_OK) return p;
+
+    uint8_t none = 0;
+    Adafruit_Fingerprint_Packet packet(FINGERPRINT_DATAPACKET, 0, &none);
+    uint16_t received = 0;
+    do {
+        if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK) return FINGERPRINT_PACKETRECIEVEERR;
+        if (packet.type != FINGERPRINT_DATAPACKET && packet.type != FINGERPRINT_ENDDATAPACKET) {
+            return FINGERPRINT_UPLOADFAIL;
+        }
+        uint16_t len = packet.length - 2; // Bỏ checksum
+        if (len > TEMPLATE_PACKET_BYTES || received + len > TEMPLATE_BYTES) return FINGERPRINT_UPLOADFAIL;
+        memcpy(out + received, packet.data, len);
+        received += len;
+    } while (packet.type != FINGERPRINT_ENDDATAPACKET);
+    return received == TEMPLATE_BYTES ? FINGERPRINT_OK : FINGERPRINT_UPLOADFAIL;
+}
+
+uint8_t downloadTemplate(Adafruit_Fingerprint &finger, const uint8_t data[TEMPLATE_BYTES], uint16_t slot) {
+    uint8_t p = usePacketSize32(finger);
+    if (p != FINGERPRINT_OK) return p;
+    uint8_t command[] = {FINGERPRINT_DOWNCHAR, 0x01};
+    Adafruit_Fingerprint_Packet packet(FINGERPRINT_COMMANDPACKET, sizeof(command), command);
+    finger.writeStructuredPacket(packet);
+    if (finger.getStructuredPacket(&packet) != FINGERPRINT_OK || packet.type != FINGERPRINT_ACKPACKET) {
+        return FINGERPRINT_PACKETRECIEVEERR;
+    }
+    if (packet.data[0] != FINGERPRINT_OK) return packet.data[0];
+
+    for (uint16_t offset = 0; offset < TEMPLATE_BYTES; offset += TEMPLATE_PACKET_BYTES) {
+        uint8_t type = offset + TEMPLATE_PACKET_BYTES < TEMPLATE_BYTES ? FINGERPRINT_DATAPACKET : FINGERPRINT_ENDDATAPACKET;
+        Adafruit_Fingerprint_Packet chunk(type, TEMPLATE_PACKET_BYTES, (uint8_t *)data + offset);
+        finger.writeStructuredPacket(chunk);
+    }
+    return finger.storeModel(slot);
+}
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void encodeBase64(const uint8_t *data, size_t len, char *out) {
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = (uint32_t)data[i] << 16;
+        if (i + 1 < len) n |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) n |= data[i + 2];
+        *out++ = base64Chars[n >> 18 & 63];
+        *out++ = base64Chars[n >> 12 & 63];
+        *out++ = i + 1 < len ? base64Chars[n >> 6 & 63] : '=';
+        *out++ = i + 2 < len ? base64Chars[n & 63] : '=';
+    }
+    *out = '\0';
+}
+
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int decodeBase64(const char *text, uint8_t *out, size_t maxLen) {
+    size_t len = 0;
+    uint32_t n = 0;
+    uint8_t bits = 0;
+    for (; *text && *text != '='; text++) {
+        int value = base64Value(*text);
+        if (value < 0) return -1;
+        n = n << 6 | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (len == maxLen) return -1;
+            out[len++] = n >> bits & 0xFF;
+        }
+    }
+    return len;
+}
+
+int8_t TemplateBuffers::addChunk(uint32_t rid, uint16_t templateId, uint16_t offset, uint16_t total,
+                                 const char *base64, const char *&error) {
+    int8_t index = -1;
+    for (uint8_t i = 0; i < TEMPLATE_BUFFERS; i++) {
+        if (buffers[i].inUse && buffers[i].rid == rid && buffers[i].templateId == templateId) index = i;
+    }
+    if (offset == 0 && index < 0) {
+        for (uint8_t i = 0; i < TEMPLATE_BUFFERS && index < 0; i++) {
+            if (!buffers[i].inUse) index = i;
+        }
+        if (index < 0) {
+            error = "Template buffers busy";
+            return -2;
+        }
+        buffers[index] = {rid, templateId, 0, true, {}};
+    }
+    if (index < 0 || total != TEMPLATE_BYTES || offset != buffers[index].received) {
+        error = "Unexpected template chunk";
+        if (index >= 0) release(index);
+        return -2;
+    }
+    TemplateBuffer &buffer = buffers[index];
+    int len = decodeBase64(base64, buffer.data + offset, TEMPLATE_BYTES - offset);
+    if (len <= 0) {
+        error = "Invalid template chunk data";
+        release(index);
+        return -2;
+    }
+    buffer.received += len;
+    return buffer.received == TEMPLATE_BYTES ? index : -1;
+}
+
+bool TemplateBuffers::releaseRid(uint32_t rid, uint16_t templateId) {
+    for (TemplateBuffer &buffer : buffers) {
+        if (buffer.inUse && (rid ? buffer.rid == rid : buffer.templateId == templateId)) {
+            buffer.inUse = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TemplateBuffers::busy() const {
+    for (const TemplateBuffer &buffer : buffers) {
+        if (buffer.inUse) return true;
+    }
+    return false;
+}
+
+void TemplateBuffers::clear() {
+    for (TemplateBuffer &buffer : buffers) buffer.inUse = false;
+}
@@ -0,0 +1,87 @@
+#include "UserDirectory.h"
+#include "ScanJournal.h"
+#include "BoardConfig.h"
+
+static const char *DIRECTORY_FILE = "/users.dir";
+static const char *DIRECTORY_TEMP = "/users.tmp";
+static const uint32_t DIRECTORY_MAGIC = 0x44495231; // "DIR1"
+
+bool UserDirectory::begin(fs::FS &filesystem) {
+    fs = &filesystem;
+    File file = fs->open(DIRECTORY_FILE, "r");
+    if (!file) {
+        DebugSerial.println("[Directory] No saved directory, waiting for server");
+        return true;
+    }
+
+    Header header;
+    bool valid = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == DIRECTORY_MAGIC &&
+                 file.read((uint8_t *)entries, sizeof(entries)) == sizeof(entries) &&
+                 header.crc == ScanJournal::crc32((const uint8_t *)entries, sizeof(entries));
+    file.close();
+    if (!valid) {
+        DebugSerial.println("[Directory] Saved directory corrupted, waiting for full sync");
+        clear();
+        return true;
+    }
+    dirVersion = header.version;
+    DebugSerial.printf("[Directory] Loaded version %lu, %u names (%u B RAM)\n", (unsigned long)dirVersion,
+                       count(), (unsigned)ramBytes());
+    return true;
+}
+
+const DirectoryEntry *UserDirectory::find(uint16_t templateId) const {
+    if (templateId < 1 || templateId > CAPACITY) return nullptr;
+    const DirectoryEntry &entry = entries[templateId - 1];
+    return entry.name[0] ? &entry : nullptr;
+}
+
+bool UserDirectory::set(uint16_t templateId, const char *name, uint8_t flags) {
+    if (templateId < 1 || templateId > CAPACITY || !name) return false;
+    DirectoryEntry &entry = entries[templateId - 1];
+    // Font OLED chỉ có ASCII: server đã bỏ dấu, ký tự lạ còn sót thay bằng '?'
+    uint8_t len = 0;
+    for (; name[len] && len < NAME_LENGTH; len++) {
+        char c = name[len];
+        entry.name[len] = (c >= 0x20 && c < 0x7F) ? c : '?';
+    }
+    entry.name[len] = 0;
+    entry.flags = flags;
+    return true;
+}
+
+void UserDirectory::remove(uint16_t templateId) {
+    if (templateId < 1 || templateId > CAPACITY) return;
+    entries[templateId - 1] = {};
+}
+
+void UserDirectory::clear() {
+    memset(entries, 0, sizeof(entries));
+    dirVersion = 0;
+}
+
+uint16_t UserDirectory::count() const {
+    uint16_t n = 0;
+    for (const DirectoryEntry &entry : entries) {
+        if (entry.name[0]) n++;
+    }
+    return n;
+}
+
+// Ghi ra file tạm rồi đổi tên: mất điện giữa chừng vẫn còn bản cũ nguyên vẹn
+bool UserDirectory::save() {
+    if (!fs) return false;
+    File file = fs->open(DIRECTORY_TEMP, "w");
+    if (!file) return false;
+    Header header = {DIRECTORY_MAGIC, dirVersion,
+                     ScanJournal::crc32((const uint8_t *)entries, sizeof(entries)), 0};
+    bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t *)entries, sizeof(entries)) == sizeof(entries);
+    file.close();
+    if (!ok || !fs->rename(DIRECTORY_TEMP, DIRECTORY_FILE)) {
+        DebugSerial.println("[Directory] Failed to save directory");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+#include "WifiManager.h"
+#include "BoardConfig.h"
+#include "ScanJournal.h"
+
+static const char *const WIFI_CACHE_PATH = "/wifi.bin";
+static const uint32_t WIFI_CACHE_MAGIC = 0x57494649; // "WIFI"
+// Kết nối thẳng thường xong trong ~1 s; quét mọi kênh + associate + DHCP chậm hơn nhiều
+static const uint32_t FAST_ATTEMPT_TIMEOUT_MS = 5000;
+static const uint32_t FULL_ATTEMPT_TIMEOUT_MS = 15000;
+static const uint32_t RETRY_WITHOUT_BACKOFF_MS = 30000; // Tính từ lúc mất mạng / khởi động
+static const uint32_t MIN_BACKOFF_MS = 1000;
+static const uint32_t MAX_BACKOFF_MS = 15000;
+
+WifiManager::WifiManager(const char *ssid, const char *password) : ssid(ssid), password(password) {}
+
+void WifiManager::setStaticIp(IPAddress ip, IPAddress gw, IPAddress sn, IPAddress dnsServer) {
+    staticIp = ip;
+    gateway = gw;
+    subnet = sn;
+    dns = dnsServer;
+}
+
+void WifiManager::begin(fs::FS *filesystem) {
+    fs = filesystem;
+    loadCache();
+    WiFi.persistent(false); // SDK không ghi cấu hình xuống flash mỗi lần begin()
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+    if (staticIp[0] != 0) WiFi.config(staticIp, gateway, subnet, dns);
+    connectingSince = millis();
+    startAttempt(hasCache);
+}
+
+void WifiManager::loadCache() {
+    hasCache = false;
+    if (!fs || !fs->exists(WIFI_CACHE_PATH)) return;
+    File f = fs->open(WIFI_CACHE_PATH, "r");
+    if (!f) return;
+    Cache cache;
+    bool complete = f.read((uint8_t *)&cache, sizeof(cache)) == sizeof(cache);
+    f.close();
+    if (!complete || cache.magic != WIFI_CACHE_MAGIC ||
+        cache.crc != ScanJournal::crc32((const uint8_t *)&cache, offsetof(Cache, crc)) ||
+        cache.ssidCrc != ScanJournal::crc32((const uint8_t *)ssid, strlen(ssid)) || cache.channel == 0) {
+        DebugSerial.println("[WiFi] Cache invalid, full scan");
+        return;
+    }
+    memcpy(cachedBssid, cache.bssid, BSSID_LENGTH);
+    cachedChannel = cache.channel;
+    hasCache = true;
+}
+
+bool WifiManager::writeCache(fs::FS &filesystem, const char *ssid, const uint8_t *bssid, uint8_t channel) {
+    Cache cache = {};
+    cache.magic = WIFI_CACHE_MAGIC;
+    cache.ssidCrc = ScanJournal::crc32((const uint8_t *)ssid, strlen(ssid));
+    memcpy(cache.bssid, bssid, BSSID_LENGTH);
+    cache.channel = channel;
+    cache.crc = ScanJournal::crc32((const uint8_t *)&cache, offsetof(Cache, crc));
+    File f = filesystem.open(WIFI_CACHE_PATH, "w");
+    if (!f) return false;
+    bool ok = f.write((const uint8_t *)&cache, sizeof(cache)) == sizeof(cache);
+    f.close();
+    return ok;
+}
+
+// Chỉ ghi flash khi AP đổi kênh/BSSID, không phải mỗi lần kết nối
+void WifiManager::saveCache() {
+    const uint8_t *bssid = WiFi.BSSID();
+    uint8_t channel = (uint8_t)WiFi.channel();
+    if (!bssid || channel == 0) return;
+    if (hasCache && channel == cachedChannel && memcmp(bssid, cachedBssid, BSSID_LENGTH) == 0) return;
+    memcpy(cachedBssid, bssid, BSSID_LENGTH);
+    cachedChannel = channel;
+    hasCache = true;
+    if (fs && !writeCache(*fs, ssid, cachedBssid, cachedChannel)) DebugSerial.println("[WiFi] Cache write failed");
+}
+
+void WifiManager::startAttempt(bool fast) {
+    isFastAttempt = fast && hasCache;
+    attemptStartedAt = millis();
+    state = STATE_CONNECTING;
+    if (isFastAttempt) {
+        DebugSerial.printf("[WiFi] Connecting to %s (ch %u, cached)\n", ssid, cachedChannel);
+        WiFi.begin(ssid, password, cachedChannel, cachedBssid);
+    } else {
+        DebugSerial.printf("[WiFi] Connecting to %s (scan)\n", ssid);
+        WiFi.begin(ssid, password);
+    }
+}
+
+void WifiManager::attemptFailed() {
+    wifiStats.failures++;
+    if (isFastAttempt) {
+        // Cache có thể đã cũ: quét lại ngay, không chờ
+        wifiStats.fallbacks++;
+        startAttempt(false);
+        return;
+    }
+    if (millis() - connectingSince < RETRY_WITHOUT_BACKOFF_MS) {
+        startAttempt(true);
+        return;
+    }
+    backoffMs = backoffMs ? min(backoffMs * 2, MAX_BACKOFF_MS) : MIN_BACKOFF_MS;
+    retryAt = millis() + backoffMs;
+    state = STATE_BACKOFF;
+    DebugSerial.printf("[WiFi] Not connected, retry in %lu ms\n", (unsigned long)backoffMs);
+}
+
+WifiEvent WifiManager::loop() {
+    switch (state) {
+    case STATE_IDLE:
+        break;
+    case STATE_CONNECTING:
+        {
+            wl_status_t status = WiFi.status();
+            if (status == WL_CONNECTED) {
+                state = STATE_CONNECTED;
+                backoffMs = 0;
+                wifiStats.connects++;
+                if (isFastAttempt) wifiStats.fastConnects++;
+                wifiStats.lastConnectMs = millis() - connectingSince;
+                saveCache();
+                IPAddress ip = WiFi.localIP();
+                DebugSerial.printf("[WiFi] Connected in %lu ms, IP %u.%u.%u.%u, RSSI %ld\n",
+                                   (unsigned long)wifiStats.lastConnectMs, ip[0], ip[1], ip[2], ip[3],
+                                   (long)WiFi.RSSI());
+                return WIFI_EVENT_CONNECTED;
+            }
+            uint32_t timeoutMs = isFastAttempt ? FAST_ATTEMPT_TIMEOUT_MS : FULL_ATTEMPT_TIMEOUT_MS;
+            if (status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED ||
+                millis() - attemptStartedAt >= timeoutMs) {
+                attemptFailed();
+            }
+            break;
+        }
+    case STATE_CONNECTED:
+        if (WiFi.status() != WL_CONNECTED) {
+            wifiStats.drops++;
+            connectingSince = millis();
+            DebugSerial.println("[WiFi] Connection lost, reconnecting");
+            startAttempt(true);
+            return WIFI_EVENT_LOST;
+        }
+        break;
+    case STATE_BACKOFF:
+        if ((long)(millis() - retryAt) >= 0) startAttempt(true);
+        break;
+    }
+    return WIFI_EVENT_NONE;
+}
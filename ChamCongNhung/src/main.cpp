@@ -4,8 +4,20 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_Fingerprint.h>
-#include <NTPClient.h>
 #include <WiFiUdp.h>
+#include <LittleFS.h>
+#include "BoardConfig.h"
+#include "ClockService.h"
+#include "CommandQueue.h"
+#include "DeviceMetrics.h"
+#include "RecentMatches.h"
+#include "ScanJournal.h"
+#include "SensorTiming.h"
+#include "TemplateIndex.h"
+#include "TemplateTransfer.h"
+#include "UserDirectory.h"
+#include "WifiManager.h"
+#include "JsonArena.h"
 
 // --- WiFi Credentials ---
 const char *ssid = "PTIT_WIFI"; // Thay bằng tên WiFi của bạn
@@ -15,568 +27,1433 @@ const char *WS_HOST = "172.11.73.90"; // Thay bằng IP của máy chủ
 // const char *password = "chothuephong"; // Thay bằng mật khẩu WiFi
 // const char *WS_HOST = "192.168.1.215"; // Thay bằng IP của máy chủ
 
+// IP tĩnh: bỏ qua DHCP khi kết nối (lại). 0.0.0.0 = dùng DHCP.
+const IPAddress staticIp(0, 0, 0, 0);
+const IPAddress staticGateway(0, 0, 0, 0);
+const IPAddress staticSubnet(255, 255, 255, 0);
+const IPAddress staticDns(0, 0, 0, 0);
+
 // --- Backend WebSocket Server ---
 const uint16_t WS_PORT = 3000;       // Port của máy chủ
 
 // --- Device ID ---
 const char *DEVICE_ID = "ESP_CHAMCONG_01"; // ID duy nhất cho thiết bị
 
-// --- Hardware Pins ---
-#define SCREEN_WIDTH 128
-#define SCREEN_HEIGHT 32
-#define BUZZER_PIN D7
-#define FINGERPRINT_RX D5
-#define FINGERPRINT_TX D6
+// --- Wire protocol ---
+// true: xin server dùng MessagePack (frame binary) qua "&proto=msgpack".
+// Thiết bị chỉ chuyển sang MessagePack sau khi nhận frame binary đầu tiên
+// (server gửi "hello"); server cũ không hỗ trợ thì vẫn dùng JSON như trước.
+const bool useMsgPack = true;
+bool isMsgPackActive = false;
+
+// --- Hardware Pins: include/BoardConfig.h ---
+
+// --- Fingerprint sensor link ---
+// Cảm biến lưu baud trong flash của nó (mặc định xuất xưởng 57600). SoftwareSerial
+// giữ 57600; UART phần cứng thì đổi cảm biến lên 115200 (mức cao nhất của AS608/R307).
+const uint32_t sensorDefaultBaud = 57600;
+#if SENSOR_ON_HW_UART
+const uint32_t sensorTargetBaud = 115200;
+const uint8_t sensorTargetBaudCode = FINGERPRINT_BAUDRATE_115200;
+#else
+const uint32_t sensorTargetBaud = 57600;
+const uint8_t sensorTargetBaudCode = FINGERPRINT_BAUDRATE_57600;
+#endif
+uint32_t sensorBaud = 0; // Baud đang dùng sau khi thương lượng
 
 // --- Objects ---
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1);
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1, OLED_I2C_CLOCK, OLED_I2C_CLOCK);
+#if SENSOR_ON_HW_UART
+Adafruit_Fingerprint finger = Adafruit_Fingerprint(&Serial);
+#else
 SoftwareSerial mySerial(FINGERPRINT_RX, FINGERPRINT_TX);
 Adafruit_Fingerprint finger = Adafruit_Fingerprint(&mySerial);
+#endif
 WebSocketsClient webSocket;
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP, "pool.ntp.org", 25200, 60000); // GMT+7
+ClockService clockService(ntpUDP, "pool.ntp.org", 25200); // GMT+7, đồng bộ NTP chạy nền
+ScanJournal journal; // Lưu lượt quét trên flash cho tới khi gửi được lên server
+UserDirectory userDirectory; // Tên người dùng theo template id, hiện ngay khi quét
+WifiManager wifiManager(ssid, password); // Kết nối WiFi nền (cache kênh/BSSID, thử lại lùi dần)
 
 // --- Variables ---
 bool isWebSocketConnected = false;
 unsigned long lastReconnectAttempt = 0;
 const unsigned long reconnectInterval = 5000; // Thử kết nối lại sau 5 giây
-unsigned long lastHeartbeatSent = 0;
-const unsigned long heartbeatInterval = 10000; // Gửi heartbeat mỗi 10 giây
+// Liveness dùng ping/pong của giao thức WebSocket: server ping mỗi 10 giây (thư viện tự
+// trả pong), thiết bị tự ping để phát hiện kết nối chết im lặng (half-open) và kết nối lại
+const uint32_t wsPingIntervalMs = 15000;
+const uint32_t wsPongTimeoutMs = 3000;
+const uint8_t wsPongMissLimit = 2; // Ngắt kết nối sau 2 ping liên tiếp không có pong
+
+bool isJournalReady = false;
+
+// Gộp nhiều lượt quét vào một frame scan_batch; server trả scan_ack tích luỹ,
+// bản ghi chỉ bị xoá khỏi journal khi đã được ack.
+const bool useScanBatching = true;            // false: mỗi lượt quét một frame scan_result
+const uint8_t scanBatchMax = 10;              // Số lượt quét tối đa mỗi frame
+const unsigned long scanBatchWindowMs = 200;  // Chờ gộp tối đa sau lượt quét chưa gửi đầu tiên
+const uint8_t scanMaxInFlight = 20;           // Số lượt quét đã gửi nhưng chưa được ack
+const unsigned long scanAckTimeoutMs = 5000;  // Không có ack thì gửi lại từ bản ghi chưa ack
+const unsigned long journalCommitMs = 5000;   // Ack chưa lưu xuống flash lâu nhất (xem ScanJournal::commit)
+uint32_t scanSentSeq = 0;                     // seq cao nhất đã gửi
+unsigned long lastScanSendTime = 0;
+unsigned long firstUnsentScanTime = 0;
+uint32_t clockHeldSeq = 0;                    // Lượt quét đầu tiên phải chờ đồng bộ giờ (0 = chưa biết)
+// Có kết nối chừng này (đủ cho hai lần hỏi NTP) mà vẫn chưa đồng bộ được thì thôi giữ lượt
+// quét chưa có giờ
+const unsigned long clockHoldMaxMs = 10000;
 
 // Thêm biến toàn cục để theo dõi trạng thái đăng ký
 bool isEnrolling = false;
 
+// Các bước của quá trình đăng ký vân tay (state machine, chạy từ loop())
+enum EnrollState {
+    ENROLL_IDLE,
+    ENROLL_WAIT_FINGER_1, // Chờ đặt ngón tay lần 1 (timeout 15s)
+    ENROLL_CONVERT_1,     // image2Tz(1) + kiểm tra trùng
+    ENROLL_REMOVE_PAUSE,  // Nghỉ 1s trước khi yêu cầu nhấc tay
+    ENROLL_WAIT_REMOVE,   // Chờ nhấc ngón tay (timeout 5s)
+    ENROLL_WAIT_FINGER_2, // Chờ đặt ngón tay lần 2 (timeout 15s)
+    ENROLL_CONVERT_2,     // image2Tz(2)
+    ENROLL_CREATE_MODEL,
+    ENROLL_STORE_MODEL,
+    ENROLL_SHOW_RESULT    // Giữ kết quả trên màn hình 2s
+};
+EnrollState enrollState = ENROLL_IDLE;
+int enrollId = 0;
+uint32_t enrollRid = 0; // rid của lệnh enroll đang chạy (0 = server cũ)
+int enrollStep = 0;
+unsigned long enrollStepStart = 0;
+unsigned long enrollStepTimeout = 0; // 0 = không giới hạn
+
+// Lệnh enroll/delete chờ chạy: callback WebSocket chỉ xếp hàng, loop() chạy từng lệnh
+CommandQueue commandQueue;
+TemplateBuffers templateBuffers; // Đặc trưng server đang gửi xuống (template_load)
+const unsigned long templateIdleMs = 10000; // Hết đợt truyền mẫu: trả kích thước gói của cảm biến
+
+// Còi kêu không chặn (tắt/bật theo millis() trong loop())
+unsigned long buzzerToggleAt = 0;
+unsigned long buzzerOnMs = 0;
+uint8_t buzzerTogglesLeft = 0;
+
+// Nội dung đang hiển thị trên OLED (2 dòng, tối đa 21 ký tự ở cỡ chữ 1).
+// displayStatus() chỉ gửi qua I2C phần thay đổi so với nội dung này.
+const int16_t displayLineY[2] = {0, 10};
+char shownLines[2][22] = {};
+bool displayNeedsFullRedraw = true; // RAM của SSD1306 chưa biết nội dung sau khi bật nguồn
+uint32_t displayUpdates = 0;        // Số lần gọi displayStatus()
+uint32_t displaySkipped = 0;        // ... trong đó nội dung không đổi, không gửi gì
+
+// Thông báo tạm thời trên màn hình: tự quay về màn hình chờ khi hết hạn (0 = không có)
+unsigned long displayRevertAt = 0;
+
+// Sau một lượt quét, chờ nhấc ngón tay ra mới quét tiếp (không chấm trùng khi giữ tay)
+bool waitingForFingerLift = false;
+// Lượt chấm đã nhận gần đây, chống chấm trùng trong SCAN_SUPPRESS_WINDOW_MS
+RecentMatches recentMatches;
+
+// Histogram độ trễ + bộ đếm, gửi server mỗi metricsIntervalMs trong message "metrics"
+DeviceMetrics deviceMetrics;
+const unsigned long metricsIntervalMs = 60000;
+unsigned long lastMetricsSent = 0;
+unsigned long metricsSince = 0; // Đầu khoảng mà histogram đang đếm
+unsigned long wsDownSince = 0; // Lúc mất kết nối WebSocket (0 = đang kết nối / chưa từng kết nối)
+unsigned long wsConnectedAt = 0;
+unsigned long readyMs = 0;     // Khởi động -> WebSocket kết nối lần đầu (0 = chưa)
+
+// Phát hiện ngón tay: ngắt từ chân TOUCH, hoặc hỏi getImage() định kỳ (thưa dần khi vắng người).
+// Chân TOUCH chỉ được tin sau khi nó báo chạm đúng lúc cảm biến thấy ngón tay, nên khi
+// không nối dây thiết bị vẫn quét định kỳ như cũ; chân im lặng trong khi cảm biến thấy
+// ngón tay thì quay về quét định kỳ.
+const bool useTouchPin = true;
+volatile bool fingerTouched = false;           // ISR đặt, loop() xoá
+bool isTouchPinTrusted = false;
+unsigned long lastFingerSeen = 0;              // Lần cuối cảm biến thấy ngón tay
+unsigned long lastFingerPoll = 0;
+const unsigned long fingerPollFastForMs = 15000; // Sau khi có người: hỏi cảm biến mỗi loop()
+const unsigned long fingerPollIdleMs = 200;      // Vắng người: hỏi thưa hơn
+const unsigned long touchPinCheckMs = 5000;      // Chế độ ngắt: thỉnh thoảng vẫn hỏi để phát hiện chân hỏng
+uint32_t fingerPolls = 0;
+uint32_t touchWakeups = 0;
+
 // --- Function Declarations ---
-void displayStatus(String line1, String line2 = "");
-void connectWiFi();
+void displayStatus(const char *line1, const char *line2 = "");
+void pushDisplayRegion(uint8_t firstPage, uint8_t lastPage, uint8_t firstCol, uint8_t lastCol);
+void showTransient(const char *line1, const char *line2, unsigned long holdMs);
+void updateDisplay();
+const char *withId(const char *prefix, int id);
+void handleWifiEvent(WifiEvent event);
 void connectWebSocket();
 void webSocketEvent(WStype_t type, uint8_t *payload, size_t length);
-void sendWebSocketMessage(const char *type, const JsonDocument &payload);
-void sendHeartbeat();
-void handleEnrollCommand(int id);
-void handleDeleteCommand(int id);
+void handleServerMessage(JsonDocument &doc);
+bool sendWebSocketMessage(const char *type, const JsonDocument &payload);
+void queueCommand(DeviceCommandType type, JsonDocument &doc);
+void cancelCommand(DeviceCommandType type, JsonDocument &doc);
+bool enqueueCommand(const DeviceCommand &command);
+void handleTemplateChunk(JsonDocument &doc);
+void handleTemplateUpload(int id, uint32_t rid);
+void handleTemplateLoad(int id, uint8_t buffer, uint32_t rid);
+void processCommandQueue();
+void sendCommandStatus(DeviceCommandType type, int id, uint32_t rid, const char *status, const char *message);
+void handleEnrollCommand(int id, uint32_t rid);
+void cancelEnrollment(const char *reason);
+void processEnrollment();
+void startBeep(unsigned long onMs, uint8_t count);
+void updateBuzzer();
+void handleDeleteCommand(int id, uint16_t count, uint32_t rid);
+void handleInventoryCommand(uint32_t rid);
+const char *commandStatusType(DeviceCommandType type);
 int getFingerprintID();
+bool beginSensor(uint32_t baud);
+bool connectSensor();
+void onFingerTouch();
+bool shouldPollFinger();
+void noteFingerPresent();
+void waitForNextLoop(unsigned long ms);
 void processFingerprintScan();
+bool scanRecordTime(const ScanRecord &rec, uint32_t &epoch, uint16_t &ms);
+void addClockQuality(JsonDocument &payload);
+bool sendScanRecord(const ScanRecord &rec);
+bool sendScanBatch(uint32_t fromSeq, uint32_t toSeq);
+void handleScanAck(uint32_t seq);
+uint32_t lastTimedSeq(uint32_t fromSeq, uint32_t toSeq);
+void drainJournal();
+void handleDirectoryMessage(JsonDocument &doc);
+void sendDirectoryAck();
+void sendMetrics();
 
 // --- Function Implementations ---
-void displayStatus(String line1, String line2) {
-    display.clearDisplay();
-    display.setCursor(0, 0);
-    display.println(line1);
-    if (line2 != "") {
-        display.setCursor(0, 10);
-        display.println(line2);
-    }
-    display.display();
-}
-
-void connectWiFi() {
-    displayStatus("Connecting WiFi");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
-    Serial.print("Connecting to WiFi.");
-    unsigned long startAttemptTime = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 30000) {
-        delay(500);
-        Serial.print(".");
-    }
-
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("\nFailed to connect to WiFi.");
-        displayStatus("WiFi Failed!");
-        delay(5000);
-        ESP.restart();
-    } else {
-        Serial.println("\nConnected to WiFi");
-        Serial.print("IP Address: ");
-        Serial.println(WiFi.localIP());
-        Serial.print("RSSI: ");
-        Serial.println(WiFi.RSSI()); // Log tín hiệu WiFi
-        displayStatus("WiFi Connected", WiFi.localIP().toString());
-        delay(1000);
+void displayStatus(const char *line1, const char *line2) {
+    displayRevertAt = 0; // Nội dung mới thay cho thông báo tạm thời đang chờ
+    displayUpdates++;
+
+    const char *lines[2] = {line1, line2};
+    bool changed = false;
+    for (uint8_t i = 0; i < 2; i++) {
+        char text[sizeof(shownLines[i])];
+        strncpy(text, lines[i], sizeof(text) - 1); // Cắt bớt thay vì tràn sang dòng dưới
+        text[sizeof(text) - 1] = '\0';
+        if (!displayNeedsFullRedraw && strcmp(text, shownLines[i]) == 0) continue;
+
+        // Khoảng ký tự khác nhau giữa nội dung cũ và mới
+        size_t oldLen = strlen(shownLines[i]);
+        size_t newLen = strlen(text);
+        size_t first = 0;
+        while (first < oldLen && first < newLen && text[first] == shownLines[i][first]) first++;
+        size_t last = max(oldLen, newLen);
+        while (last > first && last <= oldLen && last <= newLen && text[last - 1] == shownLines[i][last - 1]) last--;
+
+        int16_t y = displayLineY[i];
+        display.fillRect(0, y, SCREEN_WIDTH, 8, BLACK);
+        display.setCursor(0, y);
+        display.print(text);
+        strcpy(shownLines[i], text);
+        changed = true;
+
+        if (!displayNeedsFullRedraw) {
+            uint8_t firstCol = first * 6;
+            uint8_t lastCol = min<size_t>(last * 6, SCREEN_WIDTH) - 1;
+            pushDisplayRegion(y / 8, (y + 7) / 8, firstCol, lastCol);
+        }
+    }
+
+    if (displayNeedsFullRedraw) {
+        display.display();
+        displayNeedsFullRedraw = false;
+    } else if (!changed) {
+        displaySkipped++;
+    }
+}
+
+// Gửi một vùng framebuffer (trang firstPage..lastPage, cột firstCol..lastCol) thay vì
+// cả 512 byte như display(). SSD1306 đang ở chế độ địa chỉ ngang nên dữ liệu tự xuống
+// trang kế tiếp khi hết cửa sổ cột.
+void pushDisplayRegion(uint8_t firstPage, uint8_t lastPage, uint8_t firstCol, uint8_t lastCol) {
+    Wire.beginTransmission(OLED_ADDRESS);
+    Wire.write((uint8_t)0x00); // Chuỗi lệnh
+    Wire.write((uint8_t)SSD1306_PAGEADDR);
+    Wire.write(firstPage);
+    Wire.write(lastPage);
+    Wire.write((uint8_t)SSD1306_COLUMNADDR);
+    Wire.write(firstCol);
+    Wire.write(lastCol);
+    Wire.endTransmission();
+
+    const uint8_t *buffer = display.getBuffer();
+    uint8_t bytesOut = 0;
+    for (uint8_t page = firstPage; page <= lastPage; page++) {
+        for (uint16_t col = firstCol; col <= lastCol; col++) {
+            if (bytesOut == 0) {
+                Wire.beginTransmission(OLED_ADDRESS);
+                Wire.write((uint8_t)0x40); // Dữ liệu
+                bytesOut = 1;
+            }
+            Wire.write(buffer[page * SCREEN_WIDTH + col]);
+            if (++bytesOut >= BUFFER_LENGTH) {
+                Wire.endTransmission();
+                bytesOut = 0;
+            }
+        }
+    }
+    if (bytesOut > 0) Wire.endTransmission();
+}
+
+// Hiện thông báo trong holdMs rồi tự về màn hình chờ; loop() vẫn chạy trong lúc đó
+void showTransient(const char *line1, const char *line2, unsigned long holdMs) {
+    displayStatus(line1, line2);
+    displayRevertAt = millis() + holdMs;
+    if (displayRevertAt == 0) displayRevertAt = 1;
+}
+
+void updateDisplay() {
+    if (displayRevertAt == 0 || (long)(millis() - displayRevertAt) < 0) return;
+    if (isEnrolling) {
+        displayRevertAt = 0; // Không xoá hướng dẫn đăng ký, bước kế tiếp sẽ vẽ lại
+        return;
+    }
+    displayStatus("Moi dat van tay");
+}
+
+// Ghép "<prefix><id>" vào buffer tĩnh cho dòng hiển thị (không dùng String)
+const char *withId(const char *prefix, int id) {
+    static char text[24];
+    snprintf(text, sizeof(text), "%s%d", prefix, id);
+    return text;
+}
+
+// Kêu `count` tiếng, mỗi tiếng dài `onMs`, nghỉ giữa các tiếng bằng `onMs`
+void startBeep(unsigned long onMs, uint8_t count) {
+    if (count == 0) return;
+    digitalWrite(BUZZER_PIN, HIGH);
+    buzzerOnMs = onMs;
+    buzzerTogglesLeft = count * 2 - 1;
+    buzzerToggleAt = millis() + onMs;
+}
+
+void updateBuzzer() {
+    if (buzzerTogglesLeft == 0 || (long)(millis() - buzzerToggleAt) < 0) return;
+    buzzerTogglesLeft--;
+    digitalWrite(BUZZER_PIN, buzzerTogglesLeft % 2 == 0 ? LOW : HIGH);
+    buzzerToggleAt = millis() + buzzerOnMs;
+}
+
+// Kết nối WiFi chạy nền trong WifiManager; ở đây chỉ phản ứng khi có / mất mạng
+void handleWifiEvent(WifiEvent event) {
+    if (event == WIFI_EVENT_CONNECTED) {
+        // Bucket cuối đã là >= 30 s; chặn trên để giá trị us không tràn 32 bit khi mất mạng lâu
+        deviceMetrics.record(METRIC_WIFI_CONNECT, min<uint32_t>(wifiManager.stats().lastConnectMs, 60000) * 1000UL);
+        connectWebSocket(); // Không chờ reconnectInterval: WiFi vừa có là kết nối server ngay
+    } else if (event == WIFI_EVENT_LOST) {
+        deviceMetrics.count(METRIC_WIFI_DROPS);
+        if (!isEnrolling) displayStatus("WiFi Disconnected", "Reconnecting...");
     }
 }
 
 void connectWebSocket() {
     lastReconnectAttempt = millis();
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("WiFi not connected. Cannot connect WebSocket.");
+    if (!wifiManager.isConnected()) {
+        DebugSerial.println("WiFi not connected. Cannot connect WebSocket.");
         displayStatus("No WiFi for WS");
         return;
     }
-    String wsUrl = String("/") + "?deviceId=" + String(DEVICE_ID);
-    webSocket.begin(WS_HOST, WS_PORT, wsUrl.c_str());
+    // dir=<phiên bản bảng tên đang có>: server gửi delta hoặc cả bảng nếu khác phiên bản hiện tại
+    char wsUrl[96];
+    snprintf(wsUrl, sizeof(wsUrl), "/?deviceId=%s%s&dir=%lu", DEVICE_ID, useMsgPack ? "&proto=msgpack" : "",
+             (unsigned long)userDirectory.version());
+    webSocket.begin(WS_HOST, WS_PORT, wsUrl);
     webSocket.onEvent(webSocketEvent);
     webSocket.setReconnectInterval(5000);
-    Serial.println("Attempting WebSocket connection...");
+    webSocket.enableHeartbeat(wsPingIntervalMs, wsPongTimeoutMs, wsPongMissLimit);
+    DebugSerial.println("Attempting WebSocket connection...");
     displayStatus("Connecting WS...");
 }
 
+// Xử lý lệnh từ server (giống nhau cho frame JSON và MessagePack)
+void handleServerMessage(JsonDocument &doc) {
+    const char *messageType = doc["type"];
+    if (!messageType) {
+        DebugSerial.println("Received message without 'type' field.");
+        return;
+    }
+
+    if (strcmp(messageType, "hello") == 0) {
+        DebugSerial.printf("[WebSocket] Server hello, proto=%s\n", doc["proto"] | "json");
+    } else if (strcmp(messageType, "heartbeat") == 0) {
+        // Server cũ còn gửi heartbeat JSON và chờ trả lời
+        JsonDocument heartbeatPayload(&jsonArena);
+        heartbeatPayload["status"] = "alive";
+        sendWebSocketMessage("heartbeat", heartbeatPayload);
+    } else if (strcmp(messageType, "enroll") == 0) {
+        queueCommand(COMMAND_ENROLL, doc);
+    } else if (strcmp(messageType, "directory") == 0) {
+        handleDirectoryMessage(doc);
+    } else if (strcmp(messageType, "scan_ack") == 0) {
+        handleScanAck(doc["seq"].as<uint32_t>());
+    } else if (strcmp(messageType, "enroll_cancel") == 0) {
+        cancelCommand(COMMAND_ENROLL, doc);
+    } else if (strcmp(messageType, "delete") == 0 || strcmp(messageType, "delete_range") == 0) {
+        queueCommand(COMMAND_DELETE, doc);
+    } else if (strcmp(messageType, "inventory") == 0) {
+        queueCommand(COMMAND_INVENTORY, doc);
+    } else if (strcmp(messageType, "delete_cancel") == 0) {
+        cancelCommand(COMMAND_DELETE, doc);
+    } else if (strcmp(messageType, "template_upload") == 0) {
+        queueCommand(COMMAND_UPLOAD_TEMPLATE, doc);
+    } else if (strcmp(messageType, "template_load") == 0) {
+        handleTemplateChunk(doc);
+    } else if (strcmp(messageType, "load_cancel") == 0) {
+        cancelCommand(COMMAND_LOAD_TEMPLATE, doc);
+    } else if (strcmp(messageType, "upload_cancel") == 0) {
+        cancelCommand(COMMAND_UPLOAD_TEMPLATE, doc);
+    } else {
+        DebugSerial.print("Unknown command type received: ");
+        DebugSerial.println(messageType);
+    }
+}
+
 void webSocketEvent(WStype_t type, uint8_t *payload, size_t length) {
     switch (type) {
     case WStype_DISCONNECTED:
+        if (isWebSocketConnected) wsDownSince = millis(); // Các lần kết nối lại thất bại không tính lại
         isWebSocketConnected = false;
-        Serial.println("[WebSocket] Disconnected!");
+        DebugSerial.println("[WebSocket] Disconnected!");
+        cancelEnrollment("Connection lost");
+        // Server đã báo lỗi mọi lệnh đang chờ của thiết bị khi mất kết nối: không chạy nữa
+        if (!commandQueue.empty()) {
+            DebugSerial.printf("[Command] Dropping %u queued commands\n", commandQueue.size());
+            commandQueue.clear();
+        }
+        templateBuffers.clear();
+        scanSentSeq = 0; // Gửi lại các lượt quét chưa được ack sau khi kết nối lại
         displayStatus("WS Disconnected");
         break;
     case WStype_CONNECTED:
         isWebSocketConnected = true;
-        Serial.print("[WebSocket] Connected to url: ");
-        Serial.println((char *)payload);
-        displayStatus("WS Connected", "Server OK");
-        delay(2000); // Chờ 2 giây
-        displayStatus("Moi dat van tay"); // Chuyển sang trạng thái Ready
-        lastHeartbeatSent = millis(); // Khởi tạo thời gian heartbeat
+        wsConnectedAt = millis();
+        isMsgPackActive = false; // Dùng JSON cho tới khi server xác nhận MessagePack
+        DebugSerial.print("[WebSocket] Connected to url: ");
+        DebugSerial.println((char *)payload);
+        if (wsDownSince) {
+            deviceMetrics.record(METRIC_RECONNECT, (millis() - wsDownSince) * 1000UL);
+            deviceMetrics.count(METRIC_RECONNECTS);
+            wsDownSince = 0;
+        }
+        if (!readyMs) {
+            readyMs = millis();
+            DebugSerial.printf("[Boot] Ready in %lu ms\n", readyMs);
+        }
+        if (!isEnrolling) showTransient("WS Connected", "Server OK", 2000);
         break;
     case WStype_TEXT:
         {
             isWebSocketConnected = true;
-            Serial.printf("[WebSocket] Received: %s\n", payload);
+            // Frame dài (đoạn đặc trưng, trang bảng tên) chỉ in phần đầu: log 115200 baud chặn loop()
+            DebugSerial.printf("[WebSocket] Received: %.*s%s\n", (int)min<size_t>(length, 96), payload,
+                               length > 96 ? "..." : "");
 
-            StaticJsonDocument<200> doc;
+            JsonDocument doc(&jsonArena);
+            uint32_t decodeStart = micros();
             DeserializationError error = deserializeJson(doc, payload, length);
+            deviceMetrics.record(METRIC_WS_DECODE, micros() - decodeStart);
 
             if (error) {
-                Serial.print(F("deserializeJson() failed: "));
-                Serial.println(error.f_str());
-                StaticJsonDocument<100> errPayload;
+                DebugSerial.print(F("deserializeJson() failed: "));
+                DebugSerial.println(error.f_str());
+                JsonDocument errPayload(&jsonArena);
                 errPayload["message"] = "Invalid JSON received";
                 errPayload["original"] = (const char*)payload;
                 sendWebSocketMessage("error_report", errPayload);
                 return;
             }
-
-            const char *messageType = doc["type"];
-            if (!messageType) {
-                Serial.println("Received JSON without 'type' field.");
-                return;
+            handleServerMessage(doc);
+            break;
+        }
+    case WStype_BIN:
+        {
+            isWebSocketConnected = true;
+            DebugSerial.printf("[WebSocket] Received %u bytes (msgpack)\n", (unsigned)length);
+            if (useMsgPack && !isMsgPackActive) {
+                DebugSerial.println("[WebSocket] Server speaks MessagePack, switching wire format");
+                isMsgPackActive = true;
             }
 
-            if (strcmp(messageType, "heartbeat") == 0) {
-                Serial.println("[WebSocket] Received heartbeat from server");
-                StaticJsonDocument<50> heartbeatPayload;
-                heartbeatPayload["status"] = "alive";
-                sendWebSocketMessage("heartbeat", heartbeatPayload);
-            } else if (strcmp(messageType, "enroll") == 0) {
-                if (doc.containsKey("id") && doc["id"].is<int>()) {
-                    int idToEnroll = doc["id"];
-                    if (idToEnroll > 0) {
-                        handleEnrollCommand(idToEnroll);
-                    } else {
-                        Serial.println("Invalid ID (< 1) received for enroll command.");
-                        StaticJsonDocument<100> errPayload;
-                        errPayload["id"] = idToEnroll;
-                        errPayload["status"] = "error";
-                        errPayload["message"] = "Invalid ID (< 1) for enroll";
-                        sendWebSocketMessage("enroll_status", errPayload);
-                    }
-                } else {
-                    Serial.println("Missing or invalid 'id' field for enroll command.");
-                    StaticJsonDocument<100> errPayload;
-                    errPayload["status"] = "error";
-                    errPayload["message"] = "Missing/invalid 'id' for enroll";
-                    sendWebSocketMessage("enroll_status", errPayload);
-                }
-            } else if (strcmp(messageType, "delete") == 0) {
-                if (doc.containsKey("id") && doc["id"].is<int>()) {
-                    int idToDelete = doc["id"];
-                    if (idToDelete > 0) {
-                        handleDeleteCommand(idToDelete);
-                    } else {
-                        Serial.println("Invalid ID (< 1) received for delete command.");
-                        StaticJsonDocument<100> errPayload;
-                        errPayload["id"] = idToDelete;
-                        errPayload["status"] = "error";
-                        errPayload["message"] = "Invalid ID (< 1) for delete";
-                        sendWebSocketMessage("delete_status", errPayload);
-                    }
-                } else {
-                    Serial.println("Missing or invalid 'id' field for delete command.");
-                    StaticJsonDocument<100> errPayload;
-                    errPayload["status"] = "error";
-                    errPayload["message"] = "Missing/invalid 'id' for delete";
-                    sendWebSocketMessage("delete_status", errPayload);
-                }
-            } else {
-                Serial.print("Unknown command type received: ");
-                Serial.println(messageType);
+            JsonDocument doc(&jsonArena);
+            uint32_t decodeStart = micros();
+            DeserializationError error = deserializeMsgPack(doc, payload, length);
+            deviceMetrics.record(METRIC_WS_DECODE, micros() - decodeStart);
+            if (error) {
+                DebugSerial.print(F("deserializeMsgPack() failed: "));
+                DebugSerial.println(error.f_str());
+                JsonDocument errPayload(&jsonArena);
+                errPayload["message"] = "Invalid MessagePack received";
+                sendWebSocketMessage("error_report", errPayload);
+                return;
             }
+            handleServerMessage(doc);
             break;
         }
     case WStype_PING:
-        Serial.println("[WebSocket] Received ping");
-        break;
     case WStype_PONG:
-        Serial.println("[WebSocket] Received pong");
+        // Thư viện đã trả pong / ghi nhận pong; không log để ping mỗi 10 giây không tốn Serial
         break;
     case WStype_ERROR:
-        Serial.printf("[WebSocket] Error: %s\n", payload);
+        DebugSerial.printf("[WebSocket] Error: %s\n", payload);
         break;
     default:
         break;
     }
 }
 
-void sendWebSocketMessage(const char *type, const JsonDocument &payloadDoc) {
+bool sendWebSocketMessage(const char *type, const JsonDocument &payloadDoc) {
     if (!isWebSocketConnected) {
-        Serial.println("WebSocket not connected, cannot send message.");
-        return;
+        DebugSerial.println("WebSocket not connected, cannot send message.");
+        deviceMetrics.count(METRIC_WS_DROPPED);
+        return false;
     }
 
-    StaticJsonDocument<256> messageDoc;
+    JsonDocument messageDoc(&jsonArena);
     messageDoc["type"] = type;
     messageDoc["payload"] = payloadDoc;
 
-    String output;
-    serializeJson(messageDoc, output);
+    // Serialize vào buffer tĩnh thay vì String để không cấp phát heap mỗi lần gửi.
+    // WEBSOCKETS_MAX_HEADER_SIZE byte đầu để thư viện ghi header frame tại chỗ
+    // (headerToPayload = true), nếu không nó sẽ malloc một buffer mới cho mỗi frame.
+    static uint8_t wsTxBuffer[WEBSOCKETS_MAX_HEADER_SIZE + 768];
+    uint8_t *body = wsTxBuffer + WEBSOCKETS_MAX_HEADER_SIZE;
+    const size_t bodySize = sizeof(wsTxBuffer) - WEBSOCKETS_MAX_HEADER_SIZE;
+    uint32_t start = micros();
+    size_t needed = isMsgPackActive ? measureMsgPack(messageDoc) : measureJson(messageDoc);
+    if (needed >= bodySize) {
+        DebugSerial.printf("WS message '%s' too large (%u bytes), dropped!\n", type, (unsigned)needed);
+        deviceMetrics.count(METRIC_WS_DROPPED);
+        return false;
+    }
 
-    Serial.print("Sending WS message: ");
-    Serial.println(output);
-    if (!webSocket.sendTXT(output)) {
-        Serial.println("WebSocket sendTXT failed!");
+    bool sent;
+    if (isMsgPackActive) {
+        size_t len = serializeMsgPack(messageDoc, body, bodySize);
+        deviceMetrics.record(METRIC_WS_ENCODE, micros() - start);
+        DebugSerial.printf("Sending WS message: %s (%u bytes msgpack)\n", type, (unsigned)len);
+        start = micros();
+        sent = webSocket.sendBIN(wsTxBuffer, len, true);
+    } else {
+        size_t len = serializeJson(messageDoc, (char *)body, bodySize);
+        deviceMetrics.record(METRIC_WS_ENCODE, micros() - start);
+        DebugSerial.print("Sending WS message: ");
+        DebugSerial.println((const char *)body);
+        start = micros();
+        sent = webSocket.sendTXT(wsTxBuffer, len, true);
     }
+    deviceMetrics.record(METRIC_WS_SEND, micros() - start);
+    if (!sent) {
+        DebugSerial.println("WebSocket send failed!");
+        deviceMetrics.count(METRIC_WS_DROPPED);
+        return false;
+    }
+    return true;
 }
 
-void sendHeartbeat() {
-    StaticJsonDocument<50> heartbeatPayload;
-    heartbeatPayload["status"] = "alive";
-    sendWebSocketMessage("heartbeat", heartbeatPayload);
+// --- Enrollment state machine ---
+// Mỗi lần loop() gọi processEnrollment() chỉ tiến thêm tối đa một bước,
+// không có vòng chờ hay delay() bên trong nên WebSocket/heartbeat vẫn chạy.
+void startEnrollStep(EnrollState next, unsigned long timeoutMs) {
+    enrollState = next;
+    enrollStepStart = millis();
+    enrollStepTimeout = timeoutMs;
 }
 
-void handleEnrollCommand(int id) {
-    isEnrolling = true; // Đánh dấu bắt đầu đăng ký
-    Serial.printf("Starting enrollment process for ID: %d\n", id);
-    StaticJsonDocument<150> statusPayload;
-    statusPayload["id"] = id;
-
-    statusPayload["status"] = "ready";
-    statusPayload["step"] = 0;
-    statusPayload["message"] = "Ready to enroll";
+void sendEnrollStatus(const char *status, int step, const char *message) {
+    JsonDocument statusPayload(&jsonArena);
+    statusPayload["id"] = enrollId;
+    if (enrollRid) statusPayload["rid"] = enrollRid;
+    statusPayload["status"] = status;
+    statusPayload["step"] = step;
+    statusPayload["message"] = message;
     sendWebSocketMessage("enroll_status", statusPayload);
+}
 
-    displayStatus("Enroll ID: " + String(id), "Place finger");
-    statusPayload["status"] = "processing";
-    statusPayload["step"] = 1;
-    statusPayload["message"] = "Place finger (1st time)";
-    sendWebSocketMessage("enroll_status", statusPayload);
+// Kết thúc đăng ký: giữ thông báo trên màn hình 2 giây rồi quay về trạng thái chờ
+void finishEnrollment(const char *line1, const char *line2) {
+    displayStatus(line1, line2);
+    waitingForFingerLift = true; // Ngón tay vừa đăng ký có thể vẫn còn trên cảm biến
+    startEnrollStep(ENROLL_SHOW_RESULT, 2000);
+}
 
-    int p = -1;
-    unsigned long stepStartTime = millis();
-    while (p != FINGERPRINT_OK) {
-        p = finger.getImage();
-        if (millis() - stepStartTime > 15000) {
-            displayStatus("Timeout", "Enroll Cancelled");
-            statusPayload["status"] = "error";
-            statusPayload["message"] = "Timeout waiting for finger (1st)";
-            sendWebSocketMessage("enroll_status", statusPayload);
-            delay(2000);
-            displayStatus("Moi dat van tay");
-            return;
-        }
-        webSocket.loop();
-        delay(50);
+// --- Lệnh từ server ---
+// enroll/delete/template_upload: { id, rid }, delete_range: { id, count, rid },
+// inventory: { rid }, template_load: xem handleTemplateChunk(). Lệnh hợp lệ vào commandQueue;
+// nếu phía trước còn lệnh khác (đang đăng ký hoặc đang chờ) thì báo "queued" kèm số lệnh
+// phía trước để server giãn thời gian chờ. Kết quả về sau mang đúng rid của lệnh.
+void queueCommand(DeviceCommandType type, JsonDocument &doc) {
+    int id = doc["id"] | 0;
+    int count = doc["count"] | 1;
+    uint32_t rid = doc["rid"] | 0u;
+    if (type != COMMAND_INVENTORY && (!doc["id"].is<int>() || id < 1 || count < 1 || id + count - 1 > 0xFFFF)) {
+        DebugSerial.printf("[Command] Invalid ID/count for %s\n", commandStatusType(type));
+        sendCommandStatus(type, id, rid, "error", "Missing/invalid 'id' or 'count'");
+        return;
     }
-    p = finger.image2Tz(1);
-    if (p != FINGERPRINT_OK) {
-        displayStatus("Enroll Failed", "Image error");
-        statusPayload["status"] = "error";
-        statusPayload["message"] = "Failed to process 1st image";
-        sendWebSocketMessage("enroll_status", statusPayload);
-        delay(2000);
-        displayStatus("Moi dat van tay");
+    enqueueCommand({rid, (uint16_t)id, (uint16_t)count, type});
+}
+
+bool enqueueCommand(const DeviceCommand &command) {
+    uint8_t ahead = commandQueue.size() + (isEnrolling ? 1 : 0);
+    if (!commandQueue.push(command)) {
+        DebugSerial.printf("[Command] Queue full, rejected rid %lu\n", (unsigned long)command.rid);
+        sendCommandStatus(command.type, command.templateId, command.rid, "error", "Device command queue full");
+        return false;
+    }
+    if (ahead > 0) {
+        JsonDocument payload(&jsonArena);
+        if (command.type != COMMAND_INVENTORY) payload["id"] = command.templateId;
+        if (command.rid) payload["rid"] = command.rid;
+        payload["status"] = "queued";
+        payload["ahead"] = ahead;
+        sendWebSocketMessage(commandStatusType(command.type), payload);
+    }
+    return true;
+}
+
+// *_cancel: { id, rid } - bỏ lệnh còn chờ (và đặc trưng đang nhận), hoặc dừng đăng ký đang chạy
+void cancelCommand(DeviceCommandType type, JsonDocument &doc) {
+    int id = doc["id"] | 0;
+    uint32_t rid = doc["rid"] | 0u;
+    bool buffered = type == COMMAND_LOAD_TEMPLATE && templateBuffers.releaseRid(rid, id);
+    if (commandQueue.remove(type, rid, id) || buffered) {
+        DebugSerial.printf("[Command] Cancelled queued rid %lu (ID %d)\n", (unsigned long)rid, id);
         return;
     }
+    if (type == COMMAND_ENROLL && isEnrolling && (rid ? rid == enrollRid : id == enrollId)) {
+        cancelEnrollment("Cancelled by server");
+    }
+}
 
-    // Kiểm tra xem vân tay đã tồn tại hay chưa
-    p = finger.fingerFastSearch();
-    if (p == FINGERPRINT_OK) {
-        displayStatus("Enroll Failed", "Van tay da dang ky");
-        statusPayload["status"] = "error";
-        statusPayload["message"] = "Fingerprint already registered with ID: " + String(finger.fingerID);
-        sendWebSocketMessage("enroll_status", statusPayload);
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(100);
-        digitalWrite(BUZZER_PIN, LOW);
-        delay(100);
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(100);
-        digitalWrite(BUZZER_PIN, LOW);
-        delay(2000);
-        displayStatus("Moi dat van tay");
+// Chạy lệnh kế tiếp khi không có đăng ký nào đang chạy; mỗi loop() tối đa một lệnh
+void processCommandQueue() {
+    DeviceCommand command;
+    if (isEnrolling) return;
+    if (!commandQueue.pop(command)) {
+        // Hết đợt nạp/đọc mẫu (không còn đoạn nào đang ghép): trả kích thước gói của cảm biến
+        if (!templateBuffers.busy()) restorePacketSize(finger, templateIdleMs);
         return;
     }
+    if (command.type == COMMAND_ENROLL) handleEnrollCommand(command.templateId, command.rid);
+    else if (command.type == COMMAND_DELETE) handleDeleteCommand(command.templateId, command.count, command.rid);
+    else if (command.type == COMMAND_INVENTORY) handleInventoryCommand(command.rid);
+    else if (command.type == COMMAND_UPLOAD_TEMPLATE) handleTemplateUpload(command.templateId, command.rid);
+    else handleTemplateLoad(command.templateId, command.count, command.rid);
+}
 
-    displayStatus("Enroll ID: " + String(id), "Remove finger");
-    statusPayload["step"] = 2;
-    statusPayload["message"] = "Remove finger";
-    sendWebSocketMessage("enroll_status", statusPayload);
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(100);
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(1000);
-
-    p = 0;
-    stepStartTime = millis();
-    while (p != FINGERPRINT_NOFINGER) {
-        p = finger.getImage();
-        if (millis() - stepStartTime > 5000) {
-            displayStatus("Timeout", "Enroll Cancelled");
-            statusPayload["status"] = "error";
-            statusPayload["message"] = "Timeout waiting for finger removal";
-            sendWebSocketMessage("enroll_status", statusPayload);
-            delay(2000);
-            displayStatus("Moi dat van tay");
-            return;
-        }
-        webSocket.loop();
-        delay(50);
+const char *commandStatusType(DeviceCommandType type) {
+    switch (type) {
+    case COMMAND_ENROLL: return "enroll_status";
+    case COMMAND_DELETE: return "delete_status";
+    case COMMAND_INVENTORY: return "inventory";
+    case COMMAND_UPLOAD_TEMPLATE: return "upload_status";
+    default: return "load_status";
     }
-    Serial.println("Finger removed.");
+}
 
-    displayStatus("Enroll ID: " + String(id), "Place again");
-    statusPayload["step"] = 3;
-    statusPayload["message"] = "Place finger again (2nd time)";
-    sendWebSocketMessage("enroll_status", statusPayload);
+void sendCommandStatus(DeviceCommandType type, int id, uint32_t rid, const char *status, const char *message) {
+    JsonDocument payload(&jsonArena);
+    if (type != COMMAND_INVENTORY) payload["id"] = id;
+    if (rid) payload["rid"] = rid;
+    payload["status"] = status;
+    payload["message"] = message;
+    sendWebSocketMessage(commandStatusType(type), payload);
+}
+
+void handleEnrollCommand(int id, uint32_t rid) {
+    isEnrolling = true; // Đánh dấu bắt đầu đăng ký
+    enrollId = id;
+    enrollRid = rid;
+    enrollStep = 0;
+    DebugSerial.printf("Starting enrollment process for ID: %d\n", id);
+    sendEnrollStatus("ready", 0, "Ready to enroll");
+
+    displayStatus(withId("Enroll ID: ", id), "Place finger");
+    enrollStep = 1;
+    sendEnrollStatus("processing", 1, "Place finger (1st time)");
+    startEnrollStep(ENROLL_WAIT_FINGER_1, 15000);
+}
+
+void cancelEnrollment(const char *reason) {
+    if (!isEnrolling || enrollState == ENROLL_SHOW_RESULT) return;
+    DebugSerial.printf("Enrollment for ID %d cancelled: %s\n", enrollId, reason);
+    sendEnrollStatus("error", enrollStep, reason);
+    finishEnrollment("Enroll Cancelled", reason);
+}
+
+void processEnrollment() {
+    if (!isEnrolling) return;
 
-    p = -1;
-    stepStartTime = millis();
-    while (p != FINGERPRINT_OK) {
-        p = finger.getImage();
-        if (millis() - stepStartTime > 15000) {
-            displayStatus("Timeout", "Enroll Cancelled");
-            statusPayload["status"] = "error";
-            statusPayload["message"] = "Timeout waiting for finger (2nd)";
-            sendWebSocketMessage("enroll_status", statusPayload);
-            delay(2000);
+    unsigned long now = millis();
+    if (enrollStepTimeout > 0 && now - enrollStepStart > enrollStepTimeout) {
+        switch (enrollState) {
+        case ENROLL_WAIT_FINGER_1:
+            sendEnrollStatus("error", enrollStep, "Timeout waiting for finger (1st)");
+            finishEnrollment("Timeout", "Enroll Cancelled");
+            return;
+        case ENROLL_WAIT_REMOVE:
+            sendEnrollStatus("error", enrollStep, "Timeout waiting for finger removal");
+            finishEnrollment("Timeout", "Enroll Cancelled");
+            return;
+        case ENROLL_WAIT_FINGER_2:
+            sendEnrollStatus("error", enrollStep, "Timeout waiting for finger (2nd)");
+            finishEnrollment("Timeout", "Enroll Cancelled");
+            return;
+        case ENROLL_REMOVE_PAUSE:
+            startEnrollStep(ENROLL_WAIT_REMOVE, 5000);
+            return;
+        case ENROLL_SHOW_RESULT:
+            enrollState = ENROLL_IDLE;
+            isEnrolling = false; // Đánh dấu kết thúc đăng ký
             displayStatus("Moi dat van tay");
             return;
+        default:
+            break;
         }
-        webSocket.loop();
-        delay(50);
-    }
-    p = finger.image2Tz(2);
-    if (p != FINGERPRINT_OK) {
-        displayStatus("Enroll Failed", "Image error 2");
-        statusPayload["status"] = "error";
-        statusPayload["message"] = "Failed to process 2nd image";
-        sendWebSocketMessage("enroll_status", statusPayload);
-        delay(2000);
-        displayStatus("Moi dat van tay");
-        return;
     }
 
-    displayStatus("Processing...");
-    Serial.println("Creating model...");
-    p = finger.createModel();
-    if (p != FINGERPRINT_OK) {
-        displayStatus("Enroll Failed", "Model creation err");
-        statusPayload["status"] = "error";
-        if (p == FINGERPRINT_PACKETRECIEVEERR) statusPayload["message"] = "Comm error creating model";
-        else if (p == FINGERPRINT_ENROLLMISMATCH) statusPayload["message"] = "Fingerprints did not match";
-        else statusPayload["message"] = "Error creating model";
-        sendWebSocketMessage("enroll_status", statusPayload);
-        delay(2000);
-        displayStatus("Moi dat van tay");
-        return;
-    }
+    uint8_t p;
+    switch (enrollState) {
+    case ENROLL_WAIT_FINGER_1:
+        if (finger.getImage() == FINGERPRINT_OK) {
+            startEnrollStep(ENROLL_CONVERT_1, 0);
+        }
+        break;
 
-    Serial.println("Model created.");
-    Serial.print("Storing model #");
-    Serial.println(id);
-    p = finger.storeModel(id);
-    if (p == FINGERPRINT_OK) {
-        displayStatus("Enroll Success!", "ID: " + String(id));
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(500);
-        digitalWrite(BUZZER_PIN, LOW);
-        statusPayload["status"] = "success";
-        statusPayload["message"] = "Enrollment successful";
-        sendWebSocketMessage("enroll_status", statusPayload);
-        delay(2000);
-    } else {
-        displayStatus("Enroll Failed", "Store error");
-        statusPayload["status"] = "error";
-        if (p == FINGERPRINT_PACKETRECIEVEERR) statusPayload["message"] = "Comm error storing model";
-        else if (p == FINGERPRINT_BADLOCATION) statusPayload["message"] = "Invalid storage location";
-        else if (p == FINGERPRINT_FLASHERR) statusPayload["message"] = "Flash storage error";
-        else statusPayload["message"] = "Error storing model";
-        sendWebSocketMessage("enroll_status", statusPayload);
-        delay(2000);
-    }
-    isEnrolling = false; // Đánh dấu kết thúc đăng ký
-    displayStatus("Moi dat van tay");
+    case ENROLL_CONVERT_1:
+        if (timedSensorCall(SENSOR_IMAGE2TZ, [] { return finger.image2Tz(1); }) != FINGERPRINT_OK) {
+            sendEnrollStatus("error", enrollStep, "Failed to process 1st image");
+            finishEnrollment("Enroll Failed", "Image error");
+            break;
+        }
+        // Kiểm tra xem vân tay đã tồn tại hay chưa
+        if (timedSensorCall(SENSOR_SEARCH, [] { return finger.fingerFastSearch(); }) == FINGERPRINT_OK) {
+            displayStatus("Enroll Failed", "Van tay da dang ky");
+            char message[48];
+            snprintf(message, sizeof(message), "Fingerprint already registered with ID: %u", finger.fingerID);
+            sendEnrollStatus("error", enrollStep, message);
+            startBeep(100, 2);
+            waitingForFingerLift = true;
+            startEnrollStep(ENROLL_SHOW_RESULT, 2000);
+            break;
+        }
+        displayStatus(withId("Enroll ID: ", enrollId), "Remove finger");
+        enrollStep = 2;
+        sendEnrollStatus("processing", 2, "Remove finger");
+        startBeep(100, 1);
+        startEnrollStep(ENROLL_REMOVE_PAUSE, 1000);
+        break;
+
+    case ENROLL_REMOVE_PAUSE:
+        break; // Chờ hết 1 giây (xử lý ở phần timeout phía trên)
+
+    case ENROLL_WAIT_REMOVE:
+        if (finger.getImage() == FINGERPRINT_NOFINGER) {
+            DebugSerial.println("Finger removed.");
+            displayStatus(withId("Enroll ID: ", enrollId), "Place again");
+            enrollStep = 3;
+            sendEnrollStatus("processing", 3, "Place finger again (2nd time)");
+            startEnrollStep(ENROLL_WAIT_FINGER_2, 15000);
+        }
+        break;
+
+    case ENROLL_WAIT_FINGER_2:
+        if (finger.getImage() == FINGERPRINT_OK) {
+            startEnrollStep(ENROLL_CONVERT_2, 0);
+        }
+        break;
+
+    case ENROLL_CONVERT_2:
+        if (timedSensorCall(SENSOR_IMAGE2TZ, [] { return finger.image2Tz(2); }) != FINGERPRINT_OK) {
+            sendEnrollStatus("error", enrollStep, "Failed to process 2nd image");
+            finishEnrollment("Enroll Failed", "Image error 2");
+            break;
+        }
+        displayStatus("Processing...");
+        startEnrollStep(ENROLL_CREATE_MODEL, 0);
+        break;
+
+    case ENROLL_CREATE_MODEL:
+        DebugSerial.println("Creating model...");
+        p = timedSensorCall(SENSOR_CREATE_MODEL, [] { return finger.createModel(); });
+        if (p != FINGERPRINT_OK) {
+            if (p == FINGERPRINT_PACKETRECIEVEERR) sendEnrollStatus("error", enrollStep, "Comm error creating model");
+            else if (p == FINGERPRINT_ENROLLMISMATCH) sendEnrollStatus("error", enrollStep, "Fingerprints did not match");
+            else sendEnrollStatus("error", enrollStep, "Error creating model");
+            finishEnrollment("Enroll Failed", "Model creation err");
+            break;
+        }
+        startEnrollStep(ENROLL_STORE_MODEL, 0);
+        break;
+
+    case ENROLL_STORE_MODEL:
+        DebugSerial.println("Model created.");
+        DebugSerial.print("Storing model #");
+        DebugSerial.println(enrollId);
+        p = timedSensorCall(SENSOR_STORE_MODEL, [] { return finger.storeModel(enrollId); });
+        if (p == FINGERPRINT_OK) {
+            startBeep(500, 1);
+            sendEnrollStatus("success", enrollStep, "Enrollment successful");
+            // Gửi đặc trưng vừa lưu lên server (loop() sau) để nạp vào các thiết bị khác
+            commandQueue.push({0, (uint16_t)enrollId, 1, COMMAND_UPLOAD_TEMPLATE});
+            finishEnrollment("Enroll Success!", withId("ID: ", enrollId));
+        } else {
+            if (p == FINGERPRINT_PACKETRECIEVEERR) sendEnrollStatus("error", enrollStep, "Comm error storing model");
+            else if (p == FINGERPRINT_BADLOCATION) sendEnrollStatus("error", enrollStep, "Invalid storage location");
+            else if (p == FINGERPRINT_FLASHERR) sendEnrollStatus("error", enrollStep, "Flash storage error");
+            else sendEnrollStatus("error", enrollStep, "Error storing model");
+            finishEnrollment("Enroll Failed", "Store error");
+        }
+        break;
+
+    default:
+        break;
+    }
 }
 
-void handleDeleteCommand(int id) {
-    Serial.printf("Deleting fingerprint template ID: %d\n", id);
-    displayStatus("Deleting ID: " + String(id));
-    StaticJsonDocument<100> statusPayload;
+// Xoá một mẫu, hoặc count mẫu liên tiếp bằng một lệnh DeleteChar (delete_range)
+void handleDeleteCommand(int id, uint16_t count, uint32_t rid) {
+    DebugSerial.printf("Deleting fingerprint template ID: %d (count %u)\n", id, count);
+    displayStatus(withId("Deleting ID: ", id));
+    JsonDocument statusPayload(&jsonArena);
     statusPayload["id"] = id;
+    if (count > 1) statusPayload["count"] = count;
+    if (rid) statusPayload["rid"] = rid;
 
-    uint8_t p = finger.deleteModel(id);
+    uint8_t p = timedSensorCall(SENSOR_DELETE_MODEL, [id, count] {
+        return count > 1 ? deleteTemplateRange(finger, id, count) : finger.deleteModel(id);
+    });
 
     if (p == FINGERPRINT_OK) {
-        Serial.println("Template deleted");
-        displayStatus("Delete Success!", "ID: " + String(id));
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(100);
-        digitalWrite(BUZZER_PIN, LOW);
+        DebugSerial.println("Template deleted");
+        showTransient("Delete Success!", withId("ID: ", id), 2000);
+        startBeep(100, 1);
         statusPayload["status"] = "success";
         statusPayload["message"] = "Deletion successful";
     } else {
-        Serial.print("Error deleting template: ");
-        displayStatus("Delete Failed", "ID: " + String(id));
+        DebugSerial.print("Error deleting template: ");
+        showTransient("Delete Failed", withId("ID: ", id), 2000);
         statusPayload["status"] = "error";
         if (p == FINGERPRINT_PACKETRECIEVEERR) {
-            Serial.println("Comm error");
+            DebugSerial.println("Comm error");
             statusPayload["message"] = "Communication error";
         } else if (p == FINGERPRINT_DELETEFAIL) {
-            Serial.println("Could not delete");
+            DebugSerial.println("Could not delete");
             statusPayload["message"] = "Failed to delete from sensor";
+        } else if (p == FINGERPRINT_BADLOCATION) {
+            DebugSerial.println("Bad location");
+            statusPayload["message"] = "ID out of sensor range";
         } else {
-            Serial.println("Unknown error");
+            DebugSerial.println("Unknown error");
             statusPayload["message"] = "Unknown sensor error during delete";
         }
     }
     sendWebSocketMessage("delete_status", statusPayload);
-    delay(2000);
-    displayStatus("Moi dat van tay");
+}
+
+// --- Sao chép đặc trưng giữa các thiết bị (TemplateTransfer) ---
+// template_load: { id, rid, offset, total, data } - các đoạn base64 theo thứ tự; đủ 512 byte
+// thì lệnh nạp vào hàng đợi. Lỗi (hết bộ đệm, đoạn sai) trả load_status "error" ngay.
+void handleTemplateChunk(JsonDocument &doc) {
+    int id = doc["id"] | 0;
+    uint32_t rid = doc["rid"] | 0u;
+    if (id < 1) {
+        sendCommandStatus(COMMAND_LOAD_TEMPLATE, id, rid, "error", "Missing/invalid 'id'");
+        return;
+    }
+    const char *error = nullptr;
+    int8_t buffer = templateBuffers.addChunk(rid, id, doc["offset"] | 0, doc["total"] | 0, doc["data"] | "", error);
+    if (buffer == -2) {
+        DebugSerial.printf("[Template] Load ID %d rejected: %s\n", id, error);
+        sendCommandStatus(COMMAND_LOAD_TEMPLATE, id, rid, "error", error);
+    } else if (buffer >= 0 && !enqueueCommand({rid, (uint16_t)id, (uint16_t)buffer, COMMAND_LOAD_TEMPLATE})) {
+        templateBuffers.release(buffer);
+    }
+}
+
+// Đọc đặc trưng của slot từ cảm biến, gửi lên thành các đoạn template_chunk
+void handleTemplateUpload(int id, uint32_t rid) {
+    static uint8_t data[TEMPLATE_BYTES];
+    uint8_t p = timedSensorCall(SENSOR_UPLOAD_TEMPLATE, [id] { return uploadTemplate(finger, id, data); });
+    if (p != FINGERPRINT_OK) {
+        DebugSerial.printf("[Template] Upload ID %d failed: %u\n", id, p);
+        sendCommandStatus(COMMAND_UPLOAD_TEMPLATE, id, rid, "error",
+                          p == FINGERPRINT_DBREADFAIL ? "Template slot is empty" : "Failed to read template from sensor");
+        return;
+    }
+    char text[(TEMPLATE_CHUNK_BYTES + 2) / 3 * 4 + 1];
+    for (uint16_t offset = 0; offset < TEMPLATE_BYTES; offset += TEMPLATE_CHUNK_BYTES) {
+        encodeBase64(data + offset, min<uint16_t>(TEMPLATE_CHUNK_BYTES, TEMPLATE_BYTES - offset), text);
+        JsonDocument payload(&jsonArena);
+        payload["id"] = id;
+        if (rid) payload["rid"] = rid;
+        payload["offset"] = offset;
+        payload["total"] = TEMPLATE_BYTES;
+        payload["data"] = text;
+        if (!sendWebSocketMessage("template_chunk", payload)) return;
+    }
+}
+
+void handleTemplateLoad(int id, uint8_t buffer, uint32_t rid) {
+    uint8_t p = timedSensorCall(SENSOR_DOWNLOAD_TEMPLATE, [id, buffer] {
+        return downloadTemplate(finger, templateBuffers.at(buffer).data, id);
+    });
+    templateBuffers.release(buffer);
+    if (p == FINGERPRINT_OK) {
+        DebugSerial.printf("[Template] Loaded ID %d\n", id);
+        sendCommandStatus(COMMAND_LOAD_TEMPLATE, id, rid, "success", "Template stored");
+    } else {
+        DebugSerial.printf("[Template] Load ID %d failed: %u\n", id, p);
+        sendCommandStatus(COMMAND_LOAD_TEMPLATE, id, rid, "error",
+                          p == FINGERPRINT_BADLOCATION ? "ID out of sensor range" : "Failed to store template on sensor");
+    }
+}
+
+// inventory: { rid, status, capacity, count, bitmap } - bitmap là bảng chiếm chỗ dạng hex,
+// bit n (byte n/8, bit n%8) = slot n có mẫu, phủ slot 0..capacity
+void handleInventoryCommand(uint32_t rid) {
+    uint8_t p = finger.getParameters(); // capacity thật của cảm biến
+    uint16_t bytes = finger.capacity / 8 + 1;
+    static char hex[2 * 4 * TEMPLATE_INDEX_PAGE_BYTES + 1]; // Tối đa 1024 slot
+    bytes = min<uint16_t>(bytes, (sizeof(hex) - 1) / 2);
+    uint16_t occupied = 0;
+    uint8_t table[TEMPLATE_INDEX_PAGE_BYTES];
+    for (uint16_t i = 0; p == FINGERPRINT_OK && i < bytes; i++) {
+        if (i % TEMPLATE_INDEX_PAGE_BYTES == 0) {
+            p = timedSensorCall(SENSOR_READ_INDEX, [&table, i] {
+                return readTemplateIndex(finger, i / TEMPLATE_INDEX_PAGE_BYTES, table);
+            });
+        }
+        uint8_t bits = table[i % TEMPLATE_INDEX_PAGE_BYTES];
+        occupied += __builtin_popcount(bits);
+        sprintf(hex + 2 * i, "%02x", bits);
+    }
+    if (p != FINGERPRINT_OK) {
+        DebugSerial.printf("[Inventory] Sensor error %u\n", p);
+        sendCommandStatus(COMMAND_INVENTORY, 0, rid, "error", "Failed to read sensor index table");
+        return;
+    }
+    DebugSerial.printf("[Inventory] %u/%u slots used\n", occupied, finger.capacity);
+    JsonDocument payload(&jsonArena);
+    if (rid) payload["rid"] = rid;
+    payload["status"] = "success";
+    payload["capacity"] = finger.capacity;
+    payload["count"] = occupied;
+    payload["bitmap"] = (const char *)hex;
+    sendWebSocketMessage("inventory", payload);
+}
+
+IRAM_ATTR void onFingerTouch() {
+    fingerTouched = true;
+}
+
+// Có cần hỏi cảm biến ở loop() này không
+bool shouldPollFinger() {
+    unsigned long now = millis();
+    if (isTouchPinTrusted) {
+        bool touching = fingerTouched || digitalRead(FINGER_TOUCH_PIN) == HIGH;
+        if (fingerTouched) touchWakeups++;
+        fingerTouched = false;
+        if (!touching) {
+            waitingForFingerLift = false; // Chân TOUCH về LOW: đã nhấc tay
+            return now - lastFingerPoll >= touchPinCheckMs;
+        }
+        return !waitingForFingerLift;
+    }
+    if (waitingForFingerLift || now - lastFingerSeen < fingerPollFastForMs) return true;
+    return now - lastFingerPoll >= fingerPollIdleMs;
+}
+
+// Cảm biến thấy ngón tay: đối chiếu với chân TOUCH
+void noteFingerPresent() {
+    lastFingerSeen = millis();
+    if (!useTouchPin) return;
+    bool touching = digitalRead(FINGER_TOUCH_PIN) == HIGH;
+    if (!isTouchPinTrusted && touching) {
+        isTouchPinTrusted = true;
+        DebugSerial.println("[Finger] Touch pin confirmed, waiting on interrupt");
+    } else if (isTouchPinTrusted && !touching) {
+        isTouchPinTrusted = false;
+        DebugSerial.println("[Finger] Touch pin silent while finger present, back to polling");
+    }
+}
+
+// Chờ tới loop() sau; khi tin chân TOUCH thì thức dậy ngay khi có chạm
+void waitForNextLoop(unsigned long ms) {
+    bool wakeOnTouch = isTouchPinTrusted && !isEnrolling;
+    if (!wakeOnTouch && !clockService.isAwaitingReply()) {
+        delay(ms);
+        return;
+    }
+    unsigned long start = millis();
+    while (!(wakeOnTouch && fingerTouched) && millis() - start < ms) {
+        delay(1);
+        clockService.pollReply(); // Đọc phản hồi NTP ngay khi tới
+    }
 }
 
 int getFingerprintID() {
+    fingerPolls++;
+    uint32_t start = micros();
     uint8_t p = finger.getImage();
-    if (p == FINGERPRINT_NOFINGER) return 0;
+    if (p == FINGERPRINT_NOFINGER) {
+        recordSensorTiming(SENSOR_POLL, start);
+        waitingForFingerLift = false;
+        return 0;
+    }
+    recordSensorTiming(SENSOR_GET_IMAGE, start);
+    noteFingerPresent();
+    if (waitingForFingerLift) return 0; // Ngón tay vừa quét vẫn còn trên cảm biến
     if (p != FINGERPRINT_OK) {
-        Serial.println("Error getting image");
+        DebugSerial.println("Error getting image");
+        deviceMetrics.count(METRIC_SENSOR_ERRORS);
         return -1;
     }
+    deviceMetrics.record(METRIC_GET_IMAGE, sensorTimings[SENSOR_GET_IMAGE].lastUs);
 
-    p = finger.image2Tz();
+    p = timedSensorCall(SENSOR_IMAGE2TZ, [] { return finger.image2Tz(); });
+    deviceMetrics.record(METRIC_IMAGE2TZ, sensorTimings[SENSOR_IMAGE2TZ].lastUs);
     if (p != FINGERPRINT_OK) {
-        Serial.println("Error converting image");
+        DebugSerial.println("Error converting image");
+        deviceMetrics.count(METRIC_SENSOR_ERRORS);
         return -1;
     }
 
-    p = finger.fingerFastSearch();
+    p = timedSensorCall(SENSOR_SEARCH, [] { return finger.fingerFastSearch(); });
+    deviceMetrics.record(METRIC_SEARCH, sensorTimings[SENSOR_SEARCH].lastUs);
+    recordSensorTiming(SENSOR_IDENTIFY, start);
     if (p != FINGERPRINT_OK) return -2;
 
     return finger.fingerID;
 }
 
+bool beginSensor(uint32_t baud) {
+    finger.begin(baud);
+#if SENSOR_ON_HW_UART
+    Serial.swap(); // begin() trả UART0 về GPIO1/3, chuyển sang GPIO13/15
+#endif
+    delay(50);
+    return finger.verifyPassword();
+}
+
+// Thử baud mong muốn trước (cảm biến đã đổi từ lần khởi động trước), không được thì
+// kết nối ở baud mặc định và ghi baud mới vào cảm biến.
+bool connectSensor() {
+    if (beginSensor(sensorTargetBaud)) {
+        sensorBaud = sensorTargetBaud;
+        return true;
+    }
+    if (sensorTargetBaud == sensorDefaultBaud || !beginSensor(sensorDefaultBaud)) return false;
+    sensorBaud = sensorDefaultBaud;
+
+    DebugSerial.printf("Switching sensor baud %lu -> %lu\n", (unsigned long)sensorDefaultBaud,
+                       (unsigned long)sensorTargetBaud);
+    if (finger.setBaudRate(sensorTargetBaudCode) == FINGERPRINT_OK && beginSensor(sensorTargetBaud)) {
+        sensorBaud = sensorTargetBaud;
+        return true;
+    }
+    DebugSerial.println("Sensor baud switch failed, staying at default");
+    return beginSensor(sensorDefaultBaud);
+}
+
+// Thời điểm quét (epoch theo giờ NTP + ms), false nếu không xác định được
+bool scanRecordTime(const ScanRecord &rec, uint32_t &epoch, uint16_t &ms) {
+    if (rec.flags & SCAN_FLAG_EPOCH) {
+        epoch = rec.time;
+        ms = (rec.flags & SCAN_FLAG_MS) ? rec.ms : 0;
+        return true;
+    }
+    // Quét khi chưa đồng bộ nhưng cùng lần khởi động: rec.time là millis() lúc quét
+    return rec.bootId == journal.bootId() && clockService.epochAt(rec.time, epoch, ms);
+}
+
+// Chất lượng đồng hồ lúc gửi: tuổi lần đồng bộ (s), drift đã bù (ppm), sai số ước lượng (ms)
+void addClockQuality(JsonDocument &payload) {
+    if (!clockService.isSynced()) return;
+    JsonObject clk = payload["clk"].to<JsonObject>();
+    clk["age"] = clockService.syncAgeS();
+    clk["drift"] = clockService.driftPpm();
+    clk["err"] = clockService.errorMs();
+}
+
+// Gửi một lượt quét dưới dạng scan_result (kèm seq nếu có trong journal)
+bool sendScanRecord(const ScanRecord &rec) {
+    JsonDocument payload(&jsonArena);
+    payload["id"] = rec.templateId;
+    if (rec.seq > 0) {
+        payload["seq"] = rec.seq;
+        payload["j"] = journal.journalId();
+    }
+
+    uint32_t epoch;
+    uint16_t ms;
+    if (scanRecordTime(rec, epoch, ms)) {
+        char isoTime[32];
+        time_t seconds = epoch;
+        size_t len = strftime(isoTime, sizeof(isoTime), "%Y-%m-%dT%H:%M:%S", gmtime(&seconds));
+        snprintf(isoTime + len, sizeof(isoTime) - len, ".%03uZ", ms);
+        payload["timestamp"] = isoTime;
+    } else {
+        DebugSerial.println("NTP time not valid, sending scan without timestamp.");
+    }
+    addClockQuality(payload);
+    return sendWebSocketMessage("scan_result", payload);
+}
+
+// Gửi các bản ghi fromSeq..toSeq trong một frame scan_batch.
+// "last" cho server biết batch phủ tới đâu (kể cả bản ghi hỏng bị bỏ qua).
+bool sendScanBatch(uint32_t fromSeq, uint32_t toSeq) {
+    JsonDocument payload(&jsonArena);
+    payload["last"] = toSeq;
+    payload["j"] = journal.journalId(); // seq chỉ có nghĩa trong cùng một journal
+    JsonArray scans = payload["scans"].to<JsonArray>();
+    for (uint32_t seq = fromSeq; seq <= toSeq; seq++) {
+        ScanRecord rec;
+        if (!journal.read(seq, rec)) {
+            DebugSerial.printf("[Journal] Record %lu unreadable, skipping\n", (unsigned long)seq);
+            continue;
+        }
+        JsonObject scan = scans.add<JsonObject>();
+        scan["seq"] = rec.seq;
+        scan["id"] = rec.templateId;
+        uint32_t epoch;
+        uint16_t ms;
+        if (scanRecordTime(rec, epoch, ms)) {
+            scan["ts"] = epoch;
+            if (ms) scan["ms"] = ms;
+        }
+    }
+    addClockQuality(payload);
+    return sendWebSocketMessage("scan_batch", payload);
+}
+
+void handleScanAck(uint32_t seq) {
+    if (!isJournalReady) return;
+    uint32_t before = journal.pendingCount();
+    journal.retire(seq);
+    journal.commit(journalCommitMs);
+    lastScanSendTime = millis(); // Có ack: gia hạn thời gian chờ cho phần còn lại
+    DebugSerial.printf("[Journal] Ack %lu, retired %lu, pending %lu\n", (unsigned long)seq,
+                       (unsigned long)(before - journal.pendingCount()), (unsigned long)journal.pendingCount());
+}
+
+// Lượt quét của lần khởi động này trước lần đồng bộ NTP đầu tiên chỉ có millis(), suy ra giờ
+// được khi đồng hồ đã đồng bộ; gửi sớm thì server lấy giờ nhận làm giờ quét. Trả về seq cuối
+// trong fromSeq..toSeq gửi được ngay (fromSeq - 1 nếu không có). Bản ghi của lần khởi động
+// trước không bao giờ suy ra được giờ nên không bị giữ; NTP không tới được (quá clockHoldMaxMs
+// sau khi kết nối) thì cũng thôi giữ, server lấy giờ nhận còn hơn không ghi nhận.
+uint32_t lastTimedSeq(uint32_t fromSeq, uint32_t toSeq) {
+    if (clockHeldSeq >= fromSeq && clockHeldSeq <= toSeq) return clockHeldSeq - 1;
+    for (uint32_t seq = max(fromSeq, clockHeldSeq + 1); seq <= toSeq; seq++) {
+        ScanRecord rec;
+        if (!journal.read(seq, rec)) continue;
+        if (!(rec.flags & SCAN_FLAG_EPOCH) && rec.bootId == journal.bootId()) {
+            clockHeldSeq = seq; // Bản ghi sau nó cũng chưa đồng bộ: lần sau khỏi đọc lại
+            return seq - 1;
+        }
+    }
+    return toSeq;
+}
+
+// Gửi các lượt quét còn trong journal theo thứ tự; mỗi lần gọi gửi tối đa một frame
+void drainJournal() {
+    if (!isJournalReady) return;
+    journal.commit(journalCommitMs); // Ack dồn lại đã đủ lâu thì lưu
+    if (!isWebSocketConnected) return;
+
+    uint32_t ackedSeq = journal.firstPending() - 1;
+    uint32_t lastSeq = journal.nextSeq() - 1;
+    if (scanSentSeq < ackedSeq) scanSentSeq = ackedSeq;
+
+    if (scanSentSeq > ackedSeq && millis() - lastScanSendTime > scanAckTimeoutMs) {
+        DebugSerial.printf("[Journal] No ack for seq %lu..%lu, resending\n",
+                           (unsigned long)(ackedSeq + 1), (unsigned long)scanSentSeq);
+        scanSentSeq = ackedSeq;
+    }
+
+    if (!clockService.isSynced() && millis() - wsConnectedAt < clockHoldMaxMs) {
+        lastSeq = lastTimedSeq(scanSentSeq + 1, lastSeq);
+    }
+    uint32_t unsent = lastSeq - scanSentSeq;
+    if (unsent == 0 || scanSentSeq - ackedSeq >= scanMaxInFlight) return;
+
+    uint32_t fromSeq = scanSentSeq + 1;
+    uint32_t toSeq;
+    if (useScanBatching) {
+        // Chờ gộp thêm lượt quét, trừ khi đã đủ một batch hoặc hết cửa sổ chờ
+        if (unsent < scanBatchMax && millis() - firstUnsentScanTime < scanBatchWindowMs) return;
+        toSeq = fromSeq + min<uint32_t>(unsent, scanBatchMax) - 1;
+        if (!sendScanBatch(fromSeq, toSeq)) return;
+    } else {
+        toSeq = fromSeq;
+        ScanRecord rec;
+        if (journal.read(fromSeq, rec)) {
+            if (!sendScanRecord(rec)) return;
+        } else if (fromSeq == ackedSeq + 1) {
+            DebugSerial.printf("[Journal] Record %lu unreadable, skipping\n", (unsigned long)fromSeq);
+            journal.retire(fromSeq);
+        }
+    }
+    scanSentSeq = toSeq;
+    lastScanSendTime = millis();
+}
+
+// Bảng tên từ server. Đồng bộ cả bảng ("full") được chia trang: trang 0 xoá bảng cũ,
+// "more" = còn trang sau. Delta chỉ áp dụng khi "base" đúng phiên bản đang có.
+// Phiên bản mới chỉ được ghi nhận (và lưu flash) khi đã nhận đủ.
+void handleDirectoryMessage(JsonDocument &doc) {
+    uint32_t version = doc["version"] | 0u;
+    if (doc["full"] | false) {
+        if ((doc["page"] | 0) == 0) userDirectory.clear();
+    } else if ((doc["base"] | 0u) != userDirectory.version()) {
+        DebugSerial.printf("[Directory] Delta base %lu != local %lu, asking for resync\n",
+                           (unsigned long)(doc["base"] | 0u), (unsigned long)userDirectory.version());
+        sendDirectoryAck();
+        return;
+    }
+
+    // set: [[id, "tên", flags], ...], del: [id, ...]
+    for (JsonVariant item : doc["set"].as<JsonArray>()) {
+        JsonArray entry = item.as<JsonArray>();
+        userDirectory.set(entry[0].as<uint16_t>(), entry[1] | "", entry[2].as<uint8_t>());
+    }
+    for (JsonVariant id : doc["del"].as<JsonArray>()) {
+        userDirectory.remove(id.as<uint16_t>());
+    }
+    if (doc["more"] | false) return;
+
+    userDirectory.setVersion(version);
+    userDirectory.save();
+    DebugSerial.printf("[Directory] Version %lu, %u names\n", (unsigned long)version, userDirectory.count());
+    sendDirectoryAck();
+}
+
+void sendDirectoryAck() {
+    JsonDocument payload(&jsonArena);
+    payload["version"] = userDirectory.version();
+    payload["count"] = userDirectory.count();
+    sendWebSocketMessage("directory_ack", payload);
+}
+
+// metrics: { up, iv, heap, frag, pending, c: { scans, ... }, h: { loop: [i, n_i, n_i+1, ...], ... },
+// max: { loop: us, ... } }. h là histogram của iv giây vừa qua, chỉ gửi đoạn bucket từ bucket i
+// (khác 0 đầu tiên) tới bucket khác 0 cuối; giai đoạn không có mẫu nào thì bỏ qua.
+void sendMetrics() {
+    lastMetricsSent = millis();
+    JsonDocument payload(&jsonArena);
+    payload["up"] = millis() / 1000;
+    payload["iv"] = (millis() - metricsSince) / 1000;
+    payload["heap"] = ESP.getFreeHeap();
+    payload["frag"] = ESP.getHeapFragmentation();
+    if (isJournalReady) payload["pending"] = journal.pendingCount();
+    payload["ready"] = readyMs; // Khởi động -> kết nối server lần đầu
+    JsonObject counters = payload["c"].to<JsonObject>();
+    for (uint8_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        counters[DeviceMetrics::counterNames[i]] = deviceMetrics.counter((MetricCounter)i);
+    }
+    JsonObject histograms = payload["h"].to<JsonObject>();
+    JsonObject maxima = payload["max"].to<JsonObject>();
+    for (uint8_t i = 0; i < METRIC_STAGE_COUNT; i++) {
+        const LatencyHistogram &histogram = deviceMetrics.histogram((MetricStage)i);
+        if (histogram.total() == 0) continue;
+        uint8_t first = 0, last = METRIC_BUCKETS - 1;
+        while (histogram.counts[first] == 0) first++;
+        while (histogram.counts[last] == 0) last--;
+        JsonArray buckets = histograms[DeviceMetrics::stageNames[i]].to<JsonArray>();
+        buckets.add(first);
+        for (uint8_t b = first; b <= last; b++) buckets.add(histogram.counts[b]);
+        maxima[DeviceMetrics::stageNames[i]] = histogram.maxUs;
+    }
+    if (sendWebSocketMessage("metrics", payload)) {
+        deviceMetrics.clearHistograms();
+        metricsSince = millis();
+    }
+}
+
 void processFingerprintScan() {
+    if (!shouldPollFinger()) return;
+    lastFingerPoll = millis();
     int fingerId = getFingerprintID();
     if (fingerId == 0) return;
 
+    // Thông báo và tiếng còi chạy nền (updateDisplay/updateBuzzer), cảm biến được quét
+    // lại ngay ở loop() kế tiếp nên người sau không phải chờ màn hình
     if (fingerId > 0) {
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(100);
-        digitalWrite(BUZZER_PIN, LOW);
-
-        StaticJsonDocument<150> payload;
-        payload["id"] = fingerId;
-
-        // Validate and format NTP time
-        timeClient.update(); // Force an NTP update
-        if (timeClient.isTimeSet() && timeClient.getEpochTime() > 946684800) { // Post-2000 epoch
-            time_t epoch = timeClient.getEpochTime();
-            char isoTime[25];
-            strftime(isoTime, sizeof(isoTime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&epoch));
-            payload["timestamp"] = isoTime;
-            Serial.print("Sending timestamp: ");
-            Serial.println(isoTime);
+        waitingForFingerLift = true;
+        // Tên lấy từ bảng cục bộ: hiện ngay, không chờ server. Người đã bị vô hiệu hoá
+        // vẫn được ghi lên server (server quyết định) nhưng còi báo khác.
+        const DirectoryEntry *user = userDirectory.find(fingerId);
+        if (recentMatches.suppress(fingerId, lastFingerSeen, SCAN_SUPPRESS_WINDOW_MS)) {
+            deviceMetrics.count(METRIC_SUPPRESSED);
+            DebugSerial.printf("[Scan] ID %d again within %lu ms, not sent\n", fingerId, SCAN_SUPPRESS_WINDOW_MS);
+            startBeep(100, 1);
+            showTransient(user ? user->name : withId("ID: ", fingerId), "Already recorded", 1500);
+            return;
+        }
+        deviceMetrics.count(METRIC_SCANS);
+        bool inactive = user && !(user->flags & DIRECTORY_FLAG_ACTIVE);
+        if (inactive) {
+            startBeep(50, 2);
         } else {
-            Serial.println("NTP time not valid, sending scan without timestamp.");
+            startBeep(100, 1);
+        }
+
+        // Giờ lúc chụp ảnh vân tay (lastFingerSeen, trước image2Tz/search) lấy từ đồng hồ
+        // cục bộ, không chờ mạng; chưa đồng bộ lần nào thì lưu millis() để suy ra sau
+        uint32_t scanTime = lastFingerSeen;
+        uint16_t scanMs = 0;
+        uint8_t flags = 0;
+        if (clockService.epochAt(lastFingerSeen, scanTime, scanMs)) {
+            flags |= SCAN_FLAG_EPOCH | SCAN_FLAG_MS;
         }
 
-        sendWebSocketMessage("scan_result", payload);
-        displayStatus("ID: " + String(fingerId), "Sent to server");
-        delay(2000);
-        displayStatus("Moi dat van tay");
+        bool queued = isJournalReady && journal.append(fingerId, scanTime, flags, scanMs);
+        bool sent = false;
+        if (queued) {
+            uint32_t sentSeq = max<uint32_t>(scanSentSeq, journal.firstPending() - 1);
+            if (journal.nextSeq() - 1 - sentSeq == 1) firstUnsentScanTime = millis();
+            drainJournal();
+        } else {
+            // Không ghi được flash: gửi trực tiếp như trước
+            ScanRecord rec = {};
+            rec.templateId = fingerId;
+            rec.time = scanTime;
+            rec.ms = scanMs;
+            rec.flags = flags;
+            rec.bootId = journal.bootId();
+            sent = sendScanRecord(rec);
+        }
+        // Chỉ chống trùng khi lượt này đã được giữ lại hoặc đã đi: gửi hỏng thì quét lại được ngay
+        if (queued || sent) recentMatches.record(fingerId, lastFingerSeen);
+        const char *sendStatus;
+        if (queued) {
+            sendStatus = isWebSocketConnected ? "Sent to server" : "Saved offline";
+        } else {
+            sendStatus = sent ? "Sent to server" : "Send failed";
+        }
+        showTransient(user ? user->name : withId("ID: ", fingerId), inactive ? "User inactive" : sendStatus, 2000);
     } else if (fingerId == -2) {
-        displayStatus("Unknown Finger");
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(50);
-        digitalWrite(BUZZER_PIN, LOW);
-        delay(50);
-        digitalWrite(BUZZER_PIN, HIGH);
-        delay(50);
-        digitalWrite(BUZZER_PIN, LOW);
-        delay(1500);
-        displayStatus("Moi dat van tay");
+        waitingForFingerLift = true;
+        deviceMetrics.count(METRIC_UNKNOWN);
+        showTransient("Unknown Finger", "", 1500);
+        startBeep(50, 2);
     } else if (fingerId == -1) {
-        displayStatus("Sensor Error", "Please try again");
-        delay(1500);
-        displayStatus("Moi dat van tay");
+        showTransient("Sensor Error", "Please try again", 1500);
     }
 }
 
 void setup() {
-    Serial.begin(115200);
-    mySerial.begin(57600);
+    DebugSerial.begin(115200);
 
     pinMode(BUZZER_PIN, OUTPUT);
     digitalWrite(BUZZER_PIN, LOW);
 
-    if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {
-        Serial.println(F("SSD1306 failed"));
+    if (!display.begin(SSD1306_SWITCHCAPVCC, OLED_ADDRESS)) {
+        DebugSerial.println(F("SSD1306 failed"));
         for (;;);
     }
-    display.clearDisplay();
     display.setTextColor(WHITE);
     display.setTextSize(1);
-    display.setCursor(0, 0);
-    display.println("Initializing...");
-    display.display();
+    display.setTextWrap(false);
+    displayStatus("Initializing..."); // Lần đầu gửi cả framebuffer
 
-    finger.begin(57600);
-    delay(50);
-    if (finger.verifyPassword()) {
-        Serial.println("Found fingerprint sensor!");
+    bool isFsMounted = LittleFS.begin();
+    if (isFsMounted) {
+        isJournalReady = journal.begin(LittleFS);
+        userDirectory.begin(LittleFS);
+    } else {
+        DebugSerial.println("LittleFS mount failed, offline journal disabled");
+    }
+
+    // Không chờ WiFi: SDK kết nối nền trong lúc dò cảm biến bên dưới, quét được ngay khi vào
+    // loop(), lượt quét nằm trong journal cho tới khi có mạng
+    wifiManager.setStaticIp(staticIp, staticGateway, staticSubnet, staticDns);
+    wifiManager.begin(isFsMounted ? &LittleFS : nullptr);
+
+    if (connectSensor()) {
+        DebugSerial.printf("Found fingerprint sensor at %lu baud (%s)\n", (unsigned long)sensorBaud,
+                           SENSOR_ON_HW_UART ? "UART0 swapped" : "SoftwareSerial");
     } else {
-        Serial.println("Sensor not found!");
+        DebugSerial.println("Sensor not found!");
         displayStatus("Sensor Error!");
         while (1) {
             delay(1);
         }
     }
+    if (useTouchPin) {
+        pinMode(FINGER_TOUCH_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(FINGER_TOUCH_PIN), onFingerTouch, RISING);
+    }
     finger.getTemplateCount();
-    Serial.print("Sensor templates: ");
-    Serial.println(finger.templateCount);
+    DebugSerial.print("Sensor templates: ");
+    DebugSerial.println(finger.templateCount);
 
-    connectWiFi();
-    timeClient.begin();
-    connectWebSocket();
+    clockService.begin();
     displayStatus("Moi dat van tay");
 }
 
 void loop() {
+    uint32_t loopStart = micros();
+    handleWifiEvent(wifiManager.loop()); // Trước webSocket.loop(): có WiFi là kết nối server ngay vòng này
     webSocket.loop();
+    updateBuzzer();
+    updateDisplay();
+    processEnrollment();
+    processCommandQueue();
 
-    // Gửi heartbeat định kỳ (chỉ khi không trong quá trình đăng ký)
-    if (isWebSocketConnected && !isEnrolling && millis() - lastHeartbeatSent > heartbeatInterval) {
-        sendHeartbeat();
-        lastHeartbeatSent = millis();
-        Serial.println("Sent heartbeat to server");
-    }
-
-    // Cập nhật thời gian NTP
-    static unsigned long lastNTPUpdate = 0;
-    if (millis() - lastNTPUpdate > 300000 && WiFi.status() == WL_CONNECTED) {
-        timeClient.update();
-        lastNTPUpdate = millis();
-        Serial.println("NTP Time Updated: " + timeClient.getFormattedTime());
-    }
+    // Đồng bộ NTP nền: gửi yêu cầu khi tới hạn, đọc phản hồi ở các vòng sau
+    // (DNS chặn loop(): không phân giải lúc ngón tay đang đặt / vừa nhấc khỏi cảm biến)
+    bool fingerActive = lastFingerSeen && (waitingForFingerLift || millis() - lastFingerSeen < 2000);
+    clockService.loop(wifiManager.isConnected(), !isEnrolling && !fingerActive);
 
     // Kiểm tra heap memory
     static unsigned long lastHeapCheck = 0;
     if (millis() - lastHeapCheck > 60000) {
-        Serial.print("Free Heap: ");
-        Serial.println(ESP.getFreeHeap());
+        // Phân mảnh heap: free lớn nhưng MaxFreeBlock nhỏ dần là dấu hiệu phân mảnh
+        DebugSerial.printf("Free Heap: %u, MaxFreeBlock: %u, Fragmentation: %u%%\n",
+                           ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation());
+        DebugSerial.printf("Finger: mode=%s polls=%lu touchWakeups=%lu\n", isTouchPinTrusted ? "touch" : "poll",
+                           (unsigned long)fingerPolls, (unsigned long)touchWakeups);
+        DebugSerial.printf("Sensor us @%lu:", (unsigned long)sensorBaud);
+        printSensorTimings(DebugSerial);
+        DebugSerial.printf("Display: updates=%lu skipped=%lu\n", (unsigned long)displayUpdates,
+                           (unsigned long)displaySkipped);
+        const ClockStats &cs = clockService.stats();
+        DebugSerial.printf("Clock: synced=%d age=%lus drift=%ldppm err=%lums syncs=%lu fails=%lu rejected=%lu rtt=%lums step=%ldms\n",
+                           clockService.isSynced(), (unsigned long)clockService.syncAgeS(),
+                           (long)clockService.driftPpm(), (unsigned long)clockService.errorMs(),
+                           (unsigned long)cs.syncs, (unsigned long)cs.failures, (unsigned long)cs.rejected,
+                           (unsigned long)cs.lastRttMs,
+                           (long)cs.lastStepMs);
+        DebugSerial.printf("Directory: version=%lu names=%u ram=%u flash=%u\n", (unsigned long)userDirectory.version(),
+                           userDirectory.count(), (unsigned)UserDirectory::ramBytes(), (unsigned)UserDirectory::flashBytes());
+        DebugSerial.printf("JSON arena: peak=%u/%u heapFallbacks=%lu\n",
+                           (unsigned)jsonArena.highWater(), (unsigned)JsonArena::CAPACITY,
+                           (unsigned long)jsonArena.heapFallbacks());
+        if (isJournalReady) {
+            const ScanJournalStats &js = journal.stats();
+            DebugSerial.printf("Journal: pending=%lu appended=%lu dropped=%lu crcErr=%lu programs=%lu meta=%lu segments=%lu write(us) last=%lu avg=%lu max=%lu\n",
+                               (unsigned long)journal.pendingCount(), (unsigned long)js.appended,
+                               (unsigned long)js.dropped, (unsigned long)js.crcErrors,
+                               (unsigned long)js.programs, (unsigned long)js.metaWrites,
+                               (unsigned long)js.segmentsCreated,
+                               (unsigned long)js.lastWriteUs,
+                               (unsigned long)(js.appended ? js.totalWriteUs / js.appended : 0),
+                               (unsigned long)js.maxWriteUs);
+        }
         lastHeapCheck = millis();
     }
 
-    // Thử kết nối lại nếu mất kết nối (nhưng chỉ khi không đang đăng ký)
-    if (!isWebSocketConnected && !isEnrolling && millis() - lastReconnectAttempt > reconnectInterval) {
+    if (isWebSocketConnected && millis() - lastMetricsSent >= metricsIntervalMs) {
+        sendMetrics();
+    }
+
+    // Thử kết nối lại nếu mất kết nối (không có WiFi thì chờ WIFI_EVENT_CONNECTED)
+    if (!isWebSocketConnected && wifiManager.isConnected() && millis() - lastReconnectAttempt > reconnectInterval) {
         connectWebSocket();
     }
 
@@ -584,17 +1461,22 @@ void loop() {
     if (!isWebSocketConnected && !isEnrolling) {
         static unsigned long lastWarningTime = 0;
         if (millis() - lastWarningTime > 10000) {
-            displayStatus("WS Disconnected", "Trying to connect");
+            if (wifiManager.isConnected()) displayStatus("WS Disconnected", "Trying to connect");
+            else displayStatus("WiFi Disconnected", "Reconnecting...");
             lastWarningTime = millis();
         }
     }
 
-    // Xử lý quét vân tay (chỉ khi đã kết nối và không đang đăng ký)
-    if (isWebSocketConnected && !isEnrolling) {
+    // Gửi các lượt quét còn trong journal (gộp batch, chờ ack) khi đã có kết nối
+    drainJournal();
+
+    // Xử lý quét vân tay (vẫn quét khi mất kết nối, lưu vào journal)
+    if (!isEnrolling) {
         processFingerprintScan();
     }
 
-    delay(50);
+    deviceMetrics.record(METRIC_LOOP, micros() - loopStart);
+    waitForNextLoop(50);
 }
 
 
@@ -0,0 +1,155 @@
+// bench/exportBench.js
+// Xuất N dòng log qua HTTP thật, đo thời gian tới byte đầu tiên, tổng thời gian,
+// RSS cao nhất và độ trễ event loop lớn nhất. So sánh cách cũ (find() cả mảng rồi
+// Workbook.writeBuffer) với downloadExcel dạng stream (xlsx và csv).
+// DB được thay bằng stub sinh dữ liệu theo lô như cursor MongoDB nên không cần MongoDB.
+//
+//   node --expose-gc bench/exportBench.js [rows] [xlsx|csv|buffered ...]
+const http = require("http");
+const mongoose = require("mongoose");
+const ExcelJS = require("exceljs");
+const { monitorEventLoopDelay } = require("perf_hooks");
+const AttendanceLog = require("../models/attendanceLogModel");
+const User = require("../models/userModel");
+const logController = require("../controllers/logController");
+
+const ROWS = parseInt(process.argv[2]) || 100000;
+const MODES = process.argv.slice(3).length ? process.argv.slice(3) : ["buffered", "xlsx", "csv"];
+const USERS = 300;
+const BATCH = 1000;
+
+const users = Array.from({ length: USERS }, (_, i) => ({
+  _id: new mongoose.Types.ObjectId(),
+  name: `Nguyễn Văn ${i}`,
+  msv: `B20DCCN${String(i).padStart(3, "0")}`,
+  userId: `user-${i}`,
+}));
+const base = Date.now();
+const logAt = (i) => ({
+  _id: new mongoose.Types.ObjectId(),
+  user: users[i % USERS]._id,
+  timestamp: new Date(base - i * 30000),
+  eventType: i % 2 ? "CHECK_IN" : "CHECK_OUT",
+});
+
+function stubDatabase() {
+  User.find = () => ({ lean: async () => users });
+  AttendanceLog.countDocuments = async () => ROWS;
+  AttendanceLog.find = () => {
+    const query = {
+      sort: () => query,
+      lean: () => query,
+      populate: () => query,
+      // Cách cũ: cả kết quả là một mảng (đã populate)
+      then(resolve, reject) {
+        return Promise.resolve(
+          Array.from({ length: ROWS }, (_, i) => ({ ...logAt(i), user: users[i % USERS] }))
+        ).then(resolve, reject);
+      },
+      // Cursor: mỗi lô BATCH dòng tới sau một vòng I/O, như getMore
+      cursor() {
+        let next = 0;
+        return {
+          async *[Symbol.asyncIterator]() {
+            while (next < ROWS) {
+              await new Promise((resolve) => setImmediate(resolve));
+              const end = Math.min(ROWS, next + BATCH);
+              for (; next < end; next++) yield logAt(next);
+            }
+          },
+          close: async () => {
+            next = ROWS;
+          },
+        };
+      },
+    };
+    return query;
+  };
+}
+
+// Bản chép của downloadExcel trước khi chuyển sang stream, để so sánh
+async function bufferedExport(req, res) {
+  const logs = await AttendanceLog.find({}).populate("user", "name msv userId").sort({ timestamp: -1 }).lean();
+  const totalLogs = await AttendanceLog.countDocuments({});
+  const workbook = new ExcelJS.Workbook();
+  const worksheet = workbook.addWorksheet("Attendance Logs");
+  worksheet.columns = [
+    { header: "STT", key: "stt", width: 10 },
+    { header: "Tên", key: "name", width: 20 },
+    { header: "Thời gian", key: "time", width: 15 },
+    { header: "Ngày", key: "date", width: 15 },
+    { header: "Trạng thái", key: "eventType", width: 15 },
+  ];
+  logs.forEach((log, index) => {
+    worksheet.addRow({
+      stt: totalLogs - index,
+      name: log.user?.name || "Unknown",
+      time: new Date(log.timestamp).toLocaleTimeString("vi-VN"),
+      date: new Date(log.timestamp).toLocaleDateString("vi-VN"),
+      eventType: log.eventType === "CHECK_IN" ? "Vào" : "Ra",
+    });
+  });
+  worksheet.getRow(1).font = { bold: true };
+  res.setHeader("Content-Type", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet");
+  res.send(await workbook.xlsx.writeBuffer());
+}
+
+async function runMode(mode) {
+  const server = http.createServer((req, res) => {
+    res.send = (body) => res.end(body);
+    req.query = { format: mode === "csv" ? "csv" : undefined };
+    (mode === "buffered" ? bufferedExport : logController.downloadExcel)(req, res);
+  });
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+
+  if (global.gc) global.gc();
+  const rssBefore = process.memoryUsage().rss;
+  let rssPeak = rssBefore;
+  const sampler = setInterval(() => {
+    rssPeak = Math.max(rssPeak, process.memoryUsage().rss);
+  }, 5);
+  const loopDelay = monitorEventLoopDelay({ resolution: 5 });
+  loopDelay.enable();
+
+  const start = performance.now();
+  const result = await new Promise((resolve, reject) => {
+    http.get(`http://127.0.0.1:${server.address().port}/`, (res) => {
+      let firstByteMs = null;
+      let bytes = 0;
+      res.on("data", (chunk) => {
+        if (firstByteMs === null) firstByteMs = performance.now() - start;
+        bytes += chunk.length;
+      });
+      res.on("end", () => resolve({ firstByteMs, bytes }));
+      res.on("error", reject);
+    });
+  });
+  const totalMs = performance.now() - start;
+  clearInterval(sampler);
+  loopDelay.disable();
+  server.close();
+
+  return {
+    mode,
+    rows: ROWS,
+    firstByteMs: Math.round(result.firstByteMs),
+    totalMs: Math.round(totalMs),
+    rowsPerSec: Math.round((ROWS / totalMs) * 1000),
+    kb: Math.round(result.bytes / 1024),
+    rssGrowthMb: Math.round((rssPeak - rssBefore) / 1048576),
+    maxLoopBlockMs: Math.round(loopDelay.max / 1e6),
+  };
+}
+
+async function main() {
+  stubDatabase();
+  console.log(`rows=${ROWS}${global.gc ? "" : " (chạy với --expose-gc để số RSS ổn định hơn)"}`);
+  for (const mode of MODES) {
+    console.log(JSON.stringify(await runMode(mode)));
+  }
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,465 @@
+// bench/fleetLoad.js
+// Tải giả lập cả đội thiết bị chấm công, nói đúng giao thức của ChamCongNhung/src/main.cpp:
+//
+//   - kết nối "/?deviceId=...&proto=msgpack&dir=<phiên bản bảng tên>", chuyển sang
+//     MessagePack khi server gửi frame binary đầu tiên
+//   - lượt quét vào journal có seq, gửi scan_batch (tối đa 10 lượt, chờ gộp 200 ms,
+//     tối đa 20 lượt chưa ack, không có ack sau 5 s thì gửi lại), xoá khi có scan_ack
+//   - kết nối lại sau 5 s khi mất kết nối và gửi lại phần chưa ack
+//   - trả pong (thư viện ws tự làm) và heartbeat JSON của server cũ, directory_ack,
+//     enroll_status (processing -> success) và delete_status
+//
+// Mỗi thiết bị là một cổng có hàng người: người tới theo tiến trình Poisson với tốc độ
+// của profile, cổng phục vụ một người mỗi SERVICE_MS. Độ trễ đo ở phía thiết bị:
+//   capture->ack: lúc quét -> scan_ack (server chỉ ack sau khi bản ghi đã vào DB)
+//   send->ack   : lần gửi cuối của lượt quét -> scan_ack
+//
+// Mặc định chạy server thật trong process này (WebSocketService + controller) với DB giả
+// trong bộ nhớ (bench/memoryDb.js); MONGO_URI (tên DB phải chứa "bench") để ghi vào
+// MongoDB thật; --url=ws://host:port để bắn vào server đang chạy sẵn (chỉ số phía thiết bị).
+// Các thiết bị chạy trong process con để không tranh event loop với server.
+//
+//   node bench/fleetLoad.js --devices=2000 --profile=shift --duration=180
+//
+// Profile (lượt quét / thiết bị / phút):
+//   steady: --rate suốt thời gian chạy
+//   shift : --rate, riêng --burst giây từ 20% thời gian chạy là --burst-rate (giờ vào ca)
+//   storm : như steady nhưng mọi thiết bị mất mạng --offline giây đầu rồi cùng kết nối lại
+//           (server khởi động lại / mất mạng cả toà nhà), xả journal cùng lúc
+const http = require("http");
+const crypto = require("crypto");
+const { fork } = require("child_process");
+const mongoose = require("mongoose");
+const WebSocket = require("ws");
+const msgpack = require("../services/msgpack");
+
+const defaults = {
+  devices: 1000,
+  profile: "shift",
+  duration: 120, // Giây tạo lượt quét
+  drain: 30, // Giây tối đa chờ ack phần còn lại
+  rate: 0.5,
+  "burst-rate": 20,
+  burst: 60,
+  offline: 30,
+  users: 500,
+  proto: "msgpack",
+  "admin-ops": 20, // Lệnh enroll/delete server gửi xuống thiết bị trong lúc chạy
+  "db-rtt": 1,
+  url: "",
+};
+
+const opts = { ...defaults };
+for (const arg of process.argv.slice(2)) {
+  const match = /^--([^=]+)=(.*)$/.exec(arg);
+  if (!match || !(match[1] in defaults)) continue;
+  opts[match[1]] = typeof defaults[match[1]] === "number" ? Number(match[2]) : match[2];
+}
+
+// Như firmware
+const SCAN_BATCH_MAX = 10;
+const SCAN_BATCH_WINDOW_MS = 200;
+const SCAN_MAX_IN_FLIGHT = 20;
+const SCAN_ACK_TIMEOUT_MS = 5000;
+const RECONNECT_MS = 5000;
+const SERVICE_MS = 2500; // Một người: đặt tay -> còi -> nhấc tay -> người sau
+const TZ_OFFSET_S = 25200; // Giờ thiết bị là GMT+7
+
+const TICK_MS = 20;
+const CONNECT_BATCH = 200;
+
+const rateAt = (t) => {
+  if (opts.profile === "shift") {
+    const burstStart = opts.duration * 0.2;
+    if (t >= burstStart && t < burstStart + opts.burst) return opts["burst-rate"];
+  }
+  return opts.rate;
+};
+
+// Số lượt tới trong một tick (Poisson, Knuth; xấp xỉ chuẩn khi kỳ vọng lớn)
+const poisson = (mean) => {
+  if (mean > 30) return Math.max(0, Math.round(mean + Math.sqrt(mean) * gaussian()));
+  const limit = Math.exp(-mean);
+  let k = 0;
+  for (let p = Math.random(); p > limit; p *= Math.random()) k++;
+  return k;
+};
+const gaussian = () => Math.sqrt(-2 * Math.log(1 - Math.random())) * Math.cos(2 * Math.PI * Math.random());
+
+const summarize = (values) => {
+  if (!values.length) return { samples: 0 };
+  const sorted = Float64Array.from(values).sort();
+  const at = (p) => +sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))].toFixed(1);
+  return { samples: sorted.length, p50: at(0.5), p99: at(0.99), p999: at(0.999), max: at(1) };
+};
+
+// --- Thiết bị ---
+class Device {
+  constructor(index, fleet) {
+    this.id = `FLEET_${String(index).padStart(5, "0")}`;
+    this.fleet = fleet;
+    this.ws = null;
+    this.connected = false;
+    this.msgpackActive = false;
+    this.dirVersion = 0;
+    this.dirCount = 0;
+
+    this.journal = []; // [{ seq, id, ts, ms, capturedAt, sentAt }] chưa ack, theo seq
+    this.journalId = crypto.randomInt(0, 2 ** 31) * 2 + 1; // Như ESP.random() | 1: luôn lẻ, khác 0
+    this.nextSeq = 1;
+    this.sentSeq = 0;
+    this.ackedSeq = 0;
+    this.lastSendAt = 0;
+    this.firstUnsentAt = 0;
+
+    this.waiting = 0; // Người đang xếp hàng ở cổng
+    this.freeAt = 0;
+  }
+
+  connect() {
+    const { stats } = this.fleet;
+    const query = `deviceId=${this.id}${opts.proto === "msgpack" ? "&proto=msgpack" : ""}&dir=${this.dirVersion}`;
+    const ws = new WebSocket(`${this.fleet.url}/?${query}`);
+    this.ws = ws;
+    ws.on("open", () => {
+      stats.connects++;
+      this.connected = true;
+      this.msgpackActive = false; // JSON cho tới khi server xác nhận MessagePack
+      this.fleet.active.add(this);
+    });
+    ws.on("message", (data, isBinary) => {
+      if (isBinary && opts.proto === "msgpack") this.msgpackActive = true;
+      let message;
+      try {
+        message = isBinary ? msgpack.decode(data) : JSON.parse(data.toString());
+      } catch (error) {
+        stats.badFrames++;
+        return;
+      }
+      this.handle(message);
+    });
+    ws.on("error", () => stats.socketErrors++);
+    ws.on("close", () => {
+      if (this.ws !== ws) return;
+      if (this.connected) stats.disconnects++;
+      this.connected = false;
+      this.sentSeq = this.ackedSeq; // Gửi lại phần chưa ack sau khi kết nối lại
+      if (!this.fleet.stopping) setTimeout(() => this.connect(), RECONNECT_MS);
+    });
+  }
+
+  send(type, payload) {
+    if (!this.connected || this.ws.readyState !== WebSocket.OPEN) return false;
+    const frame = { type, payload };
+    if (this.msgpackActive) this.ws.send(Buffer.from(msgpack.encode(frame)), { binary: true });
+    else this.ws.send(JSON.stringify(frame));
+    this.fleet.stats.framesOut++;
+    return true;
+  }
+
+  handle(message) {
+    const { stats } = this.fleet;
+    switch (message.type) {
+      case "scan_ack":
+        this.ack(message.seq);
+        break;
+      case "heartbeat":
+        this.send("heartbeat", { status: "alive" });
+        break;
+      case "directory":
+        if (message.full && !message.page) this.dirCount = 0;
+        this.dirCount += (message.set || []).length - (message.del || []).length;
+        if (message.more) break;
+        this.dirVersion = message.version;
+        stats.directorySyncs++;
+        this.send("directory_ack", { version: this.dirVersion, count: this.dirCount });
+        break;
+      case "enroll": {
+        // Ba bước chạm tay rồi lưu mẫu, như state machine đăng ký trên thiết bị
+        stats.enrolls++;
+        const { id, rid } = message;
+        [1, 2, 3].forEach((step) =>
+          setTimeout(() => this.send("enroll_status", { id, rid, status: "processing", step, message: `Step ${step}` }), step * 400)
+        );
+        setTimeout(() => this.send("enroll_status", { id, rid, status: "success", step: 4, message: "Stored" }), 1800);
+        break;
+      }
+      case "delete":
+        stats.deletes++;
+        setTimeout(() => this.send("delete_status", { id: message.id, rid: message.rid, status: "success", message: "Deletion successful" }), 100);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Cổng phục vụ người đầu hàng: một lượt quét mới vào journal
+  serve(now) {
+    if (!this.waiting || now < this.freeAt) return;
+    this.waiting--;
+    this.freeAt = now + SERVICE_MS;
+    const wall = Date.now();
+    if (this.sentSeq === this.nextSeq - 1) this.firstUnsentAt = now;
+    this.journal.push({
+      seq: this.nextSeq++,
+      id: 1 + Math.floor(Math.random() * opts.users),
+      ts: Math.floor(wall / 1000) + TZ_OFFSET_S,
+      ms: wall % 1000,
+      capturedAt: now,
+      sentAt: 0,
+    });
+    this.fleet.stats.captured++;
+  }
+
+  // Như drainJournal(): mỗi lần gọi gửi tối đa một frame
+  drain(now) {
+    if (!this.connected) return;
+    if (this.sentSeq > this.ackedSeq && now - this.lastSendAt > SCAN_ACK_TIMEOUT_MS) {
+      this.fleet.stats.ackTimeouts++;
+      this.sentSeq = this.ackedSeq;
+    }
+    const lastSeq = this.nextSeq - 1;
+    const unsent = lastSeq - this.sentSeq;
+    if (unsent === 0 || this.sentSeq - this.ackedSeq >= SCAN_MAX_IN_FLIGHT) return;
+    if (unsent < SCAN_BATCH_MAX && now - this.firstUnsentAt < SCAN_BATCH_WINDOW_MS) return;
+
+    const from = this.sentSeq + 1;
+    const to = from + Math.min(unsent, SCAN_BATCH_MAX) - 1;
+    const records = this.journal.slice(from - this.ackedSeq - 1, to - this.ackedSeq);
+    const scans = records.map(({ seq, id, ts, ms }) => (ms ? { seq, id, ts, ms } : { seq, id, ts }));
+    const clk = { age: 120, drift: 0, err: 25 };
+    if (!this.send("scan_batch", { last: to, j: this.journalId, scans, clk })) return;
+    records.forEach((record) => {
+      if (record.sentAt) this.fleet.stats.resentScans++;
+      record.sentAt = now;
+    });
+    this.sentSeq = to;
+    this.lastSendAt = now;
+  }
+
+  ack(seq) {
+    const now = performance.now();
+    const { stats, latency } = this.fleet;
+    while (this.journal.length && this.journal[0].seq <= seq) {
+      const record = this.journal.shift();
+      latency.captureToAck.push(now - record.capturedAt);
+      if (record.sentAt) latency.sendToAck.push(now - record.sentAt);
+      stats.acked++;
+      this.fleet.ackedThisSecond++;
+    }
+    this.ackedSeq = Math.max(this.ackedSeq, seq);
+    this.lastSendAt = now; // Có ack: gia hạn thời gian chờ cho phần còn lại
+  }
+
+  idle() {
+    return this.waiting === 0 && this.journal.length === 0;
+  }
+}
+
+// onStart: gọi khi mọi thiết bị (trừ storm) đã kết nối và bắt đầu tạo lượt quét
+async function runFleet(url, onStart = () => {}) {
+  const fleet = {
+    url,
+    stopping: false,
+    active: new Set(), // Thiết bị còn người chờ hoặc lượt quét chưa ack
+    ackedThisSecond: 0,
+    stats: {
+      captured: 0, acked: 0, framesOut: 0, resentScans: 0, ackTimeouts: 0, connects: 0, disconnects: 0,
+      socketErrors: 0, badFrames: 0, directorySyncs: 0, enrolls: 0, deletes: 0,
+    },
+    latency: { captureToAck: [], sendToAck: [] },
+  };
+  const devices = Array.from({ length: opts.devices }, (_, i) => new Device(i, fleet));
+
+  // storm: thiết bị quét offline rồi cùng kết nối; còn lại kết nối dần trước khi đo
+  if (opts.profile !== "storm") {
+    for (let i = 0; i < devices.length; i += CONNECT_BATCH) {
+      const batch = devices.slice(i, i + CONNECT_BATCH);
+      batch.forEach((device) => device.connect());
+      while (!batch.every((device) => device.connected)) await new Promise((resolve) => setTimeout(resolve, 20));
+    }
+  }
+  const connectedAt = fleet.stats.connects;
+  onStart();
+
+  const start = performance.now();
+  const perSecond = [];
+  let lastSecond = start;
+  let stormConnected = false;
+  await new Promise((resolve) => {
+    const timer = setInterval(() => {
+      const now = performance.now();
+      const t = (now - start) / 1000;
+      if (opts.profile === "storm" && !stormConnected && t >= opts.offline) {
+        stormConnected = true;
+        devices.forEach((device) => device.connect());
+      }
+      if (t < opts.duration) {
+        const arrivals = poisson((opts.devices * rateAt(t) * TICK_MS) / 60000);
+        for (let i = 0; i < arrivals; i++) {
+          const device = devices[Math.floor(Math.random() * devices.length)];
+          device.waiting++;
+          fleet.active.add(device);
+        }
+      }
+      fleet.active.forEach((device) => {
+        device.serve(now);
+        device.drain(now);
+        if (device.idle()) fleet.active.delete(device);
+      });
+      if (now - lastSecond >= 1000) {
+        perSecond.push(fleet.ackedThisSecond);
+        fleet.ackedThisSecond = 0;
+        lastSecond = now;
+      }
+      const drained = devices.every((device) => device.idle());
+      if ((t >= opts.duration && drained) || t >= opts.duration + opts.drain) {
+        clearInterval(timer);
+        resolve();
+      }
+    }, TICK_MS);
+  });
+  const elapsedS = (performance.now() - start) / 1000;
+
+  fleet.stopping = true;
+  devices.forEach((device) => device.ws && device.ws.terminate());
+  const { stats } = fleet;
+  return {
+    devices: opts.devices,
+    profile: opts.profile,
+    elapsedS: +elapsedS.toFixed(1),
+    ...stats,
+    connects: stats.connects - (opts.profile === "storm" ? 0 : connectedAt),
+    unacked: stats.captured - stats.acked,
+    ackedPerSec: { mean: +(stats.acked / elapsedS).toFixed(1), peak: Math.max(0, ...perSecond) },
+    captureToAckMs: summarize(fleet.latency.captureToAck),
+    sendToAckMs: summarize(fleet.latency.sendToAck),
+  };
+}
+
+// --- Server (trong process này) ---
+async function setUpDatabase() {
+  if (!process.env.MONGO_URI) return require("./memoryDb").install({ users: opts.users, rttMs: opts["db-rtt"] });
+
+  const User = require("../models/userModel");
+  const AttendanceLog = require("../models/attendanceLogModel");
+  const DailyAttendance = require("../models/dailyAttendanceModel");
+  await mongoose.connect(process.env.MONGO_URI);
+  if (!/bench/i.test(mongoose.connection.name)) {
+    throw new Error(`Refusing to write into database "${mongoose.connection.name}" (name must contain "bench")`);
+  }
+  await Promise.all([User.deleteMany({}), AttendanceLog.deleteMany({}), DailyAttendance.deleteMany({})]);
+  await Promise.all([User.init(), AttendanceLog.init(), DailyAttendance.init()]);
+  await User.insertMany(Array.from({ length: opts.users }, (_, i) => ({ id: i + 1, name: `Nguoi Dung ${i + 1}` })));
+  return {
+    async collect() {
+      const [logs, duplicates] = await Promise.all([
+        AttendanceLog.countDocuments({}),
+        AttendanceLog.aggregate([
+          { $group: { _id: { d: "$deviceId", s: "$deviceSeq" }, n: { $sum: 1 } } },
+          { $match: { n: { $gt: 1 } } },
+          { $group: { _id: null, extra: { $sum: { $subtract: ["$n", 1] } } } },
+        ]),
+      ]);
+      await mongoose.connection.dropDatabase();
+      await mongoose.disconnect();
+      return { logs, duplicateLogs: duplicates[0]?.extra || 0 };
+    },
+  };
+}
+
+// Lệnh quản trị (enroll/delete) rải đều trong lúc chạy, tới thiết bị ngẫu nhiên đang kết nối
+function scheduleAdminOps(websocketService) {
+  const results = { ok: 0, failed: 0, ms: [] };
+  // Lệnh cuối vẫn kịp xong (đăng ký mất khoảng 2 s) trước khi thiết bị ngắt kết nối
+  const gap = Math.max(0, opts.duration * 1000 - 3000) / Math.max(1, opts["admin-ops"]);
+  const pending = [];
+  for (let i = 0; i < opts["admin-ops"]; i++) {
+    pending.push(
+      new Promise((resolve) => setTimeout(resolve, gap * (i + 0.5))).then(async () => {
+        const deviceIds = [...websocketService.clients.keys()];
+        if (!deviceIds.length) return;
+        const deviceId = deviceIds[Math.floor(Math.random() * deviceIds.length)];
+        const templateId = 10000 + i;
+        const start = performance.now();
+        try {
+          if (i % 2) await websocketService.requestDeletionOnDevice(deviceId, templateId);
+          else await websocketService.requestEnrollmentOnDevice(deviceId, templateId);
+          results.ok++;
+          results.ms.push(performance.now() - start);
+        } catch (error) {
+          results.failed++;
+        }
+      })
+    );
+  }
+  return () => Promise.all(pending).then(() => ({ ok: results.ok, failed: results.failed, ms: summarize(results.ms) }));
+}
+
+async function runServer() {
+  const log = console.log;
+  console.log = () => {}; // Log mỗi lượt quét/kết nối làm nhiễu phép đo
+  console.warn = () => {};
+
+  const db = await setUpDatabase();
+  const websocketService = require("../services/websocketService");
+  const logWriter = require("../services/logWriter");
+  const scanCache = require("../services/scanCache");
+  const dailySummary = require("../services/dailySummary");
+
+  const server = http.createServer();
+  websocketService.initializeWebSocketServer(server);
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+  log(
+    `fleet: ${opts.devices} devices, profile ${opts.profile}, ${opts.duration} s, ${opts.users} users, ` +
+      `${opts.proto}, DB ${process.env.MONGO_URI ? "MongoDB" : `in-memory (rtt ${opts["db-rtt"]} ms)`}`
+  );
+
+  const child = fork(__filename, [...process.argv.slice(2), `--url=ws://127.0.0.1:${server.address().port}`], {
+    env: { ...process.env, FLEET_ROLE: "devices" },
+  });
+  let adminOps = null;
+  child.on("message", (message) => {
+    if (message === "started") adminOps = scheduleAdminOps(websocketService);
+  });
+  const fleetResult = await new Promise((resolve, reject) => {
+    child.on("message", (message) => message !== "started" && resolve(message));
+    child.once("exit", (code) => code && reject(new Error(`device fleet exited with ${code}`)));
+  });
+
+  await dailySummary.flush();
+  await scanCache.flushTouches();
+  const stored = db.collect ? await db.collect() : { logs: db.stats.logs, duplicateLogs: db.stats.duplicateLogs };
+  log(JSON.stringify({ fleet: fleetResult }));
+  log(
+    JSON.stringify({
+      server: {
+        logsStored: stored.logs,
+        duplicateLogs: stored.duplicateLogs,
+        lostScans: fleetResult.captured - (stored.logs - stored.duplicateLogs),
+        ingest: logWriter.metrics(),
+        scanLatencyMs: scanCache.metrics().scanLatencyMs,
+        adminOps: adminOps ? await adminOps() : null,
+      },
+    })
+  );
+  process.exit(0);
+}
+
+async function main() {
+  if (process.env.FLEET_ROLE === "devices") {
+    // Lệnh quản trị chỉ bắt đầu khi thiết bị đã kết nối xong
+    const result = await runFleet(opts.url, () => process.send("started"));
+    process.send(result, () => process.exit(0));
+  } else if (opts.url) {
+    console.log(JSON.stringify({ fleet: await runFleet(opts.url) }));
+    process.exit(0);
+  } else {
+    await runServer();
+  }
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,154 @@
+// bench/heartbeatBench.js
+// Đo chi phí CPU của cơ chế heartbeat với 1k-10k thiết bị giả lập kết nối WebSocket thật:
+//
+//   legacy: setInterval duyệt mọi client, mỗi client quét toàn bộ pendingEnrollment rồi gửi
+//           heartbeat JSON; thiết bị (firmware cũ) trả lời và tự gửi heartbeat JSON mỗi chu kỳ.
+//   wheel : WebSocketService hiện tại - timer wheel, ping/pong của giao thức, không xét
+//           lệnh đang chờ; thiết bị chỉ trả pong (thư viện tự làm).
+//
+// Chu kỳ heartbeat rút xuống INTERVAL_MS để đo được nhiều chu kỳ trong vài giây.
+// Mỗi cấu hình chạy trong một tiến trình server riêng; thiết bị ở một tiến trình con khác.
+//
+//   node bench/heartbeatBench.js [devices...] [--pending=N]
+const http = require("http");
+const { fork } = require("child_process");
+const { monitorEventLoopDelay } = require("perf_hooks");
+
+const INTERVAL_MS = 1000;
+const WINDOW_INTERVALS = 8;
+const CONNECT_BATCH = 200;
+
+const legacyHeartbeat = { type: "heartbeat", payload: { status: "alive" } };
+
+// Bản sao startHeartbeat() trước khi chuyển sang timer wheel
+function legacyStartHeartbeat() {
+  const heartbeatTimeout = this.heartbeatInterval * 2;
+  const isDeviceEnrolling = (deviceId) => {
+    let isEnrolling = false;
+    this.pendingEnrollment.forEach((req) => {
+      if (req.deviceId === deviceId) isEnrolling = true;
+    });
+    return isEnrolling;
+  };
+  this.legacyTimer = setInterval(() => {
+    const now = Date.now();
+    this.clients.forEach((client, deviceId) => {
+      if (isDeviceEnrolling(deviceId)) return;
+      if (!client.isAlive || now - client.lastHeartbeatTime > heartbeatTimeout) {
+        client.ws.terminate();
+        this.clients.delete(deviceId);
+        this.cleanupPendingRequests(deviceId);
+        this.emit("statusChange");
+        return;
+      }
+      client.isAlive = false;
+      this.sendToClient(client.ws, { type: "heartbeat" });
+    });
+  }, this.heartbeatInterval);
+}
+
+async function runServer(mode, devices, pending) {
+  console.log = () => {}; // Log kết nối của 10k thiết bị làm nhiễu phép đo
+  const service = require("../services/websocketService");
+  service.heartbeatInterval = INTERVAL_MS;
+  if (mode === "legacy") service.startHeartbeat = legacyStartHeartbeat;
+
+  // Yêu cầu đăng ký đang chờ trên các thiết bị đầu (legacy quét hết chúng cho mỗi client)
+  for (let i = 0; i < pending; i++) {
+    service.setPending("enroll", 1000 + i, { deviceId: `bench-${i}`, resolve() {}, reject() {}, timeoutId: null });
+  }
+
+  const server = http.createServer();
+  service.initializeWebSocketServer(server);
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+
+  const client = fork(__filename, ["--client", mode, server.address().port, devices]);
+  await new Promise((resolve) => client.once("message", resolve)); // Tất cả đã kết nối
+  await new Promise((resolve) => setTimeout(resolve, INTERVAL_MS * 2)); // Ổn định
+
+  const loopDelay = monitorEventLoopDelay({ resolution: 1 });
+  loopDelay.enable();
+  const cpuStart = process.cpuUsage();
+  const start = performance.now();
+  await new Promise((resolve) => setTimeout(resolve, INTERVAL_MS * WINDOW_INTERVALS));
+  const cpu = process.cpuUsage(cpuStart);
+  const elapsedMs = performance.now() - start;
+  loopDelay.disable();
+
+  client.send("report");
+  const clientStats = await new Promise((resolve) => client.once("message", resolve));
+  client.kill();
+
+  process.send({
+    mode,
+    devices,
+    pending,
+    connected: service.clients.size,
+    cpuPct: +(((cpu.user + cpu.system) / 1000 / elapsedMs) * 100).toFixed(1),
+    cpuMsPerCycle: +((cpu.user + cpu.system) / 1000 / WINDOW_INTERVALS).toFixed(1),
+    loopDelayP99Ms: +(loopDelay.percentile(99) / 1e6).toFixed(1),
+    loopDelayMaxMs: +(loopDelay.max / 1e6).toFixed(1),
+    ...clientStats,
+  });
+  process.exit(0);
+}
+
+// Tiến trình thiết bị: mở `devices` kết nối; firmware cũ trả lời và tự gửi heartbeat JSON,
+// firmware mới để thư viện trả pong
+async function runClients(mode, port, devices) {
+  const WebSocket = require("ws");
+  const sockets = [];
+  const stats = { pings: 0, jsonHeartbeats: 0, closed: 0 };
+  for (let i = 0; i < devices; i += CONNECT_BATCH) {
+    await Promise.all(
+      Array.from({ length: Math.min(CONNECT_BATCH, devices - i) }, (_, j) =>
+        new Promise((resolve, reject) => {
+          const ws = new WebSocket(`ws://127.0.0.1:${port}/?deviceId=bench-${i + j}`);
+          ws.on("open", resolve);
+          ws.on("error", reject);
+          ws.on("ping", () => stats.pings++);
+          ws.on("close", () => stats.closed++);
+          ws.on("message", (message) => {
+            if (JSON.parse(message.toString()).type !== "heartbeat") return;
+            stats.jsonHeartbeats++;
+            ws.send(JSON.stringify(legacyHeartbeat));
+          });
+          sockets.push(ws);
+        })
+      )
+    );
+  }
+  if (mode === "legacy") {
+    setInterval(() => sockets.forEach((ws) => ws.send(JSON.stringify(legacyHeartbeat))), INTERVAL_MS);
+  }
+  process.send("ready");
+  process.on("message", () => process.send(stats));
+}
+
+function runConfig(mode, devices, pending) {
+  return new Promise((resolve, reject) => {
+    const child = fork(__filename, ["--server", mode, devices, pending]);
+    child.once("message", resolve);
+    child.once("exit", (code) => code && reject(new Error(`${mode}/${devices} exited with ${code}`)));
+  });
+}
+
+async function main() {
+  const args = process.argv.slice(2);
+  const pendingArg = args.find((arg) => arg.startsWith("--pending="));
+  const pending = pendingArg ? parseInt(pendingArg.split("=")[1]) : 50;
+  const counts = args.filter((arg) => !arg.startsWith("--")).map(Number);
+  for (const devices of counts.length ? counts : [1000, 5000, 10000]) {
+    for (const mode of ["legacy", "wheel"]) {
+      console.log(JSON.stringify(await runConfig(mode, devices, pending)));
+    }
+  }
+}
+
+const [role, ...rest] = process.argv.slice(2);
+if (role === "--server") runServer(rest[0], Number(rest[1]), Number(rest[2]));
+else if (role === "--client") runClients(rest[0], Number(rest[1]), Number(rest[2]));
+else main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
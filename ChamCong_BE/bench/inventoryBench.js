@@ -0,0 +1,147 @@
+// bench/inventoryBench.js
+// Dọn thư viện mẫu của một thiết bị lệch với DB: cảm biến còn mẫu của user đã xoá/khoá
+// (orphan, vài dải liên tiếp và rải rác), và vài user mất mẫu.
+//
+//   blind    : cách cũ - server không biết slot nào có mẫu, nên gửi delete cho từng slot
+//              không thuộc user đang hoạt động, chờ từng kết quả như initiateDeleteUser
+//   inventory: templateInventory.reconcile({ repair: true }) - một lệnh inventory, rồi
+//              delete_range cho từng dải orphan, gửi liền (thiết bị xếp hàng theo rid)
+//
+// Thiết bị giả lập (cùng process, qua WebSocket thật) làm như firmware: lệnh vào hàng đợi,
+// chạy lần lượt; mỗi lệnh tốn thời gian cảm biến như SensorTiming đo được trên AS608
+// (deleteModel ~80 ms, ReadIndexTable ~10 ms mỗi trang) cộng một vòng loop() ~50 ms.
+// Mỗi chiều mạng trễ --rtt/2 ms.
+//
+//   node bench/inventoryBench.js [--rtt=40] [--capacity=127] [--active=80]
+const http = require("http");
+const WebSocket = require("ws");
+const memoryDb = require("./memoryDb");
+
+const opts = { rtt: 40, capacity: 127, active: 80 };
+for (const arg of process.argv.slice(2)) {
+  const match = /^--([^=]+)=(\d+)$/.exec(arg);
+  if (match && match[1] in opts) opts[match[1]] = Number(match[2]);
+}
+
+const LOOP_MS = 50;
+const DELETE_MS = 80;
+const INDEX_PAGE_MS = 10;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// Thiết bị: slot -> có mẫu; hàng đợi lệnh như CommandQueue
+class Device {
+  constructor(url, slots) {
+    this.slots = slots;
+    this.queue = [];
+    this.running = false;
+    this.sensorCommands = 0;
+    this.ws = new WebSocket(url);
+    this.ws.on("message", (data) => this.receive(JSON.parse(data.toString())));
+  }
+
+  send(type, payload) {
+    setTimeout(() => this.ws.send(JSON.stringify({ type, payload })), opts.rtt / 2);
+  }
+
+  receive(message) {
+    if (!["delete", "delete_range", "inventory"].includes(message.type)) return;
+    setTimeout(() => {
+      this.queue.push(message);
+      if (this.running) {
+        const type = message.type === "inventory" ? "inventory" : "delete_status";
+        this.send(type, { id: message.id, rid: message.rid, status: "queued", ahead: this.queue.length });
+      }
+      this.run();
+    }, opts.rtt / 2);
+  }
+
+  async run() {
+    if (this.running) return;
+    this.running = true;
+    while (this.queue.length) {
+      const command = this.queue.shift();
+      await sleep(LOOP_MS / 2); // processCommandQueue() ở loop() kế tiếp
+      this.sensorCommands++;
+      if (command.type === "inventory") {
+        const bytes = Math.floor(opts.capacity / 8) + 1;
+        await sleep(INDEX_PAGE_MS * Math.ceil(bytes / 32));
+        const table = Buffer.alloc(bytes);
+        this.slots.forEach((slot) => (table[slot >> 3] |= 1 << (slot & 7)));
+        const payload = { rid: command.rid, status: "success", capacity: opts.capacity, count: this.slots.size };
+        this.send("inventory", { ...payload, bitmap: table.toString("hex") });
+      } else {
+        await sleep(DELETE_MS);
+        const count = command.count || 1;
+        for (let id = command.id; id < command.id + count; id++) this.slots.delete(id);
+        this.send("delete_status", { id: command.id, rid: command.rid, status: "success" });
+      }
+    }
+    this.running = false;
+  }
+}
+
+// Active: 1..active, trừ 5 user mất mẫu; orphan: hai dải và 10 slot rải rác phía trên
+function initialSlots() {
+  const slots = new Set();
+  for (let id = 1; id <= opts.active; id++) if (id % 17 !== 0) slots.add(id);
+  for (let id = opts.active + 1; id <= opts.active + 15; id++) slots.add(id);
+  for (let id = opts.active + 25; id <= opts.active + 32; id++) slots.add(id);
+  for (let i = 0; i < 10; i++) slots.add(Math.min(opts.capacity, opts.active + 36 + i * 2));
+  return slots;
+}
+
+async function run(mode, service, templateInventory, port) {
+  const deviceId = `inventory-${mode}`;
+  const device = new Device(`ws://127.0.0.1:${port}/?deviceId=${deviceId}`, initialSlots());
+  await new Promise((resolve) => device.ws.once("open", resolve));
+  await sleep(100);
+  const before = device.slots.size;
+
+  const start = performance.now();
+  let report;
+  if (mode === "blind") {
+    let commands = 0;
+    for (let id = opts.active + 1; id <= opts.capacity; id++) {
+      await service.requestDeletionOnDevice(deviceId, id);
+      commands++;
+    }
+    report = { commands };
+  } else {
+    report = await templateInventory.reconcile(deviceId, { repair: true });
+  }
+  const ms = performance.now() - start;
+  device.ws.close();
+  return {
+    mode,
+    ms: Math.round(ms),
+    slotsBefore: before,
+    slotsAfter: device.slots.size,
+    serverCommands: mode === "blind" ? report.commands : 1 + report.repair.commands,
+    sensorCommands: device.sensorCommands,
+    ...(mode === "inventory" && { orphans: report.orphans.length, missing: report.missing }),
+  };
+}
+
+async function main() {
+  console.log = () => {};
+  console.warn = () => {};
+  const print = (line) => process.stdout.write(`${line}\n`);
+  memoryDb.install({ users: opts.active });
+  const service = require("../services/websocketService");
+  const templateInventory = require("../services/templateInventory");
+  const server = http.createServer();
+  service.initializeWebSocketServer(server);
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+
+  print(`capacity ${opts.capacity}, ${opts.active} active users, rtt ${opts.rtt} ms`);
+  for (const mode of ["blind", "inventory"]) {
+    print(JSON.stringify(await run(mode, service, templateInventory, server.address().port)));
+  }
+  process.exit(0);
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,131 @@
+// bench/logIngestBench.js
+// Tải ghi AttendanceLog lúc vào ca: nhiều thiết bị cùng ghi, mỗi thiết bị ghi tuần tự
+// (như handleSequencedScans). So sánh save() từng bản ghi với logWriter (insertMany gộp).
+//
+// Có MONGO_URI (nên là DB thử, bản ghi của bench bị xoá sau khi chạy): đo MongoDB thật.
+// Không có: thay collection bằng mô hình server — mỗi lệnh tốn RTT mạng cộng thời gian
+// xử lý trên WORKERS luồng (chi phí cố định mỗi lệnh + chi phí mỗi document).
+//
+//   MONGO_URI=mongodb://127.0.0.1/chamcong_bench node bench/logIngestBench.js [devices] [scansPerDevice] [rttMs]
+const mongoose = require("mongoose");
+const AttendanceLog = require("../models/attendanceLogModel");
+const logWriter = require("../services/logWriter");
+
+const DEVICES = parseInt(process.argv[2]) || 50;
+const SCANS_PER_DEVICE = parseInt(process.argv[3]) || 200;
+const RTT_MS = parseFloat(process.argv[4] ?? 2);
+const OP_US = 150; // Chi phí cố định mỗi lệnh ghi trên server (parse, journal commit...)
+const DOC_US = 15; // Chi phí mỗi document
+const WORKERS = 4;
+const POOL_SIZE = 100; // maxPoolSize mặc định của driver
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// Mô hình server: WORKERS luồng, lệnh đến sau xếp hàng sau lệnh đến trước
+function simulatedCollection() {
+  const workerFreeAt = new Array(WORKERS).fill(0);
+  let pooled = 0;
+  const waiting = [];
+  let ops = 0;
+
+  const roundTrip = async (docs) => {
+    if (pooled >= POOL_SIZE) await new Promise((resolve) => waiting.push(resolve));
+    pooled++;
+    ops++;
+    await sleep(RTT_MS / 2);
+    const now = performance.now();
+    const worker = workerFreeAt.indexOf(Math.min(...workerFreeAt));
+    const doneAt = Math.max(now, workerFreeAt[worker]) + (OP_US + DOC_US * docs) / 1000;
+    workerFreeAt[worker] = doneAt;
+    await sleep(doneAt - now + RTT_MS / 2);
+    pooled--;
+    if (waiting.length) waiting.shift()();
+  };
+
+  const collection = AttendanceLog.collection;
+  collection.insertOne = async (doc) => {
+    await roundTrip(1);
+    return { acknowledged: true, insertedId: doc._id };
+  };
+  collection.insertMany = async (docs) => {
+    await roundTrip(docs.length);
+    const insertedIds = {};
+    docs.forEach((doc, i) => (insertedIds[i] = doc._id));
+    return { acknowledged: true, insertedCount: docs.length, insertedIds };
+  };
+  return { ops: () => ops };
+}
+
+function newLog(device, seq) {
+  return new AttendanceLog({
+    user: new mongoose.Types.ObjectId(),
+    timestamp: new Date(),
+    eventType: seq % 2 ? "CHECK_IN" : "CHECK_OUT",
+    deviceId: `BENCH_INGEST_${device}`,
+    deviceSeq: seq,
+    fingerprintTemplateIdUsed: (seq % 100) + 1,
+  });
+}
+
+async function runScenario(mode) {
+  const write = mode === "save" ? (doc) => doc.save() : (doc) => logWriter.insert(doc);
+  const latencies = [];
+  const start = performance.now();
+  await Promise.all(
+    Array.from({ length: DEVICES }, async (_, device) => {
+      for (let seq = 1; seq <= SCANS_PER_DEVICE; seq++) {
+        const t0 = performance.now();
+        await write(newLog(device, seq));
+        latencies.push(performance.now() - t0);
+      }
+    })
+  );
+  const elapsedMs = performance.now() - start;
+  latencies.sort((a, b) => a - b);
+  const at = (p) => +latencies[Math.round((p / 100) * (latencies.length - 1))].toFixed(2);
+  return {
+    mode,
+    records: latencies.length,
+    elapsedMs: Math.round(elapsedMs),
+    insertsPerSec: Math.round((latencies.length / elapsedMs) * 1000),
+    p50Ms: at(50),
+    p99Ms: at(99),
+  };
+}
+
+async function main() {
+  const uri = process.env.MONGO_URI;
+  let server = null;
+  if (uri) {
+    await mongoose.connect(uri);
+    await AttendanceLog.init();
+  } else {
+    server = simulatedCollection();
+  }
+  console.log(
+    `devices=${DEVICES} scans/device=${SCANS_PER_DEVICE} ` +
+      (uri ? `mongo=${uri}` : `simulated rtt=${RTT_MS}ms op=${OP_US}us doc=${DOC_US}us workers=${WORKERS}`)
+  );
+
+  const rows = [];
+  for (const mode of ["save", "insertMany"]) {
+    const opsBefore = server ? server.ops() : 0;
+    const row = await runScenario(mode);
+    if (server) row.dbRoundTrips = server.ops() - opsBefore;
+    rows.push(row);
+  }
+  console.log(rows.map((r) => JSON.stringify(r)).join("\n"));
+  const { batchSize, insertMs, waitMs } = logWriter.metrics();
+  console.log(`logWriter batchSize ${JSON.stringify(batchSize)}`);
+  console.log(`logWriter insertMs ${JSON.stringify(insertMs)} waitMs ${JSON.stringify(waitMs)}`);
+
+  if (uri) {
+    await AttendanceLog.deleteMany({ deviceId: /^BENCH_INGEST_/ });
+    await mongoose.disconnect();
+  }
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
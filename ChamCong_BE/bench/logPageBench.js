@@ -0,0 +1,271 @@
+// bench/logPageBench.js
+// Trang log GET /api/logs trên bảng log sinh sẵn --rows dòng (mặc định 2 triệu, --users user,
+// hai log mỗi timestamp để có dòng trùng khoá), ba kiểu truy vấn:
+//
+//   before: getLogs cũ - sort { timestamp: -1 }, skip, countDocuments - với index cũ { user, timestamp }
+//   page  : getLogs ?page=N (skip, tổng chính xác) với index mới
+//   cursor: getLogs ?cursor=<nextCursor> (keyset trên (timestamp, _id), tổng xấp xỉ) với index mới;
+//           cursor của trang sâu có được bằng cách đi lần lượt qua các trang pageSize 200
+//
+// Không cần MongoDB: AttendanceLog được thay bằng bộ thực thi trong bộ nhớ, chọn kế hoạch như
+// MongoDB với từng bộ index (IXSCAN theo thứ tự sort và dừng sau skip + limit; thiếu index hoặc
+// index không cho đúng thứ tự sort thì đọc hết phạm vi rồi SORT; count trên index là COUNT_SCAN)
+// và đếm khoá index / document phải đọc như keysExamined / docsExamined của explain().
+// Thời gian là của bộ thực thi này, chỉ để so sánh tương đối giữa các cách.
+//
+//   node bench/logPageBench.js [--rows=2000000] [--users=500] [--pageSize=20]
+const mongoose = require("mongoose");
+const AttendanceLog = require("../models/attendanceLogModel");
+const User = require("../models/userModel");
+const logController = require("../controllers/logController");
+
+const opts = { rows: 2000000, users: 500, pageSize: 20 };
+for (const arg of process.argv.slice(2)) {
+  const match = /^--([^=]+)=(\d+)$/.exec(arg);
+  if (match && match[1] in opts) opts[match[1]] = Number(match[2]);
+}
+
+const N = opts.rows;
+const NEWEST_MS = Date.parse("2025-06-30T12:00:00Z");
+const STEP_MS = 30000; // Hai log mỗi 30 s: ~1 năm với 2 triệu dòng
+const WALK_PAGE_SIZE = 200;
+
+// Dòng i (0 = mới nhất) đã theo thứ tự (timestamp, _id) giảm dần; _id tăng theo thứ tự ghi
+const ts = new Float64Array(N);
+const userOf = new Int32Array(N);
+for (let i = 0; i < N; i++) {
+  ts[i] = NEWEST_MS - Math.floor(i / 2) * STEP_MS;
+  userOf[i] = (i * 7919 + 13) % opts.users;
+}
+const idOf = (row) => N - row;
+const hex = (n) => n.toString(16).padStart(24, "0");
+const userIds = Array.from({ length: opts.users }, (_, u) => hex(0xf0000000 + u));
+const userByHex = new Map(userIds.map((id, u) => [id, u]));
+
+// Các dòng của từng user, cùng thứ tự (index { user, timestamp[, _id] })
+const userStart = new Int32Array(opts.users + 1);
+for (let i = 0; i < N; i++) userStart[userOf[i] + 1]++;
+for (let u = 0; u < opts.users; u++) userStart[u + 1] += userStart[u];
+const userRows = new Int32Array(N);
+{
+  const fill = userStart.slice(0, opts.users);
+  for (let i = 0; i < N; i++) userRows[fill[userOf[i]]++] = i;
+}
+
+let indexes = "new";
+const stats = { findKeys: 0, findDocs: 0, countKeys: 0, countDocs: 0 };
+
+// Phạm vi [start, end) trong danh sách (user hoặc cả bảng) thoả cận timestamp của filter
+function scanRange(filter) {
+  const user = filter.user ? userByHex.get(String(filter.user)) : null;
+  const list = user === null ? null : userRows.subarray(userStart[user], userStart[user + 1]);
+  const length = list ? list.length : N;
+  const at = list ? (p) => list[p] : (p) => p;
+  const hi = filter.timestamp?.$lte ? filter.timestamp.$lte.getTime() : Infinity;
+  const lo = filter.timestamp?.$gte ? filter.timestamp.$gte.getTime() : -Infinity;
+  const firstWhere = (pred) => {
+    let a = 0;
+    let b = length;
+    while (a < b) {
+      const m = (a + b) >> 1;
+      if (pred(ts[at(m)])) b = m;
+      else a = m + 1;
+    }
+    return a;
+  };
+  return { user, at, start: firstWhere((t) => t <= hi), end: firstWhere((t) => t < lo) };
+}
+
+// Điều kiện keyset { $or: [{ timestamp: { $lt } }, { _id: { $lt } }] }
+function residual(filter) {
+  if (!filter.$or) return () => true;
+  const t = filter.$or[0].timestamp.$lt.getTime();
+  const id = parseInt(String(filter.$or[1]._id.$lt), 16);
+  return (row) => ts[row] < t || idOf(row) < id;
+}
+
+function execFind(filter, sort, skip, limit) {
+  const { user, at, start, end } = scanRange(filter);
+  const matches = residual(filter);
+  const out = [];
+  const sortHasId = "_id" in sort;
+  const streaming = user !== null ? indexes === "new" || !sortHasId : indexes === "new";
+  if (streaming) {
+    // IXSCAN đúng thứ tự sort, _id nằm trong khoá nên điều kiện keyset lọc ngay trên index
+    let matched = 0;
+    for (let p = start; p < end && out.length < limit; p++) {
+      stats.findKeys++;
+      const row = at(p);
+      if (!matches(row)) continue;
+      stats.findDocs++; // SKIP nằm trên FETCH: dòng bị skip vẫn được đọc
+      if (matched++ >= skip) out.push(row);
+    }
+  } else if (user !== null) {
+    // IXSCAN { user, timestamp } cả phạm vi, FETCH mọi dòng rồi SORT theo (timestamp, _id)
+    const candidates = [];
+    for (let p = start; p < end; p++) {
+      stats.findKeys++;
+      stats.findDocs++;
+      if (matches(at(p))) candidates.push(at(p));
+    }
+    out.push(...candidates.slice(skip, skip + limit));
+  } else {
+    // Không có index theo timestamp: COLLSCAN cả bảng rồi SORT
+    let matched = 0;
+    for (let row = 0; row < N; row++) {
+      stats.findDocs++;
+      if (row < start || row >= end || !matches(row)) continue;
+      if (matched++ >= skip && out.length < limit) out.push(row);
+    }
+  }
+  return out;
+}
+
+function execCount(filter, limit) {
+  const { user, start, end } = scanRange(filter);
+  const count = Math.min(end - start, limit || Infinity);
+  if (Object.keys(filter).length === 0 || (user === null && indexes === "old")) stats.countDocs += N; // COLLSCAN
+  else stats.countKeys += count; // COUNT_SCAN, dừng ở limit
+  return count;
+}
+
+const toDoc = (row, populate) => ({
+  _id: new mongoose.Types.ObjectId(hex(idOf(row))),
+  user: populate
+    ? { _id: new mongoose.Types.ObjectId(userIds[userOf[row]]), name: `User ${userOf[row]}`, userId: `user-${userOf[row]}` }
+    : new mongoose.Types.ObjectId(userIds[userOf[row]]),
+  timestamp: new Date(ts[row]),
+  eventType: row % 2 ? "CHECK_IN" : "CHECK_OUT",
+  deviceId: "ESP_CHAMCONG_01",
+});
+
+function installExecutor() {
+  User.findOne = (filter) => {
+    const u = Number(String(filter.userId).replace("user-", ""));
+    const result = u >= 0 && u < opts.users ? { _id: new mongoose.Types.ObjectId(userIds[u]) } : null;
+    return { lean: async () => result, then: (resolve, reject) => Promise.resolve(result).then(resolve, reject) };
+  };
+  AttendanceLog.find = (filter) => {
+    const q = { sortSpec: {}, skipN: 0, limitN: Infinity, populated: false };
+    Object.assign(q, {
+      sort: (spec) => Object.assign(q, { sortSpec: spec }),
+      skip: (n) => Object.assign(q, { skipN: n }),
+      limit: (n) => Object.assign(q, { limitN: n }),
+      populate: () => Object.assign(q, { populated: true }),
+      lean: () => q,
+      then: (resolve, reject) =>
+        Promise.resolve()
+          .then(() => execFind(filter, q.sortSpec, q.skipN, q.limitN).map((row) => toDoc(row, q.populated)))
+          .then(resolve, reject),
+    });
+    return q;
+  };
+  AttendanceLog.countDocuments = (filter) => {
+    const q = { limitN: 0 };
+    Object.assign(q, {
+      limit: (n) => Object.assign(q, { limitN: n }),
+      then: (resolve, reject) => Promise.resolve().then(() => execCount(filter, q.limitN)).then(resolve, reject),
+    });
+    return q;
+  };
+  AttendanceLog.estimatedDocumentCount = async () => N; // Metadata collection, không đọc dòng nào
+}
+
+// getLogs thật qua req/res giả
+const callGetLogs = (query) =>
+  new Promise((resolve) => {
+    const res = {
+      status() {
+        return res;
+      },
+      json: resolve,
+    };
+    logController.getLogs({ query }, res);
+  });
+
+// getLogs trước thay đổi này (rút gọn: cùng truy vấn và cùng countDocuments)
+async function legacyGetLogs({ page, pageSize, filter }) {
+  const logs = await AttendanceLog.find(filter)
+    .populate("user", "name msv userId")
+    .sort({ timestamp: -1 })
+    .skip((page - 1) * pageSize)
+    .limit(pageSize)
+    .lean();
+  const totalLogs = await AttendanceLog.countDocuments(filter);
+  return { data: logs, totalLogs };
+}
+
+async function measure(fn) {
+  Object.keys(stats).forEach((key) => (stats[key] = 0));
+  const start = performance.now();
+  const result = await fn();
+  return { result, ...stats, ms: +(performance.now() - start).toFixed(2) };
+}
+
+// Đi qua các trang bằng nextCursor tới offset; trả cursor của trang bắt đầu ở offset
+async function cursorAt(query, offset) {
+  let cursor;
+  for (let seen = 0; seen < offset; ) {
+    const pageSize = Math.min(WALK_PAGE_SIZE, offset - seen);
+    const body = await callGetLogs({ ...query, pageSize: String(pageSize), total: "none", cursor });
+    cursor = body.data.nextCursor;
+    seen += pageSize;
+  }
+  return cursor;
+}
+
+async function scenario(name, query, legacyFilter, pages) {
+  const print = (line) => process.stdout.write(`${JSON.stringify({ scenario: name, ...line })}\n`);
+  const { pageSize } = opts;
+  for (const page of pages) {
+    indexes = "old";
+    const before = await measure(() => legacyGetLogs({ page, pageSize, filter: legacyFilter }));
+    indexes = "new";
+    const byPage = await measure(() => callGetLogs({ ...query, page: String(page), pageSize: String(pageSize) }));
+    const cursor = page > 1 ? await cursorAt(query, (page - 1) * pageSize) : undefined;
+    const byCursor = await measure(() => callGetLogs({ ...query, pageSize: String(pageSize), cursor }));
+    const ids = (rows) => rows.map((log) => String(log._id)).join();
+    const row = (mode, m, total) => ({
+      mode,
+      page,
+      find: `${m.findKeys} keys / ${m.findDocs} docs`,
+      count: `${m.countKeys} keys / ${m.countDocs} docs`,
+      ms: m.ms,
+      ...total,
+    });
+    print(row("before", before, { totalLogs: before.result.totalLogs }));
+    print(row("page", byPage, { totalLogs: byPage.result.data.totalLogs }));
+    print(
+      row("cursor", byCursor, {
+        totalLogs: byCursor.result.data.totalLogs,
+        totalIsExact: byCursor.result.data.totalIsExact,
+        samePage: ids(byCursor.result.data.data) === ids(byPage.result.data.data) &&
+          ids(byPage.result.data.data) === ids(before.result.data),
+      })
+    );
+  }
+}
+
+async function main() {
+  console.error = () => {};
+  installExecutor();
+  process.stdout.write(`${N} logs, ${opts.users} users, pageSize ${opts.pageSize}\n`);
+
+  // Cả tháng 6 của mọi user (~170 nghìn log)
+  const june = { startDate: "2025-06-01", endDate: "2025-06-30" };
+  const juneEnd = new Date(june.endDate);
+  juneEnd.setHours(23, 59, 59, 999);
+  const juneFilter = { timestamp: { $gte: new Date(june.startDate), $lte: juneEnd } };
+  await scenario("range, all users", june, juneFilter, [1, 100, 5000]);
+
+  const user = { userId: "user-7" };
+  await scenario("one user", user, { user: new mongoose.Types.ObjectId(userIds[7]) }, [1, 100]);
+
+  await scenario("no filter", {}, {}, [1, 1000, Math.floor(N / 2 / opts.pageSize)]);
+  process.exit(0);
+}
+
+main().catch((error) => {
+  process.stderr.write(`${error.stack}\n`);
+  process.exit(1);
+});
@@ -0,0 +1,90 @@
+// bench/memoryDb.js
+// MongoDB giả trong bộ nhớ cho các bench chạy cả đường quét thật (WebSocketService ->
+// fingerprintController -> scanCache/logWriter/dailySummary) mà không cần server DB.
+// Chỉ thay các lệnh model mà đường quét dùng; mỗi lệnh tốn RTT mạng cộng thời gian xử
+// lý trên WORKERS luồng (chi phí cố định mỗi lệnh + mỗi document), như logIngestBench.
+const mongoose = require("mongoose");
+const User = require("../models/userModel");
+const AttendanceLog = require("../models/attendanceLogModel");
+const DailyAttendance = require("../models/dailyAttendanceModel");
+const FingerprintTemplate = require("../models/fingerprintTemplateModel");
+
+const OP_US = 150;
+const DOC_US = 15;
+const WORKERS = 4;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function install({ users = 500, rttMs = 1 } = {}) {
+  const workerFreeAt = new Array(WORKERS).fill(0);
+  const stats = { ops: 0, logs: 0, duplicateLogs: 0, summaryUpdates: 0 };
+  const seqs = new Set(); // deviceId|deviceSeq đã ghi
+  const templates = new Map(); // templateId -> { templateId, data, size, sourceDeviceId }
+
+  const roundTrip = async (docs, result) => {
+    stats.ops++;
+    await sleep(rttMs / 2);
+    const now = performance.now();
+    const worker = workerFreeAt.indexOf(Math.min(...workerFreeAt));
+    const doneAt = Math.max(now, workerFreeAt[worker]) + (OP_US + DOC_US * docs) / 1000;
+    workerFreeAt[worker] = doneAt;
+    await sleep(doneAt - now + rttMs / 2);
+    return result;
+  };
+
+  // Query giả: .sort()/.lean() và await
+  const query = (docs, result) => ({
+    sort() { return this; },
+    lean() { return this; },
+    then(resolve, reject) {
+      return roundTrip(docs, result).then(resolve, reject);
+    },
+  });
+
+  const people = Array.from({ length: users }, (_, i) => ({
+    _id: new mongoose.Types.ObjectId(),
+    id: i + 1,
+    name: `Nguoi Dung ${i + 1}`,
+    isActive: true,
+  }));
+
+  User.find = (filter = {}) =>
+    query(users, "isActive" in filter ? people.filter((user) => user.isActive === filter.isActive) : people);
+  User.findOne = (filter) => query(1, people.find((user) => user.id === filter.id) || null);
+  User.bulkWrite = (ops) => roundTrip(ops.length, {});
+  AttendanceLog.findOne = () => query(1, null);
+  AttendanceLog.aggregate = () => query(1, []);
+  AttendanceLog.insertMany = async (docs) => {
+    await roundTrip(docs.length);
+    docs.forEach((doc) => {
+      const key = `${doc.deviceId}|${doc.deviceSeq}`;
+      if (seqs.has(key)) stats.duplicateLogs++;
+      seqs.add(key);
+    });
+    stats.logs += docs.length;
+    return { mongoose: { validationErrors: [], results: docs } };
+  };
+  DailyAttendance.bulkWrite = async (ops) => {
+    await roundTrip(ops.length);
+    stats.summaryUpdates += ops.length;
+    return {};
+  };
+  DailyAttendance.find = () => query(1, []);
+  FingerprintTemplate.find = (filter = {}) => {
+    const ids = filter.templateId?.$in;
+    const docs = [...templates.values()].filter((t) => !ids || ids.includes(t.templateId));
+    return query(docs.length, docs);
+  };
+  FingerprintTemplate.updateOne = (filter, update) => {
+    templates.set(filter.templateId, { templateId: filter.templateId, ...update.$set });
+    return roundTrip(1, {});
+  };
+  FingerprintTemplate.deleteOne = (filter) => {
+    templates.delete(filter.templateId);
+    return roundTrip(1, {});
+  };
+
+  return { stats, users: people, templates };
+}
+
+module.exports = { install };
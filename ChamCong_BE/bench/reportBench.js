@@ -0,0 +1,150 @@
+// bench/reportBench.js
+// Sinh một năm dữ liệu chấm công rồi so sánh báo cáo tháng/năm tính từ AttendanceLog
+// (quét mọi lượt quét, O(punches)) với báo cáo đọc DailyAttendance (O(users x days)).
+//
+// Có MONGO_URI: ghi dữ liệu vào DB đó (tên DB phải chứa "bench", bị xoá khi chạy xong),
+// chạy rebuild thật và đo các truy vấn thật. Không có: chạy cùng thuật toán trên mảng
+// trong bộ nhớ (rebuild qua cursor giả) để thấy số document phải đọc.
+//
+//   MONGO_URI=mongodb://127.0.0.1/chamcong_bench node bench/reportBench.js [users] [punchesPerDay]
+const mongoose = require("mongoose");
+const AttendanceLog = require("../models/attendanceLogModel");
+const DailyAttendance = require("../models/dailyAttendanceModel");
+const dailySummary = require("../services/dailySummary");
+const { summarize } = require("../services/dailySummary");
+const { dayStartOf } = require("../services/scanCache");
+
+const USERS = parseInt(process.argv[2]) || 300;
+const PUNCHES_PER_DAY = parseInt(process.argv[3]) || 4; // Vào, ra ăn trưa, vào, ra
+const YEAR = new Date().getFullYear() - 1;
+
+function generateYear() {
+  const users = Array.from({ length: USERS }, () => new mongoose.Types.ObjectId());
+  const logs = [];
+  for (let day = new Date(YEAR, 0, 1); day.getFullYear() === YEAR; day.setDate(day.getDate() + 1)) {
+    if (day.getDay() === 0 || day.getDay() === 6) continue;
+    users.forEach((user, u) => {
+      if ((u * 7 + day.getDate()) % 23 === 0) return; // Vắng
+      for (let p = 0; p < PUNCHES_PER_DAY; p++) {
+        const minutes = 7 * 60 + 45 + p * (9 * 60 / PUNCHES_PER_DAY) + ((u * 13 + p * 7 + day.getDate()) % 30);
+        logs.push({
+          user,
+          timestamp: new Date(day.getFullYear(), day.getMonth(), day.getDate(), 0, minutes),
+          eventType: p % 2 ? "CHECK_OUT" : "CHECK_IN",
+          deviceId: "BENCH_REPORT",
+        });
+      }
+    });
+  }
+  return logs;
+}
+
+// Báo cáo từ log thô: đọc mọi lượt quét trong khoảng, gom theo (user, ngày), rồi theo user
+function reportFromLogs(logs) {
+  const days = new Map();
+  for (const log of logs) {
+    const key = `${log.user}|${dayStartOf(log.timestamp)}`;
+    if (!days.has(key)) days.set(key, { user: String(log.user), events: [] });
+    days.get(key).events.push(log);
+  }
+  const totals = new Map();
+  for (const { user, events } of days.values()) {
+    events.sort((a, b) => a.timestamp - b.timestamp);
+    addToTotals(totals, user, summarize(events));
+  }
+  return totals;
+}
+
+function reportFromSummaries(summaries) {
+  const totals = new Map();
+  for (const summary of summaries) addToTotals(totals, String(summary.user), summary);
+  return totals;
+}
+
+function addToTotals(totals, user, summary) {
+  const total = totals.get(user) || { daysPresent: 0, punches: 0, workedMs: 0 };
+  total.daysPresent++;
+  total.punches += summary.punches;
+  total.workedMs += summary.workedMs;
+  totals.set(user, total);
+}
+
+const timed = async (fn) => {
+  const start = performance.now();
+  const result = await fn();
+  return { ms: +(performance.now() - start).toFixed(1), result };
+};
+
+const ranges = () => [
+  { name: "month", from: new Date(YEAR, 5, 1), to: new Date(YEAR, 6, 1) },
+  { name: "year", from: new Date(YEAR, 0, 1), to: new Date(YEAR + 1, 0, 1) },
+];
+
+async function runInMemory(logs) {
+  // Rebuild thật của dailySummary trên cursor giả, sắp như sort() của rebuild (user giảm dần, thời gian tăng dần)
+  const sorted = [...logs].sort((a, b) => String(b.user).localeCompare(String(a.user)) || a.timestamp - b.timestamp);
+  const summaries = [];
+  AttendanceLog.find = () => {
+    const query = { sort: () => query, lean: () => query, cursor: () => sorted.values() };
+    return query;
+  };
+  DailyAttendance.deleteMany = async () => ({});
+  DailyAttendance.bulkWrite = async (ops) => ops.forEach((op) => summaries.push(op.insertOne.document));
+  const rebuild = await timed(() => dailySummary.rebuild());
+  console.log(`rebuild: ${rebuild.result.logs} logs -> ${rebuild.result.summaries} summaries in ${rebuild.ms} ms`);
+
+  for (const { name, from, to } of ranges()) {
+    const raw = await timed(() => reportFromLogs(logs.filter((l) => l.timestamp >= from && l.timestamp < to)));
+    const daily = await timed(() => reportFromSummaries(summaries.filter((s) => s.day >= from && s.day < to)));
+    const same = [...raw.result].every(([user, t]) => JSON.stringify(daily.result.get(user)) === JSON.stringify(t));
+    const docs = (list) => list.filter((d) => (d.timestamp || d.day) >= from && (d.timestamp || d.day) < to).length;
+    console.log(
+      JSON.stringify({ report: name, logsRead: docs(logs), summariesRead: docs(summaries), rawMs: raw.ms, dailyMs: daily.ms, same })
+    );
+  }
+}
+
+async function runMongo(logs) {
+  const uri = process.env.MONGO_URI;
+  await mongoose.connect(uri);
+  if (!/bench/i.test(mongoose.connection.name)) {
+    throw new Error(`Refusing to write into database "${mongoose.connection.name}" (name must contain "bench")`);
+  }
+  await Promise.all([AttendanceLog.deleteMany({}), DailyAttendance.deleteMany({})]);
+  await Promise.all([AttendanceLog.init(), DailyAttendance.init()]);
+  for (let i = 0; i < logs.length; i += 10000) {
+    await AttendanceLog.insertMany(logs.slice(i, i + 10000), { lean: true, ordered: false });
+  }
+  const rebuild = await timed(() => dailySummary.rebuild());
+  console.log(`rebuild: ${rebuild.result.logs} logs -> ${rebuild.result.summaries} summaries in ${rebuild.ms} ms`);
+
+  for (const { name, from, to } of ranges()) {
+    // Cách cũ: kéo log thô về rồi gom (cùng thuật toán summarize)
+    const raw = await timed(async () =>
+      reportFromLogs(await AttendanceLog.find({ timestamp: { $gte: from, $lt: to } }, "user timestamp eventType").lean())
+    );
+    const daily = await timed(() =>
+      DailyAttendance.aggregate([
+        { $match: { day: { $gte: from, $lt: to } } },
+        { $group: { _id: "$user", daysPresent: { $sum: 1 }, punches: { $sum: "$punches" }, workedMs: { $sum: "$workedMs" } } },
+      ])
+    );
+    const same = daily.result.every(({ _id, ...total }) => JSON.stringify(raw.result.get(String(_id))) === JSON.stringify(total));
+    console.log(JSON.stringify({ report: name, rawMs: raw.ms, dailyMs: daily.ms, users: daily.result.length, same }));
+  }
+
+  await mongoose.connection.dropDatabase();
+  await mongoose.disconnect();
+}
+
+async function main() {
+  const logs = generateYear();
+  console.log(`users=${USERS} punches/day=${PUNCHES_PER_DAY} year=${YEAR}: ${logs.length} logs`);
+  if (process.env.MONGO_URI) await runMongo(logs);
+  else await runInMemory(logs);
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,150 @@
+// bench/scanBatchBench.js
+// Mô phỏng nhiều thiết bị xả hàng đợi lượt quét (giờ cao điểm / sau khi mất mạng)
+// qua WebSocketService thật, so sánh scan_result từng frame với scan_batch + scan_ack.
+// DB được thay bằng stub có độ trễ cố định nên không cần MongoDB; mỗi lượt gọi stub
+// tính là một round trip để thấy phần scanCache tiết kiệm được.
+//
+//   node bench/scanBatchBench.js [devices] [scansPerDevice] [netLatencyMs] [dbLatencyMs]
+const http = require("http");
+const WebSocket = require("ws");
+const mongoose = require("mongoose");
+const User = require("../models/userModel");
+const AttendanceLog = require("../models/attendanceLogModel");
+const websocketService = require("../services/websocketService");
+const scanCache = require("../services/scanCache");
+
+const DEVICES = parseInt(process.argv[2]) || 50;
+const SCANS_PER_DEVICE = parseInt(process.argv[3]) || 200;
+const NET_LATENCY_MS = parseInt(process.argv[4] ?? 10); // một chiều
+const DB_LATENCY_MS = parseInt(process.argv[5] ?? 1);
+const BASE_TS = Math.floor(Date.now() / 1000) - 3600; // Lượt quét trong hôm nay
+const BATCH_MAX = 10; // Giống scanBatchMax trên firmware
+const MAX_IN_FLIGHT = 20; // Giống scanMaxInFlight trên firmware
+const JOURNAL_ID = 0x2f1c4e3b; // "j" gửi kèm mọi lượt quét có seq, như journal.journalId()
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+let dbRoundTrips = 0;
+const dbCall = (result) => {
+  dbRoundTrips++;
+  return sleep(DB_LATENCY_MS).then(() => result);
+};
+
+// Query giả: hỗ trợ .sort()/.lean() và await
+const fakeQuery = (result) => ({
+  sort() { return this; },
+  lean() { return this; },
+  then(resolve, reject) {
+    return dbCall(result).then(resolve, reject);
+  },
+});
+
+const userObjectIds = new Map();
+const userObjectId = (id) => {
+  if (!userObjectIds.has(id)) userObjectIds.set(id, new mongoose.Types.ObjectId());
+  return userObjectIds.get(id);
+};
+const fakeUser = (id) => ({ _id: userObjectId(id), id, name: `User ${id}`, isActive: true, save: () => dbCall() });
+
+function stubDatabase() {
+  User.findOne = (filter) => fakeQuery(fakeUser(filter.id));
+  User.find = () => fakeQuery(Array.from({ length: 100 }, (_, i) => fakeUser(i + 1)));
+  User.bulkWrite = () => dbCall({});
+  AttendanceLog.findOne = () => fakeQuery(null);
+  AttendanceLog.aggregate = () => fakeQuery([]);
+  AttendanceLog.insertMany = () => dbCall({}); // logWriter gộp các bản ghi thành một lệnh
+}
+
+function runDevice(port, deviceId, batching) {
+  return new Promise((resolve, reject) => {
+    const ws = new WebSocket(`ws://127.0.0.1:${port}/?deviceId=${deviceId}`);
+    const stats = { frames: 0, acks: 0 };
+    let sentSeq = 0;
+    let ackedSeq = 0;
+
+    const pump = () => {
+      while (sentSeq < SCANS_PER_DEVICE && sentSeq - ackedSeq < MAX_IN_FLIGHT) {
+        const from = sentSeq + 1;
+        const to = Math.min(SCANS_PER_DEVICE, sentSeq + (batching ? BATCH_MAX : 1));
+        const scans = [];
+        for (let seq = from; seq <= to; seq++) {
+          scans.push({ seq, id: (seq % 100) + 1, ts: BASE_TS + seq });
+        }
+        const frame = batching
+          ? { type: "scan_batch", payload: { last: to, j: JOURNAL_ID, scans } }
+          : { type: "scan_result", payload: { ...scans[0], j: JOURNAL_ID } };
+        setTimeout(() => ws.send(JSON.stringify(frame)), NET_LATENCY_MS);
+        stats.frames++;
+        sentSeq = to;
+      }
+    };
+
+    ws.on("open", pump);
+    ws.on("message", (raw) => {
+      const msg = JSON.parse(raw.toString());
+      if (msg.type !== "scan_ack") return;
+      setTimeout(() => {
+        stats.acks++;
+        ackedSeq = Math.max(ackedSeq, msg.seq);
+        if (ackedSeq >= SCANS_PER_DEVICE) {
+          ws.close();
+          resolve(stats);
+        } else {
+          pump();
+        }
+      }, NET_LATENCY_MS);
+    });
+    ws.on("error", reject);
+  });
+}
+
+async function runScenario(port, batching, round) {
+  const start = process.hrtime.bigint();
+  const tripsBefore = dbRoundTrips;
+  const results = await Promise.all(
+    Array.from({ length: DEVICES }, (_, i) =>
+      runDevice(port, `BENCH_${round}_${batching ? "B" : "S"}_${i}`, batching)
+    )
+  );
+  const elapsedMs = Number(process.hrtime.bigint() - start) / 1e6;
+  const totalScans = DEVICES * SCANS_PER_DEVICE;
+  const frames = results.reduce((sum, r) => sum + r.frames, 0);
+  const acks = results.reduce((sum, r) => sum + r.acks, 0);
+  return {
+    mode: batching ? "scan_batch" : "scan_result",
+    scans: totalScans,
+    frames,
+    acks,
+    elapsedMs: Math.round(elapsedMs),
+    scansPerSec: Math.round((totalScans / elapsedMs) * 1000),
+    framesPerScan: +(frames / totalScans).toFixed(2),
+    dbRoundTripsPerScan: +((dbRoundTrips - tripsBefore) / totalScans).toFixed(2),
+  };
+}
+
+async function main() {
+  stubDatabase();
+  const log = console.log;
+  console.log = () => {}; // Controller log rất nhiều, tắt khi đo
+  console.warn = () => {};
+
+  const server = http.createServer();
+  websocketService.initializeWebSocketServer(server);
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+  const { port } = server.address();
+
+  log(
+    `devices=${DEVICES} scans/device=${SCANS_PER_DEVICE} netLatency=${NET_LATENCY_MS}ms dbLatency=${DB_LATENCY_MS}ms`
+  );
+  const rows = [];
+  rows.push(await runScenario(port, false, 1));
+  rows.push(await runScenario(port, true, 1));
+  log(rows.map((r) => JSON.stringify(r)).join("\n"));
+  await scanCache.flushTouches();
+  log(`scanCache ${JSON.stringify(scanCache.metrics())} (updatedAt flush: ${dbRoundTrips} round trips total)`);
+  process.exit(0);
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
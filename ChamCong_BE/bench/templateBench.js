@@ -0,0 +1,262 @@
+// bench/templateBench.js
+// Sao chép đặc trưng vân tay giữa các thiết bị (services/templateReplication):
+//
+//   replicate: đăng ký ở một máy -> các máy khác quét được sau bao lâu; mẫu tự gửi lên mà không
+//              có enroll_status success trước đó thì không được sao chép
+//   provision: máy mới (thư viện trống) nhận --templates mẫu đã lưu; cửa sổ 1 (nạp từng mẫu,
+//              chờ load_status rồi mới gửi mẫu sau) so với LOAD_WINDOW = 2 như firmware
+//   collect  : máy cũ có sẵn --templates mẫu, server chưa lưu mẫu nào
+//   storage  : kích thước BSON một mẫu 512 byte: Buffer / chuỗi base64 / mảng số
+//
+// Thiết bị giả lập (cùng process, qua WebSocket thật) làm như firmware: ghép các đoạn
+// template_load vào một trong TEMPLATE_BUFFERS bộ đệm (hết bộ đệm thì báo lỗi), lệnh vào hàng
+// đợi, chạy lần lượt mỗi vòng loop() ~50 ms; DownChar + Store tốn DOWNLOAD_MS, UpChar tốn
+// UPLOAD_MS (LoopBench "replicate": ~2.6 mẫu/s với cảm biến trên SoftwareSerial).
+// Mỗi chiều mạng trễ --rtt/2 ms.
+//
+//   node bench/templateBench.js [--rtt=40] [--templates=100] [--devices=4]
+const http = require("http");
+const crypto = require("crypto");
+const mongoose = require("mongoose");
+const WebSocket = require("ws");
+const memoryDb = require("./memoryDb");
+
+const opts = { rtt: 40, templates: 100, devices: 4 };
+for (const arg of process.argv.slice(2)) {
+  const match = /^--([^=]+)=(\d+)$/.exec(arg);
+  if (match && match[1] in opts) opts[match[1]] = Number(match[2]);
+}
+
+const LOOP_MS = 50;
+const DOWNLOAD_MS = 330;
+const UPLOAD_MS = 150;
+const INDEX_PAGE_MS = 10;
+const TEMPLATE_BUFFERS = 2;
+const TEMPLATE_BYTES = 512;
+const CHUNK_BYTES = 128;
+const CAPACITY = 127;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// Thiết bị: slot -> đặc trưng; hàng đợi lệnh như CommandQueue, bộ đệm như TemplateBuffers
+class Device {
+  constructor(url, slots = new Map()) {
+    this.slots = slots;
+    this.queue = [];
+    this.running = false;
+    this.receiving = new Map(); // rid -> { id, data, received }
+    this.buffersInUse = 0;
+    this.peakBuffers = 0;
+    this.rejected = 0;
+    this.onStored = () => {};
+    this.ws = new WebSocket(url);
+    this.ws.on("message", (data) => {
+      const message = JSON.parse(data.toString());
+      setTimeout(() => this.receive(message), opts.rtt / 2);
+    });
+  }
+
+  send(type, payload) {
+    setTimeout(() => this.ws.send(JSON.stringify({ type, payload })), opts.rtt / 2);
+  }
+
+  receive(message) {
+    if (message.type === "template_load") {
+      this.receiveChunk(message);
+    } else if (["enroll", "template_upload", "inventory"].includes(message.type)) {
+      this.enqueue(message);
+    }
+  }
+
+  receiveChunk({ id, rid, offset, total, data }) {
+    let entry = this.receiving.get(rid);
+    if (offset === 0) {
+      if (this.buffersInUse === TEMPLATE_BUFFERS) {
+        this.rejected++;
+        this.send("load_status", { id, rid, status: "error", message: "No free template buffer" });
+        return;
+      }
+      this.buffersInUse++;
+      this.peakBuffers = Math.max(this.peakBuffers, this.buffersInUse);
+      entry = { id, data: Buffer.alloc(total), received: 0 };
+      this.receiving.set(rid, entry);
+    }
+    if (!entry) return;
+    entry.received += Buffer.from(data, "base64").copy(entry.data, offset);
+    if (entry.received < entry.data.length) return;
+    this.receiving.delete(rid);
+    this.enqueue({ type: "load", id, rid, data: entry.data });
+  }
+
+  enqueue(command) {
+    this.queue.push(command);
+    if (this.running) {
+      const type = {
+        enroll: "enroll_status", load: "load_status", template_upload: "upload_status", inventory: "inventory",
+      }[command.type];
+      this.send(type, { id: command.id, rid: command.rid, status: "queued", ahead: this.queue.length });
+    }
+    this.run();
+  }
+
+  async run() {
+    if (this.running) return;
+    this.running = true;
+    while (this.queue.length) {
+      const command = this.queue.shift();
+      await sleep(LOOP_MS / 2); // processCommandQueue() ở loop() kế tiếp
+      if (command.type === "load") {
+        await sleep(DOWNLOAD_MS);
+        this.slots.set(command.id, command.data);
+        this.buffersInUse--;
+        this.send("load_status", { id: command.id, rid: command.rid, status: "success" });
+        this.onStored(command.id);
+      } else if (command.type === "enroll") {
+        // Như processEnrollment(): storeModel xong báo success, loop() sau tự gửi mẫu lên
+        this.send("enroll_status", { id: command.id, rid: command.rid, status: "success" });
+        await sleep(LOOP_MS + UPLOAD_MS);
+        this.sendTemplate(command.id);
+      } else if (command.type === "template_upload") {
+        await sleep(UPLOAD_MS);
+        this.sendTemplate(command.id, command.rid);
+      } else {
+        const bytes = Math.floor(CAPACITY / 8) + 1;
+        await sleep(INDEX_PAGE_MS * Math.ceil(bytes / 32));
+        const table = Buffer.alloc(bytes);
+        this.slots.forEach((_, slot) => (table[slot >> 3] |= 1 << (slot & 7)));
+        const payload = { rid: command.rid, status: "success", capacity: CAPACITY, count: this.slots.size };
+        this.send("inventory", { ...payload, bitmap: table.toString("hex") });
+      }
+    }
+    this.running = false;
+  }
+
+  // template_chunk như handleTemplateUpload(); rid = undefined khi tự gửi sau đăng ký
+  sendTemplate(id, rid) {
+    const data = this.slots.get(id);
+    for (let offset = 0; offset < data.length; offset += CHUNK_BYTES) {
+      const chunk = data.subarray(offset, offset + CHUNK_BYTES).toString("base64");
+      this.send("template_chunk", { id, rid, offset, total: data.length, data: chunk });
+    }
+  }
+}
+
+const connect = async (port, deviceId, slots) => {
+  const device = new Device(`ws://127.0.0.1:${port}/?deviceId=${deviceId}`, slots);
+  await new Promise((resolve) => device.ws.once("open", resolve));
+  return device;
+};
+
+const templateFor = (id) => crypto.createHash("sha512").update(String(id)).digest().toString("hex").repeat(8).slice(0, TEMPLATE_BYTES * 2);
+const libraryOf = (count) =>
+  new Map(Array.from({ length: count }, (_, i) => [i + 1, Buffer.from(templateFor(i + 1), "hex")]));
+
+async function replicateScenario(port, service) {
+  const devices = [];
+  for (let i = 0; i < opts.devices; i++) devices.push(await connect(port, `replica-${i}`));
+  await sleep(100);
+  const id = 7;
+  const data = Buffer.from(templateFor(id), "hex");
+  // Mẫu ID 8 gửi lên không qua đăng ký: server phải bỏ đi
+  const unsolicited = 8;
+  devices[0].slots.set(unsolicited, Buffer.from(templateFor(unsolicited), "hex"));
+  devices[0].sendTemplate(unsolicited);
+  const start = performance.now();
+  const stored = devices.slice(1).map(
+    (device) =>
+      new Promise((resolve) => {
+        device.onStored = (storedId) => storedId === id && resolve(performance.now() - start);
+      })
+  );
+  devices[0].slots.set(id, data);
+  await service.requestEnrollmentOnDevice("replica-0", id);
+  const times = await Promise.all(stored);
+  const identical = devices.slice(1).every((device) => device.slots.get(id)?.equals(data));
+  const unsolicitedDropped = devices.slice(1).every((device) => !device.slots.has(unsolicited));
+  devices.forEach((device) => device.ws.close());
+  return {
+    scenario: "replicate",
+    devices: opts.devices,
+    lastDeviceMs: Math.round(Math.max(...times)),
+    identical,
+    unsolicitedDropped,
+  };
+}
+
+async function provisionScenario(port, templateReplication, window) {
+  const deviceId = `provision-w${window}`;
+  const device = await connect(port, deviceId);
+  await sleep(100);
+  const report = await templateReplication.provision(deviceId, { window });
+  const identical = report.loaded.every((id) => device.slots.get(id)?.toString("hex") === templateFor(id));
+  device.ws.close();
+  return {
+    scenario: `provision window ${window}`,
+    loaded: report.loaded.length,
+    failed: report.failed.length,
+    ms: report.ms,
+    perSecond: +(report.loaded.length / (report.ms / 1000)).toFixed(2),
+    peakBuffers: device.peakBuffers,
+    rejected: device.rejected,
+    identical,
+  };
+}
+
+async function collectScenario(port, templateReplication, db) {
+  db.templates.clear();
+  const device = await connect(port, "collect", libraryOf(opts.templates));
+  await sleep(100);
+  const start = performance.now();
+  const report = await templateReplication.collect("collect");
+  const ms = performance.now() - start;
+  const identical = report.collected.every((id) => db.templates.get(id)?.data.equals(device.slots.get(id)));
+  device.ws.close();
+  return {
+    scenario: "collect",
+    collected: report.collected.length,
+    failed: report.failed.length,
+    ms: Math.round(ms),
+    perSecond: +(report.collected.length / (ms / 1000)).toFixed(2),
+    identical,
+  };
+}
+
+function storageScenario() {
+  const { BSON } = mongoose.mongo;
+  const data = Buffer.from(templateFor(1), "hex");
+  const doc = (value) => BSON.calculateObjectSize({ _id: new mongoose.Types.ObjectId(), templateId: 1, data: value });
+  return {
+    scenario: "storage (BSON bytes per template)",
+    buffer: doc(data),
+    base64: doc(data.toString("base64")),
+    numberArray: doc([...data]),
+  };
+}
+
+async function main() {
+  console.log = () => {};
+  console.warn = () => {};
+  const print = (line) => process.stdout.write(`${line}\n`);
+  const db = memoryDb.install({ users: opts.templates });
+  const service = require("../services/websocketService");
+  const templateReplication = require("../services/templateReplication");
+  const server = http.createServer();
+  service.initializeWebSocketServer(server);
+  await new Promise((resolve) => server.listen(0, "127.0.0.1", resolve));
+  const { port } = server.address();
+
+  print(`${opts.templates} templates, ${opts.devices} devices, rtt ${opts.rtt} ms`);
+  print(JSON.stringify(await replicateScenario(port, service)));
+  libraryOf(opts.templates).forEach((data, templateId) => db.templates.set(templateId, { templateId, data }));
+  for (const window of [1, templateReplication.LOAD_WINDOW]) {
+    print(JSON.stringify(await provisionScenario(port, templateReplication, window)));
+  }
+  print(JSON.stringify(await collectScenario(port, templateReplication, db)));
+  print(JSON.stringify(storageScenario()));
+  process.exit(0);
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
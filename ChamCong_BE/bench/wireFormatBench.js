@@ -0,0 +1,80 @@
+// bench/wireFormatBench.js
+// So sánh kích thước frame và thời gian encode/decode JSON với MessagePack
+// cho các loại tin nhắn thiết bị/server thực sự trao đổi.
+//
+// Trên Node, codec JS thuần của services/msgpack.js chậm hơn JSON.stringify/JSON.parse gốc
+// của V8 với hầu hết frame (dòng "Node CPU" cuối cùng): MessagePack tốn thêm CPU phía server
+// để đổi lấy frame nhỏ hơn và phần parse rẻ hơn trên thiết bị. Phía thiết bị đo bằng kịch bản
+// "msgpack" của ChamCongNhung/bench/LoopBench.cpp và stage wsEncode/wsDecode trong "metrics".
+//
+//   node bench/wireFormatBench.js [iterations]
+const msgpack = require("../services/msgpack");
+
+const ITERATIONS = parseInt(process.argv[2]) || 200000;
+
+const batchOf = (n) => ({
+  type: "scan_batch",
+  payload: {
+    last: 1000 + n,
+    scans: Array.from({ length: n }, (_, i) => ({
+      seq: 1001 + i,
+      id: 17 + i,
+      ts: 1718000000 + i * 3,
+    })),
+  },
+});
+
+const frames = {
+  heartbeat: { type: "heartbeat", payload: { status: "alive" } },
+  scan_result: {
+    type: "scan_result",
+    payload: { id: 17, seq: 1001, timestamp: "2024-06-10T08:01:02Z" },
+  },
+  scan_batch_10: batchOf(10),
+  enroll_status: {
+    type: "enroll_status",
+    payload: { id: 17, status: "processing", step: 1, message: "Place finger (1st time)" },
+  },
+  scan_ack: { type: "scan_ack", seq: 1010 },
+};
+
+const nsPerOp = (fn) => {
+  for (let i = 0; i < 1000; i++) fn(); // warm-up
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < ITERATIONS; i++) fn();
+  return Number(process.hrtime.bigint() - start) / ITERATIONS;
+};
+
+const rows = [];
+for (const [name, frame] of Object.entries(frames)) {
+  const json = JSON.stringify(frame);
+  const jsonBuf = Buffer.from(json);
+  const packed = msgpack.encode(frame);
+
+  if (JSON.stringify(msgpack.decode(packed)) !== json) {
+    throw new Error(`MessagePack round-trip mismatch for ${name}`);
+  }
+
+  rows.push({
+    frame: name,
+    jsonBytes: jsonBuf.length,
+    msgpackBytes: packed.length,
+    saved: `${Math.round((1 - packed.length / jsonBuf.length) * 100)}%`,
+    jsonEncodeNs: Math.round(nsPerOp(() => JSON.stringify(frame))),
+    msgpackEncodeNs: Math.round(nsPerOp(() => msgpack.encode(frame))),
+    // Server nhận Buffer: JSON cần toString() trước khi parse
+    jsonDecodeNs: Math.round(nsPerOp(() => JSON.parse(jsonBuf.toString()))),
+    msgpackDecodeNs: Math.round(nsPerOp(() => msgpack.decode(packed))),
+  });
+}
+
+console.log(`iterations=${ITERATIONS}`);
+console.table(rows);
+
+// Tổng trên một lượt của mọi loại frame: > 1x nghĩa là MessagePack tốn CPU server hơn JSON
+const sum = (key) => rows.reduce((total, row) => total + row[key], 0);
+const ratio = (packed, json) => (sum(packed) / sum(json)).toFixed(2);
+console.log(
+  `Node CPU, MessagePack / JSON: encode ${ratio("msgpackEncodeNs", "jsonEncodeNs")}x, ` +
+    `decode ${ratio("msgpackDecodeNs", "jsonDecodeNs")}x`
+);
@@ -0,0 +1,93 @@
+const websocketService = require('../services/websocketService');
+
+// Mốc bucket (ms) của histogram trong message "metrics", khớp metricBucketBoundsMs của
+// firmware: bucket i đếm giá trị < mốc i, bucket cuối là phần còn lại
+const METRIC_BUCKET_BOUNDS_MS = [1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000];
+
+// [i, n_i, n_i+1, ...] -> số mẫu và p50/p90/p99 (mốc trên của bucket chứa phân vị, không
+// vượt max thật), ms
+function summarizeHistogram(buckets, maxUs) {
+  const [first, ...counts] = buckets;
+  const n = counts.reduce((sum, count) => sum + count, 0);
+  const maxMs = Math.round((maxUs || 0) / 100) / 10;
+  const percentile = (q) => {
+    let seen = 0;
+    for (let i = 0; i < counts.length; i++) {
+      seen += counts[i];
+      if (seen >= q * n) {
+        const bound = METRIC_BUCKET_BOUNDS_MS[first + i];
+        return bound === undefined ? maxMs : Math.min(bound, maxMs);
+      }
+    }
+    return maxMs;
+  };
+  return { n, p50: percentile(0.5), p90: percentile(0.9), p99: percentile(0.99), maxMs };
+}
+
+function summarize(deviceId, entry) {
+  const { receivedAt, metrics, previous } = entry;
+  const counters = metrics.c || {};
+  const stages = {};
+  Object.entries(metrics.h || {}).forEach(([stage, buckets]) => {
+    if (Array.isArray(buckets) && buckets.length > 1) {
+      stages[stage] = summarizeHistogram(buckets, (metrics.max || {})[stage]);
+    }
+  });
+  const interval = {};
+  if (previous) {
+    Object.entries(counters).forEach(([name, value]) => {
+      interval[name] = value - ((previous.c || {})[name] || 0);
+    });
+  }
+  return {
+    deviceId,
+    connected: websocketService.clients.has(deviceId),
+    receivedAt,
+    uptimeS: metrics.up,
+    readyMs: metrics.ready, // Khởi động -> WebSocket kết nối lần đầu
+    intervalS: metrics.iv,
+    freeHeap: metrics.heap,
+    heapFragmentation: metrics.frag,
+    pendingScans: metrics.pending,
+    counters,
+    interval: previous ? interval : null, // Bộ đếm trong khoảng kể từ lần gửi trước
+    stages,
+  };
+}
+
+// GET /api/devices/metrics?sort=loop&limit=50 - Mọi thiết bị, chậm nhất (p99 của stage sort) trước
+exports.getFleetMetrics = (req, res) => {
+  try {
+    const sort = req.query.sort || 'loop';
+    const limit = Math.max(1, parseInt(req.query.limit, 10) || 50);
+    const devices = [...websocketService.deviceMetrics.entries()]
+      .map(([deviceId, entry]) => summarize(deviceId, entry))
+      .sort((a, b) => (b.stages[sort]?.p99 ?? -1) - (a.stages[sort]?.p99 ?? -1) ||
+        (b.stages[sort]?.maxMs ?? -1) - (a.stages[sort]?.maxMs ?? -1));
+    res.json({
+      status: 'success',
+      data: { sort, total: devices.length, devices: devices.slice(0, limit) }
+    });
+  } catch (error) {
+    res.status(500).json({
+      status: 'error',
+      message: error.message
+    });
+  }
+};
+
+// GET /api/devices/:deviceId/metrics - Lần gửi metrics gần nhất của một thiết bị
+exports.getDeviceMetrics = (req, res) => {
+  const { deviceId } = req.params;
+  const entry = websocketService.deviceMetrics.get(deviceId);
+  if (!entry) {
+    return res.status(404).json({
+      status: 'error',
+      message: `No metrics received from device ${deviceId}`
+    });
+  }
+  res.json({
+    status: 'success',
+    data: summarize(deviceId, entry)
+  });
+};
@@ -1,5 +1,7 @@
-const User = require("../models/userModel");
 const AttendanceLog = require("../models/attendanceLogModel");
+const scanCache = require("../services/scanCache");
+const logWriter = require("../services/logWriter");
+const dailySummary = require("../services/dailySummary");
 
 const EventType = {
   CHECK_IN: "CHECK_IN",
@@ -8,23 +10,42 @@ const EventType = {
 };
 
 const handleScanResult = async (deviceId, payload) => {
+  const start = process.hrtime.bigint();
+  try {
+    const scan = await resolveScan(deviceId, payload);
+    return scan.result || (await logScan(deviceId, scan));
+  } finally {
+    scanCache.recordLatency(Number(process.hrtime.bigint() - start) / 1e6);
+  }
+};
+
+// Bước 1: kiểm tra payload, tìm user và sự kiện cuối trong ngày (thường trúng cache).
+// Trả về { result } nếu lượt quét dừng ở đây, ngược lại những gì logScan() cần.
+const resolveScan = async (deviceId, payload) => {
   console.log(
     `[${deviceId}] Received scan_result payload:`,
     JSON.stringify(payload)
   );
 
-  const { id, timestamp } = payload;
+  const { id, timestamp, ts, ms, clk } = payload;
 
   if (id === undefined || id === null) {
     console.error(
       `[${deviceId}] Received invalid fingerprint template ID: ${id}`
     );
-    return { status: "error", message: "Invalid fingerprint template ID" };
+    return { result: { status: "error", message: "Invalid fingerprint template ID" } };
   }
 
   // Validate and assign timestamp
   let scanTimestamp;
-  if (timestamp) {
+  if (ts !== undefined && ts !== null) {
+    // scan_batch gửi epoch (giây) thay cho chuỗi ISO để gói tin nhỏ hơn, ms riêng nếu có
+    scanTimestamp = new Date(ts * 1000 + (ms || 0));
+    if (isNaN(scanTimestamp.getTime())) {
+      console.warn(`[${deviceId}] Invalid ts received: ${ts}. Using server time.`);
+      scanTimestamp = new Date();
+    }
+  } else if (timestamp) {
     scanTimestamp = new Date(timestamp);
     if (isNaN(scanTimestamp.getTime())) {
       console.warn(
@@ -40,69 +61,213 @@ const handleScanResult = async (deviceId, payload) => {
     console.log(`[${deviceId}] No timestamp provided. Using server time.`);
     scanTimestamp = new Date();
   }
+  // clk: { age (s), drift (ppm), err (ms) } — chất lượng đồng hồ thiết bị lúc gửi
+  const clockErrorMs = (ts != null || timestamp) && clk ? clk.err : undefined;
+  if (clockErrorMs > 1000) {
+    console.warn(
+      `[${deviceId}] Device clock uncertain: ±${clockErrorMs} ms, last NTP sync ${clk.age} s ago`
+    );
+  }
 
   try {
-    // 1. Tìm User bằng ID vị trí vân tay
-    const user = await User.findOne({ id: id, isActive: true });
-
-    if (user) {
-      console.log(
-        `[${deviceId}] Fingerprint scan match: User ${user.name} (ID: ${id})`
+    // 1. Tìm User bằng ID vị trí vân tay (cache, userController báo khi user đổi)
+    const user = await scanCache.findActiveUser(id);
+    if (!user) {
+      console.warn(
+        `[${deviceId}] No active user found for fingerprint template ID: ${id}`
       );
+      return { result: { status: "error", message: "No active user found for this fingerprint" } };
+    }
+    console.log(
+      `[${deviceId}] Fingerprint scan match: User ${user.name} (ID: ${id})`
+    );
 
-      // 2. Logic xác định Check-in/Check-out
-      const startOfDay = new Date(scanTimestamp);
-      startOfDay.setHours(0, 0, 0, 0);
-      const endOfDay = new Date(scanTimestamp);
-      endOfDay.setHours(23, 59, 59, 999);
-
-      const lastLogToday = await AttendanceLog.findOne({
-        user: user._id,
-        timestamp: { $gte: startOfDay, $lte: endOfDay },
-      }).sort({ timestamp: -1 });
-
-      let eventType = EventType.CHECK_IN; // Mặc định là check-in
-      if (lastLogToday && lastLogToday.eventType === EventType.CHECK_IN) {
-        eventType = EventType.CHECK_OUT; // Nếu log cuối là check-in -> giờ là check-out
-      }
-
-      // 3. Tạo bản ghi AttendanceLog
-      const newLog = new AttendanceLog({
-        user: user._id,
-        timestamp: scanTimestamp,
-        eventType: eventType,
-        deviceId: deviceId, // Include deviceId for tracking
-        fingerprintTemplateIdUsed: id, // Include fingerprint ID
-      });
-      await newLog.save();
-      user.updatedAt = scanTimestamp;
-      await user.save();
+    // 2. Sự kiện cuối trong ngày (cache) để xác định Check-in/Check-out
+    const lastEvent = await scanCache.lastEventOfDay(user._id, scanTimestamp);
+    return { payload, user, scanTimestamp, clockErrorMs, lastEvent };
+  } catch (error) {
+    console.error(
+      `[${deviceId}] Error processing scan result for ID ${id}:`,
+      error
+    );
+    // Lỗi DB tạm thời: không ack để thiết bị gửi lại
+    return { result: { status: "error", message: "Failed to process scan result", retry: true } };
+  }
+};
+
+// Mặc định là check-in; nếu log cuối là check-in -> giờ là check-out
+const nextEventType = (lastEvent) =>
+  lastEvent && lastEvent.eventType === EventType.CHECK_IN ? EventType.CHECK_OUT : EventType.CHECK_IN;
+
+// Bước 2, chạy đồng bộ tới lúc xếp hàng insert: quyết định CHECK_IN/CHECK_OUT và ghi vào cache
+// ngay, để lượt quét kế tiếp của cùng user (cùng batch hoặc từ thiết bị khác) thấy sự kiện này.
+// Promise trả về không reject: insert lỗi thì hoàn tác cache và trả kết quả retry.
+const logScan = (deviceId, scan) => {
+  const { payload, user, scanTimestamp, clockErrorMs, lastEvent } = scan;
+  const eventType = nextEventType(lastEvent);
+  const undoEvent = scanCache.recordEvent(user._id, scanTimestamp, eventType);
+
+  // 3. Tạo bản ghi AttendanceLog
+  const newLog = new AttendanceLog({
+    user: user._id,
+    timestamp: scanTimestamp,
+    eventType: eventType,
+    deviceId: deviceId, // Include deviceId for tracking
+    deviceSeq: payload.seq, // Số thứ tự journal trên thiết bị (nếu có)
+    deviceJournal: payload.j, // ... và journal mà seq đó thuộc về
+    fingerprintTemplateIdUsed: payload.id, // Include fingerprint ID
+    clockErrorMs,
+  });
+  // Gộp với lượt quét khác (cùng batch, thiết bị khác) thành một insertMany
+  return logWriter.insert(newLog).then(
+    () => {
+      scanCache.touchUser(user._id, scanTimestamp); // updatedAt = lần quét gần nhất, ghi gộp nền
+      dailySummary.record(user._id, scanTimestamp, eventType);
       console.log(
         `[${deviceId}] Attendance log saved for ${user.name}: ${eventType}`
       );
-
       return {
         status: "success",
         message: `Attendance logged for ${user.name}: ${eventType}`,
       };
-    } else {
-      console.warn(
-        `[${deviceId}] No active user found for fingerprint template ID: ${id}`
+    },
+    (error) => {
+      undoEvent();
+      console.error(
+        `[${deviceId}] Error saving attendance log for ID ${payload.id}:`,
+        error
       );
-      return {
-        status: "error",
-        message: "No active user found for this fingerprint",
-      };
+      return { status: "error", message: "Failed to process scan result", retry: true };
     }
-  } catch (error) {
-    console.error(
-      `[${deviceId}] Error processing scan result for ID ${id}:`,
-      error
+  );
+};
+
+// seq cao nhất đã xử lý cho từng thiết bị (giữ qua các lần kết nối lại), kèm journal của
+// seq đó: journal tạo lại trên thiết bị (mất meta, format flash) thì seq bắt đầu lại từ 1.
+// stored: seq > seq đã ghi vào DB nhưng chưa ack được (một seq trước đó ghi lỗi) - thiết bị
+// gửi lại thì bỏ qua, không ghi trùng.
+const lastSeqByDevice = new Map(); // Map<deviceId, { journal, seq, stored: Set<seq> }>
+
+// journal: "j" thiết bị gửi kèm mỗi lượt quét có seq
+const getSeqFloor = async (deviceId, journal) => {
+  const cached = lastSeqByDevice.get(deviceId);
+  if (cached && cached.journal === journal) return cached;
+  // Sau khi server khởi động lại hoặc thiết bị đổi journal: seq lớn nhất đã ghi của journal này
+  const lastLog = await AttendanceLog.findOne(
+    { deviceId, deviceJournal: journal, deviceSeq: { $ne: null } },
+    "deviceSeq"
+  )
+    .sort({ deviceSeq: -1 })
+    .lean();
+  const latest = lastSeqByDevice.get(deviceId);
+  if (latest && latest.journal === journal) return latest; // Batch khác đã nạp trong lúc chờ
+  if (cached) {
+    console.log(
+      `[${deviceId}] Journal changed (${cached.journal} -> ${journal}), seq floor ${cached.seq} -> ${lastLog ? lastLog.deviceSeq : 0}`
     );
-    return { status: "error", message: "Failed to process scan result" };
   }
+  const floor = { journal, seq: lastLog ? lastLog.deviceSeq : 0, stored: new Set() };
+  lastSeqByDevice.set(deviceId, floor);
+  return floor;
+};
+
+// Xử lý các lượt quét theo thứ tự seq. Trả về seq cao nhất đã xử lý liên tục
+// (ack tích luỹ) — bản ghi có seq <= giá trị này thiết bị có thể xoá khỏi journal.
+//
+// CHECK_IN/CHECK_OUT được quyết định lần lượt theo seq, insert của cả batch xếp vào logWriter
+// cùng lúc (một insertMany) rồi mới chờ; ack tiến tới hết đoạn liên tục ghi thành công.
+const handleSequencedScans = async (deviceId, scans, lastInBatch, journal) => {
+  // seq không có journal thì không biết so với mốc nào: bỏ cả frame, không ack
+  if (!Number.isInteger(journal) || journal <= 0) {
+    console.warn(`[${deviceId}] Sequenced scans without journal id ignored`);
+    return 0;
+  }
+  const floor = await getSeqFloor(deviceId, journal);
+  const ordered = [...scans].sort((a, b) => a.seq - b.seq);
+
+  const pending = []; // [{ seq, result: Promise }] theo seq
+  // Sự kiện đã xếp trong batch này theo user + ngày: ngày chưa nạp vào cache đọc từ DB,
+  // nơi insert của batch chưa vào
+  const queuedEvents = new Map();
+  for (const scan of ordered) {
+    if (scan.seq <= floor.seq || floor.stored.has(scan.seq)) {
+      console.log(`[${deviceId}] Duplicate scan seq ${scan.seq} ignored`);
+      if (scan.seq > floor.seq) pending.push({ seq: scan.seq, result: Promise.resolve(null) });
+      continue;
+    }
+    const start = process.hrtime.bigint();
+    const resolved = await resolveScan(deviceId, { ...scan, j: journal });
+    if (resolved.result) {
+      pending.push({ seq: scan.seq, result: Promise.resolve(resolved.result) });
+      if (resolved.result.retry) break;
+      continue;
+    }
+    const key = `${resolved.user._id}:${resolved.scanTimestamp.toDateString()}`;
+    const queued = queuedEvents.get(key);
+    if (queued && (!resolved.lastEvent || queued.timestamp >= resolved.lastEvent.timestamp)) {
+      resolved.lastEvent = queued;
+    }
+    queuedEvents.set(key, { timestamp: resolved.scanTimestamp, eventType: nextEventType(resolved.lastEvent) });
+    const result = logScan(deviceId, resolved).finally(() =>
+      scanCache.recordLatency(Number(process.hrtime.bigint() - start) / 1e6)
+    );
+    pending.push({ seq: scan.seq, result });
+  }
+
+  const results = await Promise.allSettled(pending.map((item) => item.result));
+  let contiguous = true;
+  results.forEach(({ status, value }, i) => {
+    const { seq } = pending[i];
+    const ok = status === "fulfilled" && !(value && value.retry);
+    if (ok && contiguous && seq > floor.seq) {
+      floor.seq = seq;
+    } else if (ok && seq > floor.seq) {
+      floor.stored.add(seq);
+    } else if (!ok) {
+      contiguous = false;
+    }
+  });
+  // Các seq ghi trước đó đã nối liền với floor
+  while (floor.stored.delete(floor.seq + 1)) floor.seq++;
+  floor.stored.forEach((seq) => seq <= floor.seq && floor.stored.delete(seq));
+
+  // Thiết bị bỏ qua bản ghi hỏng ở cuối batch: ack luôn cả phần đó
+  if (
+    lastInBatch &&
+    lastInBatch > floor.seq &&
+    ordered.every((scan) => scan.seq <= floor.seq)
+  ) {
+    floor.seq = lastInBatch;
+  }
+  return floor.seq;
+};
+
+const handleScanBatch = async (deviceId, payload) => {
+  const scans = Array.isArray(payload?.scans) ? payload.scans : [];
+  console.log(
+    `[${deviceId}] Received scan_batch with ${scans.length} scans (last seq ${payload?.last})`
+  );
+  // Chất lượng đồng hồ gửi một lần cho cả batch
+  const clk = payload?.clk;
+  return handleSequencedScans(
+    deviceId,
+    clk ? scans.map((scan) => ({ ...scan, clk })) : scans,
+    payload?.last,
+    payload?.j
+  );
+};
+
+// GET /api/scan-metrics - Tỉ lệ trúng cache, độ trễ xử lý lượt quét và ghi log theo lô
+const getScanMetrics = (req, res) => {
+  res.json({
+    status: "success",
+    data: { ...scanCache.metrics(), ingest: logWriter.metrics(), dailySummary: dailySummary.metrics() },
+  });
 };
 
 module.exports = {
+  getScanMetrics,
   handleScanResult,
+  handleScanBatch,
+  handleSequencedScans,
 };
@@ -0,0 +1,54 @@
+// controllers/inventoryController.js
+// Đối chiếu thư viện mẫu trên cảm biến của thiết bị với DB (services/templateInventory) và
+// nạp/thu mẫu giữa thiết bị và server (services/templateReplication).
+const websocketService = require("../services/websocketService");
+const templateInventory = require("../services/templateInventory");
+const templateReplication = require("../services/templateReplication");
+
+const sendError = (res, error) => {
+  if (error.message.includes("timed out")) {
+    res.status(408).json({ status: "error", message: error.message });
+  } else if (error.message.includes("Failed to send")) {
+    res.status(502).json({ status: "error", message: error.message });
+  } else {
+    res.status(500).json({ status: "error", message: error.message || "Inventory failed." });
+  }
+};
+
+const runOnDevice = async (req, res, action, work) => {
+  const { deviceId } = req.params;
+  if (!websocketService.clients.has(deviceId)) {
+    return res.status(404).json({ status: "error", message: `Device ${deviceId} is not connected.` });
+  }
+  try {
+    const report = await work(deviceId);
+    res.json({ success: "success", statusCode: 200, data: report });
+  } catch (error) {
+    console.error(`Error ${action} templates on ${deviceId}:`, error);
+    sendError(res, error);
+  }
+};
+
+const runReconcile = (req, res, repair) =>
+  runOnDevice(req, res, "reconciling", (deviceId) => templateInventory.reconcile(deviceId, { repair }));
+
+// GET /api/devices/:deviceId/inventory - Slot có mẫu trên thiết bị, orphan và missing so với DB
+const getInventory = (req, res) => runReconcile(req, res, false);
+
+// POST /api/devices/:deviceId/inventory/repair - Như trên, rồi xoá các orphan theo dải
+const repairInventory = (req, res) => runReconcile(req, res, true);
+
+// POST /api/devices/:deviceId/templates/provision - Nạp hàng loạt mẫu đã lưu của các user còn thiếu
+const provisionTemplates = (req, res) =>
+  runOnDevice(req, res, "provisioning", (deviceId) => templateReplication.provision(deviceId));
+
+// POST /api/devices/:deviceId/templates/collect - Đọc lên các mẫu có trên thiết bị mà server chưa lưu
+const collectTemplates = (req, res) =>
+  runOnDevice(req, res, "collecting", (deviceId) => templateReplication.collect(deviceId));
+
+module.exports = {
+  getInventory,
+  repairInventory,
+  provisionTemplates,
+  collectTemplates,
+};
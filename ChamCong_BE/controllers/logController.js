@@ -1,12 +1,55 @@
+const mongoose = require("mongoose");
 const AttendanceLog = require("../models/attendanceLogModel");
 const User = require("../models/userModel"); // Cần để populate
 const ExcelJS = require("exceljs");
 
+// Trang log sắp xếp theo (timestamp, _id) giảm dần - khớp index { timestamp: -1, _id: -1 } và
+// { user: 1, timestamp: -1, _id: -1 }. _id phân định các log cùng timestamp nên thứ tự ổn định.
+//
+// Keyset: ?cursor=<nextCursor của trang trước> lấy các log đứng sau log cuối trang đó, đọc đúng
+// pageSize khoá trên index dù sâu bao nhiêu. ?page=N vẫn dùng được (skip, chậm dần theo N).
+// ?total=exact|approx|none: mặc định exact cho ?page (cần totalPages), approx cho cursor.
+const LOG_FIELDS = "user timestamp eventType deviceId fingerprintTemplateIdUsed";
+const MAX_PAGE_SIZE = 200;
+const APPROX_TOTAL_CAP = 10000; // total=approx: đếm tới đây thì dừng, totalLogs là cận dưới
+
+const encodeCursor = (log) => Buffer.from(`${log.timestamp.getTime()}:${log._id}`).toString("base64url");
+
+const decodeCursor = (cursor) => {
+  const [ms, id] = Buffer.from(String(cursor), "base64url").toString().split(":");
+  const timestamp = new Date(Number(ms));
+  if (!ms || Number.isNaN(timestamp.getTime()) || !/^[0-9a-f]{24}$/i.test(id || "")) return null;
+  return { timestamp, _id: new mongoose.Types.ObjectId(id) };
+};
+
+// { totalLogs, totalIsExact }; filter rỗng thì approx đọc số document từ metadata collection
+const countLogs = async (filter, mode) => {
+  if (mode === "none") return { totalLogs: null, totalIsExact: false };
+  if (mode === "exact") return { totalLogs: await AttendanceLog.countDocuments(filter), totalIsExact: true };
+  if (Object.keys(filter).length === 0) {
+    return { totalLogs: await AttendanceLog.estimatedDocumentCount(), totalIsExact: false };
+  }
+  const totalLogs = await AttendanceLog.countDocuments(filter).limit(APPROX_TOTAL_CAP);
+  return { totalLogs, totalIsExact: totalLogs < APPROX_TOTAL_CAP };
+};
+
 const getLogs = async (req, res) => {
   try {
-    // Lấy tham số query (ví dụ: ?page=1&pageSize=20&userId=abc&startDate=...&endDate=...)
-    const page = parseInt(req.query.page) || 1;
-    const pageSize = parseInt(req.query.pageSize) || 20;
+    // Lấy tham số query (ví dụ: ?pageSize=20&cursor=...&userId=abc&startDate=...&endDate=...)
+    const pageSize = Math.min(parseInt(req.query.pageSize) || 20, MAX_PAGE_SIZE);
+    const after = req.query.cursor ? decodeCursor(req.query.cursor) : null;
+    if (req.query.cursor && !after) {
+      return res.status(400).json({
+        status: "error",
+        message: "Invalid cursor.",
+        statusCode: 400,
+      });
+    }
+    const isPageMode = !after && req.query.page !== undefined;
+    const page = isPageMode ? parseInt(req.query.page) || 1 : null;
+    const totalMode = ["exact", "approx", "none"].includes(req.query.total)
+      ? req.query.total
+      : isPageMode ? "exact" : "approx";
     const userIdFilter = req.query.userId; // Lọc theo userId của hệ thống
     const startDate = req.query.startDate
       ? new Date(req.query.startDate)
@@ -17,7 +60,7 @@ const getLogs = async (req, res) => {
     // Xây dựng bộ lọc động
     if (userIdFilter) {
       // Cần tìm _id của user từ userId trước khi lọc AttendanceLog
-      const user = await User.findOne({ userId: userIdFilter }, "_id");
+      const user = await User.findOne({ userId: userIdFilter }, "_id").lean();
       if (user) {
         filter.user = user._id; // Lọc theo ObjectId của user
       } else {
@@ -29,6 +72,8 @@ const getLogs = async (req, res) => {
           pageSize: pageSize,
           totalPages: 0,
           totalLogs: 0,
+          nextCursor: null,
+          hasMore: false,
         });
       }
     }
@@ -43,34 +88,46 @@ const getLogs = async (req, res) => {
       }
     }
 
-    const skip = (page - 1) * pageSize;
+    // Tổng đếm trên bộ lọc gốc (không có điều kiện cursor), chạy song song với truy vấn trang
+    const totalPromise = countLogs({ ...filter }, totalMode);
 
-    const logs = await AttendanceLog.find(filter)
-      .populate("user", "name msv userId") // Lấy kèm thông tin user cần thiết
-      .sort({ timestamp: -1 }) // Sắp xếp mới nhất lên đầu
-      .skip(skip)
-      .limit(pageSize)
-      .lean(); // Trả về plain JS objects
+    const pageFilter = { ...filter };
+    if (after) {
+      // Cận trên của timestamp nằm trên index; log cùng timestamp với cursor được lọc theo _id
+      pageFilter.timestamp = { ...filter.timestamp };
+      if (!pageFilter.timestamp.$lte || pageFilter.timestamp.$lte > after.timestamp) {
+        pageFilter.timestamp.$lte = after.timestamp;
+      }
+      pageFilter.$or = [{ timestamp: { $lt: after.timestamp } }, { _id: { $lt: after._id } }];
+    }
 
-    // Giữ nguyên timestamp UTC
-    const logsWithLocalTime = logs.map(log => ({
-      ...log,
-      timestamp: log.timestamp
-    }));
+    let query = AttendanceLog.find(pageFilter, LOG_FIELDS)
+      .sort({ timestamp: -1, _id: -1 }) // Mới nhất lên đầu
+      .limit(pageSize + 1); // Thêm một dòng để biết còn trang sau không
+    if (isPageMode) query = query.skip((page - 1) * pageSize);
+    const [rows, { totalLogs, totalIsExact }] = await Promise.all([
+      query
+        .populate("user", "name msv userId") // Lấy kèm thông tin user cần thiết
+        .lean(), // Trả về plain JS objects
+      totalPromise,
+    ]);
 
-    const totalLogs = await AttendanceLog.countDocuments(filter);
-    const totalPages = Math.ceil(totalLogs / pageSize);
+    const hasMore = rows.length > pageSize;
+    const logs = hasMore ? rows.slice(0, pageSize) : rows;
 
     res.json({
       success: "success",
       statusCode: 200,
       message: "Logs fetched successfully",
       data: {
-        data: logsWithLocalTime,
+        data: logs,
         page,
         pageSize,
-        totalPages,
+        totalPages: totalLogs === null ? null : Math.ceil(totalLogs / pageSize),
         totalLogs,
+        totalIsExact,
+        nextCursor: hasMore ? encodeCursor(logs[logs.length - 1]) : null,
+        hasMore,
       },
     });
   } catch (error) {
@@ -83,11 +140,47 @@ const getLogs = async (req, res) => {
   }
 };
 
+// Định dạng giống toLocaleTimeString/toLocaleDateString("vi-VN") nhưng tạo một lần,
+// không dựng lại Intl formatter cho mỗi dòng
+const timeFormat = new Intl.DateTimeFormat("vi-VN", {
+  hour: "2-digit",
+  minute: "2-digit",
+  second: "2-digit",
+});
+const dateFormat = new Intl.DateTimeFormat("vi-VN");
+
+const EXPORT_FLUSH_ROWS = 500; // Sau mỗi chừng này dòng: đẩy ra response, chờ drain nếu client chậm
+const EXPORT_CURSOR_BATCH = 1000;
+
+// Ô bắt đầu bằng = + - @ (hoặc tab/CR) bị Excel/Sheets hiểu là công thức: thêm ' phía trước.
+// xlsx không cần: ExcelJS ghi chuỗi thành ô chuỗi, không bao giờ thành công thức.
+const csvCell = (value) => {
+  let text = String(value);
+  if (/^[=+\-@\t\r]/.test(text)) text = `'${text}`;
+  return /[",\r\n]/.test(text) ? `"${text.replace(/"/g, '""')}"` : text;
+};
+
+const waitForDrain = (res) =>
+  new Promise((resolve) => {
+    const done = () => {
+      res.off("drain", done);
+      res.off("close", done);
+      resolve();
+    };
+    res.on("drain", done);
+    res.on("close", done);
+  });
+
+// GET /api/export-excel?format=csv|xlsx - Xuất log chấm công theo bộ lọc như /logs.
+// Đọc bằng cursor và ghi thẳng ra response (xlsx qua WorkbookWriter, csv thì ghi tay),
+// nên bộ nhớ không tăng theo số dòng và client nhận byte đầu tiên ngay.
 const downloadExcel = async (req, res) => {
+  let cursor = null;
   try {
     const userIdFilter = req.query.userId;
     const startDate = req.query.startDate ? new Date(req.query.startDate) : null;
     const endDate = req.query.endDate ? new Date(req.query.endDate) : null;
+    const isCsv = req.query.format === "csv";
 
     const filter = {};
     if (userIdFilter) {
@@ -112,56 +205,98 @@ const downloadExcel = async (req, res) => {
       }
     }
 
-    const logs = await AttendanceLog.find(filter)
-      .populate("user", "name msv userId")
-      .sort({ timestamp: -1 })
-      .lean();
-
-    const totalLogs = await AttendanceLog.countDocuments(filter);
-
-    // Create Excel workbook and worksheet
-    const workbook = new ExcelJS.Workbook();
-    const worksheet = workbook.addWorksheet("Attendance Logs");
-
-    // Define columns
-    worksheet.columns = [
-      { header: "STT", key: "stt", width: 10 },
-      { header: "Tên", key: "name", width: 20 },
-      { header: "Thời gian", key: "time", width: 15 },
-      { header: "Ngày", key: "date", width: 15 },
-      { header: "Trạng thái", key: "eventType", width: 15 },
-    ];
-
-    // Add rows
-    logs.forEach((log, index) => {
-      worksheet.addRow({
-        stt: totalLogs - index,
-        name: log.user?.name || "Unknown",
-        time: new Date(log.timestamp).toLocaleTimeString("vi-VN"),
-        date: new Date(log.timestamp).toLocaleDateString("vi-VN"),
-        eventType: log.eventType === "CHECK_IN" ? "Vào" : "Ra",
-      });
-    });
-
-    // Style the header row
-    worksheet.getRow(1).font = { bold: true };
-    worksheet.getRow(1).alignment = { vertical: "middle", horizontal: "center" };
+    // Tên user lấy một lần (bảng nhỏ) thay cho populate từng lô log
+    const [totalLogs, users] = await Promise.all([
+      AttendanceLog.countDocuments(filter),
+      User.find({}, "name").lean(),
+    ]);
+    const userNames = new Map(users.map((user) => [String(user._id), user.name]));
 
-    // Set response headers
+    const fileName = `attendance_logs_${new Date().toISOString().split("T")[0]}`;
     res.setHeader(
       "Content-Type",
-      "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"
+      isCsv
+        ? "text/csv; charset=utf-8"
+        : "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"
     );
     res.setHeader(
       "Content-Disposition",
-      `attachment; filename=attendance_logs_${new Date().toISOString().split("T")[0]}.xlsx`
+      `attachment; filename=${fileName}.${isCsv ? "csv" : "xlsx"}`
     );
+    res.flushHeaders();
+
+    cursor = AttendanceLog.find(filter, "user timestamp eventType")
+      .sort({ timestamp: -1 })
+      .lean()
+      .cursor({ batchSize: EXPORT_CURSOR_BATCH });
+    res.on("close", () => cursor.close().catch(() => {})); // Client huỷ tải: dừng đọc DB
 
-    // Write to buffer and send
-    const buffer = await workbook.xlsx.writeBuffer();
-    res.send(buffer);
+    let workbook = null;
+    let worksheet = null;
+    let csvChunk = "";
+    if (isCsv) {
+      csvChunk = "\uFEFFSTT,Tên,Thời gian,Ngày,Trạng thái\r\n"; // BOM để Excel đọc đúng UTF-8
+    } else {
+      workbook = new ExcelJS.stream.xlsx.WorkbookWriter({
+        stream: res,
+        useStyles: true,
+        useSharedStrings: false,
+      });
+      worksheet = workbook.addWorksheet("Attendance Logs");
+      worksheet.columns = [
+        { header: "STT", key: "stt", width: 10 },
+        { header: "Tên", key: "name", width: 20 },
+        { header: "Thời gian", key: "time", width: 15 },
+        { header: "Ngày", key: "date", width: 15 },
+        { header: "Trạng thái", key: "eventType", width: 15 },
+      ];
+      const header = worksheet.getRow(1);
+      header.font = { bold: true };
+      header.alignment = { vertical: "middle", horizontal: "center" };
+      header.commit();
+    }
+
+    let index = 0;
+    for await (const log of cursor) {
+      if (res.destroyed) break;
+      const timestamp = new Date(log.timestamp);
+      const row = {
+        stt: totalLogs - index,
+        name: userNames.get(String(log.user)) || "Unknown",
+        time: timeFormat.format(timestamp),
+        date: dateFormat.format(timestamp),
+        eventType: log.eventType === "CHECK_IN" ? "Vào" : "Ra",
+      };
+      index++;
+
+      if (isCsv) {
+        csvChunk += `${row.stt},${csvCell(row.name)},${row.time},${row.date},${row.eventType}\r\n`;
+      } else {
+        worksheet.addRow(row).commit();
+      }
+      if (index % EXPORT_FLUSH_ROWS === 0) {
+        if (isCsv) {
+          res.write(csvChunk);
+          csvChunk = "";
+        }
+        if (res.writableNeedDrain) await waitForDrain(res);
+      }
+    }
+
+    if (res.destroyed) return;
+    if (isCsv) {
+      res.end(csvChunk);
+    } else {
+      worksheet.commit();
+      await workbook.commit(); // Ghi phần cuối file zip rồi end() response
+    }
   } catch (error) {
     console.error("Error generating Excel file:", error);
+    if (cursor) cursor.close().catch(() => {});
+    if (res.headersSent) {
+      res.destroy(error); // Đã gửi một phần file: cắt kết nối để client biết file hỏng
+      return;
+    }
     res.status(500).json({
       status: "error",
       message: "Failed to generate Excel file.",
@@ -0,0 +1,108 @@
+// controllers/reportController.js
+// Báo cáo chấm công đọc từ DailyAttendance (một bản ghi mỗi user mỗi ngày), không quét
+// AttendanceLog: chi phí theo số user x số ngày, không theo số lượt quét.
+const DailyAttendance = require("../models/dailyAttendanceModel");
+const User = require("../models/userModel");
+const { dayStartOf } = require("../services/scanCache");
+
+const userInfoMap = async () => {
+  const users = await User.find({}, "name msv userId").lean();
+  return new Map(users.map((user) => [String(user._id), user]));
+};
+
+const withUser = (users, summary) => {
+  const user = users.get(String(summary.user || summary._id));
+  return {
+    ...summary,
+    name: user?.name || "Unknown",
+    msv: user?.msv,
+    userId: user?.userId,
+  };
+};
+
+// GET /api/reports/daily?date=YYYY-MM-DD - Tổng hợp từng user trong một ngày
+const getDailySummary = async (req, res) => {
+  try {
+    const date = req.query.date ? new Date(req.query.date) : new Date();
+    if (isNaN(date.getTime())) {
+      return res.status(400).json({ status: "error", message: "Invalid date." });
+    }
+    const day = new Date(dayStartOf(date));
+
+    const [summaries, users] = await Promise.all([
+      DailyAttendance.find({ day }, "-_id user firstIn lastOut punches workedMs openSince").lean(),
+      userInfoMap(),
+    ]);
+
+    res.json({
+      success: "success",
+      statusCode: 200,
+      data: { day, users: summaries.map((summary) => withUser(users, summary)) },
+    });
+  } catch (error) {
+    console.error("Error fetching daily summary:", error);
+    res.status(500).json({ status: "error", message: "Failed to fetch daily summary." });
+  }
+};
+
+// GET /api/reports/monthly?month=YYYY-MM[&userId=...] - Tổng theo user trong tháng;
+// có userId thì kèm chi tiết từng ngày của user đó
+const getMonthlyReport = async (req, res) => {
+  try {
+    const [year, month] = (req.query.month || "").split("-").map((part) => parseInt(part));
+    const now = new Date();
+    const start = new Date(year || now.getFullYear(), month ? month - 1 : now.getMonth(), 1);
+    const end = new Date(start.getFullYear(), start.getMonth() + 1, 1);
+    if (isNaN(start.getTime())) {
+      return res.status(400).json({ status: "error", message: "Invalid month." });
+    }
+
+    const filter = { day: { $gte: start, $lt: end } };
+    let days = null;
+    if (req.query.userId) {
+      const user = await User.findOne({ userId: req.query.userId }, "_id").lean();
+      if (!user) {
+        return res.status(404).json({ status: "error", message: "User not found." });
+      }
+      filter.user = user._id;
+      days = await DailyAttendance.find(filter, "-_id day firstIn lastOut punches workedMs")
+        .sort({ day: 1 })
+        .lean();
+    }
+
+    const [totals, users] = await Promise.all([
+      DailyAttendance.aggregate([
+        { $match: filter },
+        {
+          $group: {
+            _id: "$user",
+            daysPresent: { $sum: 1 },
+            punches: { $sum: "$punches" },
+            workedMs: { $sum: "$workedMs" },
+            earliestIn: { $min: "$firstIn" },
+            latestOut: { $max: "$lastOut" },
+          },
+        },
+      ]),
+      userInfoMap(),
+    ]);
+
+    res.json({
+      success: "success",
+      statusCode: 200,
+      data: {
+        month: `${start.getFullYear()}-${String(start.getMonth() + 1).padStart(2, "0")}`,
+        users: totals.map(({ _id, ...total }) => withUser(users, { user: _id, ...total })),
+        ...(days ? { days } : {}),
+      },
+    });
+  } catch (error) {
+    console.error("Error fetching monthly report:", error);
+    res.status(500).json({ status: "error", message: "Failed to fetch monthly report." });
+  }
+};
+
+module.exports = {
+  getDailySummary,
+  getMonthlyReport,
+};
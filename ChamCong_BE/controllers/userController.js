@@ -1,6 +1,9 @@
 // controllers/userController.js
 const User = require("../models/userModel");
 const websocketService = require("../services/websocketService");
+const userDirectory = require("../services/userDirectory");
+const scanCache = require("../services/scanCache");
+const templateReplication = require("../services/templateReplication");
 const { v4: uuidv4 } = require("uuid"); // Import nếu bạn dùng userId tự sinh
 
 // Thêm Map để lưu trữ thông tin tiến trình đăng ký
@@ -13,6 +16,7 @@ async function findAvailableTemplateId() {
   try {
     console.log("Searching for available fingerprint template ID...");
 
+    // Kể cả user đã xoá (isActive = false): mẫu của họ có thể còn trên thiết bị offline
     const usedUsers = await User.find({ id: { $ne: null } }, "id -_id").lean();
 
     const usedIdSet = new Set(usedUsers.map((u) => u.id));
@@ -27,7 +31,7 @@ async function findAvailableTemplateId() {
     while (availableId <= MAX_FINGERPRINT_CAPACITY) {
       const isUsedInDb = usedIdSet.has(availableId);
       const isPendingEnroll =
-        websocketService.pendingEnrollment.has(availableId);
+        websocketService.isEnrollmentPending(availableId);
 
       if (!isUsedInDb && !isPendingEnroll) {
         console.log(`Found available template ID: ${availableId}`);
@@ -164,6 +168,8 @@ const updateUser = async (req, res) => {
         .json({ status: "error", message: "User not found." });
     }
 
+    await userDirectory.upsertUser(updatedUser); // Đổi tên/khoá: thiết bị nhận delta
+    scanCache.invalidateTemplate(updatedUser.id);
     res.json({ success: "success", statusCode: 200, data: updatedUser });
   } catch (error) {
     console.error(`Error updating user ${req.params.userId}:`, error);
@@ -294,6 +300,8 @@ const requestEnrollment = async (req, res) => {
             id: availableId,
           });
           await newUser.save();
+          await userDirectory.upsertUser(newUser);
+          scanCache.invalidateTemplate(availableId);
 
           // Cập nhật thông tin tiến trình
           websocketService.setEnrollmentProgress(availableId, {
@@ -420,6 +428,10 @@ const initiateDeleteUser = async (req, res) => {
         { $set: { isActive: false } }, // Đặt là inactive và xóa liên kết vân tay
         { new: true }
       ).lean();
+      await userDirectory.removeTemplate(fingerprintTemplateId);
+      // Mẫu đã được sao chép sang các thiết bị khác: xoá ở đó nữa. User giữ id (không cấp lại)
+      await templateReplication.forget(fingerprintTemplateId, deviceId);
+      scanCache.invalidateTemplate(fingerprintTemplateId);
 
       console.log(
         `Successfully deleted fingerprint ${fingerprintTemplateId} from device. User ${userIdToDelete} status updated in DB.`
@@ -26,6 +26,24 @@ const attendanceLogSchema = new mongoose.Schema(
       enum: [EventType.CHECK_IN, EventType.CHECK_OUT, EventType.SCAN],
       default: EventType.SCAN,
     },
+    deviceId: {
+      type: String,
+    },
+    deviceSeq: {
+      // Số thứ tự journal của thiết bị, dùng để bỏ qua lượt quét gửi lại
+      type: Number,
+    },
+    deviceJournal: {
+      // Id journal của thiết bị: seq chỉ so được trong cùng journal
+      type: Number,
+    },
+    fingerprintTemplateIdUsed: {
+      type: Number,
+    },
+    clockErrorMs: {
+      // Sai số đồng hồ thiết bị tự ước lượng lúc gửi (không có = server tự gán giờ)
+      type: Number,
+    },
     // *** CẬP NHẬT ENUM Ở ĐÂY ***
     // method: {
     //   type: String,
@@ -37,7 +55,12 @@ const attendanceLogSchema = new mongoose.Schema(
   { timestamps: { createdAt: "loggedAt" } }
 ); // Thời điểm log được ghi vào DB
 
-attendanceLogSchema.index({ user: 1, timestamp: -1 });
+// Trang log (getLogs) sắp xếp theo (timestamp, _id) và phân trang keyset trên đúng thứ tự đó;
+// lọc khoảng ngày của mọi user dùng index thứ hai thay vì quét cả collection.
+// Index cũ { user: 1, timestamp: -1 } là tiền tố của index đầu, xoá được sau khi index mới build xong.
+attendanceLogSchema.index({ user: 1, timestamp: -1, _id: -1 });
+attendanceLogSchema.index({ timestamp: -1, _id: -1 });
+attendanceLogSchema.index({ deviceId: 1, deviceJournal: 1, deviceSeq: -1 }, { sparse: true });
 
 const AttendanceLog = mongoose.model("AttendanceLog", attendanceLogSchema);
 
@@ -0,0 +1,35 @@
+const mongoose = require("mongoose");
+const Schema = mongoose.Schema;
+
+// Tổng hợp chấm công của một user trong một ngày, cập nhật dần theo từng lượt quét
+// (services/dailySummary.js). Báo cáo đọc bảng này thay cho quét AttendanceLog.
+const dailyAttendanceSchema = new mongoose.Schema(
+  {
+    user: {
+      type: Schema.Types.ObjectId,
+      ref: "User",
+      required: true,
+    },
+    day: {
+      // 00:00 của ngày (giờ server, cùng quy ước với bộ lọc ngày của /logs)
+      type: Date,
+      required: true,
+    },
+    firstIn: { type: Date }, // CHECK_IN sớm nhất
+    lastOut: { type: Date }, // CHECK_OUT muộn nhất
+    punches: { type: Number, default: 0 },
+    workedMs: { type: Number, default: 0 }, // Tổng các cặp vào -> ra
+    openSince: { type: Date }, // CHECK_IN chưa có CHECK_OUT tương ứng
+    lastEventAt: { type: Date },
+    stale: { type: Boolean }, // Có lượt quét tới muộn, chờ tính lại từ AttendanceLog
+  },
+  { versionKey: false }
+);
+
+dailyAttendanceSchema.index({ user: 1, day: 1 }, { unique: true });
+dailyAttendanceSchema.index({ day: 1 });
+dailyAttendanceSchema.index({ stale: 1 }, { partialFilterExpression: { stale: true } });
+
+const DailyAttendance = mongoose.model("DailyAttendance", dailyAttendanceSchema);
+
+module.exports = DailyAttendance;
@@ -0,0 +1,25 @@
+const mongoose = require("mongoose");
+
+// Đặc trưng vân tay (UpChar của cảm biến, 512 byte) theo slot/User.id, để nạp vào các thiết
+// bị khác (services/templateReplication.js). Lưu dạng nhị phân: 512 byte thay vì ~684 ký tự
+// base64 hay mảng số.
+const fingerprintTemplateSchema = new mongoose.Schema(
+  {
+    templateId: {
+      type: Number,
+      required: true,
+      unique: true,
+    },
+    data: {
+      type: Buffer,
+      required: true,
+    },
+    size: { type: Number },
+    sourceDeviceId: { type: String }, // Thiết bị đã đăng ký / gửi mẫu lên
+  },
+  { timestamps: true, versionKey: false }
+);
+
+const FingerprintTemplate = mongoose.model("FingerprintTemplate", fingerprintTemplateSchema);
+
+module.exports = FingerprintTemplate;
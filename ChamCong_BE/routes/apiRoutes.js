@@ -3,15 +3,28 @@ const express = require('express');
 const statusController = require('../controllers/statusController');
 const logController = require('../controllers/logController');
 const userController = require('../controllers/userController');
+const fingerprintController = require('../controllers/fingerprintController');
+const reportController = require('../controllers/reportController');
+const inventoryController = require('../controllers/inventoryController');
+const deviceMetricsController = require('../controllers/deviceMetricsController');
 
 const router = express.Router();
 
 // Device Status SSE
 router.get('/device-status', statusController.getDeviceStatusSSE);
 
+// Độ trễ/bộ đếm thiết bị gửi lên (message "metrics")
+router.get('/devices/metrics', deviceMetricsController.getFleetMetrics); // ?sort=loop|search|wsSend|...&limit=
+router.get('/devices/:deviceId/metrics', deviceMetricsController.getDeviceMetrics);
+
 // Attendance Logs
 router.get('/logs', logController.getLogs);
-router.get('/export-excel', logController.downloadExcel);
+router.get('/export-excel', logController.downloadExcel); // ?format=csv: xuất CSV (nhanh hơn xlsx)
+router.get('/scan-metrics', fingerprintController.getScanMetrics); // Cache, độ trễ xử lý lượt quét, ghi log theo lô
+
+// Reports (đọc từ DailyAttendance)
+router.get('/reports/daily', reportController.getDailySummary);
+router.get('/reports/monthly', reportController.getMonthlyReport);
 
 // User Management
 router.get('/users', userController.getUsers);
@@ -19,6 +32,12 @@ router.post('/users', userController.addUser); // API thêm user cơ bản
 router.put('/users/:userId', userController.updateUser); // Cập nhật user theo userId
 router.delete('/users/:userId', userController.initiateDeleteUser); // Xóa user và vân tay
 
+// Thư viện mẫu trên thiết bị (so với DB)
+router.get('/devices/:deviceId/inventory', inventoryController.getInventory);
+router.post('/devices/:deviceId/inventory/repair', inventoryController.repairInventory); // Xoá slot orphan theo dải
+router.post('/devices/:deviceId/templates/provision', inventoryController.provisionTemplates); // Nạp mẫu còn thiếu
+router.post('/devices/:deviceId/templates/collect', inventoryController.collectTemplates); // Thu mẫu chưa lưu
+
 // Fingerprint Enrollment
 router.post('/enroll/request', userController.requestEnrollment); // Yêu cầu bắt đầu đăng ký
 router.get('/enroll/progress/:id', userController.getEnrollmentProgress);
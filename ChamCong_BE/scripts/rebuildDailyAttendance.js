@@ -0,0 +1,34 @@
+// scripts/rebuildDailyAttendance.js
+// Tính lại DailyAttendance từ AttendanceLog (backfill lần đầu, hoặc sửa các ngày bị lệch).
+//
+//   node scripts/rebuildDailyAttendance.js                       # toàn bộ
+//   node scripts/rebuildDailyAttendance.js 2025-01-01 2025-01-31 # từ ngày .. tới ngày
+const mongoose = require("mongoose");
+const connectDB = require("../services/databaseService");
+const dailySummary = require("../services/dailySummary");
+const DailyAttendance = require("../models/dailyAttendanceModel");
+
+async function main() {
+  const [from, to] = process.argv.slice(2).map((arg) => new Date(arg));
+  if ((from && isNaN(from.getTime())) || (to && isNaN(to.getTime()))) {
+    console.error("Usage: node scripts/rebuildDailyAttendance.js [fromDate] [toDate]");
+    process.exit(1);
+  }
+
+  await connectDB();
+  await DailyAttendance.init(); // Tạo index (user, day) trước khi ghi
+
+  const start = Date.now();
+  const { logs, summaries } = await dailySummary.rebuild(from, to);
+  console.log(
+    `Rebuilt ${summaries} daily summaries from ${logs} logs` +
+      `${from ? ` (${from.toDateString()} .. ${(to || new Date()).toDateString()})` : ""}` +
+      ` in ${((Date.now() - start) / 1000).toFixed(1)} s`
+  );
+  await mongoose.disconnect();
+}
+
+main().catch((error) => {
+  console.error("Rebuild failed:", error);
+  process.exit(1);
+});
@@ -0,0 +1,193 @@
+// services/dailySummary.js
+// Giữ DailyAttendance (user, ngày) khớp với AttendanceLog:
+//
+//   - record(): mỗi lượt quét đã ghi vào DB đẩy một lệnh cập nhật (pipeline update,
+//     upsert) vào hàng đợi; gộp ghi bằng một bulkWrite có thứ tự mỗi giây, nên các
+//     sự kiện của cùng user được áp dụng đúng thứ tự nhận. Lượt quét tới muộn (journal
+//     gửi lại sau khi mất mạng) có thời gian trước lastEventAt: không ghép cặp theo thứ
+//     tự nhận mà đánh dấu stale, flush() tính lại (user, ngày) đó từ AttendanceLog.
+//   - rebuild(): tính lại từ AttendanceLog cho một khoảng ngày (backfill, sửa lệch sau
+//     khi ghi summary lỗi hoặc lượt quét cũ tới muộn).
+const AttendanceLog = require("../models/attendanceLogModel");
+const DailyAttendance = require("../models/dailyAttendanceModel");
+const { dayStartOf } = require("./scanCache");
+
+const FLUSH_MS = 1000;
+const REBUILD_CURSOR_BATCH = 5000;
+const REBUILD_WRITE_BATCH = 1000;
+const STALE = { $set: { stale: true } };
+
+// Gộp các sự kiện của một user trong một ngày (đã sắp theo thời gian) thành summary.
+// Cùng quy tắc với update() bên dưới: cặp vào -> ra cộng vào workedMs.
+const summarize = (events) => {
+  const summary = { punches: 0, workedMs: 0, firstIn: null, lastOut: null, openSince: null, lastEventAt: null };
+  for (const { timestamp, eventType } of events) {
+    summary.punches++;
+    summary.lastEventAt = timestamp;
+    if (eventType === "CHECK_IN") {
+      if (!summary.firstIn || timestamp < summary.firstIn) summary.firstIn = timestamp;
+      summary.openSince = timestamp;
+    } else if (eventType === "CHECK_OUT") {
+      if (!summary.lastOut || timestamp > summary.lastOut) summary.lastOut = timestamp;
+      if (summary.openSince && timestamp >= summary.openSince) summary.workedMs += timestamp - summary.openSince;
+      summary.openSince = null;
+    }
+  }
+  return summary;
+};
+
+// Pipeline update tương đương một bước của summarize(), chạy nguyên tử trên server.
+// Chỉ đúng khi sự kiện tới theo thứ tự thời gian; sự kiện cũ hơn lastEventAt chỉ cập nhật
+// punches/firstIn/lastOut và đặt stale để tính lại cả ngày.
+const update = (timestamp, eventType) => {
+  const lastEventAt = { $ifNull: ["$lastEventAt", timestamp] };
+  const inOrder = { $gte: [timestamp, lastEventAt] };
+  const set = {
+    punches: { $add: [{ $ifNull: ["$punches", 0] }, 1] },
+    workedMs: { $ifNull: ["$workedMs", 0] },
+    lastEventAt: { $max: [lastEventAt, timestamp] },
+    stale: { $or: [{ $ifNull: ["$stale", false] }, { $not: [inOrder] }] },
+  };
+  if (eventType === "CHECK_IN") {
+    set.firstIn = { $min: [{ $ifNull: ["$firstIn", timestamp] }, timestamp] };
+    set.openSince = { $cond: [inOrder, timestamp, "$openSince"] };
+  } else if (eventType === "CHECK_OUT") {
+    const paired = { $and: [inOrder, { $ifNull: ["$openSince", false] }, { $gte: [timestamp, "$openSince"] }] };
+    set.lastOut = { $max: [{ $ifNull: ["$lastOut", timestamp] }, timestamp] };
+    set.workedMs = {
+      $add: [{ $ifNull: ["$workedMs", 0] }, { $cond: [paired, { $subtract: [timestamp, "$openSince"] }, 0] }],
+    };
+    set.openSince = { $cond: [inOrder, null, "$openSince"] };
+  }
+  return [{ $set: set }];
+};
+
+const dayKey = (user, day) => `${user}|${new Date(day).getTime()}`;
+
+class DailySummary {
+  constructor() {
+    this.pending = [];
+    this.timer = null;
+    this.flushing = Promise.resolve(); // Các lần flush chạy nối tiếp
+    this.recomputing = new Set(); // dayKey đang được tính lại từ AttendanceLog
+    this.stats = { updates: 0, flushes: 0, failed: 0, recomputed: 0 };
+  }
+
+  record(userId, timestamp, eventType) {
+    const day = new Date(dayStartOf(timestamp));
+    this.pending.push({
+      updateOne: {
+        filter: { user: userId, day },
+        update: this.recomputing.has(dayKey(userId, day)) ? STALE : update(timestamp, eventType),
+        upsert: true,
+      },
+    });
+    if (!this.timer) this.timer = setTimeout(() => this.flush(), FLUSH_MS);
+  }
+
+  flush() {
+    if (this.timer) clearTimeout(this.timer);
+    this.timer = null;
+    this.flushing = this.flushing.then(() => this.write());
+    return this.flushing;
+  }
+
+  async write() {
+    if (!this.pending.length) return;
+    const ops = this.pending;
+    this.pending = [];
+    try {
+      await DailyAttendance.bulkWrite(ops, { ordered: true });
+      this.stats.updates += ops.length;
+    } catch (error) {
+      // Không thử lại (có thể đã áp dụng một phần): chạy rebuild cho ngày đó để sửa
+      this.stats.failed += ops.length;
+      console.error("[DailySummary] Failed to update daily attendance, rebuild needed:", error);
+    }
+    this.stats.flushes++;
+    try {
+      const stale = await DailyAttendance.find({ stale: true }, "user day").lean();
+      for (const { user, day } of stale) await this.recompute(user, day);
+    } catch (error) {
+      console.error("[DailySummary] Failed to recompute late scans, rebuild needed:", error);
+    }
+  }
+
+  // Tính lại một (user, ngày) từ AttendanceLog. Sự kiện ghi nhận trong lúc đang tính (log
+  // có thể đã hoặc chưa nằm trong kết quả đọc) không cộng dồn mà chỉ đặt lại stale, nên
+  // ngày đó được tính lại lần nữa ở lần flush sau thay vì bị cộng hai lần.
+  async recompute(user, day) {
+    const key = dayKey(user, day);
+    this.recomputing.add(key);
+    for (const op of this.pending) {
+      if (dayKey(op.updateOne.filter.user, op.updateOne.filter.day) === key) op.updateOne.update = STALE;
+    }
+    try {
+      const events = await AttendanceLog.find(
+        { user, timestamp: { $gte: day, $lt: new Date(day.getTime() + 86400000) } },
+        "timestamp eventType"
+      )
+        .sort({ timestamp: 1 })
+        .lean();
+      await DailyAttendance.replaceOne({ user, day }, { user, day, ...summarize(events) }, { upsert: true });
+      this.stats.recomputed++;
+    } finally {
+      this.recomputing.delete(key);
+    }
+  }
+
+  // Tính lại summary của các ngày trong [from, to] từ AttendanceLog.
+  // Nên chạy lúc không có lượt quét của các ngày đó (backfill / sửa ngày cũ).
+  async rebuild(from, to) {
+    const range = {};
+    if (from) range.$gte = new Date(dayStartOf(from));
+    if (to) range.$lt = new Date(dayStartOf(to) + 86400000);
+    const logFilter = Object.keys(range).length ? { timestamp: range } : {};
+    const dayFilter = Object.keys(range).length ? { day: range } : {};
+
+    await this.flush(); // Cập nhật đang chờ không được ghi đè lên kết quả rebuild
+    await DailyAttendance.deleteMany(dayFilter);
+
+    // Theo (user, thời gian): đi ngược index { user: 1, timestamp: -1, _id: -1 } nên không
+    // phải sort trong bộ nhớ; mỗi lúc chỉ giữ sự kiện của một (user, ngày)
+    const cursor = AttendanceLog.find(logFilter, "user timestamp eventType")
+      .sort({ user: -1, timestamp: 1, _id: 1 })
+      .lean()
+      .cursor({ batchSize: REBUILD_CURSOR_BATCH });
+
+    let ops = [];
+    let current = null; // { user, day, events }
+    let logs = 0;
+    let summaries = 0;
+    const emit = async () => {
+      if (!current) return;
+      const document = { user: current.user, day: new Date(current.day), ...summarize(current.events) };
+      ops.push({ insertOne: { document } });
+      summaries++;
+      if (ops.length >= REBUILD_WRITE_BATCH) {
+        await DailyAttendance.bulkWrite(ops, { ordered: false });
+        ops = [];
+      }
+    };
+
+    for await (const log of cursor) {
+      logs++;
+      const day = dayStartOf(log.timestamp);
+      if (!current || String(current.user) !== String(log.user) || current.day !== day) {
+        await emit();
+        current = { user: log.user, day, events: [] };
+      }
+      current.events.push(log);
+    }
+    await emit();
+    if (ops.length) await DailyAttendance.bulkWrite(ops, { ordered: false });
+    return { logs, summaries };
+  }
+
+  metrics() {
+    return { ...this.stats, pending: this.pending.length };
+  }
+}
+
+module.exports = new DailySummary();
+module.exports.summarize = summarize;
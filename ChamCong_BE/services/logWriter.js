@@ -0,0 +1,118 @@
+// services/logWriter.js
+// Gộp các lệnh ghi AttendanceLog: lượt quét từ nhiều thiết bị cùng lúc (giờ vào ca)
+// được gom vài ms hoặc tới BATCH_MAX bản ghi rồi ghi bằng một insertMany không
+// thứ tự. Lúc không có lệnh ghi nào đang chạy thì ghi ngay ở vòng event loop kế tiếp
+// (không chờ cửa sổ), nên lúc vắng thiết bị không bị chậm hơn save().
+//
+// Promise của từng lượt quét chỉ xong khi bản ghi của nó đã vào DB (hoặc reject với
+// lỗi riêng của bản ghi đó), nên ack gửi thiết bị vẫn đúng như khi dùng save().
+const AttendanceLog = require("../models/attendanceLogModel");
+const SampleWindow = require("./sampleWindow");
+
+const BATCH_MAX = 100; // Đủ thì ghi ngay, không chờ hết cửa sổ
+const FLUSH_MS = 2; // Cửa sổ gom: bản ghi đầu tiên chờ tối đa chừng này
+const MAX_IN_FLIGHT = 4; // insertMany chạy song song; hết chỗ thì tiếp tục gom
+const SAMPLES = 1024;
+
+class LogWriter {
+  constructor() {
+    this.queue = []; // [{ doc, resolve, reject, queuedAt }]
+    this.timer = null;
+    this.inFlight = 0;
+
+    this.stats = { batches: 0, records: 0, failed: 0, batchErrors: 0 };
+    this.batchSizes = new SampleWindow(SAMPLES);
+    this.insertMs = new SampleWindow(SAMPLES); // Thời gian một insertMany
+    this.waitMs = new SampleWindow(SAMPLES); // Từ lúc xếp hàng tới lúc ghi xong
+  }
+
+  // Ghi một AttendanceLog (document chưa lưu). Resolve khi đã vào DB.
+  insert(doc) {
+    const error = doc.validateSync();
+    if (error) return Promise.reject(error);
+
+    return new Promise((resolve, reject) => {
+      this.queue.push({ doc, resolve, reject, queuedAt: process.hrtime.bigint() });
+      if (this.queue.length >= BATCH_MAX) {
+        this.flush();
+      } else if (!this.timer) {
+        this.timer = this.inFlight
+          ? setTimeout(() => this.flush(), FLUSH_MS)
+          : setImmediate(() => this.flush());
+      }
+    });
+  }
+
+  flush() {
+    if (this.timer) {
+      clearTimeout(this.timer);
+      clearImmediate(this.timer);
+      this.timer = null;
+    }
+    // Hết chỗ: giữ lại, insertMany đang chạy xong sẽ gọi flush() tiếp
+    while (this.queue.length && this.inFlight < MAX_IN_FLIGHT) {
+      this.write(this.queue.splice(0, BATCH_MAX));
+    }
+  }
+
+  async write(entries) {
+    this.inFlight++;
+    const start = process.hrtime.bigint();
+    // failures[i]: lỗi riêng của bản ghi i (trùng khoá...), các bản ghi khác vẫn được ghi
+    const failures = new Array(entries.length);
+    try {
+      const result = await AttendanceLog.insertMany(
+        entries.map((entry) => entry.doc),
+        { ordered: false, rawResult: true }
+      );
+      (result?.mongoose?.validationErrors || []).forEach((error) => {
+        const index = result.mongoose.results.indexOf(error);
+        if (index >= 0) failures[index] = error;
+      });
+    } catch (error) {
+      if (Array.isArray(error.writeErrors)) {
+        error.writeErrors.forEach((writeError) => {
+          const cause = writeError.err || writeError;
+          failures[writeError.index] = Object.assign(new Error(cause.errmsg || error.message), {
+            code: cause.code,
+          });
+        });
+      } else {
+        // Lỗi cả lô (mất kết nối...): không biết bản ghi nào đã vào, báo lỗi hết để thiết bị gửi lại
+        this.stats.batchErrors++;
+        failures.fill(error);
+      }
+    }
+
+    const end = process.hrtime.bigint();
+    this.stats.batches++;
+    this.batchSizes.add(entries.length);
+    this.insertMs.add(Number(end - start) / 1e6);
+    entries.forEach((entry, i) => {
+      this.waitMs.add(Number(end - entry.queuedAt) / 1e6);
+      if (failures[i]) {
+        this.stats.failed++;
+        entry.reject(failures[i]);
+      } else {
+        this.stats.records++;
+        entry.resolve(entry.doc);
+      }
+    });
+
+    this.inFlight--;
+    if (this.queue.length && !this.timer) this.flush();
+  }
+
+  metrics() {
+    return {
+      ...this.stats,
+      queued: this.queue.length,
+      inFlight: this.inFlight,
+      batchSize: this.batchSizes.summary(),
+      insertMs: this.insertMs.summary(),
+      waitMs: this.waitMs.summary(),
+    };
+  }
+}
+
+module.exports = new LogWriter();
@@ -0,0 +1,255 @@
+// services/msgpack.js
+// Bộ mã hoá/giải mã MessagePack tối giản cho giao tiếp với thiết bị
+// (tương thích serializeMsgPack/deserializeMsgPack của ArduinoJson).
+// Hỗ trợ: nil, bool, số nguyên/số thực, chuỗi, bin (Buffer), mảng, map.
+// Chậm hơn JSON gốc của V8 (bench/wireFormatBench.js): lợi ích nằm ở byte truyền và CPU
+// của thiết bị, không phải CPU server.
+
+// Buffer dùng lại giữa các lần encode (chỉ cấp phát lại khi không đủ chỗ)
+let scratch = Buffer.allocUnsafe(1024);
+
+const encode = (value) => {
+  let pos = 0;
+  const ensure = (n) => {
+    if (pos + n > scratch.length) {
+      const bigger = Buffer.allocUnsafe(Math.max(scratch.length * 2, pos + n));
+      scratch.copy(bigger, 0, 0, pos);
+      scratch = bigger;
+    }
+  };
+  const u8 = (b) => {
+    scratch[pos++] = b;
+  };
+  const u16 = (v) => {
+    scratch.writeUInt16BE(v, pos);
+    pos += 2;
+  };
+  const u32 = (v) => {
+    scratch.writeUInt32BE(v, pos);
+    pos += 4;
+  };
+
+  const writeString = (v) => {
+    // Độ dài UTF-8 tối đa 3 byte/ký tự (UTF-16); chuỗi ASCII ngắn ghi trực tiếp
+    ensure(5 + v.length * 3);
+    let ascii = v.length < 32;
+    for (let i = 0; ascii && i < v.length; i++) {
+      if (v.charCodeAt(i) > 0x7f) ascii = false;
+    }
+    if (ascii) {
+      u8(0xa0 | v.length);
+      for (let i = 0; i < v.length; i++) scratch[pos++] = v.charCodeAt(i);
+      return;
+    }
+    const len = Buffer.byteLength(v, "utf8");
+    if (len < 32) u8(0xa0 | len);
+    else if (len < 0x100) {
+      u8(0xd9);
+      u8(len);
+    } else if (len < 0x10000) {
+      u8(0xda);
+      u16(len);
+    } else {
+      u8(0xdb);
+      u32(len);
+    }
+    pos += scratch.write(v, pos, "utf8");
+  };
+
+  const writeNumber = (n) => {
+    ensure(9);
+    if (!Number.isSafeInteger(n)) {
+      u8(0xcb);
+      scratch.writeDoubleBE(n, pos);
+      pos += 8;
+    } else if (n >= 0) {
+      if (n < 0x80) u8(n);
+      else if (n < 0x100) {
+        u8(0xcc);
+        u8(n);
+      } else if (n < 0x10000) {
+        u8(0xcd);
+        u16(n);
+      } else if (n <= 0xffffffff) {
+        u8(0xce);
+        u32(n);
+      } else {
+        u8(0xcf);
+        scratch.writeBigUInt64BE(BigInt(n), pos);
+        pos += 8;
+      }
+    } else if (n >= -32) {
+      u8(n & 0xff);
+    } else if (n >= -0x80) {
+      u8(0xd0);
+      u8(n & 0xff);
+    } else if (n >= -0x8000) {
+      u8(0xd1);
+      scratch.writeInt16BE(n, pos);
+      pos += 2;
+    } else if (n >= -0x80000000) {
+      u8(0xd2);
+      scratch.writeInt32BE(n, pos);
+      pos += 4;
+    } else {
+      u8(0xd3);
+      scratch.writeBigInt64BE(BigInt(n), pos);
+      pos += 8;
+    }
+  };
+
+  const writeHeader = (len, fix, fixMax, op16, op32) => {
+    ensure(5);
+    if (len < fixMax) u8(fix | len);
+    else if (len < 0x10000) {
+      u8(op16);
+      u16(len);
+    } else {
+      u8(op32);
+      u32(len);
+    }
+  };
+
+  const write = (v) => {
+    if (v === null || v === undefined) {
+      ensure(1);
+      u8(0xc0);
+    } else if (v === false || v === true) {
+      ensure(1);
+      u8(v ? 0xc3 : 0xc2);
+    } else if (typeof v === "number") {
+      writeNumber(v);
+    } else if (typeof v === "string") {
+      writeString(v);
+    } else if (Buffer.isBuffer(v)) {
+      const len = v.length;
+      ensure(5 + len);
+      if (len < 0x100) {
+        u8(0xc4);
+        u8(len);
+      } else if (len < 0x10000) {
+        u8(0xc5);
+        u16(len);
+      } else {
+        u8(0xc6);
+        u32(len);
+      }
+      v.copy(scratch, pos);
+      pos += len;
+    } else if (Array.isArray(v)) {
+      writeHeader(v.length, 0x90, 16, 0xdc, 0xdd);
+      for (let i = 0; i < v.length; i++) write(v[i]);
+    } else if (v instanceof Date) {
+      writeString(v.toISOString());
+    } else if (typeof v === "object") {
+      let len = 0;
+      for (const k in v) if (v[k] !== undefined) len++;
+      writeHeader(len, 0x80, 16, 0xde, 0xdf);
+      for (const k in v) {
+        if (v[k] === undefined) continue;
+        writeString(k);
+        write(v[k]);
+      }
+    } else {
+      throw new TypeError(`Cannot encode ${typeof v} as MessagePack`);
+    }
+  };
+
+  write(value);
+  return Buffer.from(scratch.subarray(0, pos));
+};
+
+const decode = (buffer) => {
+  let pos = 0;
+  const need = (n) => {
+    if (pos + n > buffer.length) {
+      throw new RangeError("Truncated MessagePack data");
+    }
+  };
+  const readStr = (len) => {
+    need(len);
+    let str;
+    if (len < 16) {
+      // Khoá/chuỗi ngắn ASCII: ghép trực tiếp nhanh hơn toString()
+      str = "";
+      for (let i = pos; i < pos + len; i++) {
+        const c = buffer[i];
+        if (c > 0x7f) {
+          str = buffer.toString("utf8", pos, pos + len);
+          break;
+        }
+        str += String.fromCharCode(c);
+      }
+    } else {
+      str = buffer.toString("utf8", pos, pos + len);
+    }
+    pos += len;
+    return str;
+  };
+  const readBin = (len) => {
+    need(len);
+    const bin = buffer.subarray(pos, pos + len);
+    pos += len;
+    return bin;
+  };
+  const readArray = (len) => {
+    const arr = new Array(len);
+    for (let i = 0; i < len; i++) arr[i] = read();
+    return arr;
+  };
+  const readMap = (len) => {
+    const obj = {};
+    for (let i = 0; i < len; i++) {
+      const key = read();
+      obj[key] = read();
+    }
+    return obj;
+  };
+
+  const read = () => {
+    need(1);
+    const b = buffer[pos++];
+    if (b < 0x80) return b;
+    if (b >= 0xe0) return b - 0x100;
+    if ((b & 0xf0) === 0x80) return readMap(b & 0x0f);
+    if ((b & 0xf0) === 0x90) return readArray(b & 0x0f);
+    if ((b & 0xe0) === 0xa0) return readStr(b & 0x1f);
+
+    let v;
+    switch (b) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xc4: need(1); return readBin(buffer[pos++]);
+      case 0xc5: need(2); v = buffer.readUInt16BE(pos); pos += 2; return readBin(v);
+      case 0xc6: need(4); v = buffer.readUInt32BE(pos); pos += 4; return readBin(v);
+      case 0xca: need(4); v = buffer.readFloatBE(pos); pos += 4; return v;
+      case 0xcb: need(8); v = buffer.readDoubleBE(pos); pos += 8; return v;
+      case 0xcc: need(1); return buffer[pos++];
+      case 0xcd: need(2); v = buffer.readUInt16BE(pos); pos += 2; return v;
+      case 0xce: need(4); v = buffer.readUInt32BE(pos); pos += 4; return v;
+      case 0xcf: need(8); v = Number(buffer.readBigUInt64BE(pos)); pos += 8; return v;
+      case 0xd0: need(1); v = buffer.readInt8(pos); pos += 1; return v;
+      case 0xd1: need(2); v = buffer.readInt16BE(pos); pos += 2; return v;
+      case 0xd2: need(4); v = buffer.readInt32BE(pos); pos += 4; return v;
+      case 0xd3: need(8); v = Number(buffer.readBigInt64BE(pos)); pos += 8; return v;
+      case 0xd9: need(1); return readStr(buffer[pos++]);
+      case 0xda: need(2); v = buffer.readUInt16BE(pos); pos += 2; return readStr(v);
+      case 0xdb: need(4); v = buffer.readUInt32BE(pos); pos += 4; return readStr(v);
+      case 0xdc: need(2); v = buffer.readUInt16BE(pos); pos += 2; return readArray(v);
+      case 0xdd: need(4); v = buffer.readUInt32BE(pos); pos += 4; return readArray(v);
+      case 0xde: need(2); v = buffer.readUInt16BE(pos); pos += 2; return readMap(v);
+      case 0xdf: need(4); v = buffer.readUInt32BE(pos); pos += 4; return readMap(v);
+      default:
+        throw new TypeError(`Unsupported MessagePack type 0x${b.toString(16)}`);
+    }
+  };
+
+  const value = read();
+  if (pos !== buffer.length) {
+    throw new RangeError("Trailing bytes after MessagePack value");
+  }
+  return value;
+};
+
+module.exports = { encode, decode };
@@ -0,0 +1,30 @@
+// services/sampleWindow.js
+// Cửa sổ N mẫu gần nhất (vòng tròn) để tính p50/p99 cho các metrics nội bộ.
+class SampleWindow {
+  constructor(size) {
+    this.samples = new Float64Array(size);
+    this.count = 0;
+  }
+
+  add(value) {
+    this.samples[this.count % this.samples.length] = value;
+    this.count++;
+  }
+
+  summary() {
+    const sorted = Array.from(this.samples.subarray(0, Math.min(this.count, this.samples.length))).sort(
+      (a, b) => a - b
+    );
+    const at = (p) =>
+      sorted.length ? sorted[Math.min(sorted.length - 1, Math.round((p / 100) * (sorted.length - 1)))] : 0;
+    return {
+      samples: sorted.length,
+      total: this.count,
+      p50: +at(50).toFixed(2),
+      p99: +at(99).toFixed(2),
+      max: +(sorted[sorted.length - 1] || 0).toFixed(2),
+    };
+  }
+}
+
+module.exports = SampleWindow;
@@ -0,0 +1,202 @@
+// services/scanCache.js
+// Cache trong tiến trình cho đường xử lý lượt quét (fingerprintController.handleScanResult):
+//
+//   - users: template id -> user (lean: _id, name, isActive). Nạp cả bảng một lần,
+//     userController gọi invalidateTemplate() sau mỗi lần ghi user có vân tay.
+//   - lastEvents: user -> sự kiện cuối cùng trong ngày (CHECK_IN/CHECK_OUT). Lần đầu gặp
+//     một ngày mới, một aggregate lấy sự kiện cuối của mọi user trong ngày đó; sau đó
+//     lượt quét nào cũng tự cập nhật cache, nên trường hợp thường chỉ còn lệnh insert.
+//
+// Chỉ đúng khi AttendanceLog chỉ được ghi qua handleScanResult của tiến trình này
+// (một instance server, như hiện tại).
+const User = require("../models/userModel");
+const AttendanceLog = require("../models/attendanceLogModel");
+const SampleWindow = require("./sampleWindow");
+
+const LATENCY_SAMPLES = 4096; // Số lần xử lý gần nhất dùng để tính p50/p99
+const TOUCH_FLUSH_MS = 1000; // Gộp cập nhật updatedAt của user, ghi một lần mỗi giây
+
+const dayStartOf = (date) => {
+  const start = new Date(date);
+  start.setHours(0, 0, 0, 0);
+  return start.getTime();
+};
+
+class ScanCache {
+  constructor() {
+    this.users = new Map(); // Map<templateId, user | null>
+    this.usersLoading = null;
+    this.staleTemplates = new Set(); // Đã đổi trong DB, đọc lại lần sau
+
+    this.lastEvents = new Map(); // Map<user _id (string), { timestamp, eventType }>
+    this.primedDay = null; // dayStart (ms) mà lastEvents đang phản ánh đầy đủ
+    this.priming = null;
+
+    this.pendingTouches = new Map(); // Map<user _id (string), Date>
+    this.touchTimer = null;
+
+    this.stats = { userHits: 0, userMisses: 0, dayHits: 0, dayMisses: 0 };
+    this.latencies = new SampleWindow(LATENCY_SAMPLES);
+  }
+
+  loadUsers() {
+    if (!this.usersLoading) {
+      this.usersLoading = User.find({ id: { $ne: null } }, "id name isActive")
+        .lean()
+        .then((users) => {
+          users.forEach((user) => this.users.set(user.id, user));
+        })
+        .catch((error) => {
+          this.usersLoading = null;
+          throw error;
+        });
+    }
+    return this.usersLoading;
+  }
+
+  // User đang hoạt động có vân tay templateId, null nếu không có
+  async findActiveUser(templateId) {
+    await this.loadUsers();
+    let user;
+    if (this.staleTemplates.has(templateId)) {
+      this.stats.userMisses++;
+      this.staleTemplates.delete(templateId);
+      user = await User.findOne({ id: templateId }, "id name isActive").lean();
+      this.users.set(templateId, user);
+    } else {
+      this.stats.userHits++;
+      user = this.users.get(templateId);
+    }
+    return user && user.isActive ? user : null;
+  }
+
+  invalidateTemplate(templateId) {
+    if (templateId == null) return;
+    this.users.delete(templateId);
+    this.staleTemplates.add(templateId);
+  }
+
+  // Ngày mới hơn ngày đang cache thì nạp ngày đó. Timestamp của thiết bị theo giờ
+  // GMT+7 nên "hôm nay" của nó có thể lệch một ngày so với đồng hồ server.
+  isNewerDay(day) {
+    const now = Date.now();
+    return (
+      (this.primedDay === null || day > this.primedDay) &&
+      day >= dayStartOf(now - 86400000) &&
+      day <= dayStartOf(now + 86400000)
+    );
+  }
+
+  // Sự kiện cuối của user trong ngày chứa timestamp: { timestamp, eventType } hoặc null
+  async lastEventOfDay(userId, timestamp) {
+    const day = dayStartOf(timestamp);
+    let waited = false; // Phải chờ aggregate của ngày mới: tính là miss
+    if (this.isNewerDay(day)) {
+      waited = true;
+      await this.primeDay(day).catch((error) =>
+        console.error("[ScanCache] Cannot load today's attendance state:", error)
+      );
+    }
+    if (day === this.primedDay) {
+      if (waited) this.stats.dayMisses++;
+      else this.stats.dayHits++;
+      return this.lastEvents.get(String(userId)) || null;
+    }
+
+    // Ngày khác (lượt quét cũ gửi bù): hỏi DB như trước
+    this.stats.dayMisses++;
+    return AttendanceLog.findOne(
+      { user: userId, timestamp: { $gte: new Date(day), $lte: new Date(day + 86400000 - 1) } },
+      "timestamp eventType"
+    )
+      .sort({ timestamp: -1 })
+      .lean();
+  }
+
+  primeDay(day) {
+    if (!this.priming || this.priming.day !== day) {
+      const promise = AttendanceLog.aggregate([
+        { $match: { timestamp: { $gte: new Date(day), $lte: new Date(day + 86400000 - 1) } } },
+        { $sort: { timestamp: -1 } },
+        { $group: { _id: "$user", timestamp: { $first: "$timestamp" }, eventType: { $first: "$eventType" } } },
+      ]).then((rows) => {
+        if (this.primedDay !== null && this.primedDay > day) return; // Ngày mới hơn đã nạp xong trước
+        this.lastEvents.clear();
+        rows.forEach((row) =>
+          this.lastEvents.set(String(row._id), { timestamp: row.timestamp, eventType: row.eventType })
+        );
+        this.primedDay = day;
+        console.log(`[ScanCache] Loaded attendance state of ${rows.length} users for ${new Date(day).toDateString()}`);
+      });
+      this.priming = { day, promise };
+      promise.catch(() => {
+        if (this.priming && this.priming.promise === promise) this.priming = null;
+      });
+    }
+    return this.priming.promise;
+  }
+
+  // Ghi nhận sự kiện vừa quyết định (trước khi insert, để lượt quét đồng thời của cùng
+  // user thấy ngay). Trả về hàm hoàn tác nếu insert thất bại; sự kiện sau đó đã thay chỗ
+  // (lượt quét kế tiếp cùng batch) thì giữ nguyên.
+  recordEvent(userId, timestamp, eventType) {
+    const key = String(userId);
+    if (dayStartOf(timestamp) !== this.primedDay) return () => {};
+    const previous = this.lastEvents.get(key);
+    if (previous && previous.timestamp > timestamp) return () => {};
+    const event = { timestamp, eventType };
+    this.lastEvents.set(key, event);
+    return () => {
+      if (this.lastEvents.get(key) !== event) return;
+      if (previous) this.lastEvents.set(key, previous);
+      else this.lastEvents.delete(key);
+    };
+  }
+
+  // user.updatedAt = lần quét gần nhất; gộp lại ghi nền, không nằm trên đường xử lý
+  touchUser(userId, timestamp) {
+    const key = String(userId);
+    const current = this.pendingTouches.get(key);
+    if (!current || current < timestamp) this.pendingTouches.set(key, timestamp);
+    if (!this.touchTimer) {
+      this.touchTimer = setTimeout(() => this.flushTouches(), TOUCH_FLUSH_MS);
+    }
+  }
+
+  async flushTouches() {
+    this.touchTimer = null;
+    if (!this.pendingTouches.size) return;
+    const ops = [...this.pendingTouches].map(([id, timestamp]) => ({
+      updateOne: { filter: { _id: id }, update: { $max: { updatedAt: timestamp } }, timestamps: false },
+    }));
+    this.pendingTouches.clear();
+    try {
+      await User.bulkWrite(ops, { ordered: false });
+    } catch (error) {
+      console.error("[ScanCache] Failed to update users' last scan time:", error);
+    }
+  }
+
+  recordLatency(ms) {
+    this.latencies.add(ms);
+  }
+
+  metrics() {
+    const { userHits, userMisses, dayHits, dayMisses } = this.stats;
+    const rate = (hits, misses) => (hits + misses ? +(hits / (hits + misses)).toFixed(4) : null);
+    return {
+      users: { cached: this.users.size, hits: userHits, misses: userMisses, hitRate: rate(userHits, userMisses) },
+      lastEvent: {
+        day: this.primedDay ? new Date(this.primedDay).toISOString() : null,
+        cached: this.lastEvents.size,
+        hits: dayHits,
+        misses: dayMisses,
+        hitRate: rate(dayHits, dayMisses),
+      },
+      scanLatencyMs: this.latencies.summary(),
+    };
+  }
+}
+
+module.exports = new ScanCache();
+module.exports.dayStartOf = dayStartOf;
@@ -0,0 +1,102 @@
+// services/templateInventory.js
+// Đối chiếu thư viện mẫu trên cảm biến của một thiết bị với User.id trong DB:
+//
+//   1. Lệnh "inventory": thiết bị đọc bảng chiếm chỗ của cảm biến (ReadIndexTable) và trả
+//      về một bitmap trong một message - thay vì hỏi từng slot.
+//   2. So với các user đang hoạt động có vân tay:
+//        orphan : slot có mẫu nhưng không thuộc user đang hoạt động (user đã xoá/khoá mà xoá
+//                 trên thiết bị thất bại, hoặc đăng ký dở)
+//        missing: user đang hoạt động mà slot trống (không quét được, cần đăng ký lại)
+//   3. repair: xoá các orphan theo từng dải slot liên tiếp (delete_range, một lệnh cảm biến
+//      mỗi dải), gửi liền không chờ nhau - thiết bị tự xếp hàng theo rid. Slot đang bận (đang
+//      đăng ký, đang được nạp mẫu) không tính là orphan dù user chưa hoạt động.
+const User = require("../models/userModel");
+const websocketService = require("./websocketService");
+const scanCache = require("./scanCache");
+
+// (deviceId, templateId) => true nếu slot đang bận. templateReplication tự đăng ký kiểm tra
+// của nó qua addBusyCheck() (nó require module này, không require ngược lại được).
+const busyChecks = [(deviceId, templateId) => websocketService.isEnrollmentPending(templateId)];
+
+function addBusyCheck(check) {
+  busyChecks.push(check);
+}
+
+// "fe03..." -> [1, 2, ..., 9, ...]: bit n (byte n/8, bit n%8) = slot n; slot 0 không dùng
+function decodeBitmap(hex) {
+  const slots = [];
+  for (let i = 0; i + 1 < hex.length; i += 2) {
+    const bits = parseInt(hex.slice(i, i + 2), 16);
+    for (let bit = 0; bit < 8; bit++) {
+      const slot = (i / 2) * 8 + bit;
+      if (bits & (1 << bit) && slot > 0) slots.push(slot);
+    }
+  }
+  return slots;
+}
+
+// [1, 2, 3, 7, 9, 10] -> [{ first: 1, count: 3 }, { first: 7, count: 1 }, { first: 9, count: 2 }]
+function toRanges(ids) {
+  const ranges = [];
+  [...new Set(ids)]
+    .sort((a, b) => a - b)
+    .forEach((id) => {
+      const last = ranges[ranges.length - 1];
+      if (last && last.first + last.count === id) last.count++;
+      else ranges.push({ first: id, count: 1 });
+    });
+  return ranges;
+}
+
+// isBusy(slot): slot đang đăng ký/nạp mẫu - không phải orphan, để riêng trong busy
+function diffInventory(occupied, activeIds, isBusy = () => false) {
+  const onDevice = new Set(occupied);
+  const expected = new Set(activeIds);
+  const unexpected = occupied.filter((slot) => !expected.has(slot));
+  return {
+    orphans: unexpected.filter((slot) => !isBusy(slot)),
+    busy: unexpected.filter((slot) => isBusy(slot)),
+    missing: activeIds.filter((id) => !onDevice.has(id)).sort((a, b) => a - b),
+  };
+}
+
+// delete_many: mỗi dải liên tiếp một lệnh delete_range, các lệnh gửi liền nhau
+async function deleteMany(deviceId, ids) {
+  const ranges = toRanges(ids);
+  const results = await Promise.allSettled(
+    ranges.map(({ first, count }) => websocketService.requestRangeDeletionOnDevice(deviceId, first, count))
+  );
+  const deleted = [];
+  const failed = [];
+  results.forEach((result, i) => {
+    const { first, count } = ranges[i];
+    const slots = Array.from({ length: count }, (_, k) => first + k);
+    if (result.status === "fulfilled") deleted.push(...slots);
+    else failed.push({ first, count, message: result.reason.message });
+  });
+  deleted.forEach((id) => scanCache.invalidateTemplate(id));
+  return { commands: ranges.length, deleted, failed };
+}
+
+async function reconcile(deviceId, { repair = false } = {}) {
+  const [inventory, users] = await Promise.all([
+    websocketService.requestInventoryFromDevice(deviceId),
+    User.find({ id: { $ne: null }, isActive: true }, "id -_id").lean(),
+  ]);
+  const occupied = decodeBitmap(inventory.bitmap || "");
+  const isBusy = (slot) => busyChecks.some((check) => check(deviceId, slot));
+  const { orphans, busy, missing } = diffInventory(occupied, users.map((user) => user.id), isBusy);
+  const report = {
+    deviceId,
+    capacity: inventory.capacity,
+    occupied: occupied.length,
+    activeUsers: users.length,
+    orphans,
+    busy,
+    missing,
+  };
+  if (repair && orphans.length) report.repair = await deleteMany(deviceId, orphans);
+  return report;
+}
+
+module.exports = { decodeBitmap, toRanges, diffInventory, deleteMany, reconcile, addBusyCheck };
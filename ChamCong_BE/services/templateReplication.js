@@ -0,0 +1,213 @@
+// services/templateReplication.js
+// Sao chép đặc trưng vân tay giữa các thiết bị: đăng ký một lần ở một máy, quét được ở mọi máy.
+//
+//   1. Đăng ký thành công thì thiết bị tự đọc đặc trưng (UpChar, 512 byte) và gửi lên thành các
+//      đoạn template_chunk; websocketService ghép lại và phát 'templateUploaded'.
+//   2. Lưu vào FingerprintTemplate (nhị phân), ghi đè mẫu cũ cùng ID.
+//   3. Nạp vào slot cùng ID trên mọi thiết bị khác đang kết nối (template_load -> DownChar + Store).
+//
+// provision(deviceId): thiết bị mới/thay cảm biến - inventory (templateInventory), rồi nạp hàng
+// loạt mẫu của các user đang hoạt động còn thiếu. collect(deviceId): thiết bị cũ đã có mẫu từ
+// trước khi có bảng này - đọc lên các mẫu server chưa lưu.
+//
+// Xoá user: forget() xoá mẫu trên mọi thiết bị đang kết nối; thiết bị offline (hoặc xoá thất bại)
+// được dọn khi kết nối lại (purgeForgotten). User bị xoá giữ nguyên User.id nên slot không được
+// cấp cho người khác trong lúc mẫu cũ có thể còn trên thiết bị nào đó.
+//
+// Mỗi thiết bị có tối đa LOAD_WINDOW lệnh nạp đang chạy (firmware có TEMPLATE_BUFFERS = 2 bộ đệm):
+// trong lúc cảm biến ghi mẫu này thì mẫu sau đã nằm sẵn trong RAM thiết bị, nên tốc độ nạp là tốc
+// độ cảm biến chứ không phải một RTT mỗi mẫu.
+const FingerprintTemplate = require("../models/fingerprintTemplateModel");
+const User = require("../models/userModel");
+const websocketService = require("./websocketService");
+const templateInventory = require("./templateInventory");
+
+const LOAD_WINDOW = 2;
+const UPLOAD_WINDOW = 2;
+
+const loaders = new Map(); // Map<deviceId, { queue: [{ templateId, data, done }], inFlight, window, ids }>
+let forgottenIds = null; // Promise<Set<templateId>> của user đã xoá (User.id còn, isActive = false)
+
+function pump(deviceId) {
+  const loader = loaders.get(deviceId);
+  while (loader.inFlight < loader.window && loader.queue.length) {
+    const { templateId, data, done } = loader.queue.shift();
+    loader.inFlight++;
+    websocketService
+      .requestTemplateLoadOnDevice(deviceId, templateId, data)
+      .then(
+        () => done({ templateId }),
+        (error) => done({ templateId, message: error.message })
+      )
+      .finally(() => {
+        const count = loader.ids.get(templateId) - 1;
+        if (count) loader.ids.set(templateId, count);
+        else loader.ids.delete(templateId);
+        loader.inFlight--;
+        if (loader.queue.length) pump(deviceId);
+        else if (!loader.inFlight) loaders.delete(deviceId);
+      });
+  }
+}
+
+// Nạp [{ templateId, data }] vào thiết bị; luôn resolve { loaded: [id], failed: [{ templateId, message }] }
+async function loadTemplates(deviceId, templates, { window = LOAD_WINDOW } = {}) {
+  let loader = loaders.get(deviceId);
+  if (!loader) {
+    loader = { queue: [], inFlight: 0, window, ids: new Map() }; // ids: templateId -> số lệnh nạp chưa xong
+    loaders.set(deviceId, loader);
+  }
+  const results = await Promise.all(
+    templates.map(
+      ({ templateId, data }) =>
+        new Promise((done) => {
+          loader.queue.push({ templateId, data, done });
+          loader.ids.set(templateId, (loader.ids.get(templateId) || 0) + 1);
+          pump(deviceId);
+        })
+    )
+  );
+  return {
+    loaded: results.filter((r) => !r.message).map((r) => r.templateId),
+    failed: results.filter((r) => r.message),
+  };
+}
+
+// Mẫu templateId đang chờ hoặc đang nạp vào deviceId: reconcile không được xoá slot này
+function isLoading(deviceId, templateId) {
+  const loader = loaders.get(deviceId);
+  return Boolean(loader && loader.ids.has(templateId));
+}
+
+templateInventory.addBusyCheck(isLoading);
+
+async function storeTemplate(deviceId, templateId, data) {
+  await FingerprintTemplate.updateOne(
+    { templateId },
+    { $set: { data, size: data.length, sourceDeviceId: deviceId } },
+    { upsert: true }
+  );
+}
+
+// Mẫu mới đăng ký: lưu, rồi nạp vào các thiết bị khác đang kết nối. ID của user đã xoá thì bỏ qua
+// (slot không được cấp lại, mẫu gửi lên cho ID đó không thể là một lần đăng ký hợp lệ).
+async function replicate(deviceId, templateId, data) {
+  if ((await loadForgottenIds()).has(templateId)) {
+    console.warn(`Ignoring template ${templateId} from ${deviceId}: user was deleted`);
+    return { templateId, targets: 0, failed: [], skipped: true };
+  }
+  await storeTemplate(deviceId, templateId, data);
+  const targets = [...websocketService.clients.keys()].filter((id) => id !== deviceId);
+  const results = await Promise.all(targets.map((target) => loadTemplates(target, [{ templateId, data }])));
+  const failed = targets.filter((_, i) => results[i].failed.length);
+  console.log(
+    `Template ${templateId} from ${deviceId} replicated to ${targets.length - failed.length}/${targets.length} devices` +
+      (failed.length ? ` (failed: ${failed.join(", ")})` : "")
+  );
+  return { templateId, targets: targets.length, failed };
+}
+
+websocketService.on("templateUploaded", (deviceId, templateId, data) => {
+  replicate(deviceId, templateId, data).catch((error) =>
+    console.error(`Error replicating template ${templateId} from ${deviceId}:`, error)
+  );
+});
+
+async function provision(deviceId, { window = LOAD_WINDOW } = {}) {
+  const report = await templateInventory.reconcile(deviceId);
+  // Không .lean(): document đã hydrate trả data là Buffer (lean trả bson Binary)
+  const templates = await FingerprintTemplate.find({ templateId: { $in: report.missing } });
+  const stored = new Set(templates.map((t) => t.templateId));
+  const start = Date.now();
+  const { loaded, failed } = await loadTemplates(
+    deviceId,
+    templates.map((t) => ({ templateId: t.templateId, data: t.data })),
+    { window }
+  );
+  return {
+    deviceId,
+    capacity: report.capacity,
+    missing: report.missing.length,
+    loaded,
+    failed,
+    withoutTemplate: report.missing.filter((id) => !stored.has(id)), // Cần đăng ký lại trực tiếp
+    ms: Date.now() - start,
+  };
+}
+
+async function collect(deviceId) {
+  const [inventory, users, stored] = await Promise.all([
+    websocketService.requestInventoryFromDevice(deviceId),
+    User.find({ id: { $ne: null }, isActive: true }, "id -_id").lean(),
+    FingerprintTemplate.find({}, "templateId -_id").lean(),
+  ]);
+  const onDevice = new Set(templateInventory.decodeBitmap(inventory.bitmap || ""));
+  const storedIds = new Set(stored.map((t) => t.templateId));
+  const ids = users.map((u) => u.id).filter((id) => onDevice.has(id) && !storedIds.has(id));
+
+  const collected = [];
+  const failed = [];
+  let next = 0;
+  const worker = async () => {
+    while (next < ids.length) {
+      const templateId = ids[next++];
+      try {
+        const { data } = await websocketService.requestTemplateUploadFromDevice(deviceId, templateId);
+        await storeTemplate(deviceId, templateId, data);
+        collected.push(templateId);
+      } catch (error) {
+        failed.push({ templateId, message: error.message });
+      }
+    }
+  };
+  await Promise.all(Array.from({ length: UPLOAD_WINDOW }, worker));
+  return { deviceId, candidates: ids.length, collected: collected.sort((a, b) => a - b), failed };
+}
+
+function loadForgottenIds() {
+  if (!forgottenIds) {
+    forgottenIds = User.find({ id: { $ne: null }, isActive: false }, "id -_id")
+      .lean()
+      .then((users) => new Set(users.map((user) => user.id)));
+    forgottenIds.catch(() => (forgottenIds = null));
+  }
+  return forgottenIds;
+}
+
+// User bị xoá (đã xoá trên exceptDeviceId): mẫu không còn được nạp vào thiết bị nào nữa, và xoá
+// khỏi các thiết bị khác đang kết nối. Thiết bị không xoá được thì purgeForgotten() làm lại khi
+// nó kết nối lại.
+async function forget(templateId, exceptDeviceId) {
+  (await loadForgottenIds()).add(templateId);
+  await FingerprintTemplate.deleteOne({ templateId });
+  const targets = [...websocketService.clients.keys()].filter((id) => id !== exceptDeviceId);
+  const results = await Promise.allSettled(
+    targets.map((target) => websocketService.requestDeletionOnDevice(target, templateId))
+  );
+  const failed = targets.filter((_, i) => results[i].status === "rejected");
+  console.log(
+    `Template ${templateId} deleted from ${targets.length - failed.length}/${targets.length} other devices` +
+      (failed.length ? ` (retry on reconnect: ${failed.join(", ")})` : "")
+  );
+  return { templateId, targets: targets.length, failed };
+}
+
+// Thiết bị vừa kết nối: xoá các slot của user đã xoá mà nó còn giữ (nó offline lúc xoá)
+async function purgeForgotten(deviceId) {
+  const forgotten = await loadForgottenIds();
+  if (!forgotten.size) return { deviceId, deleted: [], failed: [] };
+  const inventory = await websocketService.requestInventoryFromDevice(deviceId);
+  const stale = templateInventory.decodeBitmap(inventory.bitmap || "").filter((id) => forgotten.has(id));
+  if (!stale.length) return { deviceId, deleted: [], failed: [] };
+  const { deleted, failed } = await templateInventory.deleteMany(deviceId, stale);
+  console.log(`Purged ${deleted.length} templates of deleted users from ${deviceId}`);
+  return { deviceId, deleted, failed };
+}
+
+websocketService.on("deviceConnected", (deviceId) => {
+  purgeForgotten(deviceId).catch((error) =>
+    console.error(`Error purging deleted templates from ${deviceId}:`, error.message)
+  );
+});
+
+module.exports = { LOAD_WINDOW, loadTemplates, replicate, provision, collect, forget, purgeForgotten };
@@ -0,0 +1,59 @@
+// services/timerWheel.js
+// Timer wheel đơn giản: vòng `slots` ô, mỗi ô cách nhau `tickMs`. Thêm/huỷ một mục là
+// O(1), và mỗi tick chỉ xử lý các mục hết hạn ở ô hiện tại - không phải một setTimeout
+// cho mỗi mục, cũng không phải quét toàn bộ danh sách mỗi chu kỳ.
+//
+// Độ chính xác bằng tickMs; delay tối đa (slots - 1) * tickMs.
+class TimerWheel {
+  constructor(tickMs, slots, onExpire) {
+    this.tickMs = tickMs;
+    this.slots = Array.from({ length: slots }, () => new Set());
+    this.cursor = 0;
+    this.onExpire = onExpire;
+    this.slotOf = new Map(); // item -> chỉ số ô
+    this.timer = null;
+  }
+
+  start() {
+    if (!this.timer) this.timer = setInterval(() => this.tick(), this.tickMs);
+    return this;
+  }
+
+  stop() {
+    clearInterval(this.timer);
+    this.timer = null;
+  }
+
+  // Hết hạn sau khoảng delayMs (làm tròn lên theo tick); thêm lại thì thay lịch cũ
+  add(item, delayMs) {
+    this.remove(item);
+    const ticks = Math.min(this.slots.length - 1, Math.max(1, Math.ceil(delayMs / this.tickMs)));
+    const slot = (this.cursor + ticks) % this.slots.length;
+    this.slots[slot].add(item);
+    this.slotOf.set(item, slot);
+  }
+
+  remove(item) {
+    const slot = this.slotOf.get(item);
+    if (slot === undefined) return;
+    this.slots[slot].delete(item);
+    this.slotOf.delete(item);
+  }
+
+  tick() {
+    this.cursor = (this.cursor + 1) % this.slots.length;
+    const due = this.slots[this.cursor];
+    if (!due.size) return;
+    this.slots[this.cursor] = new Set();
+    due.forEach((item) => {
+      this.slotOf.delete(item);
+      this.onExpire(item);
+    });
+  }
+
+  get size() {
+    return this.slotOf.size;
+  }
+}
+
+module.exports = TimerWheel;
@@ -0,0 +1,162 @@
+// services/userDirectory.js
+// Bảng template id -> tên rút gọn/trạng thái gửi xuống thiết bị để hiện tên ngay khi quét.
+//
+// Mỗi thay đổi (đăng ký, sửa tên, khoá/mở, xoá vân tay) tăng version và được giữ
+// trong changes để gửi delta cho thiết bị đang ở phiên bản cũ. Thiết bị quá cũ (hoặc
+// server vừa khởi động lại) nhận cả bảng, chia trang.
+//
+// version (uint32 trên thiết bị) = epoch << 16 | counter. epoch ngẫu nhiên, khác 0, đổi mỗi
+// lần server khởi động (và khi counter tràn): hai lần chạy có thể cùng tới một counter nhưng
+// bảng khác nhau, nên chỉ so phiên bản / tính delta khi cùng epoch.
+//
+// Định dạng (JSON hoặc MessagePack, như mọi frame khác):
+//   { type: "directory", version, base, set: [[id, name, flags]], del: [id] }   delta
+//   { type: "directory", version, full: true, page, more, set: [...] }          cả bảng
+// flags: bit 0 = user đang hoạt động.
+const crypto = require("crypto");
+const EventEmitter = require("events");
+const User = require("../models/userModel");
+
+const MAX_NAME_LENGTH = 14; // DirectoryEntry::name trên thiết bị (15 byte kể cả NUL)
+const PAGE_SIZE = 20; // Mục mỗi frame: ~550 byte JSON, vừa arena JSON 4 KB của ESP8266
+const MAX_CHANGES = 256; // Số thay đổi giữ lại để tính delta
+const FLAG_ACTIVE = 0x01;
+const COUNTER_BITS = 16;
+const MAX_COUNTER = 2 ** COUNTER_BITS - 1;
+
+const epochOf = (version) => Math.floor(version / 2 ** COUNTER_BITS);
+
+// Font OLED chỉ có ASCII: bỏ dấu tiếng Việt
+const toAscii = (text) =>
+  text
+    .normalize("NFD")
+    .replace(/[\u0300-\u036f]/g, "")
+    .replace(/đ/g, "d")
+    .replace(/Đ/g, "D")
+    .replace(/[^\x20-\x7e]/g, "?");
+
+// "Nguyen Thi Minh Khai" -> "N.T.M. Khai": giữ tên (từ cuối), viết tắt họ và đệm
+const shortName = (name) => {
+  const words = toAscii(name || "").trim().split(/\s+/).filter(Boolean);
+  let short = words.join(" ");
+  if (short.length <= MAX_NAME_LENGTH) return short;
+  const last = words[words.length - 1];
+  const initials = words.slice(0, -1).map((w) => `${w[0]}.`).join("");
+  short = initials ? `${initials} ${last}` : last;
+  return short.slice(0, MAX_NAME_LENGTH);
+};
+
+const entryOf = (user) => [user.id, shortName(user.name), user.isActive ? FLAG_ACTIVE : 0];
+
+class UserDirectory extends EventEmitter {
+  constructor() {
+    super();
+    this.entries = new Map(); // Map<templateId, [id, name, flags]>
+    this.changes = []; // [{ version, id, entry | null }]
+    this.newEpoch(0);
+    this.loading = null;
+  }
+
+  // Epoch mới khác epoch vừa dùng; thiết bị ở epoch khác luôn nhận cả bảng
+  newEpoch(previous) {
+    let epoch;
+    do epoch = crypto.randomInt(1, 2 ** (32 - COUNTER_BITS));
+    while (epoch === previous);
+    this.epoch = epoch;
+    this.version = epoch * 2 ** COUNTER_BITS;
+    this.changes = [];
+  }
+
+  load() {
+    if (!this.loading) {
+      this.loading = User.find({ id: { $ne: null } }, "id name isActive -_id")
+        .lean()
+        .then((users) => {
+          users.forEach((user) => this.entries.set(user.id, entryOf(user)));
+          console.log(`[Directory] Loaded ${this.entries.size} users, version ${this.version}`);
+        })
+        .catch((error) => {
+          this.loading = null;
+          throw error;
+        });
+    }
+    return this.loading;
+  }
+
+  // Gọi sau khi user được tạo/sửa trong DB (userController)
+  async upsertUser(user) {
+    if (!user || !user.id) return;
+    await this.load();
+    const entry = entryOf(user);
+    const current = this.entries.get(user.id);
+    if (current && current[1] === entry[1] && current[2] === entry[2]) return;
+    this.entries.set(user.id, entry);
+    this.record(user.id, entry);
+  }
+
+  // Gọi sau khi mẫu vân tay bị xoá khỏi cảm biến
+  async removeTemplate(templateId) {
+    await this.load();
+    if (!this.entries.delete(templateId)) return;
+    this.record(templateId, null);
+  }
+
+  record(id, entry) {
+    if (this.version - this.epoch * 2 ** COUNTER_BITS >= MAX_COUNTER) {
+      this.newEpoch(this.epoch);
+      this.emit("change", null);
+      return;
+    }
+    const base = this.version;
+    this.version++;
+    this.changes.push({ version: this.version, id, entry });
+    if (this.changes.length > MAX_CHANGES) this.changes.shift();
+    this.emit("change", this.deltaFrom(base));
+  }
+
+  // Delta từ phiên bản base lên phiên bản hiện tại, null nếu không còn đủ lịch sử
+  // hoặc delta lớn hơn một trang (khi đó gửi cả bảng rẻ hơn)
+  deltaFrom(base) {
+    if (epochOf(base) !== this.epoch || base > this.version) return null;
+    const oldest = this.changes.length ? this.changes[0].version - 1 : this.version;
+    if (base < oldest) return null;
+
+    const latest = new Map(); // Chỉ giữ thay đổi cuối của mỗi id
+    this.changes.forEach((change) => {
+      if (change.version > base) latest.set(change.id, change.entry);
+    });
+    if (latest.size > PAGE_SIZE) return null;
+
+    const set = [];
+    const del = [];
+    latest.forEach((entry, id) => (entry ? set.push(entry) : del.push(id)));
+    return { type: "directory", base, version: this.version, set, del };
+  }
+
+  snapshotPages() {
+    const entries = [...this.entries.values()].sort((a, b) => a[0] - b[0]);
+    const pages = [];
+    for (let first = 0, page = 0; first < entries.length || page === 0; first += PAGE_SIZE, page++) {
+      pages.push({
+        type: "directory",
+        full: true,
+        version: this.version,
+        page,
+        more: first + PAGE_SIZE < entries.length,
+        set: entries.slice(first, first + PAGE_SIZE),
+      });
+    }
+    return pages;
+  }
+
+  // Các frame đưa thiết bị đang ở deviceVersion lên phiên bản hiện tại
+  async syncMessages(deviceVersion) {
+    await this.load();
+    if (deviceVersion === this.version) return [];
+    const delta = deviceVersion > 0 ? this.deltaFrom(deviceVersion) : null;
+    return delta ? [delta] : this.snapshotPages();
+  }
+}
+
+module.exports = new UserDirectory();
+module.exports.shortName = shortName;
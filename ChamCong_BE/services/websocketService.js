@@ -1,17 +1,49 @@
 const WebSocket = require('ws');
 const EventEmitter = require('events');
 const fingerprintController = require('../controllers/fingerprintController');
+const msgpack = require('./msgpack');
+const userDirectory = require('./userDirectory');
+const TimerWheel = require('./timerWheel');
+
+const HEARTBEAT_WHEEL_SLOTS = 20; // Mỗi tick kiểm tra khoảng 1/20 số thiết bị
+// Thiết bị chạy lần lượt các lệnh enroll/delete; mỗi lệnh đứng trước cộng thêm chừng này thời gian chờ
+const COMMAND_SLOT_MS = 30000;
+// Mẫu thiết bị tự gửi lên chỉ được nhận nếu chính thiết bị đó vừa báo đăng ký thành công ID này
+const ENROLL_UPLOAD_WINDOW_MS = 10000;
+const COMMAND_KINDS = ['enroll', 'delete', 'inventory', 'load', 'upload'];
+const COMMAND_LABELS = {
+    enroll: 'Enrollment', delete: 'Deletion', inventory: 'Inventory', load: 'Template load', upload: 'Template upload'
+};
+// Đặc trưng gửi xuống thiết bị thành các đoạn template_load cỡ này (khớp TEMPLATE_CHUNK_BYTES của firmware)
+const TEMPLATE_CHUNK_BYTES = 128;
+const TEMPLATE_MAX_BYTES = 4096;
 
 class WebSocketService extends EventEmitter {
     constructor() {
         super();
         this.wss = null;
-        this.clients = new Map(); // Map<deviceId, { ws, lastHeartbeatTime, isAlive }>
-        this.pendingEnrollment = new Map();
+        this.clients = new Map(); // Map<deviceId, { ws, deviceId, lastHeartbeatTime, isAlive }>
+        // Cùng một ID có thể chờ trên nhiều thiết bị (đăng ký, xoá, nạp/đọc mẫu): khoá "deviceId:templateId"
+        this.pendingEnrollment = new Map(); // Map<"deviceId:templateId", { rid, resolve, reject, timeoutId, deviceId, timeout }>
+        this.enrollingIds = new Map(); // Map<templateId, số thiết bị đang đăng ký ID đó> - chỉ mục của pendingEnrollment
         this.pendingDeletion = new Map();
+        this.pendingInventory = new Map(); // Map<deviceId, {...}> - mỗi thiết bị một lệnh inventory
+        this.pendingLoad = new Map();
+        this.pendingUpload = new Map();
+        // Chỉ mục deviceId -> khoá đang chờ, để không phải quét các Map trên theo thiết bị
+        this.pendingByDevice = new Map(); // Map<deviceId, { enroll: Set, delete: Set, inventory: Set, ... }>
+        this.templateUploads = new Map(); // Map<"deviceId:templateId", { data: Buffer, received }> - đoạn đang ghép
+        this.recentEnrollments = new Map(); // Map<"deviceId:templateId", thời điểm enroll_status success>
+        // message "metrics" gần nhất của mỗi thiết bị (giữ cả khi thiết bị đã ngắt kết nối)
+        this.deviceMetrics = new Map(); // Map<deviceId, { receivedAt, metrics, previous }>
+        this.nextRequestId = 1; // rid của lệnh enroll/delete, thiết bị trả lại trong *_status
         this.enrollmentProgress = new Map(); // Thêm Map để lưu trữ thông tin tiến trình đăng ký
-        this.heartbeatInterval = 10000; // Gửi heartbeat mỗi 10 giây
-        this.heartbeatTimeout = 20000; // Timeout 15 giây nếu không nhận được phản hồi
+        this.scanQueues = new Map(); // Map<deviceId, Promise> - xử lý lượt quét tuần tự theo seq
+        this.heartbeatInterval = 10000; // Ping mỗi thiết bị mỗi 10 giây
+        this.heartbeatWheel = null;
+
+        // Bảng tên người dùng thay đổi: gửi delta cho các thiết bị đang giữ bảng
+        userDirectory.on('change', (delta) => this.broadcastDirectory(delta));
     }
 
     initializeWebSocketServer(server) {
@@ -23,40 +55,87 @@ class WebSocketService extends EventEmitter {
         this.wss.on('connection', (ws, req) => {
             const urlParams = new URLSearchParams(req.url.split('?')[1]);
             const deviceId = urlParams.get('deviceId') || `esp-${Date.now()}`;
-            console.log(`New client connected: ${deviceId}`);
+            // Thiết bị xin dùng MessagePack qua "&proto=msgpack"; mặc định là JSON
+            const proto = urlParams.get('proto') === 'msgpack' ? 'msgpack' : 'json';
+            console.log(`New client connected: ${deviceId} (proto=${proto})`);
+
+            // Thiết bị kết nối lại trước khi server phát hiện kết nối cũ đã chết (half-open)
+            const previous = this.clients.get(deviceId);
+            if (previous) {
+                this.heartbeatWheel?.remove(previous);
+                previous.ws.terminate();
+            }
 
             // Khởi tạo metadata cho client
-            this.clients.set(deviceId, {
+            const client = {
                 ws,
+                deviceId,
                 lastHeartbeatTime: Date.now(),
                 isAlive: true
-            });
+            };
+            this.clients.set(deviceId, client);
+            // Lần ping đầu rải ngẫu nhiên trong chu kỳ: thiết bị kết nối lại cùng lúc (server
+            // khởi động lại) không dồn vào cùng một tick
+            this.heartbeatWheel?.add(client, this.heartbeatInterval * (0.5 + Math.random() / 2));
+            // Thư viện WebSocket trên thiết bị tự trả pong cho ping của server
+            ws.on('pong', () => this.markAlive(client));
             ws.deviceId = deviceId;
+            ws.proto = proto;
+            if (proto === 'msgpack') {
+                // Frame binary đầu tiên xác nhận với thiết bị là server hỗ trợ MessagePack
+                this.sendToClient(ws, { type: 'hello', proto });
+            }
+            // Thiết bị có bảng tên gửi kèm phiên bản đang giữ qua "&dir=<version>"
+            if (urlParams.has('dir')) {
+                this.syncDirectory(deviceId, ws, Number(urlParams.get('dir')) || 0);
+            }
 
             // Xử lý tin nhắn nhận được
-            ws.on('message', async (message) => {
+            ws.on('message', async (message, isBinary) => {
                 let data;
                 try {
-                    const messageString = message instanceof Buffer ? message.toString() : message;
-                    data = JSON.parse(messageString);
+                    data = isBinary ? msgpack.decode(message) : JSON.parse(message.toString());
+                    this.markAlive(client);
 
                     switch (data.type) {
                         case 'scan_result':
-                            await fingerprintController.handleScanResult(deviceId, data.payload);
+                            if (data.payload && data.payload.seq) {
+                                this.enqueueScanWork(deviceId, ws, () =>
+                                    fingerprintController.handleSequencedScans(deviceId, [data.payload], undefined, data.payload.j));
+                            } else {
+                                await fingerprintController.handleScanResult(deviceId, data.payload);
+                            }
+                            break;
+                        case 'scan_batch':
+                            this.enqueueScanWork(deviceId, ws, () =>
+                                fingerprintController.handleScanBatch(deviceId, data.payload));
                             break;
                         case 'enroll_status':
-                            this.handleEnrollmentResponse(data.payload);
+                            this.handleEnrollmentResponse(deviceId, data.payload);
                             break;
                         case 'delete_status':
-                            this.handleDeletionResponse(data.payload);
+                            this.handleDeletionResponse(deviceId, data.payload);
+                            break;
+                        case 'inventory':
+                            this.handleInventoryResponse(deviceId, data.payload);
+                            break;
+                        case 'template_chunk':
+                            this.handleTemplateChunk(deviceId, data.payload);
+                            break;
+                        case 'load_status':
+                            this.handleCommandResponse('load', deviceId, data.payload);
+                            break;
+                        case 'upload_status':
+                            this.handleCommandResponse('upload', deviceId, data.payload);
+                            break;
+                        case 'metrics':
+                            this.handleMetrics(deviceId, data.payload);
+                            break;
+                        case 'directory_ack':
+                            this.handleDirectoryAck(deviceId, ws, data.payload);
                             break;
                         case 'heartbeat':
-                            // Cập nhật trạng thái heartbeat
-                            const client = this.clients.get(deviceId);
-                            if (client) {
-                                client.lastHeartbeatTime = Date.now();
-                                client.isAlive = true;
-                            }
+                            // Firmware cũ còn gửi heartbeat JSON; markAlive() ở trên đã xử lý
                             break;
                         default:
                             console.log(`Unknown WS message type from ${deviceId}: ${data.type}`);
@@ -68,19 +147,16 @@ class WebSocketService extends EventEmitter {
 
             ws.on('close', (code, reason) => {
                 console.log(`Client ${deviceId} disconnected: Code=${code}, Reason=${reason || 'none'}`);
-                this.clients.delete(deviceId);
-                this.cleanupPendingRequests(deviceId);
-                this.emit('statusChange');
+                this.dropClient(client);
             });
 
             ws.on('error', (error) => {
                 console.error(`WebSocket error from ${deviceId}:`, error.message);
-                this.clients.delete(deviceId);
-                this.cleanupPendingRequests(deviceId);
-                this.emit('statusChange');
+                this.dropClient(client);
             });
 
             this.emit('statusChange');
+            this.emit('deviceConnected', deviceId);
         });
 
         this.wss.on('error', (error) => {
@@ -93,50 +169,186 @@ class WebSocketService extends EventEmitter {
         return this.wss;
     }
 
+    // Liveness bằng ping/pong của giao thức WebSocket: mỗi thiết bị nằm trong một ô của timer
+    // wheel, mỗi tick chỉ ping những thiết bị tới hạn thay vì duyệt toàn bộ client mỗi chu kỳ
     startHeartbeat() {
-        setInterval(() => {
-            const now = Date.now();
-            this.clients.forEach((client, deviceId) => {
-                // Kiểm tra nếu thiết bị đang trong quá trình đăng ký vân tay thì bỏ qua kiểm tra heartbeat
-                const isDeviceEnrolling = this.isDeviceEnrolling(deviceId);
-                if (isDeviceEnrolling) {
-                    console.log(`Skip heartbeat check for ${deviceId} - currently enrolling`);
-                    return;
-                }
-                
-                // Kiểm tra nếu client không phản hồi trong thời gian timeout
-                if (!client.isAlive || now - client.lastHeartbeatTime > this.heartbeatTimeout) {
-                    console.log(`Client ${deviceId} is unresponsive (last heartbeat: ${new Date(client.lastHeartbeatTime).toISOString()}). Terminating connection.`);
-                    client.ws.terminate();
-                    this.clients.delete(deviceId);
-                    this.cleanupPendingRequests(deviceId);
-                    this.emit('statusChange');
-                    return;
-                }
-                client.isAlive = false; // Mong đợi phản hồi heartbeat
+        if (this.heartbeatWheel) return;
+        this.heartbeatWheel = new TimerWheel(
+            this.heartbeatInterval / HEARTBEAT_WHEEL_SLOTS,
+            HEARTBEAT_WHEEL_SLOTS + 1,
+            (client) => this.checkLiveness(client)
+        ).start();
+        this.clients.forEach((client) => this.heartbeatWheel.add(client, this.heartbeatInterval));
+    }
+
+    checkLiveness(client) {
+        const { deviceId, ws } = client;
+        if (this.clients.get(deviceId) !== client) return; // Đã ngắt hoặc đã kết nối lại
+
+        // Không có pong cho ping trước -> coi như mất kết nối. Không miễn cho thiết bị đang
+        // đăng ký: firmware đăng ký không chặn loop() nên vẫn trả pong, thiết bị treo giữa lúc
+        // đăng ký thì phải bị ngắt để lệnh đang chờ bị huỷ thay vì chờ tới hết hạn
+        if (!client.isAlive) {
+            console.log(`Client ${deviceId} is unresponsive (last heartbeat: ${new Date(client.lastHeartbeatTime).toISOString()}). Terminating connection.`);
+            ws.terminate();
+            this.dropClient(client);
+            return;
+        }
+        client.isAlive = false; // Mong đợi pong (hoặc bất kỳ message nào) trước lần kiểm tra sau
+        try {
+            ws.ping();
+        } catch (error) {
+            console.error(`Error sending ping to ${deviceId}:`, error);
+            ws.terminate();
+            this.dropClient(client);
+            return;
+        }
+        this.heartbeatWheel.add(client, this.heartbeatInterval);
+    }
+
+    markAlive(client) {
+        client.isAlive = true;
+        client.lastHeartbeatTime = Date.now();
+    }
+
+    // Gỡ client khỏi danh sách; bỏ qua nếu deviceId đã có kết nối mới thay thế
+    dropClient(client) {
+        this.heartbeatWheel?.remove(client);
+        if (this.clients.get(client.deviceId) !== client) return;
+        this.clients.delete(client.deviceId);
+        this.cleanupPendingRequests(client.deviceId);
+        this.emit('statusChange');
+    }
+
+    // templateId có đang chờ đăng ký trên thiết bị nào không (để không cấp lại ID đó)
+    isEnrollmentPending(templateId) {
+        return this.enrollingIds.has(templateId);
+    }
+
+    pendingMap(kind) {
+        return {
+            enroll: this.pendingEnrollment,
+            delete: this.pendingDeletion,
+            inventory: this.pendingInventory,
+            load: this.pendingLoad,
+            upload: this.pendingUpload
+        }[kind];
+    }
+
+    // Khoá của yêu cầu trong pendingMap(kind)
+    pendingKey(kind, deviceId, templateId) {
+        return kind === 'inventory' ? deviceId : `${deviceId}:${templateId}`;
+    }
+
+    // Ghi yêu cầu đang chờ vào Map theo khoá và vào chỉ mục theo thiết bị (khoá luôn thuộc về
+    // một thiết bị; requestCommand() không để hai yêu cầu trùng khoá)
+    setPending(kind, id, entry) {
+        this.pendingMap(kind).set(id, entry);
+        let byDevice = this.pendingByDevice.get(entry.deviceId);
+        if (!byDevice) {
+            byDevice = Object.fromEntries(COMMAND_KINDS.map((k) => [k, new Set()]));
+            this.pendingByDevice.set(entry.deviceId, byDevice);
+        }
+        byDevice[kind].add(id);
+        if (kind === 'enroll') this.enrollingIds.set(entry.templateId, (this.enrollingIds.get(entry.templateId) || 0) + 1);
+    }
+
+    // Bỏ một lượt của templateId khỏi enrollingIds
+    releaseEnrollingId(templateId) {
+        const count = this.enrollingIds.get(templateId) - 1;
+        if (count > 0) this.enrollingIds.set(templateId, count);
+        else this.enrollingIds.delete(templateId);
+    }
+
+    deletePending(kind, id) {
+        const map = this.pendingMap(kind);
+        const entry = map.get(id);
+        if (!entry) return;
+        map.delete(id);
+        if (kind === 'enroll') this.releaseEnrollingId(entry.templateId);
+        const byDevice = this.pendingByDevice.get(entry.deviceId);
+        if (!byDevice) return;
+        byDevice[kind].delete(id);
+        if (COMMAND_KINDS.every((k) => !byDevice[k].size)) {
+            this.pendingByDevice.delete(entry.deviceId);
+        }
+    }
+
+    // Các frame quét của cùng một thiết bị được xử lý nối tiếp (kể cả khi kết nối lại)
+    // để giữ đúng thứ tự CHECK_IN/CHECK_OUT và để bỏ qua seq trùng chính xác.
+    enqueueScanWork(deviceId, ws, work) {
+        const previous = this.scanQueues.get(deviceId) || Promise.resolve();
+        const next = previous
+            .then(work)
+            .then((ackSeq) => this.sendScanAck(ws, ackSeq))
+            .catch((error) => console.error(`Error processing scans from ${deviceId}:`, error));
+        this.scanQueues.set(deviceId, next);
+        next.then(() => {
+            if (this.scanQueues.get(deviceId) === next) this.scanQueues.delete(deviceId);
+        });
+        return next;
+    }
+
+    // Ack tích luỹ: mọi lượt quét có seq <= ackSeq đã được ghi nhận
+    sendScanAck(ws, ackSeq) {
+        if (!ackSeq || ws.readyState !== WebSocket.OPEN) return;
+        try {
+            this.sendToClient(ws, { type: 'scan_ack', seq: ackSeq });
+        } catch (error) {
+            console.error(`Error sending scan_ack to ${ws.deviceId}:`, error);
+        }
+    }
+
+    // Gửi theo định dạng đã thương lượng: MessagePack (binary) hoặc JSON (text)
+    sendToClient(ws, message) {
+        if (ws.proto === 'msgpack') {
+            ws.send(msgpack.encode(message), { binary: true });
+        } else {
+            ws.send(JSON.stringify(message));
+        }
+    }
+
+    // Gửi các frame "directory" đưa thiết bị từ deviceVersion lên phiên bản hiện tại
+    async syncDirectory(deviceId, ws, deviceVersion) {
+        try {
+            const messages = await userDirectory.syncMessages(deviceVersion);
+            const client = this.clients.get(deviceId);
+            if (!client || client.ws !== ws || ws.readyState !== WebSocket.OPEN) return;
+            messages.forEach((message) => this.sendToClient(ws, message));
+            client.dirVersion = messages.length ? messages[messages.length - 1].version : deviceVersion;
+            if (messages.length) {
+                console.log(`[Directory] ${deviceId}: ${deviceVersion} -> ${client.dirVersion} (${messages.length} frames)`);
+            }
+        } catch (error) {
+            console.error(`Error syncing user directory to ${deviceId}:`, error);
+        }
+    }
+
+    broadcastDirectory(delta) {
+        this.clients.forEach((client, deviceId) => {
+            if (client.dirVersion === undefined) return; // Firmware không có bảng tên
+            if (delta && client.dirVersion === delta.base) {
                 try {
-                    const heartbeatMsg = JSON.stringify({ type: 'heartbeat' });
-                    client.ws.send(heartbeatMsg);
+                    this.sendToClient(client.ws, delta);
+                    client.dirVersion = delta.version;
                 } catch (error) {
-                    console.error(`Error sending heartbeat to ${deviceId}:`, error);
-                    client.ws.terminate();
-                    this.clients.delete(deviceId);
-                    this.cleanupPendingRequests(deviceId);
-                    this.emit('statusChange');
+                    console.error(`Error sending directory delta to ${deviceId}:`, error);
                 }
-            });
-        }, this.heartbeatInterval);
-    }
-
-    // Hàm kiểm tra xem thiết bị có đang trong quá trình đăng ký vân tay không
-    isDeviceEnrolling(deviceId) {
-        let isEnrolling = false;
-        this.pendingEnrollment.forEach((req, id) => {
-            if (req.deviceId === deviceId) {
-                isEnrolling = true;
+            } else {
+                this.syncDirectory(deviceId, client.ws, client.dirVersion);
             }
         });
-        return isEnrolling;
+    }
+
+    // Thiết bị báo phiên bản đã áp dụng; lệch (delta sai base, mất frame) thì đồng bộ lại
+    handleDirectoryAck(deviceId, ws, payload) {
+        const client = this.clients.get(deviceId);
+        if (!client || !payload) return;
+        const version = Number(payload.version) || 0;
+        client.dirVersion = version;
+        if (version !== userDirectory.version) {
+            this.syncDirectory(deviceId, ws, version);
+        }
     }
 
     getWss() {
@@ -152,13 +364,11 @@ class WebSocketService extends EventEmitter {
         if (client && client.isAlive) {
             try {
                 console.log(`Sending command to ${deviceId}:`, command);
-                client.ws.send(JSON.stringify(command));
+                this.sendToClient(client.ws, command);
                 return true;
             } catch (error) {
                 console.error(`Error sending command to ${deviceId}:`, error);
-                this.clients.delete(deviceId);
-                this.cleanupPendingRequests(deviceId);
-                this.emit('statusChange');
+                this.dropClient(client);
                 return false;
             }
         } else {
@@ -179,35 +389,85 @@ class WebSocketService extends EventEmitter {
     }
 
     requestEnrollmentOnDevice(deviceId, templateId, timeout = 30000) {
-        return new Promise((resolve, reject) => {
-            const command = { type: "enroll", id: templateId };
-            if (this.sendCommandToDevice(deviceId, command)) {
-                const timeoutId = setTimeout(() => {
-                    this.pendingEnrollment.delete(templateId);
-                    reject(new Error(`Enrollment request for ID ${templateId} on ${deviceId} timed out.`));
-                }, timeout);
-                this.pendingEnrollment.set(templateId, { resolve, reject, timeoutId, deviceId });
-                console.log(`Enrollment request initiated for ID ${templateId} on ${deviceId}. Waiting for response...`);
-            } else {
-                reject(new Error(`Failed to send enroll command to device ${deviceId}.`));
+        return this.requestCommand('enroll', deviceId, templateId, timeout);
+    }
+
+    // Gửi lệnh enroll/delete/inventory/... kèm rid (id yêu cầu) mà không chờ lệnh trước của thiết
+    // bị xong: thiết bị tự xếp hàng và trả *_status/inventory mang đúng rid. `command` có thể là
+    // mảng frame (các đoạn template_load), tất cả mang cùng rid.
+    //
+    // Lệnh cùng khoá (cùng thiết bị, cùng ID) đang chờ thì không ghi đè nó: đăng ký trùng bị từ
+    // chối, các lệnh khác xếp sau lệnh đang chờ.
+    requestCommand(kind, deviceId, templateId, timeout, command = { type: kind, id: templateId }) {
+        const key = this.pendingKey(kind, deviceId, templateId);
+        const previous = this.pendingMap(kind).get(key);
+        if (previous) {
+            if (kind === 'enroll') {
+                return Promise.reject(new Error(`Enrollment for ID ${templateId} is already pending on ${deviceId}.`));
+            }
+            return previous.settled.then(() => this.requestCommand(kind, deviceId, templateId, timeout, command));
+        }
+        let entry = null;
+        const request = new Promise((resolve, reject) => {
+            const rid = this.nextRequestId++;
+            const sent = [].concat(command).every((frame) => this.sendCommandToDevice(deviceId, { ...frame, rid }));
+            if (!sent) {
+                reject(new Error(`Failed to send ${kind} command to device ${deviceId}.`));
+                return;
             }
+            entry = { rid, resolve, reject, timeoutId: null, deviceId, templateId, timeout };
+            this.setPending(kind, key, entry);
+            this.armCommandTimeout(kind, key, entry, timeout);
+            console.log(`${kind} request ${rid} initiated for ID ${templateId} on ${deviceId}. Waiting for response...`);
         });
+        if (entry) entry.settled = request.then(() => {}, () => {});
+        return request;
+    }
+
+    // (Đặt lại) thời gian chờ của yêu cầu; hết hạn thì báo thiết bị bỏ lệnh. Yêu cầu luôn bị
+    // reject khi hết hạn, kể cả khi khoá của nó đã không còn trỏ tới nó.
+    armCommandTimeout(kind, key, entry, ms, during = '') {
+        clearTimeout(entry.timeoutId);
+        entry.timeoutId = setTimeout(() => {
+            if (this.pendingMap(kind).get(key) === entry) this.deletePending(kind, key);
+            this.cancelCommandOnDevice(kind, entry.deviceId, entry.templateId, entry.rid);
+            const label = COMMAND_LABELS[kind];
+            entry.reject(new Error(`${label} request for ID ${entry.templateId} on ${entry.deviceId} timed out${during}.`));
+        }, ms);
+    }
+
+    // Báo thiết bị bỏ lệnh còn trong hàng đợi hoặc dừng state machine đăng ký
+    // (inventory chỉ đọc cảm biến, để nó chạy xong)
+    cancelCommandOnDevice(kind, deviceId, templateId, rid) {
+        if (kind !== 'inventory' && this.clients.has(deviceId)) {
+            this.sendCommandToDevice(deviceId, { type: `${kind}_cancel`, id: templateId, rid });
+        }
+    }
+
+    // Yêu cầu ứng với phản hồi: cùng thiết bị, cùng templateId, và rid phải khớp nếu thiết bị
+    // có trả rid (phản hồi muộn của lệnh cũ cùng ID không được kết thúc lệnh mới)
+    matchPending(kind, deviceId, payload) {
+        const pending = this.pendingMap(kind).get(this.pendingKey(kind, deviceId, payload.id));
+        if (!pending || pending.deviceId !== deviceId) return null;
+        if (payload.rid && payload.rid !== pending.rid) return null;
+        return pending;
     }
 
-    handleEnrollmentResponse(payload) {
-        const { id, status, message, step } = payload;
-        const pending = this.pendingEnrollment.get(id);
+    handleEnrollmentResponse(deviceId, payload) {
+        const { id, status, message, step, ahead } = payload;
+        const pending = this.matchPending('enroll', deviceId, payload);
 
         if (pending) {
-            clearTimeout(pending.timeoutId);
             console.log(`Handling enrollment response for ID ${id}: ${status}`);
 
-            // Cập nhật thông tin tiến trình
+            // Cập nhật thông tin tiến trình; lệnh còn xếp hàng vẫn hiển thị là đang xử lý
             const progress = this.enrollmentProgress.get(id);
             if (progress) {
-                progress.status = status;
+                progress.status = status === 'queued' ? 'processing' : status;
                 progress.step = step || progress.step;
-                progress.message = message || progress.message;
+                progress.message = status === 'queued'
+                    ? `Đang chờ ${ahead} lệnh phía trước trên thiết bị`
+                    : message || progress.message;
                 this.enrollmentProgress.set(id, progress);
                 
                 // Phát sự kiện có cập nhật tiến trình
@@ -216,25 +476,37 @@ class WebSocketService extends EventEmitter {
                 this.emit('enrollmentProgress', id, progress);
             }
 
+            const key = this.pendingKey('enroll', deviceId, id);
             if (status === 'success') {
+                clearTimeout(pending.timeoutId);
+                this.deletePending('enroll', key);
+                this.rememberEnrollment(key);
                 pending.resolve({ status, id });
-                this.pendingEnrollment.delete(id);
             } else if (status === 'error') {
+                clearTimeout(pending.timeoutId);
+                this.deletePending('enroll', key);
                 pending.reject(new Error(message || `Enrollment failed on device for ID ${id}.`));
-                this.pendingEnrollment.delete(id);
+            } else if (status === 'queued') {
+                // Các lệnh phía trước mỗi lệnh được tối đa COMMAND_SLOT_MS
+                this.armCommandTimeout('enroll', key, pending, pending.timeout + (ahead || 1) * COMMAND_SLOT_MS);
             } else if (status === 'processing') {
                 console.log(`Enrollment progress for ID ${id}: Step ${step} - ${message}`);
-                const timeoutId = setTimeout(() => {
-                    this.pendingEnrollment.delete(id);
-                    pending.reject(new Error(`Enrollment request for ID ${id} on ${pending.deviceId} timed out during processing.`));
-                }, 30000);
-                this.pendingEnrollment.set(id, { ...pending, timeoutId });
+                this.armCommandTimeout('enroll', key, pending, 30000, ' during processing');
             }
         } else {
             console.warn(`Received enrollment response for unknown/completed ID: ${id}`);
         }
     }
 
+    // Thiết bị gửi mẫu vừa đăng ký ngay sau enroll_status success (xem handleTemplateChunk)
+    rememberEnrollment(key) {
+        const now = Date.now();
+        for (const [other, at] of this.recentEnrollments) {
+            if (now - at > ENROLL_UPLOAD_WINDOW_MS) this.recentEnrollments.delete(other);
+        }
+        this.recentEnrollments.set(key, now);
+    }
+
     getEnrollmentProgress(id) {
         return this.enrollmentProgress.get(id);
     }
@@ -247,53 +519,156 @@ class WebSocketService extends EventEmitter {
     }
 
     requestDeletionOnDevice(deviceId, templateId, timeout = 10000) {
-        return new Promise((resolve, reject) => {
-            const command = { type: "delete", id: templateId };
-            if (this.sendCommandToDevice(deviceId, command)) {
-                const timeoutId = setTimeout(() => {
-                    this.pendingDeletion.delete(templateId);
-                    reject(new Error(`Deletion request for ID ${templateId} on ${deviceId} timed out.`));
-                }, timeout);
-                this.pendingDeletion.set(templateId, { resolve, reject, timeoutId, deviceId });
-                console.log(`Deletion request initiated for ID ${templateId} on ${deviceId}. Waiting for response...`);
-            } else {
-                reject(new Error(`Failed to send delete command to device ${deviceId}.`));
-            }
-        });
+        return this.requestCommand('delete', deviceId, templateId, timeout);
+    }
+
+    // Xoá `count` slot liên tiếp từ firstId bằng một lệnh cảm biến; phản hồi là delete_status của firstId
+    requestRangeDeletionOnDevice(deviceId, firstId, count, timeout = 10000) {
+        if (count === 1) return this.requestDeletionOnDevice(deviceId, firstId, timeout);
+        return this.requestCommand('delete', deviceId, firstId, timeout, { type: 'delete_range', id: firstId, count });
+    }
+
+    // Bảng chiếm chỗ thư viện mẫu của thiết bị: { capacity, count, bitmap } (bitmap hex, bit n = slot n)
+    requestInventoryFromDevice(deviceId, timeout = 10000) {
+        return this.requestCommand('inventory', deviceId, deviceId, timeout, { type: 'inventory' });
+    }
+
+    handleInventoryResponse(deviceId, payload) {
+        const { status, message, ahead, rid } = payload;
+        const pending = this.pendingInventory.get(deviceId);
+        if (!pending || (rid && rid !== pending.rid)) {
+            console.warn(`Received inventory response for unknown/completed request on ${deviceId}`);
+            return;
+        }
+        if (status === 'queued') {
+            this.armCommandTimeout('inventory', deviceId, pending, pending.timeout + (ahead || 1) * COMMAND_SLOT_MS);
+            return;
+        }
+        clearTimeout(pending.timeoutId);
+        this.deletePending('inventory', deviceId);
+        if (status === 'success') {
+            const { capacity, count, bitmap } = payload;
+            pending.resolve({ status, capacity, count, bitmap });
+        } else {
+            pending.reject(new Error(message || `Inventory failed on device ${deviceId}.`));
+        }
+    }
+
+    handleDeletionResponse(deviceId, payload) {
+        this.handleCommandResponse('delete', deviceId, payload);
     }
 
-    handleDeletionResponse(payload) {
-        const { id, status, message } = payload;
-        const pending = this.pendingDeletion.get(id);
+    // *_status của lệnh delete/load/upload: "queued" giãn thời gian chờ, success/error kết thúc
+    handleCommandResponse(kind, deviceId, payload) {
+        const { id, status, message, ahead } = payload;
+        const pending = this.matchPending(kind, deviceId, payload);
+        const label = COMMAND_LABELS[kind];
 
         if (pending) {
+            const key = this.pendingKey(kind, deviceId, id);
+            console.log(`Handling ${kind} response for ID ${id}: ${status}`);
+            if (status === 'queued') {
+                this.armCommandTimeout(kind, key, pending, pending.timeout + (ahead || 1) * COMMAND_SLOT_MS);
+                return;
+            }
             clearTimeout(pending.timeoutId);
-            this.pendingDeletion.delete(id);
-            console.log(`Handling deletion response for ID ${id}: ${status}`);
+            this.deletePending(kind, key);
             if (status === 'success') {
                 pending.resolve({ status, id });
             } else {
-                pending.reject(new Error(message || `Deletion failed on device for ID ${id}.`));
+                pending.reject(new Error(message || `${label} failed on device for ID ${id}.`));
             }
         } else {
-            console.warn(`Received deletion response for unknown/completed ID: ${id}`);
+            console.warn(`Received ${kind} response for unknown/completed ID: ${id}`);
+        }
+    }
+
+    // Nạp đặc trưng (Buffer 512 byte) vào slot templateId của thiết bị: các đoạn template_load
+    // gửi liền nhau cùng rid, thiết bị ghép đủ rồi xếp lệnh ghi vào cảm biến; kết quả là load_status
+    requestTemplateLoadOnDevice(deviceId, templateId, data, timeout = 10000) {
+        const frames = [];
+        for (let offset = 0; offset < data.length; offset += TEMPLATE_CHUNK_BYTES) {
+            const chunk = data.subarray(offset, offset + TEMPLATE_CHUNK_BYTES);
+            frames.push({ type: 'template_load', id: templateId, offset, total: data.length, data: chunk.toString('base64') });
+        }
+        return this.requestCommand('load', deviceId, templateId, timeout, frames);
+    }
+
+    // Đọc đặc trưng của slot templateId trên thiết bị; resolve { id, data } khi đủ các đoạn template_chunk
+    requestTemplateUploadFromDevice(deviceId, templateId, timeout = 10000) {
+        return this.requestCommand('upload', deviceId, templateId, timeout, { type: 'template_upload', id: templateId });
+    }
+
+    // template_chunk: { id, rid?, offset, total, data } - theo thứ tự offset. Đủ các đoạn thì trả cho
+    // requestTemplateUploadFromDevice(); mẫu thiết bị tự gửi (sau mỗi lần đăng ký thành công, không
+    // có yêu cầu chờ) thì phát 'templateUploaded' để lưu và sao chép sang các thiết bị khác - chỉ khi
+    // chính thiết bị đó vừa báo enroll success cho ID này, còn lại bỏ đi.
+    handleTemplateChunk(deviceId, payload) {
+        const { id, offset, total } = payload;
+        const key = `${deviceId}:${id}`;
+        if (offset === 0 && total > 0 && total <= TEMPLATE_MAX_BYTES) {
+            this.templateUploads.set(key, { data: Buffer.alloc(total), received: 0 });
+        }
+        const upload = this.templateUploads.get(key);
+        const bytes = Buffer.from(payload.data || '', 'base64');
+        if (!upload || offset !== upload.received || offset + bytes.length > upload.data.length) {
+            console.warn(`Dropping out-of-order template chunk for ID ${id} from ${deviceId} (offset ${offset})`);
+            this.templateUploads.delete(key);
+            return;
+        }
+        bytes.copy(upload.data, offset);
+        upload.received += bytes.length;
+        if (upload.received < upload.data.length) return;
+
+        this.templateUploads.delete(key);
+        const pending = this.matchPending('upload', deviceId, payload);
+        if (pending) {
+            clearTimeout(pending.timeoutId);
+            this.deletePending('upload', key);
+            pending.resolve({ status: 'success', id, data: upload.data });
+            return;
         }
+        const enrolledAt = this.recentEnrollments.get(key);
+        this.recentEnrollments.delete(key);
+        if (enrolledAt === undefined || Date.now() - enrolledAt > ENROLL_UPLOAD_WINDOW_MS) {
+            console.warn(`Dropping unsolicited template for ID ${id} from ${deviceId} (no recent enrollment)`);
+            return;
+        }
+        this.emit('templateUploaded', deviceId, id, upload.data);
+    }
+
+    // metrics: { up, iv, heap, frag, pending, c, h, max } - xem sendMetrics() trong firmware.
+    // Giữ lần gửi trước để tính bộ đếm (tích luỹ từ lúc khởi động) của riêng khoảng vừa qua.
+    handleMetrics(deviceId, payload) {
+        if (!payload || typeof payload !== 'object') return;
+        const last = this.deviceMetrics.get(deviceId);
+        // Thiết bị khởi động lại thì bộ đếm về 0: không lấy hiệu với lần gửi trước
+        const previous = last && last.metrics.up <= payload.up ? last.metrics : null;
+        this.deviceMetrics.set(deviceId, { receivedAt: new Date(), metrics: payload, previous });
+        this.emit('metrics', deviceId, payload);
     }
 
     cleanupPendingRequests(deviceId) {
-        this.pendingEnrollment.forEach((req, id) => {
-            if (req.deviceId === deviceId) {
-                clearTimeout(req.timeoutId);
-                req.reject(new Error(`Device ${deviceId} disconnected during enrollment for ID ${id}.`));
-                this.pendingEnrollment.delete(id);
-            }
-        });
-        this.pendingDeletion.forEach((req, id) => {
-            if (req.deviceId === deviceId) {
+        for (const key of this.templateUploads.keys()) {
+            if (key.startsWith(`${deviceId}:`)) this.templateUploads.delete(key);
+        }
+        const byDevice = this.pendingByDevice.get(deviceId);
+        if (!byDevice) return;
+        this.pendingByDevice.delete(deviceId);
+        const during = {
+            enroll: 'enrollment', delete: 'deletion', load: 'template load', upload: 'template upload'
+        };
+        COMMAND_KINDS.forEach((kind) => {
+            const map = this.pendingMap(kind);
+            byDevice[kind].forEach((key) => {
+                const req = map.get(key);
+                map.delete(key);
+                if (kind === 'enroll') this.releaseEnrollingId(req.templateId);
                 clearTimeout(req.timeoutId);
-                req.reject(new Error(`Device ${deviceId} disconnected during deletion for ID ${id}.`));
-                this.pendingDeletion.delete(id);
-            }
+                req.reject(new Error(kind === 'inventory'
+                    ? `Device ${deviceId} disconnected during inventory.`
+                    : `Device ${deviceId} disconnected during ${during[kind]} for ID ${req.templateId}.`));
+            });
         });
     }
 }